@@ -79,9 +79,9 @@ void RunAllTest(void)
 	RUN_TEST_SUITE(suite2);
 }
 
-int main()
+int main(int argc, char *argv[])
 {
-	utest_main();
+	utest_main_args(argc, argv);
 
 	return 0;
 }
\ No newline at end of file
@@ -12,6 +12,7 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <utest_report.h>
 
 #ifndef TEST_PRINT
 #define TEST_PRINT(fmt, ...) printf(fmt, ##__VA_ARGS__)
@@ -33,6 +34,10 @@
 #define TC_PASS 0
 #define TC_FAIL 1
 #define TC_SKIP 2
+/* Passed in an earlier run, not run again, see the `result-cache` option */
+#define TC_CACHED 3
+/* Failed, then passed on a retry or quarantined, see utest_flaky.h */
+#define TC_FLAKY 4
 
 #ifndef TC_PASS_STR
 #define TC_PASS_STR "PASS"
@@ -43,6 +48,12 @@
 #ifndef TC_SKIP_STR
 #define TC_SKIP_STR "SKIP"
 #endif
+#ifndef TC_CACHED_STR
+#define TC_CACHED_STR "CACHED-PASS"
+#endif
+#ifndef TC_FLAKY_STR
+#define TC_FLAKY_STR "FLAKY"
+#endif
 
 static inline const char *TC_RESULT_TO_STR(int result)
 {
@@ -53,6 +64,10 @@ static inline const char *TC_RESULT_TO_STR(int result)
 		return TC_FAIL_STR;
 	case TC_SKIP:
 		return TC_SKIP_STR;
+	case TC_CACHED:
+		return TC_CACHED_STR;
+	case TC_FLAKY:
+		return TC_FLAKY_STR;
 	default:
 		return "?";
 	}
@@ -70,11 +85,13 @@ static inline const char *TC_RESULT_TO_STR(int result)
 #define TC_PRINT(fmt, ...) TEST_PRINT(fmt, ##__VA_ARGS__)
 #endif
 
+/*
+ * The runner events below are dispatched to the registered reporters, see
+ * utest_report.h. They can still be overridden before including this file.
+ */
+
 #ifndef TC_START
-#define TC_START(name)							\
-	do {								\
-		TEST_PRINT(".%s ", name);				\
-	} while (0)
+#define TC_START(name) z_utest_report_test_start(name)
 #endif
 
 #ifndef TC_END
@@ -82,12 +99,8 @@ static inline const char *TC_RESULT_TO_STR(int result)
 #endif
 
 #ifndef Z_TC_END_RESULT
-/* prints result and the function name */
-#define Z_TC_END_RESULT(result)						\
-	do {									\
-		TC_END(result, " %s .", TC_RESULT_TO_STR(result));	\
-		PRINT_LINE;							\
-	} while (0)
+/* reports result and the function name */
+#define Z_TC_END_RESULT(result) z_utest_report_test_end(result)
 #endif
 
 #ifndef TC_END_RESULT
@@ -96,16 +109,11 @@ static inline const char *TC_RESULT_TO_STR(int result)
 #endif
 
 #ifndef TC_SUITE_START
-#define TC_SUITE_START(name)					\
-	do { \
-		PRINT_LINE;					\
-	} while (0)
+#define TC_SUITE_START(name) z_utest_report_suite_start(name)
 #endif
 
 #ifndef TC_SUITE_END
-#define TC_SUITE_END(name, result)				\
-	do {							\
-	} while (0)
+#define TC_SUITE_END(name, result) z_utest_report_suite_end(name, result)
 #endif
 
 
@@ -114,11 +122,8 @@ static inline const char *TC_RESULT_TO_STR(int result)
 #ifndef TC_END_REPORT
 #define TC_END_REPORT(result)                               \
 	do {                                                    \
-		PRINT_LINE;                                         \
-		TC_END(result,                                      \
-		       "PROJECT EXECUTION %s\n",               \
-		       (result) == TC_PASS ? "SUCCESSFUL" : "FAILED");	\
-		TC_END_POST(result);                                    \
+		z_utest_report_end(result);                         \
+		TC_END_POST(result);                                \
 	} while (0)
 #endif
 
@@ -17,6 +17,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
+#include <utest_report.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -34,10 +35,10 @@ static inline bool __utest_assert(bool cond,
 		va_list vargs;
 
 		va_start(vargs, msg);
-		PRINT("\n    %s:%d: %s: %s\n",
-		      file, line, func, default_msg);
-		vprintf(msg, vargs);
-		printf("\n");
+		z_utest_failure_printf("\n    %s:%d: %s: %s\n",
+				       file, line, func, default_msg);
+		z_utest_failure_vprintf(msg, vargs);
+		z_utest_failure_printf("\n");
 		va_end(vargs);
 		utest_fail();
 		return false;
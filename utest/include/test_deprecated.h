@@ -22,12 +22,27 @@ extern "C"
 {
 #endif
 
+	struct utest_param_source;
+
 	struct unit_test
 	{
 		const char *name;
 		void (*test)(void);
 		void (*setup)(void);
 		void (*teardown)(void);
+		/* Parameters of a TEST_P case, NULL for a plain test */
+		const struct utest_param_source *params;
+		/* UTEST_TAG() bits, see utest_tags.h */
+		uint64_t tags;
+	};
+
+	struct unit_test_suite
+	{
+		const char *name;
+		struct unit_test *tests;
+		/* Run once before the first and after the last selected test, may be NULL */
+		void (*before_all)(void);
+		void (*after_all)(void);
 	};
 
 	/**
@@ -42,6 +57,36 @@ extern "C"
 	 */
 	int z_utest_run_test_suite(const char *name, struct unit_test *suite);
 
+	/**
+	 * @brief Run a test suite described by @a suite.
+	 *
+	 * Internal implementation. Do not call directly. Same as z_utest_run_test_suite(), also running
+	 * the suite-level fixtures. Nothing runs if no test of the suite is selected by the filter.
+	 *
+	 * @param suite The suite to run.
+	 * @return Negative value if the test suite never ran; otherwise, return the number of failures.
+	 */
+	int z_utest_run_suite(const struct unit_test_suite *suite);
+
+	/**
+	 * @brief Run a fixture function outside of any test.
+	 *
+	 * Internal implementation. Assertions in @a fn are caught, and a failure is reported as a test
+	 * named @a label.
+	 *
+	 * @return TC_PASS, TC_FAIL or TC_SKIP.
+	 */
+	int z_utest_run_fixture(const char *label, void (*fn)(void));
+
+	/**
+	 * @brief Run @a fn, catching the failures, skips and passes it raises.
+	 *
+	 * Internal implementation. Nothing is reported, and the enclosing test keeps running.
+	 *
+	 * @return TC_PASS, TC_FAIL or TC_SKIP.
+	 */
+	int z_utest_try(void (*fn)(void));
+
 	/**
 	 * @defgroup utest_test_deprecated utest testing macros
 	 * @ingroup utest
@@ -56,6 +101,8 @@ extern "C"
 #define TEST_SETUP_NAME(ts_name) _testsuite_##ts_name##_setup
 #define TEST_TEARDOWN_NAME(ts_name) _testsuite_##ts_name##_teardown
 #define TEST_CASE_NAME(ts_name, tc_name) _test_##ts_name##_##tc_name
+#define TEST_BEFORE_ALL_NAME(ts_name) _testsuite_##ts_name##_before_all
+#define TEST_AFTER_ALL_NAME(ts_name) _testsuite_##ts_name##_after_all
 
 /**
  * @brief Define a test case
@@ -70,7 +117,67 @@ extern "C"
 		TEST_ID_INFO(ts_name, tc_name),       \
 			TEST_CASE_NAME(ts_name, tc_name), \
 			TEST_SETUP_NAME(ts_name),         \
-			TEST_TEARDOWN_NAME(ts_name)       \
+			TEST_TEARDOWN_NAME(ts_name),      \
+			NULL,                             \
+			0                                 \
+	}
+
+/**
+ * @brief Define a parameterized test case
+ *
+ * This should be called as an argument to TEST_SUITE. The case runs once per
+ * parameter of its TEST_P_VALUES, TEST_P_RANGE or TEST_P_GENERATOR
+ * instantiation, see utest_param.h.
+ *
+ * @param ts_name Test suite name
+ * @param tc_name Test case name
+ */
+#define TEST_CASE_P(ts_name, tc_name)         \
+	{                                         \
+		TEST_ID_INFO(ts_name, tc_name),       \
+			TEST_CASE_NAME(ts_name, tc_name), \
+			TEST_SETUP_NAME(ts_name),         \
+			TEST_TEARDOWN_NAME(ts_name),      \
+			&TEST_P_SOURCE(ts_name, tc_name), \
+			0                                 \
+	}
+
+/**
+ * @brief Define a test case carrying tags
+ *
+ * This should be called as an argument to TEST_SUITE, see utest_tags.h.
+ *
+ * @param ts_name Test suite name
+ * @param tc_name Test case name
+ * @param tc_tags UTEST_TAG() bits, combined with |
+ */
+#define TEST_CASE_TAGS(ts_name, tc_name, tc_tags) \
+	{                                             \
+		TEST_ID_INFO(ts_name, tc_name),           \
+			TEST_CASE_NAME(ts_name, tc_name),     \
+			TEST_SETUP_NAME(ts_name),             \
+			TEST_TEARDOWN_NAME(ts_name),          \
+			NULL,                                 \
+			(tc_tags)                             \
+	}
+
+/**
+ * @brief Define a parameterized test case carrying tags
+ *
+ * Every instance carries the tags, see TEST_CASE_P() and TEST_CASE_TAGS().
+ *
+ * @param ts_name Test suite name
+ * @param tc_name Test case name
+ * @param tc_tags UTEST_TAG() bits, combined with |
+ */
+#define TEST_CASE_P_TAGS(ts_name, tc_name, tc_tags) \
+	{                                               \
+		TEST_ID_INFO(ts_name, tc_name),             \
+			TEST_CASE_NAME(ts_name, tc_name),       \
+			TEST_SETUP_NAME(ts_name),               \
+			TEST_TEARDOWN_NAME(ts_name),            \
+			&TEST_P_SOURCE(ts_name, tc_name),       \
+			(tc_tags)                               \
 	}
 
 /**
@@ -88,15 +195,20 @@ extern "C"
  *
  * @param suite Name of the testing suite
  */
-#define TEST_SUITE(suite, ...) \
-	struct unit_test _test_suite_##suite[] = {__VA_ARGS__, {0}}
+#define TEST_SUITE(suite, ...)                                                        \
+	struct unit_test _test_suite_##suite[] = {__VA_ARGS__, {0}};                  \
+	extern void TEST_BEFORE_ALL_NAME(suite)(void) __attribute__((weak));          \
+	extern void TEST_AFTER_ALL_NAME(suite)(void) __attribute__((weak));           \
+	const struct unit_test_suite _test_suite_desc_##suite = {                     \
+		#suite, _test_suite_##suite,                                          \
+		TEST_BEFORE_ALL_NAME(suite), TEST_AFTER_ALL_NAME(suite)}
 
 /**
  * @brief Run test suite
  *
  * @param suite Name of the testing suite
  */
-#define RUN_TEST_SUITE(suite) z_utest_run_test_suite(#suite, _test_suite_##suite)
+#define RUN_TEST_SUITE(suite) z_utest_run_suite(&_test_suite_desc_##suite)
 
 	/**
 	 * @}
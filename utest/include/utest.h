@@ -36,6 +36,33 @@
 #include <test_mock.h>
 #include <test_deprecated.h>
 #include <tc_util.h>
+#include <utest_report.h>
+#include <utest_options.h>
+#include <utest_capture.h>
+#include <utest_trace.h>
+#include <utest_fixture.h>
+#include <utest_hash.h>
+#include <utest_filter.h>
+#include <utest_fork.h>
+#include <utest_param.h>
+#include <utest_rng.h>
+#include <utest_property.h>
+#include <utest_fuzz.h>
+#include <utest_coverage.h>
+#include <utest_result_cache.h>
+#include <utest_death.h>
+#include <utest_crash.h>
+#include <utest_serve.h>
+#include <utest_module.h>
+#include <utest_jobserver.h>
+#include <utest_programs.h>
+#include <utest_tags.h>
+#include <utest_limits.h>
+#include <utest_journal.h>
+#include <utest_dist.h>
+#include <utest_flaky.h>
+#include <utest_priority.h>
+#include <utest_order.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -47,6 +74,16 @@ extern "C" {
  */
 void utest_main(void);
 
+/**
+ * @brief Entry function taking the command line of the test program.
+ *
+ * Same as utest_main(), with runner options read from @a argv in addition
+ * to the environment, see utest_options.h.
+ *
+ * @return 1 if a test failed, 0 otherwise
+ */
+int utest_main_args(int argc, char *argv[]);
+
 /**
  * @brief run all test function, must to implement this.
  *
@@ -82,6 +119,22 @@ void utest_skip(void);
 
 #define TEST_TEARDOWN(ts_name) void TEST_TEARDOWN_NAME(ts_name)(void)
 
+/**
+ * @brief Define a function run once before the first selected test of a suite
+ *
+ * Optional. If it fails or skips, the tests of the suite are reported as
+ * skipped and the failure is reported as a test named `BEFORE_ALL(suite)`.
+ */
+#define TEST_BEFORE_ALL(ts_name) void TEST_BEFORE_ALL_NAME(ts_name)(void)
+
+/**
+ * @brief Define a function run once after the last test of a suite
+ *
+ * Optional. Only runs if the BEFORE_ALL function succeeded. A failure is
+ * reported as a test named `AFTER_ALL(suite)`.
+ */
+#define TEST_AFTER_ALL(ts_name) void TEST_AFTER_ALL_NAME(ts_name)(void)
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,83 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ *
+ * @brief utest output capture
+ */
+
+#ifndef _TESTSUITE_INCLUDE_UTEST_CAPTURE_H_
+#define _TESTSUITE_INCLUDE_UTEST_CAPTURE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup utest_capture utest output capture
+ * @ingroup utest
+ *
+ * With the `capture` option, file descriptors 1 and 2 are redirected to
+ * in-memory files while a test runs. The captured bytes are thrown away
+ * when the test passes and attached to the result when it fails, so the
+ * reporters only show the output of failing tests.
+ *
+ * @{
+ */
+
+/**
+ * @brief Get the bytes written so far by the running test
+ *
+ * @param fd 1 for the standard output, 2 for the standard error
+ * @param len Set to the number of bytes captured
+ * @return The captured bytes, valid until the next call or the end of the
+ *         test, or NULL if capture is not enabled.
+ */
+const char *utest_captured_output(int fd, size_t *len);
+
+/**
+ * @brief Assert that the running test wrote @a str to the standard output
+ *
+ * Requires the `capture` option.
+ *
+ * @param str String to look for
+ * @param msg Optional message to print if the assertion fails
+ */
+#define EXPECT_STDOUT_CONTAINS(str, ...)                                     \
+	TEST_ASSERT(z_utest_captured_contains(1, str),                       \
+		    "stdout does not contain " #str, ##__VA_ARGS__)
+
+/**
+ * @brief Assert that the running test wrote @a str to the standard error
+ *
+ * Requires the `capture` option.
+ *
+ * @param str String to look for
+ * @param msg Optional message to print if the assertion fails
+ */
+#define EXPECT_STDERR_CONTAINS(str, ...)                                     \
+	TEST_ASSERT(z_utest_captured_contains(2, str),                       \
+		    "stderr does not contain " #str, ##__VA_ARGS__)
+
+/**
+ * @}
+ */
+
+bool z_utest_captured_contains(int fd, const char *str);
+
+void z_utest_capture_init(void);
+void z_utest_capture_fork_child(void);
+void z_utest_capture_start(void);
+void z_utest_capture_stop(void);
+void z_utest_capture_release(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TESTSUITE_INCLUDE_UTEST_CAPTURE_H_ */
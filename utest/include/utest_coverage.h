@@ -0,0 +1,61 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ *
+ * @brief utest per-test coverage and change-driven test selection
+ */
+
+#ifndef _TESTSUITE_INCLUDE_UTEST_COVERAGE_H_
+#define _TESTSUITE_INCLUDE_UTEST_COVERAGE_H_
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup utest_coverage utest test impact analysis
+ * @ingroup utest
+ *
+ * With the `record-coverage` option, the runner records which functions
+ * each test executes, and saves one bitmap per test under
+ * `<cache-dir>/coverage/`, next to the table of functions it indexes.
+ * Functions are seen through the `-finstrument-functions` callbacks, so
+ * the code under test must be compiled with that flag.
+ *
+ * A later run given the changed code, as `changed-functions=f,g` or
+ * `changed-files=src/a.c,src/b.c`, only runs the tests whose recorded
+ * coverage contains one of them. Tests without a recorded map, recorded
+ * against another function table, or with a changed function or file
+ * unknown to the table (a new function or a header, for instance) always
+ * run. So do all tests when a changed file defines data objects, which
+ * tests may read without calling any function of the file. For instance:
+ *
+ * ```
+ *      ./tests --changed-files=$(git diff --name-only main | paste -sd,)
+ * ```
+ *
+ * Source files come from the `.debug_aranges` debug information, so
+ * `changed-files` needs a build with `-g`.
+ *
+ * @{
+ */
+
+/**
+ * @}
+ */
+
+void z_utest_coverage_init(void);
+void z_utest_coverage_start(void);
+void z_utest_coverage_stop(const char *suite, const char *name);
+bool z_utest_coverage_selected(const char *suite, const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TESTSUITE_INCLUDE_UTEST_COVERAGE_H_ */
@@ -0,0 +1,54 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ *
+ * @brief utest crash containment
+ */
+
+#ifndef _TESTSUITE_INCLUDE_UTEST_CRASH_H_
+#define _TESTSUITE_INCLUDE_UTEST_CRASH_H_
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup utest_crash utest crash containment
+ * @ingroup utest
+ *
+ * A test killed by SIGSEGV, SIGBUS, SIGFPE, SIGILL or SIGABRT fails
+ * instead of taking the run down. The signal handler runs on an alternate
+ * stack, so that stack overflows are caught too, then jumps back to the
+ * runner, which runs the teardown and goes on with the next test. The
+ * failure message gives the signal, the faulting address and a backtrace.
+ *
+ * The crashed code does not get to release what it held, so later tests
+ * may be affected: the fork mode keeps them apart. There, a test process
+ * that dies anyway, crashing in its teardown for instance, still reports
+ * the signal and the backtrace before it goes.
+ *
+ * Crashes in threads other than the main one, and outside of tests and
+ * fixtures, are left to the default action. `crash-handler=0` disables
+ * the handler altogether, to get a core dump for instance.
+ *
+ * @{
+ */
+
+/**
+ * @}
+ */
+
+void z_utest_crash_init(void);
+bool z_utest_crash_arm(bool armed);
+void z_utest_crash_report(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TESTSUITE_INCLUDE_UTEST_CRASH_H_ */
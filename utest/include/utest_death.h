@@ -0,0 +1,147 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ *
+ * @brief utest death tests
+ */
+
+#ifndef _TESTSUITE_INCLUDE_UTEST_DEATH_H_
+#define _TESTSUITE_INCLUDE_UTEST_DEATH_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup utest_death utest death tests
+ * @ingroup utest
+ *
+ * EXPECT_DEATH and EXPECT_EXIT run a statement in a child process and check
+ * how it ended: its wait status, and its standard error against an
+ * extended regular expression. A failed assertion inside the statement
+ * ends the child with status 1, its message written to standard error.
+ *
+ * ```{.c}
+ *      TEST(hal, null_buffer)
+ *      {
+ *              EXPECT_DEATH(hal_write(NULL, 4), "buf != NULL");
+ *              EXPECT_EXIT(hal_shutdown(), UTEST_EXITED_WITH(0));
+ *      }
+ * ```
+ *
+ * The child is a regular fork() with private memory. With
+ * `death-test-style=vfork`, it is started with vfork() instead while the
+ * process has a single thread: it then runs in the memory of the test,
+ * suspended until the child is gone, which costs no page table copy. This
+ * only suits statements that die without touching the state of the test:
+ * what they change, heap and stdio buffers included, stays changed for the
+ * test, and what they print to the standard output may be printed by the
+ * test again.
+ *
+ * @{
+ */
+
+/**
+ * @brief Predicate on the wait status of a death test child
+ */
+struct utest_exit_pred {
+	/* Check wait status @a status, given @a arg */
+	bool (*match)(int status, int arg);
+	int arg;
+	/* What the statement should do, "exit with code 0" for instance */
+	const char *desc;
+};
+
+/** The child called exit(@a code) */
+#define UTEST_EXITED_WITH(code)                                               \
+	((struct utest_exit_pred){z_utest_exited_with, (code),                \
+				  "exit with code " #code})
+
+/** The child was killed by signal @a signum */
+#define UTEST_KILLED_BY(signum)                                               \
+	((struct utest_exit_pred){z_utest_killed_by, (signum),                \
+				  "be killed by signal " #signum})
+
+/**
+ * @brief Expect @a stmt to die, with a standard error matching @a regex
+ *
+ * Dying is being killed by a signal or exiting with a non-zero status.
+ *
+ * @param stmt Statement to run
+ * @param regex Extended regular expression searched in the standard error
+ *              of the statement, NULL or "" to match anything
+ * @param msg Optional message to print if the assertion fails
+ */
+#define EXPECT_DEATH(stmt, regex, ...)                                        \
+	Z_UTEST_DEATH_TEST(stmt,                                              \
+			   ((struct utest_exit_pred){z_utest_died, 0, "die"}), \
+			   regex, ##__VA_ARGS__)
+
+/**
+ * @brief Expect @a stmt to end with a wait status matching @a pred
+ *
+ * @param stmt Statement to run
+ * @param pred A struct utest_exit_pred, such as UTEST_EXITED_WITH(0)
+ * @param msg Optional message to print if the assertion fails
+ */
+#define EXPECT_EXIT(stmt, pred, ...)                                          \
+	Z_UTEST_DEATH_TEST(stmt, pred, NULL, ##__VA_ARGS__)
+
+/**
+ * @}
+ */
+
+/* State of a death test, on the stack of the test function */
+struct z_utest_death {
+	pid_t pid;
+	bool fast;
+	int err_fd;
+	size_t failure_mark;
+};
+
+/*
+ * vfork() has to be called from the frame the child runs in, that is from
+ * the test function itself: no helper can return twice on its behalf.
+ */
+#define Z_UTEST_DEATH_TEST(stmt, pred, regex, ...)                            \
+	do {                                                                  \
+		struct z_utest_death _death;                                  \
+                                                                              \
+		if (z_utest_death_prepare(&_death)) {                         \
+			_death.pid = _death.fast ? vfork() : fork();          \
+			if (_death.pid == 0) {                                \
+				z_utest_death_child(&_death);                 \
+				stmt;                                         \
+				z_utest_death_returned();                     \
+			}                                                     \
+		}                                                             \
+		z_utest_death_check(&_death, pred, regex, #stmt, __FILE__,    \
+				    __LINE__, __func__, "" __VA_ARGS__);      \
+	} while (0)
+
+bool z_utest_died(int status, int arg);
+bool z_utest_exited_with(int status, int code);
+bool z_utest_killed_by(int status, int signum);
+
+bool z_utest_death_prepare(struct z_utest_death *death);
+void z_utest_death_child(const struct z_utest_death *death);
+void z_utest_death_returned(void) __attribute__((noreturn));
+void z_utest_death_check(struct z_utest_death *death,
+			 struct utest_exit_pred pred, const char *regex,
+			 const char *stmt, const char *file, int line,
+			 const char *func, const char *msg, ...);
+void z_utest_death_unwind(int result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TESTSUITE_INCLUDE_UTEST_DEATH_H_ */
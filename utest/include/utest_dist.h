@@ -0,0 +1,88 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ *
+ * @brief utest distributed runs, a coordinator and its workers
+ */
+
+#ifndef _TESTSUITE_INCLUDE_UTEST_DIST_H_
+#define _TESTSUITE_INCLUDE_UTEST_DIST_H_
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup utest_dist utest distributed runs
+ * @ingroup utest
+ *
+ * One run of a test program can be spread over several machines. The
+ * program started with the `coordinate[=[HOST:]PORT]` option runs no test:
+ * it lists the selected tests, listens on TCP, by default on an ephemeral
+ * port of 127.0.0.1, and hands the tests out to the workers that connect.
+ * The same program started with `worker=HOST:PORT` on each machine runs
+ * what it is given, through the normal runner and its options, and streams
+ * the results back; the coordinator reports them as one run.
+ *
+ * ```
+ *      agent0$ ./tests --coordinate=0.0.0.0:7000 --reporter=junit:all.xml
+ *      agent1$ ./tests --worker=agent0:7000 --fork --jobs=0
+ *      agent2$ ./tests --worker=agent0:7000 --fork --jobs=0
+ * ```
+ *
+ * With `workers=N`, the coordinator also starts N workers on the local
+ * machine, with its own options. That is how to try it out on one machine:
+ *
+ * ```
+ *      $ ./tests --coordinate --workers=4
+ * ```
+ *
+ * Tests are handed out in batches, the longest first, using the durations
+ * of the previous run, kept in `<cache-dir>/durations/<program>`; tests
+ * that have none count for the mean of the others. Batches hold a share of
+ * the work left, so they shrink towards the end of the run, and the workers
+ * finish together. Each batch runs in a process forked by the worker, like
+ * a request to a server, see @ref utest_serve: the BEFORE_ALL fixture of a
+ * suite runs once per batch holding its tests.
+ *
+ * A worker that is lost, because it dies or its connection breaks, has its
+ * tests handed out again. A test that was running on
+ * CONFIG_utest_DIST_ATTEMPTS lost workers, or that workers did not run at
+ * all as many times, fails instead. A batch process that dies fails the
+ * test it was running, which lets the worker carry on.
+ *
+ * Suites are reported each in one piece, in completion order.
+ *
+ * @{
+ */
+
+/** Times a test is handed out before it fails for good. */
+#ifndef CONFIG_utest_DIST_ATTEMPTS
+#define CONFIG_utest_DIST_ATTEMPTS 3
+#endif
+
+/** Maximum number of tests in a batch. */
+#ifndef CONFIG_utest_DIST_BATCH_MAX
+#define CONFIG_utest_DIST_BATCH_MAX 256
+#endif
+
+/**
+ * @}
+ */
+
+bool z_utest_dist_listing(void);
+void z_utest_dist_list(const char *suite, const char *name);
+bool z_utest_dist_selected(const char *suite, const char *name);
+int z_utest_dist_run(void);
+void z_utest_dist_work(int (*run)(void));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TESTSUITE_INCLUDE_UTEST_DIST_H_ */
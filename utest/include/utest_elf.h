@@ -0,0 +1,128 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ *
+ * @brief utest ELF reader for the test program itself
+ *
+ * Internal. Gives the runner the functions of the running executable, with
+ * the source file of each when debug information is available, so that
+ * addresses seen at run time can be named, and the bytes and relocations
+ * they are made of.
+ */
+
+#ifndef _TESTSUITE_INCLUDE_UTEST_ELF_H_
+#define _TESTSUITE_INCLUDE_UTEST_ELF_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct z_utest_elf_func {
+	const char *name;
+	/* Name of the compilation unit, "" if unknown */
+	const char *file;
+	/* Link-time address and size */
+	uintptr_t addr;
+	size_t size;
+};
+
+/* A field of code or data holding the address of something else */
+struct z_utest_elf_ref {
+	/* Link-time address and size of the field */
+	uintptr_t offset;
+	size_t size;
+	/* Link-time address referred to, 0 for an undefined symbol */
+	uintptr_t target;
+	/* Name of the undefined symbol referred to, NULL otherwise */
+	const char *name;
+};
+
+/**
+ * @brief Functions of the running executable, sorted by address
+ *
+ * Loaded on first use. Aliases are dropped, so that every address belongs
+ * to at most one function.
+ *
+ * @param count Set to the number of functions, 0 if the executable cannot
+ *              be read or has no symbol table
+ */
+const struct z_utest_elf_func *z_utest_elf_functions(size_t *count);
+
+/**
+ * @brief Index of the function containing run-time address @a addr
+ *
+ * @return The index in z_utest_elf_functions(), or -1.
+ */
+long z_utest_elf_lookup(uintptr_t addr);
+
+/**
+ * @brief Data objects of the running executable, sorted by address
+ *
+ * Same as z_utest_elf_functions(), without source files.
+ */
+const struct z_utest_elf_func *z_utest_elf_objects(size_t *count);
+
+/**
+ * @brief Source files defining data objects, variables with a static address
+ *
+ * Read from the variables of the debug information on first use, empty in
+ * a build without `-g`.
+ *
+ * @param count Set to the number of files
+ */
+const char *const *z_utest_elf_data_files(size_t *count);
+
+/**
+ * @brief Index of the symbol of @a syms containing link-time address @a addr
+ *
+ * @return The index in @a syms, or -1.
+ */
+long z_utest_elf_find(const struct z_utest_elf_func *syms, size_t count,
+		      uintptr_t addr);
+
+/**
+ * @brief Difference between run-time and link-time addresses
+ */
+uintptr_t z_utest_elf_bias(void);
+
+/**
+ * @brief File contents at link-time address @a addr
+ *
+ * @param avail Set to the number of bytes readable up to the section end
+ * @param flags Set to the flags of the section containing @a addr, 0 if it
+ *              is in no allocated section
+ * @return The bytes, NULL outside of any section or in a section without
+ *         file contents, such as .bss.
+ */
+const uint8_t *z_utest_elf_bytes(uintptr_t addr, size_t *avail,
+				 uint64_t *flags);
+
+/**
+ * @brief Relocations of the fields in [@a addr, @a addr + @a size)
+ *
+ * Only available on x86-64. Executables keep the dynamic relocations of
+ * their data when position independent, and the relocations of their code
+ * when linked with `-Wl,--emit-relocs`.
+ *
+ * @param count Set to the number of relocations, sorted by offset
+ */
+const struct z_utest_elf_ref *z_utest_elf_refs(uintptr_t addr, size_t size,
+					       size_t *count);
+
+/**
+ * @brief Whether the code relocations were kept, see z_utest_elf_refs()
+ */
+bool z_utest_elf_code_relocated(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TESTSUITE_INCLUDE_UTEST_ELF_H_ */
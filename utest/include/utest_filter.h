@@ -0,0 +1,62 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ *
+ * @brief utest test selection
+ */
+
+#ifndef _TESTSUITE_INCLUDE_UTEST_FILTER_H_
+#define _TESTSUITE_INCLUDE_UTEST_FILTER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup utest_filter utest test selection
+ * @ingroup utest
+ *
+ * The `filter` option selects the tests to run. Tests are identified as
+ * `suite.case`, e.g. `sample.mem_equal` for TEST(sample, mem_equal). The
+ * option is a `:` separated list of shell wildcard patterns, optionally
+ * followed by `-` and patterns to exclude, for instance
+ * `--filter=codec.*:parser.*-codec.slow_*`.
+ *
+ * The `shard-count=N` and `shard-index=I` options split the selected tests
+ * into N disjoint shards and only run shard I (from 0), so that N runners
+ * together run every test exactly once.
+ *
+ * @{
+ */
+
+/**
+ * @brief Write the `suite.case` identifier of a test into @a buf
+ *
+ * @param suite Name of the suite
+ * @param name Name of the test, as built by TEST_ID_INFO()
+ * @return @a buf
+ */
+const char *utest_test_id(const char *suite, const char *name, char *buf,
+			  size_t size);
+
+/**
+ * @}
+ */
+
+/* Size of a buffer holding any test identifier, see utest_test_id() */
+#define Z_UTEST_TEST_ID_MAX 256
+
+bool z_utest_shard_match(const char *id, long index, long count);
+bool z_utest_test_selected(const char *suite, const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TESTSUITE_INCLUDE_UTEST_FILTER_H_ */
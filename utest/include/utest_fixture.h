@@ -0,0 +1,197 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ *
+ * @brief utest shared fixtures
+ */
+
+#ifndef _TESTSUITE_INCLUDE_UTEST_FIXTURE_H_
+#define _TESTSUITE_INCLUDE_UTEST_FIXTURE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup utest_fixture utest shared fixtures
+ * @ingroup utest
+ *
+ * A shared fixture is built the first time any test asks for it, then kept
+ * for the rest of the run and torn down after the last suite. Fixtures no
+ * selected test asks for are never built.
+ *
+ * In the fork mode a fixture is only shared within a process. Fixtures the
+ * runner built, from a TEST_BEFORE_ALL for instance, are inherited by the
+ * test processes forked after and torn down at the end of the run. A test
+ * process builds the others again and tears them down when its test ends;
+ * a failure to do so is printed to stderr.
+ *
+ * ```{.c}
+ *      static void *load_vectors(void) { ... }
+ *      static void free_vectors(void *data) { ... }
+ *      UTEST_SHARED_FIXTURE(vectors, load_vectors, free_vectors);
+ *
+ *      TEST(codec, decode)
+ *      {
+ *              struct vectors *v = utest_shared_fixture(vectors);
+ *              ...
+ *      }
+ * ```
+ *
+ * @{
+ */
+
+struct utest_shared_fixture {
+	const char *name;
+	/* Build the fixture, may use assertions */
+	void *(*setup)(void);
+	/* Release the fixture, may be NULL */
+	void (*teardown)(void *data);
+	/* Internal */
+	void *data;
+	int state;
+	struct utest_shared_fixture *next;
+};
+
+/**
+ * @brief Define a shared fixture
+ *
+ * @param fixture_name Name of the fixture
+ * @param setup_fn `void *setup_fn(void)` building the fixture
+ * @param teardown_fn `void teardown_fn(void *)` releasing it, or NULL
+ */
+#define UTEST_SHARED_FIXTURE(fixture_name, setup_fn, teardown_fn)             \
+	struct utest_shared_fixture fixture_name = {                          \
+		#fixture_name, setup_fn, teardown_fn, 0, 0, 0 }
+
+/**
+ * @brief Declare a shared fixture defined in another file
+ */
+#define UTEST_SHARED_FIXTURE_DECLARE(fixture_name)                            \
+	extern struct utest_shared_fixture fixture_name
+
+/**
+ * @brief Get the data of a shared fixture, building it on first use
+ *
+ * If building the fixture fails, the current test and every later test
+ * asking for it fail.
+ */
+#define utest_shared_fixture(fixture_name)                                    \
+	utest_shared_fixture_get(&(fixture_name))
+
+void *utest_shared_fixture_get(struct utest_shared_fixture *fixture);
+
+/**
+ * @brief Growable buffer a cached fixture is serialized into
+ *
+ * The buffer moves while it grows and is later mapped at another address,
+ * so the data must not contain pointers: link its parts with offsets from
+ * the start of the blob instead, see UTEST_BLOB_PTR().
+ */
+struct utest_blob {
+	char *data;
+	size_t len;
+	size_t size;
+};
+
+/**
+ * @brief Reserve @a len zeroed bytes aligned on @a align (at most 64)
+ *
+ * @return Offset of the reserved bytes. The test fails if out of memory.
+ */
+size_t utest_blob_reserve(struct utest_blob *blob, size_t len, size_t align);
+
+/**
+ * @brief Append a copy of @a data, aligned on @a align (at most 64)
+ *
+ * @return Offset of the copy.
+ */
+size_t utest_blob_append(struct utest_blob *blob, const void *data,
+			 size_t len, size_t align);
+
+/**
+ * @brief Address of offset @a off in a blob being built
+ *
+ * Only valid until the next utest_blob_reserve() or utest_blob_append().
+ */
+#define utest_blob_at(blob, off) ((void *)((blob)->data + (off)))
+
+/**
+ * @brief Typed pointer to offset @a off of a loaded blob at @a base
+ */
+#define UTEST_BLOB_PTR(base, off, type)                                       \
+	((const type *)((const char *)(base) + (off)))
+
+/**
+ * @brief Fixture persisted in the cache directory across runs
+ *
+ * The fixture is keyed on its name, its version and the contents of its
+ * input files. The first run builds it and writes it to
+ * `<cache-dir>/fixtures/<name>.blob`; later runs map that file read-only
+ * instead of building it again, as long as the key did not change.
+ */
+struct utest_cached_fixture {
+	const char *name;
+	/* Bump when the build function or the blob layout changes */
+	uint32_t version;
+	const char *const *inputs;
+	size_t num_inputs;
+	/* Serialize the fixture into @a blob, return 0 on success */
+	int (*build)(struct utest_blob *blob);
+	/* Internal */
+	const void *data;
+	size_t size;
+	int state;
+};
+
+/**
+ * @brief Define a cached fixture
+ *
+ * @param fixture_name Name of the fixture, also names the cache file
+ * @param fixture_version Version of the fixture format
+ * @param build_fn `int build_fn(struct utest_blob *)` building the fixture
+ * @param ... Paths of the input files the fixture is built from
+ */
+#define UTEST_CACHED_FIXTURE(fixture_name, fixture_version, build_fn, ...)    \
+	static const char *const _utest_inputs_##fixture_name[] = {           \
+		__VA_ARGS__};                                                 \
+	struct utest_cached_fixture fixture_name = {                          \
+		#fixture_name, fixture_version, _utest_inputs_##fixture_name, \
+		sizeof(_utest_inputs_##fixture_name) / sizeof(const char *),  \
+		build_fn, 0, 0, 0}
+
+/**
+ * @brief Get a cached fixture, loading or building it on first use
+ *
+ * @param fixture_name Name of the fixture
+ * @param size_ptr Set to the size of the blob, may be NULL
+ * @return Read-only address of the blob, valid until the end of the run.
+ */
+#define utest_cached_fixture(fixture_name, size_ptr)                          \
+	utest_cached_fixture_get(&(fixture_name), size_ptr)
+
+const void *utest_cached_fixture_get(struct utest_cached_fixture *fixture,
+				     size_t *size);
+
+/**
+ * @}
+ */
+
+int z_utest_shared_fixtures_teardown(void);
+int z_utest_shared_fixtures_release(bool (*match)(const void *fixture,
+						   const void *arg),
+				    const void *arg);
+void z_utest_shared_fixtures_detach(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TESTSUITE_INCLUDE_UTEST_FIXTURE_H_ */
@@ -0,0 +1,70 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ *
+ * @brief utest flaky test retries, history and quarantine
+ */
+
+#ifndef _TESTSUITE_INCLUDE_UTEST_FLAKY_H_
+#define _TESTSUITE_INCLUDE_UTEST_FLAKY_H_
+
+#include <stdbool.h>
+#include <utest_report.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup utest_flaky utest flaky tests
+ * @ingroup utest
+ *
+ * With the `retries=N` option, a test that fails runs again, up to N more
+ * times; in the fork mode, see @ref utest_fork, each attempt runs in a
+ * fresh process. A test that passes on a retry is reported as FLAKY, with
+ * the message of its first failure, and does not fail the run. Only the
+ * last attempt of a test that never passes is reported.
+ *
+ * With the `flaky[=PERCENT]` option, the outcome of every test is kept in
+ * `<cache-dir>/flaky/<program>`, over its last CONFIG_utest_FLAKY_WINDOW
+ * runs: passed, or failed or flaky. A test that both passed and did not in
+ * that window, and did not for more than PERCENT of the runs, 5 by default,
+ * is quarantined: it still runs, but its failures are reported as FLAKY,
+ * along with its failure rate, and do not fail the run. A test failing in
+ * every run is broken rather than flaky, it is not quarantined.
+ *
+ * ```
+ *      $ ./tests --fork --retries=2 --flaky=10
+ * ```
+ *
+ * Results of test programs, see @ref utest_programs, and of the workers of
+ * a distributed run, see @ref utest_dist, are kept by the runner reporting
+ * them, under the name of the suite they are reported in.
+ *
+ * @{
+ */
+
+/** Number of runs the history of a test spans, at most 64. */
+#ifndef CONFIG_utest_FLAKY_WINDOW
+#define CONFIG_utest_FLAKY_WINDOW 32
+#endif
+
+/**
+ * @}
+ */
+
+void z_utest_flaky_init(void);
+void z_utest_flaky_expect(const char *suite, const char *name);
+bool z_utest_flaky_filter(const struct utest_result *result,
+			  struct utest_result *out);
+bool z_utest_flaky_retry(void);
+int z_utest_flaky_status(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TESTSUITE_INCLUDE_UTEST_FLAKY_H_ */
@@ -0,0 +1,80 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ *
+ * @brief utest fork mode
+ */
+
+#ifndef _TESTSUITE_INCLUDE_UTEST_FORK_H_
+#define _TESTSUITE_INCLUDE_UTEST_FORK_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <test_deprecated.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup utest_fork utest fork mode
+ * @ingroup utest
+ *
+ * With the `fork` option, the runner process acts as a zygote: suite
+ * fixtures (TEST_BEFORE_ALL) run once in the runner, then every test runs
+ * in a child forked from that initialized state. Each test gets a pristine
+ * copy-on-write snapshot, and a crashing test cannot take the run down.
+ * Results travel back through shared memory, see @ref utest_ring, and are
+ * reported by the runner as usual.
+ *
+ * The `jobs=N` option runs up to N tests at the same time, 0 meaning one
+ * per online CPU, and implies `fork`. Results are then reported in
+ * completion order. Run from `make -j`, the runner also waits for a token
+ * of the make jobserver before each extra job, see @ref utest_jobserver.
+ * Tests that share a limited resource are kept from running together by
+ * their tags, see @ref utest_tags.
+ *
+ * Shared fixtures built inside a test child are lost when it exits, so
+ * they are rebuilt by every test using them.
+ *
+ * @{
+ */
+
+/**
+ * @brief Check whether tests run in forked children
+ */
+bool utest_fork_enabled(void);
+
+/**
+ * @brief Number of tests run at the same time, 1 without the fork mode
+ */
+int utest_fork_jobs(void);
+
+/**
+ * @brief Check whether the calling code runs in a forked test child
+ */
+bool utest_in_child(void);
+
+/**
+ * @}
+ */
+
+/* Size of a copy of the name of a test */
+#define Z_UTEST_TEST_NAME_MAX 256
+
+typedef int (*z_utest_run_fn)(struct unit_test *test);
+
+void z_utest_fork_init(void);
+int z_utest_fork_submit(struct unit_test *test, z_utest_run_fn run);
+int z_utest_fork_drain(void);
+bool z_utest_fork_report_death(const char *msg, size_t len);
+int z_utest_fork_workers(int wanted);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TESTSUITE_INCLUDE_UTEST_FORK_H_ */
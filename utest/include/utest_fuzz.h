@@ -0,0 +1,98 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ *
+ * @brief utest coverage-guided fuzzing
+ */
+
+#ifndef _TESTSUITE_INCLUDE_UTEST_FUZZ_H_
+#define _TESTSUITE_INCLUDE_UTEST_FUZZ_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <test_deprecated.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup utest_fuzz utest coverage-guided fuzzing
+ * @ingroup utest
+ *
+ * A FUZZ_TEST takes a byte buffer and is registered with TEST_CASE like any
+ * other test. In a normal run it replays every input of its corpus,
+ * `<corpus-dir>/<suite>.<case>/`, plus the empty input, and fails if any of
+ * them fails an assertion.
+ *
+ * With the `fuzz` option, it instead forks `fuzz-jobs` workers (one per
+ * online CPU by default) that mutate the corpus inputs and keep the ones
+ * reaching new code. New inputs are written to the corpus directory, which
+ * is how the workers share them. Fuzzing stops at the first failing or
+ * crashing input, saved to `<cache-dir>/fuzz/`, or after `fuzz-time`
+ * seconds if given. In the fork mode, the tests fuzzing together share the
+ * workers: each test process forks `fuzz-jobs` divided by `jobs` of them,
+ * at least one.
+ *
+ * Coverage comes from the `-fsanitize-coverage=trace-pc-guard` callbacks,
+ * implemented by utest: compile the code under test with that flag, and
+ * preferably with `-fsanitize=address` too. GCC only offers
+ * `-fsanitize-coverage=trace-pc`, also supported, edges then being hashed
+ * into a fixed-size map. Without instrumentation the fuzzer still runs,
+ * but blind.
+ *
+ * ```{.c}
+ *      FUZZ_TEST(json, parse)(const uint8_t *data, size_t len)
+ *      {
+ *              struct json *doc = json_parse((const char *)data, len);
+ *
+ *              json_free(doc);
+ *      }
+ *
+ *      TEST_SUITE(json, TEST_CASE(json, parse));
+ * ```
+ *
+ * Other options: `corpus-dir`, `corpus` by default, and `fuzz-max-len`,
+ * the maximum length of generated inputs.
+ *
+ * @{
+ */
+
+/** Default maximum length of generated inputs, see `fuzz-max-len` */
+#ifndef CONFIG_utest_FUZZ_MAX_LEN
+#define CONFIG_utest_FUZZ_MAX_LEN 4096
+#endif
+
+typedef void (*utest_fuzz_fn)(const uint8_t *data, size_t len);
+
+#define FUZZ_TEST_BODY(ts_name, tc_name) _test_##ts_name##_##tc_name##_fuzz
+
+/**
+ * @brief Define a fuzz target, followed by its parameter list and body
+ *
+ * @param ts_name Test suite name
+ * @param tc_name Test case name
+ */
+#define FUZZ_TEST(ts_name, tc_name)                                           \
+	static void FUZZ_TEST_BODY(ts_name, tc_name)(const uint8_t *data,     \
+						     size_t len);             \
+	void TEST_CASE_NAME(ts_name, tc_name)(void)                           \
+	{                                                                     \
+		z_utest_fuzz_run(FUZZ_TEST_BODY(ts_name, tc_name));           \
+	}                                                                     \
+	static void FUZZ_TEST_BODY(ts_name, tc_name)
+
+/**
+ * @}
+ */
+
+void z_utest_fuzz_run(utest_fuzz_fn fn);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TESTSUITE_INCLUDE_UTEST_FUZZ_H_ */
@@ -0,0 +1,58 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ *
+ * @brief utest content hashing
+ */
+
+#ifndef _TESTSUITE_INCLUDE_UTEST_HASH_H_
+#define _TESTSUITE_INCLUDE_UTEST_HASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup utest_hash utest content hashing
+ * @ingroup utest
+ *
+ * Fast non-cryptographic 64-bit hash (XXH64) used for cache keys.
+ *
+ * @{
+ */
+
+/**
+ * @brief Hash @a len bytes at @a data
+ */
+uint64_t utest_hash64(const void *data, size_t len, uint64_t seed);
+
+/**
+ * @brief Hash the contents of file @a path
+ *
+ * @return 0 on success, -1 if the file cannot be read.
+ */
+int utest_hash_file(const char *path, uint64_t seed, uint64_t *hash);
+
+/**
+ * @brief Mix @a value into @a hash
+ */
+static inline uint64_t utest_hash_combine(uint64_t hash, uint64_t value)
+{
+	return utest_hash64(&value, sizeof(value), hash);
+}
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TESTSUITE_INCLUDE_UTEST_HASH_H_ */
@@ -0,0 +1,60 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ *
+ * @brief utest GNU make jobserver client
+ */
+
+#ifndef _TESTSUITE_INCLUDE_UTEST_JOBSERVER_H_
+#define _TESTSUITE_INCLUDE_UTEST_JOBSERVER_H_
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup utest_jobserver utest jobserver client
+ * @ingroup utest
+ *
+ * When run from `make -jN`, the runner takes its share of the N jobs from
+ * the make jobserver, found in `MAKEFLAGS` (`--jobserver-auth=R,W` or
+ * `--jobserver-auth=fifo:PATH`). The first job runs on the token make
+ * gave to the runner itself; every other test process of the fork mode,
+ * see @ref utest_fork, or test program run by the orchestrator, see
+ * @ref utest_programs, waits for a token and gives it back when it exits.
+ * The `jobs` option still caps the number of jobs; with `jobs=0`, the cap
+ * is the N of `make -jN` instead of the number of CPUs.
+ *
+ * A fifo jobserver, the default of GNU make 4.4, is found by any process.
+ * The pipe of older versions is only handed down to recipes run as
+ * recursive make, so these recipes must start with `+`:
+ *
+ * ```
+ *      check: $(TESTS)
+ *      	+./runner --jobs=0 --programs=$(subst $(space),:,$(TESTS))
+ * ```
+ *
+ * @{
+ */
+
+/**
+ * @}
+ */
+
+void z_utest_jobserver_init(void);
+bool z_utest_jobserver_create(int jobs);
+int z_utest_jobserver_fd(void);
+int z_utest_jobserver_jobs(void);
+bool z_utest_jobserver_start(int running);
+void z_utest_jobserver_done(int running);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TESTSUITE_INCLUDE_UTEST_JOBSERVER_H_ */
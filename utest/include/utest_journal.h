@@ -0,0 +1,59 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ *
+ * @brief utest results journal, resuming a run that died
+ */
+
+#ifndef _TESTSUITE_INCLUDE_UTEST_JOURNAL_H_
+#define _TESTSUITE_INCLUDE_UTEST_JOURNAL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup utest_journal utest results journal
+ * @ingroup utest
+ *
+ * With the `journal[=PATH]` option, every result is appended to a journal
+ * file as its test ends, by default `<cache-dir>/journal/results`. The file
+ * is mapped in memory, so that a crash of the runner loses none of it,
+ * even when the reporters had not written out yet. It is synced to disk every
+ * `journal-sync` milliseconds, 1000 by default, 0 syncing after every
+ * result: that is what a crash of the machine may lose.
+ *
+ * The `resume` option continues the run the journal belongs to: the tests
+ * found in it are not run again, their results are handed to the reporters
+ * in place, so the final report covers the whole run. A test the runner
+ * died running, outside of the fork mode, fails instead of taking the
+ * runner down again. New results are appended to the same journal, so a
+ * run can be resumed any number of times.
+ *
+ * ```
+ *      $ ./soak --journal=soak.journal --reporter=junit:soak.xml
+ *      Killed
+ *      $ ./soak --journal=soak.journal --reporter=junit:soak.xml --resume
+ * ```
+ *
+ * Test programs run by the orchestrator, see @ref utest_programs, are run
+ * again in full.
+ *
+ * @{
+ */
+
+/**
+ * @}
+ */
+
+void z_utest_journal_init(void);
+int z_utest_journal_replay(const char *suite, const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TESTSUITE_INCLUDE_UTEST_JOURNAL_H_ */
@@ -0,0 +1,72 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ *
+ * @brief utest per-test resource limits and usage
+ */
+
+#ifndef _TESTSUITE_INCLUDE_UTEST_LIMITS_H_
+#define _TESTSUITE_INCLUDE_UTEST_LIMITS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <utest_report.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup utest_limits utest resource limits and usage
+ * @ingroup utest
+ *
+ * Every result carries the resources its test used, see struct utest_usage:
+ * CPU time, peak resident set size, page faults and context switches. The
+ * `jsonl` reporter writes them, and so does the console reporter with the
+ * `usage` option.
+ *
+ * Limits keep a runaway test from taking the machine down with it. They
+ * apply to each test process, so they imply the fork mode, see
+ * @ref utest_fork. Sizes take a `K`, `M` or `G` suffix.
+ *
+ * - `limit-as=SIZE`: address space (RLIMIT_AS), which includes what the
+ *   test process shares with the runner.
+ * - `limit-cpu=SECONDS`: CPU time (RLIMIT_CPU).
+ * - `limit-nofile=N`: open file descriptors (RLIMIT_NOFILE).
+ * - `limit-memory=SIZE`: memory actually used, enforced with a cgroup v2
+ *   per job slot, created in the directory given by the `cgroup` option.
+ *   That directory must be delegated to the runner, hold no process, and
+ *   have the memory controller available. Without it, `limit-memory` is
+ *   applied as `limit-as`.
+ *
+ * A test going over its limits fails; it cannot take down the runner, nor
+ * the other tests.
+ *
+ * ```
+ *      $ ./tests --limit-cpu=10 --limit-as=4G --jobs=0
+ * ```
+ *
+ * @{
+ */
+
+/**
+ * @}
+ */
+
+struct rusage;
+
+bool z_utest_limits_init(void);
+void z_utest_limits_prepare(int slot);
+void z_utest_limits_apply(int slot);
+bool z_utest_limits_explain(int slot, int status, char *msg, size_t size);
+void z_utest_usage_from(const struct rusage *end, const struct rusage *start,
+			struct utest_usage *usage);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TESTSUITE_INCLUDE_UTEST_LIMITS_H_ */
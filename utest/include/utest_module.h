@@ -0,0 +1,72 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ *
+ * @brief utest loadable test modules
+ */
+
+#ifndef _TESTSUITE_INCLUDE_UTEST_MODULE_H_
+#define _TESTSUITE_INCLUDE_UTEST_MODULE_H_
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup utest_module utest test modules
+ * @ingroup utest
+ *
+ * Test programs can be built as shared objects and loaded into a single
+ * runner, which saves linking and starting one executable per program.
+ * A module is the sources of a test program, RunAllTest() included, built
+ * with `-shared -fPIC` and without utest itself: its utest symbols resolve
+ * against the runner, which must be linked with `-rdynamic`.
+ *
+ * ```
+ *      $ cc -shared -fPIC -Iutest/include -o parser.so test_parser.c
+ *      $ ./runner --modules=parser.so:lexer.so:plugins/
+ * ```
+ *
+ * The `modules` option lists shared objects and directories, separated by
+ * colons; every `*.so` file of a directory is loaded, by name order. After
+ * the RunAllTest() of the runner, the RunAllTest() of each module runs, in
+ * the same process or with the workers of the fork mode. The runner itself
+ * may have no test, RunAllTest() is optional in it. A module that cannot be
+ * loaded is reported as a failed test named `MODULE(<path>)`.
+ *
+ * Modules are loaded from a copy, so that rebuilding one never touches the
+ * code being run. In the server mode, see utest_serve.h, a module that
+ * changed is reloaded before the next request: the AFTER_ALL fixtures of
+ * its suites run, the old copy is unloaded, the new one loaded and its
+ * BEFORE_ALL fixtures run, without restarting the server.
+ *
+ * The result cache only knows the code of the runner executable, tests of
+ * modules always run.
+ *
+ * @{
+ */
+
+/**
+ * @}
+ */
+
+struct z_utest_module;
+
+void z_utest_modules_load(void);
+int z_utest_modules_run(void);
+int z_utest_module_run(const struct z_utest_module *module);
+bool z_utest_module_contains(const struct z_utest_module *module,
+			     const void *addr);
+void z_utest_modules_reload(void (*retire)(const struct z_utest_module *),
+			    void (*warm)(const struct z_utest_module *));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TESTSUITE_INCLUDE_UTEST_MODULE_H_ */
@@ -0,0 +1,93 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ *
+ * @brief utest runner options
+ */
+
+#ifndef _TESTSUITE_INCLUDE_UTEST_OPTIONS_H_
+#define _TESTSUITE_INCLUDE_UTEST_OPTIONS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup utest_options utest runner options
+ * @ingroup utest
+ *
+ * Every runner option can be given on the command line as `--name=value`
+ * (or just `--name` for flags), or through the environment as
+ * `UTEST_NAME=value`, where the name is upper-cased and dashes become
+ * underscores. The command line takes precedence.
+ *
+ * @{
+ */
+
+/**
+ * @brief Remember the command line of the test program
+ *
+ * Called by utest_main_args(). Arguments not starting with `--` are ignored.
+ */
+void utest_options_init(int argc, char *argv[]);
+
+/**
+ * @brief Look up option @a name
+ *
+ * @return The option value, an empty string for a flag given without value,
+ *         or NULL if the option was not given.
+ */
+const char *utest_option(const char *name);
+
+/**
+ * @brief Check whether flag @a name is set
+ *
+ * A flag is set when given without a value or with any value other than
+ * `0`, `no`, `off` or `false`.
+ */
+bool utest_option_enabled(const char *name);
+
+/**
+ * @brief Look up option @a name as an integer
+ *
+ * @return The option value, or @a def if missing or malformed.
+ */
+long utest_option_long(const char *name, long def);
+
+/**
+ * @brief Build the path of @a file in the @a subdir directory of the cache
+ *
+ * The cache lives in the directory given by the `cache-dir` option,
+ * `.utest-cache` by default. Missing directories are created.
+ *
+ * @return 0 on success, -1 if the directory cannot be created or the path
+ *         does not fit in @a size bytes.
+ */
+int utest_cache_path(const char *subdir, const char *file, char *path,
+		     size_t size);
+
+/**
+ * @}
+ */
+
+/* Sizes of the buffers for cache paths and the lines of cache files */
+#define Z_UTEST_PATH_MAX 512
+#define Z_UTEST_LINE_MAX 1024
+
+char **z_utest_options_args(int *argc);
+void z_utest_options_overlay(int argc, char *argv[]);
+int z_utest_cache_test_path(const char *subdir, const char *id, char *path,
+			    size_t size);
+int z_utest_write_atomic(const char *path, const void *data, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TESTSUITE_INCLUDE_UTEST_OPTIONS_H_ */
@@ -0,0 +1,77 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ *
+ * @brief utest detection of tests depending on the order they run in
+ */
+
+#ifndef _TESTSUITE_INCLUDE_UTEST_ORDER_H_
+#define _TESTSUITE_INCLUDE_UTEST_ORDER_H_
+
+#include <stdbool.h>
+#include <utest_fork.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup utest_order utest order dependencies
+ * @ingroup utest
+ *
+ * A test that passes alone but fails after another one, or the other way
+ * around, depends on state left behind: a fake not reset, a static of the
+ * code under test. With the `detect-order-deps[=ROUNDS]` option, before its
+ * tests run as usual, each suite runs them in process, once in the order
+ * they are declared in and ROUNDS more times, CONFIG_utest_ORDER_ROUNDS by
+ * default, in random orders. Each order runs in a process forked from the
+ * state the suite starts in, after its BEFORE_ALL fixture.
+ *
+ * For a test that both passed and failed in those runs, the tests that ran
+ * before it are bisected to find the one changing its outcome. Every step
+ * forks from the process holding the state after the tests the previous
+ * steps ran, so a step only runs the tests it adds, and the whole search
+ * about as many tests as precede the test. The test found is run alone
+ * before the other to check that it is enough.
+ *
+ * Each dependency found is reported as a failed test named after the test
+ * depending on the order, `ORDER(TEST(suite, case))`, with the test it
+ * depends on. The random orders are drawn from the `seed` option, random
+ * by default, which the report gives to run them again:
+ *
+ * ```
+ *      $ ./tests --detect-order-deps=20
+ *      $ ./tests --detect-order-deps=20 --seed=0x5eed --filter='math.*'
+ * ```
+ *
+ * At most CONFIG_utest_ORDER_BISECT_MAX tests of a suite are bisected.
+ *
+ * @{
+ */
+
+/** Random orders a suite runs in, besides its declaration order. */
+#ifndef CONFIG_utest_ORDER_ROUNDS
+#define CONFIG_utest_ORDER_ROUNDS 5
+#endif
+
+/** Tests of a suite bisected at most. */
+#ifndef CONFIG_utest_ORDER_BISECT_MAX
+#define CONFIG_utest_ORDER_BISECT_MAX 8
+#endif
+
+/**
+ * @}
+ */
+
+bool z_utest_order_enabled(void);
+int z_utest_order_detect(const struct unit_test_suite *suite,
+			 z_utest_run_fn run);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TESTSUITE_INCLUDE_UTEST_ORDER_H_ */
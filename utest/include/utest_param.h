@@ -0,0 +1,154 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ *
+ * @brief utest parameterized tests
+ */
+
+#ifndef _TESTSUITE_INCLUDE_UTEST_PARAM_H_
+#define _TESTSUITE_INCLUDE_UTEST_PARAM_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <test_deprecated.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup utest_param utest parameterized tests
+ * @ingroup utest
+ *
+ * A TEST_P case runs once per parameter. Parameters come from a static
+ * array, an integer range or a generator callback, and are only produced
+ * when the case is about to run, so a huge table costs nothing until then.
+ * Each instance is named after its index, `TEST(suite, case/3)`, which is
+ * what filters and shards select on.
+ *
+ * ```{.c}
+ *      TEST_P(math, square, int)
+ *      {
+ *              EXPECT_GE(*param * *param, 0);
+ *      }
+ *
+ *      static const int values[] = { -3, 0, 7 };
+ *      TEST_P_VALUES(math, square, values);
+ *
+ *      TEST_SUITE(math, TEST_CASE_P(math, square));
+ * ```
+ *
+ * @{
+ */
+
+struct utest_param_source {
+	/* Number of parameters */
+	size_t count;
+	/* Size of one parameter */
+	size_t size;
+	/* Static array of parameters, or NULL to use generate() */
+	const void *values;
+	/* Write parameter @a index to @a param */
+	void (*generate)(size_t index, void *param);
+};
+
+#define TEST_P_TYPE(ts_name, tc_name) _test_##ts_name##_##tc_name##_param_t
+#define TEST_P_BODY(ts_name, tc_name) _test_##ts_name##_##tc_name##_body
+#define TEST_P_SOURCE(ts_name, tc_name) _test_##ts_name##_##tc_name##_params
+
+/**
+ * @brief Define a parameterized test, the body gets `const type *param`
+ *
+ * @param ts_name Test suite name
+ * @param tc_name Test case name
+ * @param type Parameter type
+ */
+#define TEST_P(ts_name, tc_name, type)                                        \
+	typedef type TEST_P_TYPE(ts_name, tc_name);                           \
+	extern const struct utest_param_source TEST_P_SOURCE(ts_name,         \
+							     tc_name);        \
+	static void TEST_P_BODY(ts_name, tc_name)(const type *param);         \
+	void TEST_CASE_NAME(ts_name, tc_name)(void)                           \
+	{                                                                     \
+		TEST_P_BODY(ts_name, tc_name)((const type *)utest_param());   \
+	}                                                                     \
+	static void TEST_P_BODY(ts_name, tc_name)(const type *param)
+
+/**
+ * @brief Run a TEST_P case once per element of static array @a array
+ */
+#define TEST_P_VALUES(ts_name, tc_name, array)                                \
+	const struct utest_param_source TEST_P_SOURCE(ts_name, tc_name) = {   \
+		sizeof(array) / sizeof((array)[0]),                           \
+		sizeof(TEST_P_TYPE(ts_name, tc_name)), (array), NULL}
+
+/**
+ * @brief Run an integer TEST_P case for @a start, @a start + @a step, ...
+ *        up to but excluding @a end
+ */
+#define TEST_P_RANGE(ts_name, tc_name, start, end, step)                      \
+	static void _test_##ts_name##_##tc_name##_range(size_t index,         \
+							void *param)          \
+	{                                                                     \
+		*(TEST_P_TYPE(ts_name, tc_name) *)param =                     \
+			(TEST_P_TYPE(ts_name, tc_name))((start) +             \
+							(long long)index *    \
+								(step));      \
+	}                                                                     \
+	const struct utest_param_source TEST_P_SOURCE(ts_name, tc_name) = {   \
+		Z_UTEST_RANGE_COUNT(start, end, step),                        \
+		sizeof(TEST_P_TYPE(ts_name, tc_name)), NULL,                  \
+		_test_##ts_name##_##tc_name##_range}
+
+/**
+ * @brief Run a TEST_P case @a count times, with parameters from @a fn
+ *
+ * @param fn `void fn(size_t index, void *param)`, writing parameter
+ *           @a index to @a param
+ */
+#define TEST_P_GENERATOR(ts_name, tc_name, count, fn)                         \
+	const struct utest_param_source TEST_P_SOURCE(ts_name, tc_name) = {   \
+		(count), sizeof(TEST_P_TYPE(ts_name, tc_name)), NULL, (fn)}
+
+/**
+ * @brief Parameter of the running TEST_P instance
+ */
+const void *utest_param(void);
+
+/**
+ * @brief Index of the running TEST_P instance
+ */
+size_t utest_param_index(void);
+
+/**
+ * @}
+ */
+
+#define Z_UTEST_RANGE_COUNT(start, end, step)                                 \
+	((step) > 0 ? ((end) > (start)                                        \
+		       ? (size_t)(((end) - (start) + (step) - 1) / (step))    \
+		       : 0)                                                   \
+		    : (step) < 0 ? ((start) > (end)                           \
+				    ? (size_t)(((start) - (end) - (step) - 1) \
+					       / -(step))                     \
+				    : 0)                                      \
+				 : 0)
+
+typedef int (*z_utest_param_fn)(struct unit_test *instance);
+
+bool z_utest_param_any_selected(const char *suite, const struct unit_test *test);
+int z_utest_param_for_each(const char *suite, const struct unit_test *test,
+			   z_utest_param_fn fn);
+/* Parameters of the instance being dispatched, NULL for a plain test */
+const struct utest_param_source *z_utest_param_source(void);
+int z_utest_param_run(const struct utest_param_source *params, size_t index,
+		      int (*fn)(void *arg), void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TESTSUITE_INCLUDE_UTEST_PARAM_H_ */
@@ -0,0 +1,78 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ *
+ * @brief utest failure-first test order and time budget
+ */
+
+#ifndef _TESTSUITE_INCLUDE_UTEST_PRIORITY_H_
+#define _TESTSUITE_INCLUDE_UTEST_PRIORITY_H_
+
+#include <stdbool.h>
+#include <test_deprecated.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup utest_priority utest test priorities
+ * @ingroup utest
+ *
+ * With the `prioritize` option, the tests most likely to fail run first,
+ * so that a failure shows up early in the run:
+ *
+ * 1. tests that failed in one of the last CONFIG_utest_PRIORITY_RECENT
+ *    runs, the most recent failures first,
+ * 2. tests whose code changed since they last ran, as the result cache
+ *    sees it, see @ref utest_result_cache, and new tests,
+ * 3. the others, the shortest first.
+ *
+ * With `time-budget=DURATION`, such as `60s`, `1500ms` or `2m`, the run
+ * also only takes the tests that fit in DURATION, in that order, going by
+ * their last duration. A test that does not fit is left out, a shorter one
+ * after it may still be taken. Tests are no longer started once DURATION
+ * is over. Left out tests are reported as skipped, in a suite of their own
+ * for the suites none of whose tests ran.
+ *
+ * ```
+ *      $ ./tests --time-budget=60s --fork --jobs=0
+ * ```
+ *
+ * Suites run in pieces, one for each stretch of the order holding their
+ * tests, in which tests keep that order, but for the instances of a
+ * parameterized test, which run together; the BEFORE_ALL fixture of a
+ * suite runs once per piece.
+ *
+ * The last status, failures, duration and code hash of each test are kept
+ * in `<cache-dir>/history/<program>` by the runs that order the tests, and
+ * by those given the `history` option, which keeps them without changing
+ * the order.
+ *
+ * @{
+ */
+
+/** Number of runs a failure counts as recent for. */
+#ifndef CONFIG_utest_PRIORITY_RECENT
+#define CONFIG_utest_PRIORITY_RECENT 8
+#endif
+
+/**
+ * @}
+ */
+
+void z_utest_priority_init(void);
+bool z_utest_priority_listing(void);
+void z_utest_priority_list(const struct unit_test_suite *suite,
+			   const struct unit_test *test);
+bool z_utest_priority_selected(const char *suite, const char *name);
+bool z_utest_priority_run(void (*run)(void));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TESTSUITE_INCLUDE_UTEST_PRIORITY_H_ */
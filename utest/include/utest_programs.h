@@ -0,0 +1,95 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ *
+ * @brief utest test program orchestrator
+ */
+
+#ifndef _TESTSUITE_INCLUDE_UTEST_PROGRAMS_H_
+#define _TESTSUITE_INCLUDE_UTEST_PROGRAMS_H_
+
+#include <utest_report.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup utest_programs utest test program orchestrator
+ * @ingroup utest
+ *
+ * The `programs` option lists test executables and directories, separated
+ * by colons; every executable file of a directory is run, by name order.
+ * After its own tests and modules, the runner runs these programs, up to
+ * `jobs` at the same time, and reports their tests along with its own, as
+ * one run: a single console summary, a single JUnit file...
+ *
+ * ```
+ *      $ ./runner --jobs=0 --programs=build/tests/ --reporter=junit:all.xml
+ * ```
+ *
+ * Each program gets the other options of the runner, and sends its results
+ * back instead of reporting them itself. Its suites are reported as
+ * `<program>:<suite>`, each in one piece, in completion order. A program
+ * that dies, or that is not a utest program and exits with another status
+ * than 0, is reported as a failed test named `PROGRAM(<path>)`.
+ *
+ * The programs and their own fork mode jobs share the `jobs` limit: the
+ * runner acts as the jobserver of its programs, see @ref utest_jobserver,
+ * or hands down the one of make. Under `make -j`, `jobs` defaults to as many
+ * programs as the jobserver allows.
+ *
+ * @{
+ */
+
+/**
+ * @}
+ */
+
+/* Events of the result stream of a program */
+enum {
+	Z_UTEST_EVENT_SUITE_START,
+	Z_UTEST_EVENT_TEST_END,
+	Z_UTEST_EVENT_SUITE_END,
+	Z_UTEST_EVENT_RUN_END,
+	Z_UTEST_EVENT_TEST_START,
+};
+
+/* Strings of an event, each one followed by a NUL */
+enum {
+	Z_UTEST_EVENT_SUITE,
+	Z_UTEST_EVENT_NAME,
+	Z_UTEST_EVENT_MESSAGE,
+	Z_UTEST_EVENT_STDOUT,
+	Z_UTEST_EVENT_STDERR,
+	Z_UTEST_EVENT_STRINGS
+};
+
+struct z_utest_event {
+	uint32_t type;
+	int32_t status;
+	uint64_t duration_ns;
+	uint32_t len[Z_UTEST_EVENT_STRINGS];
+	struct utest_usage usage;
+};
+
+void z_utest_event_write(struct utest_outbuf *out, struct z_utest_event *ev,
+			 const char *const str[Z_UTEST_EVENT_STRINGS],
+			 const size_t len[Z_UTEST_EVENT_STRINGS]);
+size_t z_utest_event_size(const char *data, size_t len);
+void z_utest_event_read(const char *data, struct z_utest_event *ev,
+			const char *str[Z_UTEST_EVENT_STRINGS]);
+
+int z_utest_programs_run(void);
+struct utest_reporter *z_utest_programs_reporter(void);
+char **z_utest_programs_args(void);
+void z_utest_programs_unsetenv(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TESTSUITE_INCLUDE_UTEST_PROGRAMS_H_ */
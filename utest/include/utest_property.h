@@ -0,0 +1,176 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ *
+ * @brief utest property-based tests
+ */
+
+#ifndef _TESTSUITE_INCLUDE_UTEST_PROPERTY_H_
+#define _TESTSUITE_INCLUDE_UTEST_PROPERTY_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <test_deprecated.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup utest_property utest property-based tests
+ * @ingroup utest
+ *
+ * A PROPERTY body runs many times, each time drawing fresh inputs from the
+ * utest_gen_*() generators, and fails as soon as one run fails an
+ * assertion. Generators are backed by a xoshiro256** generator seeded per
+ * run, and every value they return is recorded as a sequence of raw
+ * choices. A failing sequence is then shrunk, by deleting and lowering
+ * choices while the body keeps failing, and the failure is reported with
+ * the values drawn by the smallest counterexample and the seed to rerun it.
+ *
+ * Generators compose by calling each other, for instance from the element
+ * callback of utest_gen_array(). The properties are registered with
+ * TEST_CASE like any other test.
+ *
+ * ```{.c}
+ *      PROPERTY(codec, roundtrip)
+ *      {
+ *              size_t len;
+ *              const uint8_t *in = utest_gen_bytes(0, 64, &len);
+ *
+ *              EXPECT_EQ(decode(encode(in, len)), len);
+ *      }
+ *
+ *      TEST_SUITE(codec, TEST_CASE(codec, roundtrip));
+ * ```
+ *
+ * Options:
+ * - `seed=N` sets the base seed, random by default.
+ * - `property-iterations=N` sets the number of runs per property.
+ * - `property-shrinks=N` bounds the number of runs spent shrinking.
+ * - `property-jobs=N` sets the number of worker processes, the value of
+ *   `jobs` by default.
+ *
+ * The runs of a property are spread over the worker processes, forked from
+ * the test, and the smallest failing run is shrunk in the test itself. In
+ * the fork mode, the tests running together share the workers: each test
+ * process forks N divided by `jobs` of them, at least one. The seed printed
+ * on failure reproduces a failure in any mode.
+ *
+ * @{
+ */
+
+/** Default number of runs per property, see the `property-iterations` option */
+#ifndef CONFIG_utest_PROPERTY_ITERATIONS
+#define CONFIG_utest_PROPERTY_ITERATIONS 1000
+#endif
+
+/** Default bound on shrinking runs, see the `property-shrinks` option */
+#ifndef CONFIG_utest_PROPERTY_SHRINKS
+#define CONFIG_utest_PROPERTY_SHRINKS 2000
+#endif
+
+#define PROPERTY_BODY(ts_name, tc_name) _test_##ts_name##_##tc_name##_property
+
+/**
+ * @brief Define a property, run against many generated inputs
+ *
+ * @param ts_name Test suite name
+ * @param tc_name Test case name
+ */
+#define PROPERTY(ts_name, tc_name)                                            \
+	static void PROPERTY_BODY(ts_name, tc_name)(void);                    \
+	void TEST_CASE_NAME(ts_name, tc_name)(void)                           \
+	{                                                                     \
+		z_utest_property_run(PROPERTY_BODY(ts_name, tc_name));        \
+	}                                                                     \
+	static void PROPERTY_BODY(ts_name, tc_name)(void)
+
+/**
+ * @brief Discard the current run if @a cond does not hold
+ *
+ * Discarded runs neither pass nor fail. A property discarding most of its
+ * runs should generate its inputs differently.
+ */
+#define PROPERTY_ASSUME(cond)                                                 \
+	do {                                                                  \
+		if (!(cond)) {                                                \
+			utest_skip();                                         \
+		}                                                             \
+	} while (false)
+
+/** @brief Draw a boolean, shrinks to false */
+bool utest_gen_bool(void);
+
+/** @brief Draw any 64-bit value, shrinks to 0 */
+uint64_t utest_gen_u64(void);
+
+/** @brief Draw any 32-bit value, shrinks to 0 */
+uint32_t utest_gen_u32(void);
+
+/**
+ * @brief Draw an integer in [@a min, @a max]
+ *
+ * Bounds and small values are drawn more often than a uniform draw would.
+ * Shrinks toward 0, or toward the bound closest to 0 if 0 is out of range.
+ */
+int64_t utest_gen_int(int64_t min, int64_t max);
+
+/** @brief Draw a size in [@a min, @a max], shrinks toward @a min */
+size_t utest_gen_size(size_t min, size_t max);
+
+/** @brief Draw an index in [0, @a n), shrinks toward 0 */
+size_t utest_gen_choice(size_t n);
+
+/** @brief Draw a double in [@a min, @a max), shrinks toward @a min */
+double utest_gen_double(double min, double max);
+
+/**
+ * @brief Draw between @a min_len and @a max_len bytes
+ *
+ * @param len Set to the number of bytes drawn
+ * @return The bytes, valid until the end of the run.
+ */
+const uint8_t *utest_gen_bytes(size_t min_len, size_t max_len, size_t *len);
+
+/**
+ * @brief Draw a printable string of @a min_len to @a max_len characters
+ *
+ * @return The NUL-terminated string, valid until the end of the run.
+ */
+const char *utest_gen_string(size_t min_len, size_t max_len);
+
+/**
+ * @brief Draw an array of @a min_count to @a max_count elements
+ *
+ * @param elem_size Size of an element
+ * @param gen Called to fill in each zero-initialized element, typically
+ *            with other generators
+ * @param count Set to the number of elements drawn
+ * @return The array, valid until the end of the run.
+ */
+void *utest_gen_array(size_t min_count, size_t max_count, size_t elem_size,
+		      void (*gen)(void *elem), size_t *count);
+
+/**
+ * @brief Allocate @a size zeroed bytes released at the end of the run
+ *
+ * For element generators building nested data.
+ */
+void *utest_gen_alloc(size_t size);
+
+/**
+ * @}
+ */
+
+void z_utest_property_run(void (*body)(void));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TESTSUITE_INCLUDE_UTEST_PROPERTY_H_ */
@@ -0,0 +1,232 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ *
+ * @brief utest result reporters
+ */
+
+#ifndef _TESTSUITE_INCLUDE_UTEST_REPORT_H_
+#define _TESTSUITE_INCLUDE_UTEST_REPORT_H_
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup utest_report utest result reporters
+ * @ingroup utest
+ *
+ * Every runner event (suite start, test end, final report...) is dispatched
+ * to a list of reporters. The built-in console reporter formats the classic
+ * text output into a large buffer and only issues a write() when the buffer
+ * fills up or a suite ends. Unless the `capture` option keeps the output of
+ * the tests away from the console, what a test prints stays next to its
+ * result: on a terminal, each line is written out as soon as it is
+ * complete, otherwise lines go through the stdio buffer of the tests.
+ * Additional reporters can be registered with utest_register_reporter().
+ *
+ * @{
+ */
+
+/** Size of the failure message kept for the running test, in bytes. */
+#ifndef CONFIG_utest_FAILURE_MSG_SIZE
+#define CONFIG_utest_FAILURE_MSG_SIZE 4096
+#endif
+
+/** Size of the console reporter output buffer, in bytes. */
+#ifndef CONFIG_utest_REPORT_BUFFER_SIZE
+#define CONFIG_utest_REPORT_BUFFER_SIZE (64 * 1024)
+#endif
+
+/**
+ * @brief Resources used by a test, from getrusage()
+ *
+ * All zero when unknown, for instance for a cached result.
+ */
+struct utest_usage {
+	/** CPU time spent in user and in system mode */
+	uint64_t user_ns;
+	uint64_t system_ns;
+	/**
+	 * Peak resident set size, in KiB: of the test process in the fork
+	 * mode, of the whole runner so far otherwise
+	 */
+	uint64_t max_rss_kb;
+	/** Page faults served without and with I/O */
+	uint64_t minor_faults;
+	uint64_t major_faults;
+	/** Context switches while waiting, and forced by the scheduler */
+	uint64_t voluntary_switches;
+	uint64_t involuntary_switches;
+};
+
+/**
+ * @brief Result of one finished test, as seen by the reporters
+ */
+struct utest_result {
+	/** Name of the suite the test belongs to */
+	const char *suite;
+	/** Name of the test */
+	const char *name;
+	/** One of TC_PASS, TC_FAIL, TC_SKIP or TC_CACHED */
+	int status;
+	/** Wall clock duration of setup, test and teardown */
+	uint64_t duration_ns;
+	/** Failure message, empty if the test did not report anything */
+	const char *message;
+	/** Length of @a message, without the terminating NUL */
+	size_t message_len;
+	/** Standard output of a failed test, when capture is enabled */
+	const char *captured_stdout;
+	size_t captured_stdout_len;
+	/** Standard error of a failed test, when capture is enabled */
+	const char *captured_stderr;
+	size_t captured_stderr_len;
+	/** Resources used by setup, test and teardown */
+	struct utest_usage usage;
+};
+
+/**
+ * @brief Reporter interface
+ *
+ * Any callback may be NULL. Callbacks are invoked in registration order.
+ */
+struct utest_reporter {
+	const char *name;
+	void (*on_run_start)(struct utest_reporter *rep);
+	void (*on_suite_start)(struct utest_reporter *rep, const char *suite);
+	void (*on_test_start)(struct utest_reporter *rep, const char *suite,
+			      const char *name);
+	void (*on_test_end)(struct utest_reporter *rep,
+			    const struct utest_result *result);
+	void (*on_suite_end)(struct utest_reporter *rep, const char *suite,
+			     int result);
+	void (*on_run_end)(struct utest_reporter *rep, int result);
+	/** Free for use by the reporter implementation */
+	void *user_data;
+	/** Internal, do not touch */
+	struct utest_reporter *next;
+};
+
+/**
+ * @brief Add @a rep to the list of active reporters
+ *
+ * Registering the same reporter twice has no effect.
+ */
+void utest_register_reporter(struct utest_reporter *rep);
+
+/**
+ * @brief Remove @a rep from the list of active reporters
+ */
+void utest_unregister_reporter(struct utest_reporter *rep);
+
+/**
+ * @brief The built-in buffered console reporter
+ *
+ * Registered by utest_main() unless other reporters were selected with the
+ * `reporter` option, see z_utest_setup_reporters().
+ */
+extern struct utest_reporter utest_console_reporter;
+
+/**
+ * @brief Create one of the built-in streaming reporters
+ *
+ * @param kind `junit` (JUnit XML), `jsonl` (JSON Lines) or `tap`
+ * @param path Output file, or NULL or `-` for the standard output
+ * @return The reporter, to be passed to utest_register_reporter(), or NULL
+ *         if @a kind is unknown or @a path cannot be opened.
+ */
+struct utest_reporter *utest_reporter_create(const char *kind,
+					     const char *path);
+
+/**
+ * @brief Buffered output stream used by the reporters
+ *
+ * Formats into @a buf and flushes to @a fd with write() when full.
+ */
+struct utest_outbuf {
+	int fd;
+	char *buf;
+	size_t len;
+	size_t size;
+};
+
+void utest_outbuf_init(struct utest_outbuf *out, int fd, char *buf,
+		       size_t size);
+void utest_outbuf_write(struct utest_outbuf *out, const char *data,
+			size_t len);
+void utest_outbuf_puts(struct utest_outbuf *out, const char *str);
+void utest_outbuf_vprintf(struct utest_outbuf *out, const char *fmt,
+			  va_list vargs);
+void utest_outbuf_printf(struct utest_outbuf *out, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+void utest_outbuf_flush(struct utest_outbuf *out);
+
+/**
+ * @brief Append to the failure message of the running test
+ *
+ * The message is handed to the reporters along with the result instead of
+ * being printed right away. It is truncated to CONFIG_utest_FAILURE_MSG_SIZE.
+ */
+void z_utest_failure_printf(const char *fmt, ...)
+	__attribute__((format(printf, 1, 2)));
+void z_utest_failure_vprintf(const char *fmt, va_list vargs);
+void z_utest_failure_reset(void);
+const char *z_utest_failure_message(size_t *len);
+void z_utest_failure_truncate(size_t len);
+
+/**
+ * @brief Register the reporters selected with the `reporter` option
+ *
+ * The option is a comma separated list of `kind[:path]`, for instance
+ * `--reporter=console,junit:report.xml`. Without it, or when none of the
+ * reporters it lists can be created, only the console reporter is used.
+ */
+void z_utest_setup_reporters(void);
+
+/**
+ * @brief File descriptor of the original standard output
+ *
+ * Reporters write there, so that their output is not affected when the
+ * runner redirects fd 1 while a test runs.
+ */
+int z_utest_stdout_fd(void);
+
+/**
+ * @brief write() all of @a buf to @a fd, retrying on EINTR
+ *
+ * @return 0 on success, -1 on error.
+ */
+int z_utest_write_all(int fd, const void *buf, size_t len);
+
+/* Runner events, see the TC_* macros in tc_util.h */
+void z_utest_report_run_start(void);
+void z_utest_report_suite_start(const char *suite);
+void z_utest_report_test_start(const char *name);
+void z_utest_report_test_end(int result);
+void z_utest_report_result(const struct utest_result *result);
+void z_utest_report_suite_end(const char *suite, int result);
+void z_utest_report_fixture_start(const char *label);
+void z_utest_report_test_dispatched(const char *name);
+const char *z_utest_report_current_suite(void);
+const char *z_utest_report_current_test(void);
+void z_utest_report_set_sink(void (*sink)(const struct utest_result *result));
+void z_utest_report_fixture_end(int result);
+void z_utest_report_end(int result);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TESTSUITE_INCLUDE_UTEST_REPORT_H_ */
@@ -0,0 +1,75 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ *
+ * @brief utest result cache, skipping the tests nothing changed for
+ */
+
+#ifndef _TESTSUITE_INCLUDE_UTEST_RESULT_CACHE_H_
+#define _TESTSUITE_INCLUDE_UTEST_RESULT_CACHE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <test_deprecated.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup utest_result_cache utest result cache
+ * @ingroup utest
+ *
+ * With the `result-cache` option, a test that passed is recorded under
+ * `<cache-dir>/results/` with a hash of the code it may run, and is
+ * reported as CACHED-PASS instead of running as long as that hash and the
+ * data files it read are unchanged.
+ *
+ * The code of a test is its function, its setup and teardown, the
+ * BEFORE_ALL and AFTER_ALL of its suite, and everything they reach, read
+ * from the executable itself: called functions, referenced data and the
+ * functions their pointers lead to, such as the build function of a
+ * cached fixture. Addresses are left out of the hash, so that unrelated
+ * changes moving the code around do not invalidate it.
+ *
+ * On x86-64, references are found by decoding calls, jumps and
+ * RIP-relative operands, which works for position independent executables,
+ * the default. Linking with `-Wl,--emit-relocs` makes them exact. On other
+ * architectures any change to the code invalidates every test.
+ *
+ * Data files are declared by the test with utest_depend_file() as it reads
+ * them. The inputs of cached fixtures and the corpus of fuzz tests are
+ * declared by utest. Runs given the `seed` or `fuzz` option do not use
+ * the cache.
+ *
+ * @{
+ */
+
+/**
+ * @brief Declare that the running test reads @a path
+ *
+ * The result of the test is only reused while the contents of @a path, or
+ * for a directory the names and contents of its files, stay the same. A
+ * missing file counts as a content of its own.
+ */
+void utest_depend_file(const char *path);
+
+/**
+ * @}
+ */
+
+void z_utest_result_cache_init(void);
+bool z_utest_result_cache_hit(const struct unit_test_suite *suite,
+			      const struct unit_test *test);
+void z_utest_result_cache_store(const char *suite, const char *name);
+bool z_utest_code_hash(const struct unit_test_suite *suite,
+		       const struct unit_test *test, uint64_t *hash);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TESTSUITE_INCLUDE_UTEST_RESULT_CACHE_H_ */
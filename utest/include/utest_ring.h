@@ -0,0 +1,88 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ *
+ * @brief utest shared memory result rings
+ */
+
+#ifndef _TESTSUITE_INCLUDE_UTEST_RING_H_
+#define _TESTSUITE_INCLUDE_UTEST_RING_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <utest_report.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup utest_ring utest result rings
+ * @ingroup utest
+ *
+ * Test processes of the fork mode hand their results to the runner through
+ * shared memory, one ring per job slot. A ring holds fixed-size result
+ * records, and an arena for the strings they carry. The writing process and
+ * the runner each own one end of the ring, and synchronize with atomic
+ * loads and stores only: a test process publishes its result without a
+ * system call, and the runner takes every published record in one batch.
+ *
+ * Strings that do not fit in the arena are cut, the captured output first.
+ *
+ * @{
+ */
+
+/** Number of records of a ring. */
+#ifndef CONFIG_utest_RING_RECORDS
+#define CONFIG_utest_RING_RECORDS 64
+#endif
+
+/** Size of the string arena of a ring, in bytes. */
+#ifndef CONFIG_utest_RING_ARENA_SIZE
+#define CONFIG_utest_RING_ARENA_SIZE (4 * 1024 * 1024)
+#endif
+
+/**
+ * @}
+ */
+
+/* Strings carried by a record, stored one after the other in the arena */
+enum {
+	Z_UTEST_RING_MESSAGE,
+	Z_UTEST_RING_STDOUT,
+	Z_UTEST_RING_STDERR,
+	Z_UTEST_RING_STRINGS
+};
+
+struct z_utest_ring_rec {
+	/* Set by the writer, to tell its records from a previous writer's */
+	uint32_t tag;
+	int32_t status;
+	uint64_t duration_ns;
+	uint32_t len[Z_UTEST_RING_STRINGS];
+	/* Arena offset of the strings, set by z_utest_ring_push() */
+	uint64_t offset;
+	struct utest_usage usage;
+};
+
+struct z_utest_ring;
+
+struct z_utest_ring *z_utest_rings_create(int count);
+void z_utest_rings_destroy(struct z_utest_ring *rings, int count);
+struct z_utest_ring *z_utest_ring_get(struct z_utest_ring *rings, int index);
+bool z_utest_ring_push(struct z_utest_ring *ring, struct z_utest_ring_rec *rec,
+		       const char *const str[Z_UTEST_RING_STRINGS]);
+size_t z_utest_ring_consume(struct z_utest_ring *ring,
+			    void (*fn)(const struct z_utest_ring_rec *rec,
+				       const char *data, void *arg),
+			    void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TESTSUITE_INCLUDE_UTEST_RING_H_ */
@@ -0,0 +1,96 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ *
+ * @brief utest pseudo-random number generator
+ */
+
+#ifndef _TESTSUITE_INCLUDE_UTEST_RNG_H_
+#define _TESTSUITE_INCLUDE_UTEST_RNG_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup utest_rng utest pseudo-random number generator
+ * @ingroup utest
+ *
+ * xoshiro256**, seeded through splitmix64. Fast and good enough for
+ * generating test inputs, not for anything cryptographic.
+ *
+ * @{
+ */
+
+struct utest_rng {
+	uint64_t s[4];
+};
+
+static inline uint64_t z_utest_splitmix64(uint64_t *x)
+{
+	uint64_t z = (*x += 0x9e3779b97f4a7c15u);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9u;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebu;
+
+	return z ^ (z >> 31);
+}
+
+static inline uint64_t z_utest_rotl(uint64_t x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+/**
+ * @brief Seed @a rng, equal seeds give equal sequences
+ */
+static inline void utest_rng_seed(struct utest_rng *rng, uint64_t seed)
+{
+	for (int i = 0; i < 4; i++) {
+		rng->s[i] = z_utest_splitmix64(&seed);
+	}
+}
+
+/**
+ * @brief Next 64 random bits
+ */
+static inline uint64_t utest_rng_next(struct utest_rng *rng)
+{
+	uint64_t *s = rng->s;
+	uint64_t result = z_utest_rotl(s[1] * 5, 7) * 9;
+	uint64_t t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = z_utest_rotl(s[3], 45);
+
+	return result;
+}
+
+/**
+ * @brief Random value in [0, @a bound]
+ */
+static inline uint64_t utest_rng_below(struct utest_rng *rng, uint64_t bound)
+{
+	uint64_t r = utest_rng_next(rng);
+
+	return bound == UINT64_MAX ? r : r % (bound + 1);
+}
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TESTSUITE_INCLUDE_UTEST_RNG_H_ */
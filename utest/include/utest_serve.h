@@ -0,0 +1,66 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ *
+ * @brief utest server mode
+ */
+
+#ifndef _TESTSUITE_INCLUDE_UTEST_SERVE_H_
+#define _TESTSUITE_INCLUDE_UTEST_SERVE_H_
+
+#include <stdbool.h>
+#include <test_deprecated.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup utest_serve utest server mode
+ * @ingroup utest
+ *
+ * With the `serve` option, the test program stays resident instead of
+ * running the tests. It runs the BEFORE_ALL fixture of every suite once,
+ * then listens on a Unix domain socket: the path given as value, or
+ * `<cache-dir>/serve/<program>.sock`.
+ *
+ * ```
+ *      $ ./tests --serve &
+ *      $ ./tests --client --filter='parser.*'
+ * ```
+ *
+ * The `client` option, with the same optional path, turns the program into
+ * a client: it sends its other options, its `UTEST_` environment variables
+ * and its working directory to the server, which runs the tests in a
+ * process forked from its warm state. Output goes straight to the standard
+ * output and error of the client, as tests complete. The client exits with
+ * 0 if every test passed, 1 otherwise. Without a server, the client runs
+ * the tests itself, and exits the same way.
+ *
+ * Each request runs from a pristine copy of the server, as in the fork
+ * mode: what tests change does not carry over to the next request. The
+ * AFTER_ALL fixtures of warm suites run when the server stops, on SIGINT
+ * or SIGTERM. When the executable is rebuilt, the server starts over from
+ * the new one at the next request.
+ *
+ * @{
+ */
+
+/**
+ * @}
+ */
+
+bool z_utest_client(void);
+void z_utest_serve(int argc, char *argv[], int (*run)(void));
+bool z_utest_serve_warming(void);
+void z_utest_serve_warmed(const struct unit_test_suite *suite);
+bool z_utest_serve_warm(const struct unit_test_suite *suite);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TESTSUITE_INCLUDE_UTEST_SERVE_H_ */
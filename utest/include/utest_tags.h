@@ -0,0 +1,101 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ *
+ * @brief utest test tags and resources
+ */
+
+#ifndef _TESTSUITE_INCLUDE_UTEST_TAGS_H_
+#define _TESTSUITE_INCLUDE_UTEST_TAGS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup utest_tags utest test tags and resources
+ * @ingroup utest
+ *
+ * A test carries up to 64 tags, a bit set given to TEST_CASE_TAGS(). The
+ * program names its tags in a UTEST_TAGS() table, and can give each one a
+ * capacity: the number of tests carrying it that the fork mode runs at the
+ * same time, see @ref utest_fork. A tag can stand for a fixed local port
+ * (capacity 1), for a share of the memory of the machine, or require its
+ * tests to run alone.
+ *
+ * ```{.c}
+ *      #define TAG_PORT   UTEST_TAG(0)
+ *      #define TAG_BIGMEM UTEST_TAG(1)
+ *      #define TAG_SLOW   UTEST_TAG(2)
+ *
+ *      UTEST_TAGS({ "port", TAG_PORT, 1 },
+ *                 { "bigmem", TAG_BIGMEM, 4 },
+ *                 { "slow", TAG_SLOW, 0 });
+ *
+ *      TEST_SUITE(net, TEST_CASE_TAGS(net, bind, TAG_PORT),
+ *                 TEST_CASE_TAGS(net, huge, TAG_BIGMEM | TAG_SLOW));
+ * ```
+ *
+ * A test that cannot start because of its resources is held back, and the
+ * tests after it take the free job slots. Parameterized test instances are
+ * not held back, they wait for their resources in place.
+ *
+ * The `resources` option overrides capacities, as a `:` separated list of
+ * `name=capacity`, for instance `--resources=bigmem=2` on a smaller
+ * machine.
+ *
+ * The `tags` option selects tests by tag, as a `:` separated list of tag
+ * names: tests carrying any of them run, and tests carrying a tag preceded
+ * by `-` do not, for instance `--tags=port:-slow` or `--tags=-slow`.
+ *
+ * @{
+ */
+
+/** @brief Tag number @a bit, from 0 to 63 */
+#define UTEST_TAG(bit) ((uint64_t)1 << (bit))
+
+/** @brief Capacity of a tag whose tests run with no other test */
+#define UTEST_TAG_ALONE (-1)
+
+/**
+ * @brief Name and capacity of a tag
+ */
+struct utest_tag {
+	const char *name;
+	/** The tag, a UTEST_TAG() */
+	uint64_t tag;
+	/** Tests carrying the tag run at the same time, 0 for any number */
+	int capacity;
+};
+
+/**
+ * @brief Define the tags of the test program, once
+ *
+ * @param ... struct utest_tag initializers
+ */
+#define UTEST_TAGS(...) \
+	const struct utest_tag utest_tags[] = { __VA_ARGS__, { 0 } }
+
+/**
+ * @}
+ */
+
+extern const struct utest_tag utest_tags[] __attribute__((weak));
+
+void z_utest_tags_init(void);
+bool z_utest_tags_selected(uint64_t tags);
+bool z_utest_resources_fit(uint64_t tags, int running);
+void z_utest_resources_take(uint64_t tags);
+void z_utest_resources_give(uint64_t tags);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TESTSUITE_INCLUDE_UTEST_TAGS_H_ */
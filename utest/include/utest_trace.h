@@ -0,0 +1,161 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ *
+ * @brief utest flight recorder
+ */
+
+#ifndef _TESTSUITE_INCLUDE_UTEST_TRACE_H_
+#define _TESTSUITE_INCLUDE_UTEST_TRACE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup utest_trace utest flight recorder
+ * @ingroup utest
+ *
+ * utest_trace() records a format string pointer and its raw arguments into
+ * a per-test ring buffer, without formatting anything. The most recent
+ * records are formatted and attached to the failure message when the test
+ * fails, or printed on request with utest_trace_dump().
+ *
+ * Since only pointers are recorded, `%s` arguments must still be valid
+ * when the test ends, e.g. string literals.
+ *
+ * @{
+ */
+
+/** Number of records kept per test, must be a power of two. */
+#ifndef CONFIG_utest_TRACE_ENTRIES
+#define CONFIG_utest_TRACE_ENTRIES 256
+#endif
+
+/** Number of records attached to a failure, see also the `trace-dump` option */
+#ifndef CONFIG_utest_TRACE_DUMP
+#define CONFIG_utest_TRACE_DUMP 32
+#endif
+
+#define Z_UTEST_TRACE_MAX_ARGS 6
+
+/**
+ * @brief Record a trace message for the running test
+ *
+ * @param fmt printf() format, must be a string with static storage
+ * @param ... Up to 6 arguments for @a fmt
+ */
+#define utest_trace(fmt, ...)                                                \
+	z_utest_trace_record(fmt, Z_UTEST_TRACE_NARGS(__VA_ARGS__),          \
+			     (const uint64_t[]){                             \
+				     Z_UTEST_TRACE_MAP(__VA_ARGS__) 0 })
+
+/**
+ * @brief Print every record of the running test to the standard output
+ */
+void utest_trace_dump(void);
+
+/**
+ * @}
+ */
+
+struct z_utest_trace_entry {
+	const char *fmt;
+	uint32_t nargs;
+	uint64_t args[Z_UTEST_TRACE_MAX_ARGS];
+};
+
+struct z_utest_trace_buffer {
+	uint32_t head;
+	struct z_utest_trace_entry entries[CONFIG_utest_TRACE_ENTRIES];
+};
+
+extern struct z_utest_trace_buffer z_utest_trace_buf;
+
+static inline void z_utest_trace_record(const char *fmt, uint32_t nargs,
+					const uint64_t *args)
+{
+	struct z_utest_trace_entry *e =
+		&z_utest_trace_buf.entries[z_utest_trace_buf.head++ &
+					   (CONFIG_utest_TRACE_ENTRIES - 1)];
+
+	e->fmt = fmt;
+	e->nargs = nargs;
+	for (uint32_t i = 0; i < nargs; i++) {
+		e->args[i] = args[i];
+	}
+}
+
+/* Store the bits of any scalar argument in 64 bits, floats as double */
+static inline uint64_t z_utest_trace_bits(const void *p, size_t size,
+					  int kind)
+{
+	union {
+		uint64_t u;
+		double d;
+	} v = { 0 };
+
+	if (kind == 1) {
+		v.d = *(const float *)p;
+	} else if (kind == 2) {
+		v.d = *(const double *)p;
+	} else if (kind == 3) {
+		v.d = (double)*(const long double *)p;
+	} else if (size == 1) {
+		v.u = *(const uint8_t *)p;
+	} else if (size == 2) {
+		v.u = *(const uint16_t *)p;
+	} else if (size == 4) {
+		v.u = *(const uint32_t *)p;
+	} else {
+		v.u = *(const uint64_t *)p;
+	}
+
+	return v.u;
+}
+
+#define Z_UTEST_TRACE_ARG(x)                                                 \
+	z_utest_trace_bits(&(__typeof__((x) + 0)){ (x) }, sizeof((x) + 0),   \
+			   _Generic((x) + 0, float: 1, double: 2,            \
+				    long double: 3, default: 0)),
+
+#define Z_UTEST_TRACE_NARGS(...)                                             \
+	Z_UTEST_TRACE_NARGS_(_, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define Z_UTEST_TRACE_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, N, ...) N
+
+#define Z_UTEST_TRACE_CAT(a, b) Z_UTEST_TRACE_CAT_(a, b)
+#define Z_UTEST_TRACE_CAT_(a, b) a##b
+
+#define Z_UTEST_TRACE_MAP(...)                                               \
+	Z_UTEST_TRACE_CAT(Z_UTEST_TRACE_MAP_,                                \
+			  Z_UTEST_TRACE_NARGS(__VA_ARGS__))(__VA_ARGS__)
+#define Z_UTEST_TRACE_MAP_0()
+#define Z_UTEST_TRACE_MAP_1(a) Z_UTEST_TRACE_ARG(a)
+#define Z_UTEST_TRACE_MAP_2(a, ...)                                          \
+	Z_UTEST_TRACE_ARG(a) Z_UTEST_TRACE_MAP_1(__VA_ARGS__)
+#define Z_UTEST_TRACE_MAP_3(a, ...)                                          \
+	Z_UTEST_TRACE_ARG(a) Z_UTEST_TRACE_MAP_2(__VA_ARGS__)
+#define Z_UTEST_TRACE_MAP_4(a, ...)                                          \
+	Z_UTEST_TRACE_ARG(a) Z_UTEST_TRACE_MAP_3(__VA_ARGS__)
+#define Z_UTEST_TRACE_MAP_5(a, ...)                                          \
+	Z_UTEST_TRACE_ARG(a) Z_UTEST_TRACE_MAP_4(__VA_ARGS__)
+#define Z_UTEST_TRACE_MAP_6(a, ...)                                          \
+	Z_UTEST_TRACE_ARG(a) Z_UTEST_TRACE_MAP_5(__VA_ARGS__)
+/* More than Z_UTEST_TRACE_MAX_ARGS arguments do not compile */
+#define Z_UTEST_TRACE_MAP_7(...) utest_trace_supports_at_most_6_arguments
+#define Z_UTEST_TRACE_MAP_8(...) utest_trace_supports_at_most_6_arguments
+
+void z_utest_trace_reset(void);
+void z_utest_trace_dump_failure(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TESTSUITE_INCLUDE_UTEST_TRACE_H_ */
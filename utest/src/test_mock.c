@@ -30,7 +30,7 @@ static struct parameter *alloc_parameter(void)
 
 	param = calloc(1, sizeof(struct parameter));
 	if (!param) {
-		PRINT("Failed to allocate mock parameter\n");
+		z_utest_failure_printf("Failed to allocate mock parameter\n");
 		utest_fail();
 	}
 
@@ -99,7 +99,8 @@ void z_utest_check_expected_value(const char *fn, const char *name,
 
 	param = find_and_delete_value(&parameter_list, fn, name);
 	if (!param) {
-		PRINT("Failed to find parameter %s for %s\n", name, fn);
+		z_utest_failure_printf("Failed to find parameter %s for %s\n",
+				       name, fn);
 		utest_fail();
 	}
 
@@ -110,8 +111,9 @@ void z_utest_check_expected_value(const char *fn, const char *name,
 		/* We need to cast these values since the toolchain doesn't
 		 * provide inttypes.h
 		 */
-		PRINT("%s:%s received wrong value: Got %lu, expected %lu\n", fn,
-		      name, (unsigned long)val, (unsigned long)expected);
+		z_utest_failure_printf("%s:%s received wrong value: Got %lu, expected %lu\n",
+				       fn, name, (unsigned long)val,
+				       (unsigned long)expected);
 		utest_fail();
 	}
 }
@@ -129,7 +131,8 @@ void z_utest_check_expected_data(const char *fn, const char *name, void *data,
 
 	param = find_and_delete_value(&parameter_list, fn, name);
 	if (!param) {
-		PRINT("Failed to find parameter %s for %s\n", name, fn);
+		z_utest_failure_printf("Failed to find parameter %s for %s\n",
+				       name, fn);
 		/* No return from this function but for coverity reasons
 		 * put a return after to avoid the warning of a null
 		 * dereference of param below.
@@ -142,15 +145,16 @@ void z_utest_check_expected_data(const char *fn, const char *name, void *data,
 	free_parameter(param);
 
 	if (expected == NULL && data != NULL) {
-		PRINT("%s:%s received null pointer\n", fn, name);
+		z_utest_failure_printf("%s:%s received null pointer\n", fn, name);
 		utest_fail();
 	} else if (data == NULL && expected != NULL) {
-		PRINT("%s:%s received data while expected null pointer\n", fn,
-		      name);
+		z_utest_failure_printf("%s:%s received data while expected null pointer\n",
+				       fn, name);
 		utest_fail();
 	} else if (data != NULL) {
 		if (memcmp(data, expected, length) != 0) {
-			PRINT("%s:%s data provided don't match\n", fn, name);
+			z_utest_failure_printf("%s:%s data provided don't match\n",
+					       fn, name);
 			utest_fail();
 		}
 	}
@@ -168,14 +172,15 @@ void z_utest_copy_return_data(const char *fn, const char *name, void *data,
 	void *return_data;
 
 	if (data == NULL) {
-		PRINT("%s:%s received null pointer\n", fn, name);
+		z_utest_failure_printf("%s:%s received null pointer\n", fn, name);
 		utest_fail();
 		return;
 	}
 
 	param = find_and_delete_value(&parameter_list, fn, name);
 	if (!param) {
-		PRINT("Failed to find parameter %s for %s\n", name, fn);
+		z_utest_failure_printf("Failed to find parameter %s for %s\n",
+				       name, fn);
 		memset(data, 0, length);
 		utest_fail();
 	} else {
@@ -197,7 +202,8 @@ uintptr_t z_utest_get_return_value(const char *fn)
 		find_and_delete_value(&return_value_list, fn, "");
 
 	if (!param) {
-		PRINT("Failed to find return value for function %s\n", fn);
+		z_utest_failure_printf("Failed to find return value for function %s\n",
+				       fn);
 		utest_fail();
 	}
 
@@ -223,14 +229,14 @@ int z_cleanup_mock(void)
 	int fail = 0;
 
 	if (parameter_list.next) {
-		PRINT("Parameter not used by mock: %s:%s\n",
-		      parameter_list.next->fn,
-		      parameter_list.next->name);
+		z_utest_failure_printf("Parameter not used by mock: %s:%s\n",
+				       parameter_list.next->fn,
+				       parameter_list.next->name);
 		fail = 1;
 	}
 	if (return_value_list.next) {
-		PRINT("Return value no used by mock: %s\n",
-		      return_value_list.next->fn);
+		z_utest_failure_printf("Return value no used by mock: %s\n",
+				       return_value_list.next->fn);
 		fail = 2;
 	}
 
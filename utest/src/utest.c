@@ -9,9 +9,11 @@
 
 enum Test_phase
 {
+	TEST_PHASE_SUITE_SETUP,
 	TEST_PHASE_SETUP,
 	TEST_PHASE_TEST,
 	TEST_PHASE_TEARDOWN,
+	TEST_PHASE_SUITE_TEARDOWN,
 	TEST_PHASE_FRAMEWORK
 };
 
@@ -19,6 +21,9 @@ static enum Test_phase phase = TEST_PHASE_FRAMEWORK;
 
 static int test_status;
 
+/* Suite whose tests are being dispatched */
+static const struct unit_test_suite *running_suite;
+
 static int cleanup_test(struct unit_test *test)
 {
 	int ret = TC_PASS;
@@ -28,14 +33,14 @@ static int cleanup_test(struct unit_test *test)
 
 	if (!ret && mock_status == 1)
 	{
-		PRINT("Test %s failed: Unused mock parameter values\n",
-			  test->name);
+		z_utest_failure_printf("Test %s failed: Unused mock parameter values\n",
+				       test->name);
 		ret = TC_FAIL;
 	}
 	else if (!ret && mock_status == 2)
 	{
-		PRINT("Test %s failed: Unused mock return values\n",
-			  test->name);
+		z_utest_failure_printf("Test %s failed: Unused mock return values\n",
+				       test->name);
 		ret = TC_FAIL;
 	}
 	else
@@ -76,16 +81,19 @@ static jmp_buf test_pass;
 
 void utest_fail(void)
 {
+	z_utest_death_unwind(TC_FAIL);
 	longjmp(test_fail, 1);
 }
 
 void utest_skip(void)
 {
+	z_utest_death_unwind(TC_SKIP);
 	longjmp(test_skip, 1);
 }
 
 void utest_pass(void)
 {
+	z_utest_death_unwind(TC_PASS);
 	longjmp(test_pass, 1);
 }
 
@@ -95,9 +103,12 @@ static int run_test(struct unit_test *test)
 	int skip = 0;
 
 	TC_START(test->name);
+	z_utest_coverage_start();
+	z_utest_crash_arm(true);
 
 	if (setjmp(test_fail))
 	{
+		z_utest_crash_report();
 		ret = TC_FAIL;
 		goto out;
 	}
@@ -117,15 +128,27 @@ static int run_test(struct unit_test *test)
 
 	run_test_functions(test);
 out:
-	phase = TEST_PHASE_TEARDOWN;
-	test->teardown();
+	/* Or a teardown that fails would run again */
+	if (phase != TEST_PHASE_TEARDOWN)
+	{
+		phase = TEST_PHASE_TEARDOWN;
+		test->teardown();
+	}
 	phase = TEST_PHASE_FRAMEWORK;
+	z_utest_crash_arm(false);
 
 	if (cleanup_test(test) != TC_PASS)
 	{
 		ret = TC_FAIL;
 	}
 
+	z_utest_coverage_stop(z_utest_report_current_suite(), test->name);
+
+	if (ret == TC_PASS)
+	{
+		z_utest_result_cache_store(z_utest_report_current_suite(), test->name);
+	}
+
 	if (ret == TC_SKIP)
 	{
 		Z_TC_END_RESULT(TC_SKIP);
@@ -138,27 +161,243 @@ out:
 	return ret;
 }
 
+int z_utest_try(void (*fn)(void))
+{
+	int ret = TC_PASS;
+	jmp_buf saved_fail;
+	jmp_buf saved_skip;
+	jmp_buf saved_pass;
+	bool armed = z_utest_crash_arm(true);
+
+	memcpy(saved_fail, test_fail, sizeof(jmp_buf));
+	memcpy(saved_skip, test_skip, sizeof(jmp_buf));
+	memcpy(saved_pass, test_pass, sizeof(jmp_buf));
+
+	if (setjmp(test_fail))
+	{
+		z_utest_crash_report();
+		ret = TC_FAIL;
+		goto out;
+	}
+
+	if (setjmp(test_skip))
+	{
+		ret = TC_SKIP;
+		goto out;
+	}
+
+	if (setjmp(test_pass))
+	{
+		ret = TC_PASS;
+		goto out;
+	}
+
+	fn();
+out:
+	memcpy(test_fail, saved_fail, sizeof(jmp_buf));
+	memcpy(test_skip, saved_skip, sizeof(jmp_buf));
+	memcpy(test_pass, saved_pass, sizeof(jmp_buf));
+	z_utest_crash_arm(armed);
+
+	return ret;
+}
+
+int z_utest_run_fixture(const char *label, void (*fn)(void))
+{
+	int ret;
+	enum Test_phase saved_phase = phase;
+
+	z_utest_report_fixture_start(label);
+	ret = z_utest_try(fn);
+	phase = saved_phase;
+	z_utest_report_fixture_end(ret);
+
+	return ret;
+}
+
 /* End Porting */
 
-int z_utest_run_test_suite(const char *name, struct unit_test *suite)
+/* Run @a test in process or hand it to the fork mode, count failures */
+static int dispatch_test(struct unit_test *test)
 {
+	int journaled = z_utest_journal_replay(running_suite->name, test->name);
+
+	if (journaled >= 0)
+	{
+		return journaled == TC_FAIL ? 1 : 0;
+	}
+
+	if (z_utest_result_cache_hit(running_suite, test))
+	{
+		TC_START(test->name);
+		Z_TC_END_RESULT(TC_CACHED);
+		return 0;
+	}
+
+	if (utest_fork_enabled())
+	{
+		return z_utest_fork_submit(test, run_test);
+	}
+
+	/* Failures may be retried, see utest_flaky.h */
+	do
+	{
+		z_utest_flaky_expect(running_suite->name, test->name);
+		run_test(test);
+	} while (z_utest_flaky_retry());
+
+	return z_utest_flaky_status() == TC_FAIL ? 1 : 0;
+}
+
+static int skip_test(struct unit_test *test)
+{
+	TC_START(test->name);
+	z_utest_failure_printf("\n    BEFORE_ALL(%s) did not pass\n",
+			       z_utest_report_current_suite());
+	Z_TC_END_RESULT(TC_SKIP);
+
+	return 0;
+}
+
+static int list_test(struct unit_test *test)
+{
+	if (z_utest_priority_listing())
+	{
+		z_utest_priority_list(running_suite, test);
+	}
+	else
+	{
+		z_utest_dist_list(running_suite->name, test->name);
+	}
+
+	return 0;
+}
+
+static bool test_selected(const char *suite, const struct unit_test *test)
+{
+	if (!z_utest_tags_selected(test->tags))
+	{
+		return false;
+	}
+
+	if (test->params)
+	{
+		return z_utest_param_any_selected(suite, test);
+	}
+
+	return z_utest_test_selected(suite, test->name);
+}
+
+int z_utest_run_suite(const struct unit_test_suite *suite)
+{
+	struct unit_test *tests = suite->tests;
 	int fail = 0;
-	unsigned int test_num = 0;
+	int fixture = TC_PASS;
+	unsigned int selected = 0;
+	unsigned int test_num;
+	char label[128];
 
 	if (test_status < 0)
 	{
 		return test_status;
 	}
 
-	TC_SUITE_START(name);
-	while (suite[test_num].test)
+	running_suite = suite;
+
+	/* The server only builds the suite fixtures, to keep them warm */
+	if (z_utest_serve_warming())
 	{
-		if (run_test(&suite[test_num]) == TC_FAIL)
+		if (suite->before_all && !z_utest_serve_warm(suite))
+		{
+			snprintf(label, sizeof(label), "BEFORE_ALL(%s)", suite->name);
+			TC_SUITE_START(suite->name);
+			phase = TEST_PHASE_SUITE_SETUP;
+			fixture = z_utest_run_fixture(label, suite->before_all);
+			phase = TEST_PHASE_FRAMEWORK;
+			TC_SUITE_END(suite->name, fixture);
+			if (fixture == TC_PASS)
+			{
+				z_utest_serve_warmed(suite);
+			}
+		}
+		return 0;
+	}
+
+	for (test_num = 0; tests[test_num].test && !selected; test_num++)
+	{
+		if (test_selected(suite->name, &tests[test_num]))
+		{
+			selected++;
+		}
+	}
+
+	/* Keep the suite fixtures from running for nothing */
+	if (!selected)
+	{
+		return 0;
+	}
+
+	/*
+	 * The coordinator only lists the tests, its workers run them; so does
+	 * a run ordering them before it runs them
+	 */
+	if (z_utest_dist_listing() || z_utest_priority_listing())
+	{
+		for (test_num = 0; tests[test_num].test; test_num++)
+		{
+			if (!z_utest_tags_selected(tests[test_num].tags))
+			{
+				continue;
+			}
+
+			if (tests[test_num].params)
+			{
+				z_utest_param_for_each(suite->name, &tests[test_num], list_test);
+			}
+			else if (z_utest_test_selected(suite->name, tests[test_num].name))
+			{
+				list_test(&tests[test_num]);
+			}
+		}
+		return 0;
+	}
+
+	TC_SUITE_START(suite->name);
+
+	if (suite->before_all && !z_utest_serve_warm(suite))
+	{
+		snprintf(label, sizeof(label), "BEFORE_ALL(%s)", suite->name);
+		phase = TEST_PHASE_SUITE_SETUP;
+		fixture = z_utest_run_fixture(label, suite->before_all);
+		if (fixture == TC_FAIL)
 		{
 			fail++;
 		}
+	}
 
-		test_num++;
+	/* Other orders first, from the state the suite starts in */
+	if (fixture == TC_PASS && z_utest_order_enabled())
+	{
+		fail += z_utest_order_detect(suite, run_test);
+	}
+
+	for (test_num = 0; tests[test_num].test; test_num++)
+	{
+		z_utest_param_fn run = (fixture == TC_PASS) ? dispatch_test : skip_test;
+
+		if (!z_utest_tags_selected(tests[test_num].tags))
+		{
+			continue;
+		}
+
+		if (tests[test_num].params)
+		{
+			fail += z_utest_param_for_each(suite->name, &tests[test_num], run);
+		}
+		else if (z_utest_test_selected(suite->name, tests[test_num].name))
+		{
+			fail += run(&tests[test_num]);
+		}
 
 		if (fail && FAIL_FAST)
 		{
@@ -166,13 +405,36 @@ int z_utest_run_test_suite(const char *name, struct unit_test *suite)
 		}
 	}
 
-	TC_SUITE_END(name, (fail > 0 ? TC_FAIL : TC_PASS));
+	if (utest_fork_enabled())
+	{
+		fail += z_utest_fork_drain();
+	}
+
+	if (suite->after_all && fixture == TC_PASS && !z_utest_serve_warm(suite))
+	{
+		snprintf(label, sizeof(label), "AFTER_ALL(%s)", suite->name);
+		phase = TEST_PHASE_SUITE_TEARDOWN;
+		if (z_utest_run_fixture(label, suite->after_all) == TC_FAIL)
+		{
+			fail++;
+		}
+		phase = TEST_PHASE_FRAMEWORK;
+	}
+
+	TC_SUITE_END(suite->name, (fail > 0 ? TC_FAIL : TC_PASS));
 
 	test_status = (test_status || fail) ? 1 : 0;
 
 	return fail;
 }
 
+int z_utest_run_test_suite(const char *name, struct unit_test *suite)
+{
+	const struct unit_test_suite desc = {name, suite, NULL, NULL};
+
+	return z_utest_run_suite(&desc);
+}
+
 static void end_report(void)
 {
 	if (test_status)
@@ -187,9 +449,87 @@ static void end_report(void)
 
 void utest_main(void)
 {
-	z_init_mock();
+	utest_main_args(0, NULL);
+}
+
+static void run_suites(void)
+{
 	RunAllTest();
+	if (z_utest_modules_run())
+	{
+		test_status = 1;
+	}
+}
+
+/* Initialize what the options control, run the tests, return 1 on failure */
+static int run_all(void)
+{
+	z_utest_fork_init();
+	z_utest_tags_init();
+	z_utest_coverage_init();
+	z_utest_result_cache_init();
+	z_init_mock();
+	z_utest_setup_reporters();
+	z_utest_journal_init();
+	z_utest_flaky_init();
+	z_utest_priority_init();
+	z_utest_capture_init();
+	z_utest_crash_init();
+	z_utest_report_run_start();
+	if (!z_utest_priority_run(run_suites))
+	{
+		run_suites();
+	}
+	if (z_utest_programs_run())
+	{
+		test_status = 1;
+	}
+	if (z_utest_dist_run())
+	{
+		test_status = 1;
+	}
+	if (z_utest_shared_fixtures_teardown())
+	{
+		test_status = 1;
+	}
 	end_report();
 
+	return test_status;
+}
+
+int utest_main_args(int argc, char *argv[])
+{
+	int status = 0;
+
+	utest_options_init(argc, argv);
+
+	if (z_utest_client())
+	{
+		return 0;
+	}
+
+	z_utest_modules_load();
+
+	if (utest_option("serve"))
+	{
+		z_utest_serve(argc, argv, run_all);
+	}
+	else if (utest_option("worker"))
+	{
+		z_utest_dist_work(run_all);
+	}
+	else
+	{
+		status = run_all();
+	}
+
 	DO_END_TEST();
+
+	/* A client without server still exits as one, see utest_serve.h */
+	if (utest_option("client"))
+	{
+		exit(status);
+	}
+
+	return status;
 }
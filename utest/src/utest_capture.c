@@ -0,0 +1,190 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define _GNU_SOURCE
+#include <utest.h>
+#include <utest_capture.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct capture {
+	/* Descriptor being captured, 1 or 2 */
+	int target;
+	/* Where the original descriptor is kept while capturing */
+	int saved;
+	/* In-memory file receiving the output */
+	int mem;
+	const char *map;
+	size_t map_len;
+};
+
+static struct capture captures[2] = {
+	{ .target = STDOUT_FILENO, .saved = -1, .mem = -1 },
+	{ .target = STDERR_FILENO, .saved = -1, .mem = -1 },
+};
+
+static bool enabled;
+static bool active;
+
+static int mem_file(void)
+{
+#ifdef MFD_CLOEXEC
+	return memfd_create("utest-capture", MFD_CLOEXEC);
+#else
+	FILE *tmp = tmpfile();
+
+	return tmp ? fileno(tmp) : -1;
+#endif
+}
+
+static struct capture *get_capture(int fd)
+{
+	return &captures[fd == STDERR_FILENO ? 1 : 0];
+}
+
+static void unmap(struct capture *c)
+{
+	if (c->map) {
+		munmap((void *)c->map, c->map_len);
+	}
+	c->map = NULL;
+	c->map_len = 0;
+}
+
+static void map(struct capture *c)
+{
+	struct stat st;
+	void *addr;
+
+	unmap(c);
+
+	if (fstat(c->mem, &st) || st.st_size == 0) {
+		return;
+	}
+
+	addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, c->mem, 0);
+	if (addr == MAP_FAILED) {
+		return;
+	}
+
+	c->map = addr;
+	c->map_len = (size_t)st.st_size;
+}
+
+void z_utest_capture_init(void)
+{
+	enabled = utest_option_enabled("capture");
+	if (!enabled) {
+		return;
+	}
+
+	captures[0].saved = z_utest_stdout_fd();
+	captures[1].saved = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 3);
+
+	for (int i = 0; i < 2; i++) {
+		captures[i].mem = mem_file();
+		if (captures[i].saved < 0 || captures[i].mem < 0) {
+			fprintf(stderr, "utest: output capture unavailable\n");
+			enabled = false;
+			return;
+		}
+	}
+}
+
+/* Children of the fork mode must not share the in-memory files */
+void z_utest_capture_fork_child(void)
+{
+	if (!enabled) {
+		return;
+	}
+
+	for (int i = 0; i < 2; i++) {
+		close(captures[i].mem);
+		captures[i].mem = mem_file();
+		if (captures[i].mem < 0) {
+			enabled = false;
+		}
+	}
+}
+
+void z_utest_capture_start(void)
+{
+	if (!enabled) {
+		return;
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+
+	for (int i = 0; i < 2; i++) {
+		struct capture *c = &captures[i];
+
+		unmap(c);
+		if (ftruncate(c->mem, 0) == 0) {
+			lseek(c->mem, 0, SEEK_SET);
+		}
+		dup2(c->mem, c->target);
+	}
+
+	active = true;
+}
+
+void z_utest_capture_stop(void)
+{
+	if (!active) {
+		return;
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+
+	for (int i = 0; i < 2; i++) {
+		dup2(captures[i].saved, captures[i].target);
+	}
+
+	active = false;
+}
+
+void z_utest_capture_release(void)
+{
+	for (int i = 0; i < 2; i++) {
+		unmap(&captures[i]);
+	}
+}
+
+const char *utest_captured_output(int fd, size_t *len)
+{
+	struct capture *c = get_capture(fd);
+
+	*len = 0;
+
+	if (!enabled) {
+		return NULL;
+	}
+
+	fflush(fd == STDERR_FILENO ? stderr : stdout);
+	map(c);
+	*len = c->map_len;
+
+	return c->map ? c->map : "";
+}
+
+bool z_utest_captured_contains(int fd, const char *str)
+{
+	const char *data;
+	size_t len;
+
+	data = utest_captured_output(fd, &len);
+	if (!data) {
+		z_utest_failure_printf("\n    output capture is not enabled, "
+				       "run with --capture\n");
+		return false;
+	}
+
+	return memmem(data, len, str, strlen(str)) != NULL;
+}
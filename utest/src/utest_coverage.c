@@ -0,0 +1,474 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define _GNU_SOURCE
+#include <utest.h>
+#include <utest_coverage.h>
+#include <utest_elf.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define COV_MAGIC 0x56435455u /* "UTCV" */
+
+#define NO_INSTRUMENT __attribute__((no_instrument_function))
+
+/* Header of a per-test map, followed by one bit per function */
+struct cov_header {
+	uint32_t magic;
+	uint32_t count;
+	/* Hash of the function table the bits index */
+	uint64_t table;
+};
+
+/* Functions entered by the running test, an open-addressing set */
+static struct {
+	bool active;
+	uintptr_t last;
+	uintptr_t *slots;
+	size_t cap;
+	size_t count;
+} entered;
+
+static bool recording;
+static uint64_t table_hash;
+
+/* Selection state, the bitmap indexes the recorded function table */
+static bool selecting;
+static bool select_all;
+static uint64_t recorded_table;
+static uint32_t recorded_count;
+static uint8_t *changed;
+
+/* ----------------------------- recording --------------------------- */
+
+NO_INSTRUMENT
+static size_t slot_of(uintptr_t addr, size_t cap)
+{
+	return (size_t)((addr >> 4) * 0x9e3779b97f4a7c15u) & (cap - 1);
+}
+
+NO_INSTRUMENT
+static void entered_grow(void)
+{
+	size_t cap = entered.cap ? entered.cap * 2 : 4096;
+	uintptr_t *slots = calloc(cap, sizeof(*slots));
+
+	if (!slots) {
+		entered.active = false;
+		return;
+	}
+
+	for (size_t i = 0; i < entered.cap; i++) {
+		uintptr_t a = entered.slots[i];
+		size_t j;
+
+		if (!a) {
+			continue;
+		}
+		for (j = slot_of(a, cap); slots[j]; j = (j + 1) & (cap - 1)) {
+		}
+		slots[j] = a;
+	}
+
+	free(entered.slots);
+	entered.slots = slots;
+	entered.cap = cap;
+}
+
+NO_INSTRUMENT
+void __cyg_profile_func_enter(void *fn, void *call_site)
+{
+	uintptr_t addr = (uintptr_t)fn;
+	size_t i;
+
+	(void)call_site;
+
+	if (!entered.active || addr == entered.last) {
+		return;
+	}
+	entered.last = addr;
+
+	if (2 * (entered.count + 1) > entered.cap) {
+		entered_grow();
+		if (!entered.active) {
+			return;
+		}
+	}
+
+	for (i = slot_of(addr, entered.cap); entered.slots[i];
+	     i = (i + 1) & (entered.cap - 1)) {
+		if (entered.slots[i] == addr) {
+			return;
+		}
+	}
+	entered.slots[i] = addr;
+	entered.count++;
+}
+
+NO_INSTRUMENT
+void __cyg_profile_func_exit(void *fn, void *call_site)
+{
+	(void)fn;
+	(void)call_site;
+}
+
+/* Save the function table the per-test bitmaps index */
+static void write_table(void)
+{
+	const struct z_utest_elf_func *funcs;
+	char path[Z_UTEST_PATH_MAX];
+	char *buf = NULL;
+	size_t len = 0;
+	size_t count;
+	FILE *f;
+
+	funcs = z_utest_elf_functions(&count);
+	if (!count) {
+		fprintf(stderr, "utest: cannot read the symbol table, "
+				"coverage is not recorded\n");
+		recording = false;
+		return;
+	}
+
+	table_hash = 0;
+	for (size_t i = 0; i < count; i++) {
+		table_hash = utest_hash64(funcs[i].name, strlen(funcs[i].name),
+					  table_hash);
+		table_hash = utest_hash64(funcs[i].file, strlen(funcs[i].file),
+					  table_hash);
+	}
+
+	f = open_memstream(&buf, &len);
+	if (!f) {
+		recording = false;
+		return;
+	}
+	fprintf(f, "utest-functions %016" PRIx64 " %zu\n", table_hash, count);
+	for (size_t i = 0; i < count; i++) {
+		fprintf(f, "%s\t%s\n", funcs[i].name, funcs[i].file);
+	}
+	fclose(f);
+
+	if (z_utest_cache_test_path("coverage", "functions", path,
+				    sizeof(path)) ||
+	    z_utest_write_atomic(path, buf, len)) {
+		fprintf(stderr, "utest: cannot write %s, coverage is not "
+				"recorded\n", path);
+		recording = false;
+	}
+
+	free(buf);
+}
+
+void z_utest_coverage_start(void)
+{
+	if (!recording) {
+		return;
+	}
+
+	if (entered.slots) {
+		memset(entered.slots, 0, entered.cap * sizeof(*entered.slots));
+	}
+	entered.count = 0;
+	entered.last = 0;
+	entered.active = true;
+}
+
+void z_utest_coverage_stop(const char *suite, const char *name)
+{
+	struct cov_header *header;
+	char id[Z_UTEST_TEST_ID_MAX];
+	char path[Z_UTEST_PATH_MAX];
+	size_t count;
+	size_t len;
+
+	if (!entered.active) {
+		return;
+	}
+	entered.active = false;
+
+	z_utest_elf_functions(&count);
+
+	len = sizeof(*header) + (count + 7) / 8;
+	header = calloc(1, len);
+	if (!header) {
+		return;
+	}
+	header->magic = COV_MAGIC;
+	header->count = (uint32_t)count;
+	header->table = table_hash;
+
+	for (size_t i = 0; i < entered.cap; i++) {
+		long idx = entered.slots[i] ?
+				   z_utest_elf_lookup(entered.slots[i]) : -1;
+
+		if (idx >= 0) {
+			((uint8_t *)(header + 1))[idx / 8] |=
+				(uint8_t)(1u << (idx % 8));
+		}
+	}
+
+	utest_test_id(suite, name, id, sizeof(id));
+	strncat(id, ".cov", sizeof(id) - strlen(id) - 1);
+	if (!z_utest_cache_test_path("coverage", id, path, sizeof(path))) {
+		z_utest_write_atomic(path, header, len);
+	}
+
+	free(header);
+}
+
+/* ----------------------------- selection --------------------------- */
+
+/* "a/b/c.c" and "c.c" or "b/c.c" name the same file */
+static bool same_file(const char *a, const char *b)
+{
+	size_t la;
+	size_t lb;
+
+	while (!strncmp(a, "./", 2)) {
+		a += 2;
+	}
+	while (!strncmp(b, "./", 2)) {
+		b += 2;
+	}
+
+	la = strlen(a);
+	lb = strlen(b);
+	if (!la || !lb) {
+		return false;
+	}
+	if (la < lb) {
+		const char *t = a;
+
+		a = b;
+		b = t;
+		la = lb;
+		lb = strlen(b);
+	}
+
+	return !strcmp(a + la - lb, b) && (la == lb || a[la - lb - 1] == '/');
+}
+
+static bool defines_data(const char *file)
+{
+	const char *const *data_files;
+	size_t count;
+
+	data_files = z_utest_elf_data_files(&count);
+	for (size_t i = 0; i < count; i++) {
+		if (same_file(data_files[i], file)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* Split a comma-separated option into a NULL-terminated list */
+static char **split(const char *value)
+{
+	char *copy;
+	char **list;
+	size_t n = 2;
+	size_t i = 0;
+
+	if (!value || !*value) {
+		return NULL;
+	}
+
+	for (const char *p = value; *p; p++) {
+		n += (*p == ',');
+	}
+
+	copy = strdup(value);
+	list = calloc(n, sizeof(*list));
+	if (!copy || !list) {
+		free(copy);
+		free(list);
+		return NULL;
+	}
+
+	for (char *tok = strtok(copy, ","); tok; tok = strtok(NULL, ",")) {
+		list[i++] = tok;
+	}
+
+	if (!i) {
+		free(copy);
+		free(list);
+		return NULL;
+	}
+
+	return list;
+}
+
+static void free_list(char **list)
+{
+	if (list) {
+		free(list[0]);
+		free(list);
+	}
+}
+
+/* Mark the recorded functions touched by the change */
+static void load_changes(char **functions, char **files)
+{
+	char path[Z_UTEST_PATH_MAX];
+	char line[Z_UTEST_LINE_MAX];
+	bool *func_known = NULL;
+	bool *file_known = NULL;
+	size_t nfuncs = 0;
+	size_t nfiles = 0;
+	uint32_t idx = 0;
+	FILE *f;
+
+	while (functions && functions[nfuncs]) {
+		nfuncs++;
+	}
+	while (files && files[nfiles]) {
+		nfiles++;
+	}
+
+	if (z_utest_cache_test_path("coverage", "functions", path,
+				    sizeof(path)) ||
+	    !(f = fopen(path, "r"))) {
+		fprintf(stderr, "utest: no coverage map, record one with "
+				"--record-coverage, running all tests\n");
+		select_all = true;
+		return;
+	}
+
+	if (!fgets(line, sizeof(line), f) ||
+	    sscanf(line, "utest-functions %" SCNx64 " %" SCNu32,
+		   &recorded_table, &recorded_count) != 2 ||
+	    !(changed = calloc(1, (recorded_count + 7) / 8 + 1)) ||
+	    !(func_known = calloc(nfuncs + 1, sizeof(*func_known))) ||
+	    !(file_known = calloc(nfiles + 1, sizeof(*file_known)))) {
+		select_all = true;
+		free(func_known);
+		fclose(f);
+		return;
+	}
+
+	while (idx < recorded_count && fgets(line, sizeof(line), f)) {
+		char *tab = strchr(line, '\t');
+		bool hit;
+
+		line[strcspn(line, "\n")] = '\0';
+		if (tab) {
+			*tab++ = '\0';
+		}
+
+		hit = false;
+		for (size_t i = 0; i < nfuncs; i++) {
+			if (!strcmp(functions[i], line)) {
+				func_known[i] = true;
+				hit = true;
+			}
+		}
+		for (size_t i = 0; tab && i < nfiles; i++) {
+			if (same_file(tab, files[i])) {
+				file_known[i] = true;
+				hit = true;
+			}
+		}
+
+		if (hit) {
+			changed[idx / 8] |= (uint8_t)(1u << (idx % 8));
+		}
+		idx++;
+	}
+	fclose(f);
+
+	/* A change we cannot place, a new function say, may affect any test */
+	for (size_t i = 0; i < nfuncs && !select_all; i++) {
+		if (!func_known[i]) {
+			fprintf(stderr, "utest: %s is not in the coverage map, "
+					"running all tests\n", functions[i]);
+			select_all = true;
+		}
+	}
+	for (size_t i = 0; i < nfiles && !select_all; i++) {
+		if (!file_known[i]) {
+			fprintf(stderr, "utest: %s is not in the coverage map, "
+					"running all tests\n", files[i]);
+			select_all = true;
+		}
+	}
+
+	/* Tests reading the data of a file do not call into it */
+	for (size_t i = 0; i < nfiles && !select_all; i++) {
+		if (defines_data(files[i])) {
+			fprintf(stderr, "utest: %s defines data, running all "
+					"tests\n", files[i]);
+			select_all = true;
+		}
+	}
+
+	free(func_known);
+	free(file_known);
+}
+
+void z_utest_coverage_init(void)
+{
+	char **functions = split(utest_option("changed-functions"));
+	char **files = split(utest_option("changed-files"));
+
+	recording = utest_option_enabled("record-coverage");
+	if (recording) {
+		write_table();
+	}
+
+	selecting = functions || files;
+	if (selecting) {
+		load_changes(functions, files);
+	}
+
+	free_list(functions);
+	free_list(files);
+}
+
+bool z_utest_coverage_selected(const char *suite, const char *name)
+{
+	struct cov_header header;
+	char id[Z_UTEST_TEST_ID_MAX];
+	char path[Z_UTEST_PATH_MAX];
+	bool hit = false;
+	FILE *f;
+
+	if (!selecting || select_all) {
+		return true;
+	}
+
+	utest_test_id(suite, name, id, sizeof(id));
+	strncat(id, ".cov", sizeof(id) - strlen(id) - 1);
+	if (z_utest_cache_test_path("coverage", id, path, sizeof(path)) ||
+	    !(f = fopen(path, "rb"))) {
+		/* Never recorded, may be a new test */
+		return true;
+	}
+
+	if (fread(&header, sizeof(header), 1, f) != 1 ||
+	    header.magic != COV_MAGIC || header.table != recorded_table ||
+	    header.count != recorded_count) {
+		fclose(f);
+		return true;
+	}
+
+	for (uint32_t i = 0; i < (recorded_count + 7) / 8 && !hit; i++) {
+		int c = fgetc(f);
+
+		if (c == EOF) {
+			hit = true;
+			break;
+		}
+		hit = (c & changed[i]) != 0;
+	}
+	fclose(f);
+
+	return hit;
+}
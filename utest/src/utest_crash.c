@@ -0,0 +1,306 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define _GNU_SOURCE
+#include <utest.h>
+#include <utest_crash.h>
+#include <utest_elf.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+/* Room for the handler, and for backtrace() and the jump out of it */
+#define ALT_STACK_SIZE (64 * 1024)
+
+#define MAX_FRAMES 32
+
+static const int crash_signals[] = {
+	SIGABRT, SIGBUS, SIGFPE, SIGILL, SIGSEGV,
+};
+
+static bool installed;
+static volatile sig_atomic_t armed;
+static volatile sig_atomic_t in_handler;
+
+/* The last crash, recorded by the handler and reported after the jump */
+static struct {
+	volatile sig_atomic_t pending;
+	int signo;
+	int code;
+	void *addr;
+	void *frames[MAX_FRAMES];
+	int count;
+} crash;
+
+/* Text of a crash the process dies of, formatted in the handler */
+static char death_note[2048];
+
+bool z_utest_crash_arm(bool on)
+{
+	bool was = armed;
+
+	armed = on;
+
+	return was;
+}
+
+static bool has_fault_address(int signo)
+{
+	return signo == SIGSEGV || signo == SIGBUS || signo == SIGFPE ||
+	       signo == SIGILL;
+}
+
+/* Program counter of the faulting instruction, 0 if unknown */
+static uintptr_t fault_pc(const void *uctx)
+{
+	const ucontext_t *uc = uctx;
+
+	if (!uc) {
+		return 0;
+	}
+#if defined(__x86_64__)
+	return (uintptr_t)uc->uc_mcontext.gregs[REG_RIP];
+#elif defined(__i386__)
+	return (uintptr_t)uc->uc_mcontext.gregs[REG_EIP];
+#elif defined(__aarch64__)
+	return (uintptr_t)uc->uc_mcontext.pc;
+#else
+	return 0;
+#endif
+}
+
+/*
+ * Frames of the handler and of the kernel trampoline come first: start at
+ * the faulting instruction when it is found, after the handler otherwise.
+ */
+static void record(int signo, const siginfo_t *info, const void *uctx)
+{
+	void *frames[MAX_FRAMES + 4];
+	uintptr_t pc = fault_pc(uctx);
+	int count = backtrace(frames, MAX_FRAMES + 4);
+	int first = count > 1 ? 1 : 0;
+
+	for (int i = 0; i < count; i++) {
+		if ((uintptr_t)frames[i] == pc) {
+			first = i;
+			break;
+		}
+	}
+
+	crash.signo = signo;
+	crash.code = info ? info->si_code : 0;
+	crash.addr = info ? info->si_addr : NULL;
+	crash.count = 0;
+	if (pc && (first >= count || (uintptr_t)frames[first] != pc)) {
+		crash.frames[crash.count++] = (void *)pc;
+		first = count;
+	}
+	for (int i = first; i < count && crash.count < MAX_FRAMES; i++) {
+		crash.frames[crash.count++] = frames[i];
+	}
+}
+
+static size_t append(char *buf, size_t size, size_t len, const char *fmt, ...)
+	__attribute__((format(printf, 4, 5)));
+
+static size_t append(char *buf, size_t size, size_t len, const char *fmt, ...)
+{
+	va_list vargs;
+	int n;
+
+	if (len >= size) {
+		return len;
+	}
+	va_start(vargs, fmt);
+	n = vsnprintf(buf + len, size - len, fmt, vargs);
+	va_end(vargs);
+
+	return n < 0 ? len : len + (size_t)n;
+}
+
+static size_t describe(char *buf, size_t size)
+{
+	size_t len = append(buf, size, 0, "\n    crashed with signal %d (%s)",
+			    crash.signo, strsignal(crash.signo));
+
+	if (has_fault_address(crash.signo) && crash.code > 0) {
+		len = append(buf, size, len, " at address %p", crash.addr);
+	}
+
+	return append(buf, size, len, "\n");
+}
+
+/*
+ * Raw frames, for a process about to die: symbol names would mean loading
+ * the symbol table, which takes locks the crashed code may hold.
+ */
+static void die(int signo)
+{
+	size_t len = describe(death_note, sizeof(death_note));
+
+	for (int i = 0; i < crash.count; i++) {
+		Dl_info dl;
+
+		if (dladdr(crash.frames[i], &dl) && dl.dli_fname) {
+			len = append(death_note, sizeof(death_note), len,
+				     "    #%d %p (%s+0x%lx)\n", i,
+				     crash.frames[i], dl.dli_fname,
+				     (unsigned long)((uintptr_t)crash.frames[i] -
+						     (uintptr_t)dl.dli_fbase));
+		} else {
+			len = append(death_note, sizeof(death_note), len,
+				     "    #%d %p\n", i, crash.frames[i]);
+		}
+	}
+	if (len >= sizeof(death_note)) {
+		len = sizeof(death_note) - 1;
+	}
+
+	if (!z_utest_fork_report_death(death_note, len)) {
+		z_utest_write_all(STDERR_FILENO, death_note, len);
+	}
+
+	/* Blocked until the handler returns, then fatal */
+	signal(signo, SIG_DFL);
+	raise(signo);
+}
+
+static void handler(int signo, siginfo_t *info, void *uctx)
+{
+	sigset_t self;
+
+	/* Crashed while handling a crash, of another signal */
+	if (in_handler) {
+		signal(signo, SIG_DFL);
+		raise(signo);
+		return;
+	}
+	in_handler = 1;
+
+	record(signo, info, uctx);
+
+	/* Other threads have no runner to jump back to */
+	if (!armed || syscall(SYS_gettid) != getpid()) {
+		die(signo);
+		return;
+	}
+
+	crash.pending = 1;
+	in_handler = 0;
+
+	/* The jump does not go through the kernel, which would unblock it */
+	sigemptyset(&self);
+	sigaddset(&self, signo);
+	sigprocmask(SIG_UNBLOCK, &self, NULL);
+
+	utest_fail();
+}
+
+void z_utest_crash_init(void)
+{
+	const char *opt = utest_option("crash-handler");
+	struct sigaction sa;
+	stack_t ss;
+	void *warm[1];
+
+	if (installed || (opt && !strcmp(opt, "0"))) {
+		return;
+	}
+
+	ss.ss_sp = malloc(ALT_STACK_SIZE);
+	ss.ss_size = ALT_STACK_SIZE;
+	ss.ss_flags = 0;
+	if (!ss.ss_sp || sigaltstack(&ss, NULL)) {
+		free(ss.ss_sp);
+		return;
+	}
+
+	/* The first backtrace() loads libgcc, not something to do in a handler */
+	backtrace(warm, 1);
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_sigaction = handler;
+	sa.sa_flags = SA_SIGINFO | SA_ONSTACK;
+	sigemptyset(&sa.sa_mask);
+	for (size_t i = 0; i < sizeof(crash_signals) / sizeof(crash_signals[0]);
+	     i++) {
+		sigaction(crash_signals[i], &sa, NULL);
+	}
+
+	installed = true;
+}
+
+void z_utest_crash_report(void)
+{
+	char buf[512];
+
+	if (!crash.pending) {
+		return;
+	}
+	crash.pending = 0;
+
+	describe(buf, sizeof(buf));
+	z_utest_failure_printf("%s", buf);
+
+	for (int i = 0; i < crash.count; i++) {
+		uintptr_t pc = (uintptr_t)crash.frames[i];
+		/* Return addresses point after the call */
+		uintptr_t at = i > 0 ? pc - 1 : pc;
+		size_t count;
+		const struct z_utest_elf_func *funcs =
+			z_utest_elf_functions(&count);
+		long idx = z_utest_elf_lookup(at);
+		int same = 0;
+		Dl_info dl;
+
+		/* A stack overflow is mostly the same frame over and over */
+		while (i + same + 1 < crash.count &&
+		       crash.frames[i + same + 1] == crash.frames[i]) {
+			same++;
+		}
+
+		if (idx >= 0) {
+			const struct z_utest_elf_func *f = &funcs[idx];
+
+			z_utest_failure_printf(
+				"    #%d %p %s+0x%lx%s%s%s\n", i, crash.frames[i],
+				f->name,
+				(unsigned long)(pc - z_utest_elf_bias() - f->addr),
+				*f->file ? " (" : "", f->file,
+				*f->file ? ")" : "");
+		} else if (dladdr((void *)at, &dl) && dl.dli_sname) {
+			z_utest_failure_printf(
+				"    #%d %p %s+0x%lx (%s)\n", i, crash.frames[i],
+				dl.dli_sname,
+				(unsigned long)(pc - (uintptr_t)dl.dli_saddr),
+				dl.dli_fname);
+		} else if (dladdr((void *)at, &dl) && dl.dli_fname) {
+			z_utest_failure_printf(
+				"    #%d %p (%s+0x%lx)\n", i, crash.frames[i],
+				dl.dli_fname,
+				(unsigned long)(pc - (uintptr_t)dl.dli_fbase));
+		} else {
+			z_utest_failure_printf("    #%d %p\n", i,
+					       crash.frames[i]);
+		}
+		if (same) {
+			z_utest_failure_printf("    ... %d more\n", same);
+			i += same;
+		}
+
+		/* Nothing of interest below the runner */
+		if (idx >= 0 && (!strcmp(funcs[idx].name, "run_test_functions") ||
+				 !strcmp(funcs[idx].name, "run_test") ||
+				 !strcmp(funcs[idx].name, "z_utest_try"))) {
+			break;
+		}
+	}
+}
@@ -0,0 +1,327 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define _GNU_SOURCE
+#include <utest.h>
+#include <utest_death.h>
+#include <errno.h>
+#include <regex.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* Standard error shown in a failure message, the regex sees all of it */
+#define STDERR_SHOWN 1024
+
+/* Exit status of a child whose statement failed an assertion */
+#define ASSERT_FAILED_STATUS 1
+
+/* Whether this process is the child of a death test */
+static bool in_child;
+
+/* Failure messages past this mark are the child's */
+static size_t child_failure_mark;
+
+/*
+ * Set by a child whose statement returned, read by the test once it is
+ * gone. Shared memory, as a forked child has its own copy of everything
+ * else, mapped for each death test: test processes forked from the same
+ * runner must not share it.
+ */
+static int *returned;
+
+/* Signals a crash handler of the test may catch */
+static const int crash_signals[] = {
+	SIGABRT, SIGBUS, SIGFPE, SIGILL, SIGSEGV, SIGSYS, SIGTRAP,
+};
+
+bool z_utest_died(int status, int arg)
+{
+	(void)arg;
+
+	return WIFSIGNALED(status) ||
+	       (WIFEXITED(status) && WEXITSTATUS(status) != 0);
+}
+
+bool z_utest_exited_with(int status, int code)
+{
+	return WIFEXITED(status) && WEXITSTATUS(status) == code;
+}
+
+bool z_utest_killed_by(int status, int signum)
+{
+	return WIFSIGNALED(status) && WTERMSIG(status) == signum;
+}
+
+/* vfork() shares the memory of every thread, not only the caller's */
+static bool single_threaded(void)
+{
+	char buf[512];
+	const char *p;
+	long threads = 0;
+	FILE *f = fopen("/proc/self/stat", "r");
+
+	if (!f) {
+		return false;
+	}
+	p = fgets(buf, sizeof(buf), f);
+	fclose(f);
+
+	/* num_threads is the 18th field after the command name */
+	p = p ? strrchr(buf, ')') : NULL;
+	if (!p || sscanf(p + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u "
+			 "%*u %*u %*u %*d %*d %*d %*d %ld", &threads) != 1) {
+		return false;
+	}
+
+	return threads == 1;
+}
+
+bool z_utest_death_prepare(struct z_utest_death *death)
+{
+	const char *style = utest_option("death-test-style");
+
+	death->pid = -1;
+	death->err_fd = -1;
+	death->fast = style && !strcmp(style, "vfork") && single_threaded();
+	z_utest_failure_message(&death->failure_mark);
+
+	in_child = false;
+	child_failure_mark = death->failure_mark;
+	returned = mmap(NULL, sizeof(*returned), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (returned == MAP_FAILED) {
+		returned = NULL;
+		return false;
+	}
+	*returned = 0;
+
+	/* A file rather than a pipe: a vfork() parent cannot drain a pipe */
+	death->err_fd = memfd_create("utest-death", MFD_CLOEXEC);
+	if (death->err_fd < 0) {
+		return false;
+	}
+
+	/* Or a forked child would print what is buffered a second time */
+	if (!death->fast) {
+		fflush(stdout);
+		fflush(stderr);
+	}
+
+	return true;
+}
+
+void z_utest_death_child(const struct z_utest_death *death)
+{
+	struct sigaction sa = { .sa_handler = SIG_DFL };
+	struct rlimit no_core = { 0, 0 };
+	sigset_t all;
+
+	in_child = true;
+
+	dup2(death->err_fd, STDERR_FILENO);
+
+	/* Die the default way, and quickly */
+	for (size_t i = 0; i < sizeof(crash_signals) / sizeof(crash_signals[0]);
+	     i++) {
+		sigaction(crash_signals[i], &sa, NULL);
+	}
+	sigfillset(&all);
+	sigprocmask(SIG_UNBLOCK, &all, NULL);
+	setrlimit(RLIMIT_CORE, &no_core);
+}
+
+void z_utest_death_returned(void)
+{
+	*returned = 1;
+	_exit(0);
+}
+
+void z_utest_death_unwind(int result)
+{
+	const char *msg;
+	size_t len;
+
+	if (!in_child) {
+		return;
+	}
+
+	if (result != TC_FAIL) {
+		/* Passing or skipping ends the statement like returning */
+		z_utest_death_returned();
+	}
+
+	/* The assertion message becomes part of what the statement printed */
+	msg = z_utest_failure_message(&len);
+	if (len > child_failure_mark) {
+		ssize_t n = write(STDERR_FILENO, msg + child_failure_mark,
+				  len - child_failure_mark);
+		(void)n;
+	}
+
+	_exit(ASSERT_FAILED_STATUS);
+}
+
+static void describe(int status, char *buf, size_t size)
+{
+	if (WIFEXITED(status)) {
+		snprintf(buf, size, "exited with code %d", WEXITSTATUS(status));
+	} else if (WIFSIGNALED(status)) {
+		snprintf(buf, size, "was killed by signal %d (%s)",
+			 WTERMSIG(status), strsignal(WTERMSIG(status)));
+	} else {
+		snprintf(buf, size, "ended with status 0x%x", status);
+	}
+}
+
+/* Everything the child wrote to its standard error */
+static char *read_stderr(int fd)
+{
+	char *buf = NULL;
+	size_t len = 0;
+	size_t size = 0;
+
+	if (lseek(fd, 0, SEEK_SET) < 0) {
+		return NULL;
+	}
+
+	for (;;) {
+		ssize_t n;
+
+		if (size - len < 4096) {
+			char *grown = realloc(buf, size ? size * 2 : 8192);
+
+			if (!grown) {
+				break;
+			}
+			buf = grown;
+			size = size ? size * 2 : 8192;
+		}
+
+		n = read(fd, buf + len, size - len - 1);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			break;
+		}
+		len += (size_t)n;
+	}
+
+	if (buf) {
+		buf[len] = '\0';
+	}
+
+	return buf;
+}
+
+/* NULL if @a text matches @a regex, why it does not otherwise */
+static const char *match(const char *regex, const char *text, char *why,
+			 size_t size)
+{
+	regex_t re;
+	int ret;
+
+	if (!regex || !*regex) {
+		return NULL;
+	}
+
+	ret = regcomp(&re, regex, REG_EXTENDED | REG_NOSUB);
+	if (ret) {
+		char err[128];
+
+		regerror(ret, &re, err, sizeof(err));
+		snprintf(why, size, "invalid regex \"%s\": %s", regex, err);
+		return why;
+	}
+
+	ret = regexec(&re, text ? text : "", 0, NULL, 0);
+	regfree(&re);
+	if (ret) {
+		snprintf(why, size, "standard error does not match \"%s\"",
+			 regex);
+		return why;
+	}
+
+	return NULL;
+}
+
+void z_utest_death_check(struct z_utest_death *death,
+			 struct utest_exit_pred pred, const char *regex,
+			 const char *stmt, const char *file, int line,
+			 const char *func, const char *msg, ...)
+{
+	char why[256];
+	char how[128];
+	const char *fail = NULL;
+	char *err = NULL;
+	bool child_returned = false;
+	int status = 0;
+	va_list vargs;
+
+	if (death->pid > 0) {
+		while (waitpid(death->pid, &status, 0) < 0 && errno == EINTR) {
+		}
+		err = read_stderr(death->err_fd);
+	}
+
+	/* A vfork() child set it in our memory */
+	in_child = false;
+	if (returned) {
+		child_returned = *returned;
+		munmap(returned, sizeof(*returned));
+		returned = NULL;
+	}
+	if (death->err_fd >= 0) {
+		close(death->err_fd);
+	}
+
+	/* Messages of a vfork() child landed in our buffer */
+	z_utest_failure_truncate(death->failure_mark);
+
+	describe(status, how, sizeof(how));
+
+	if (death->pid <= 0) {
+		snprintf(why, sizeof(why), "cannot start a child: %s",
+			 strerror(errno));
+		fail = why;
+	} else if (child_returned) {
+		snprintf(why, sizeof(why), "should %s, but returned", pred.desc);
+		fail = why;
+	} else if (!pred.match(status, pred.arg)) {
+		snprintf(why, sizeof(why), "should %s, but %s", pred.desc, how);
+		fail = why;
+	} else {
+		fail = match(regex, err, why, sizeof(why));
+	}
+
+	if (!fail) {
+		free(err);
+		return;
+	}
+
+	z_utest_failure_printf("\n    %s:%d: %s: (%s %s)\n", file, line, func,
+			       stmt, fail);
+	if (err && *err) {
+		size_t len = strlen(err);
+
+		z_utest_failure_printf("    standard error:\n%.*s%s\n",
+				       (int)(len < STDERR_SHOWN ? len
+								: STDERR_SHOWN),
+				       err, len > STDERR_SHOWN ? "..." : "");
+	}
+	va_start(vargs, msg);
+	z_utest_failure_vprintf(msg, vargs);
+	va_end(vargs);
+	z_utest_failure_printf("\n");
+	free(err);
+
+	utest_fail();
+}
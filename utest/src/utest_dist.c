@@ -0,0 +1,1357 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define _GNU_SOURCE
+#include <utest.h>
+#include <utest_dist.h>
+#include <utest_programs.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/* How long a worker keeps trying to reach its coordinator */
+#define CONNECT_TIMEOUT_MS 10000
+
+/* Messages of the coordinator to its workers */
+enum {
+	ORDER_BATCH,
+	ORDER_STOP,
+};
+
+struct msg {
+	uint32_t type;
+	/* Bytes of payload after the message: "suite\0name\0" per test */
+	uint32_t len;
+};
+
+struct test {
+	char *suite;
+	char *name;
+	int group;
+	uint64_t estimate_ns;
+	bool estimated;
+	int attempts;
+	/* Worker running it, -1 otherwise */
+	int worker;
+	/* Its Z_UTEST_EVENT_TEST_END event, NULL until it ended */
+	char *result;
+};
+
+/* Tests of a suite, reported together */
+struct group {
+	const char *suite;
+	int first;
+	int count;
+	/* Tests that did not end yet, batches holding some of them */
+	int left;
+	int running;
+	/* Results of its fixtures, which are not listed tests */
+	char *extra;
+	size_t extra_len;
+	bool reported;
+};
+
+struct worker {
+	int fd;
+	/* Events received and not handled yet */
+	char *buf;
+	size_t len;
+	size_t size;
+	int *batch;
+	int batch_len;
+	/* Groups of the batch */
+	int *groups;
+	int ngroups;
+	/* Test of the batch started last, -1 if none */
+	int started;
+};
+
+static struct {
+	struct test *tests;
+	int count;
+	struct group *groups;
+	int ngroups;
+	/* Tests by hash of suite and name, open addressing, -1 is free */
+	uint64_t *keys;
+	int *slots;
+	size_t nslots;
+	/* Tests by decreasing estimate, and the next one to hand out */
+	int *order;
+	int next;
+	/* Tests given back by workers, handed out first */
+	int *requeued;
+	int nrequeued;
+	/* Estimated duration of the tests waiting to be handed out */
+	uint64_t queued_ns;
+	int left;
+	int unreported;
+	struct worker *workers;
+	int nworkers;
+	/* Workers started on this machine, and how many still run */
+	pid_t *pids;
+	int npids;
+	int local;
+	int fail;
+	/* Lines of the durations file for tests not listed */
+	char **history;
+	int nhistory;
+} co;
+
+/* Tests of the batch a worker process runs, sorted hashes */
+static struct {
+	bool active;
+	uint64_t *keys;
+	size_t count;
+} batch;
+
+static uint64_t test_key(const char *suite, const char *name)
+{
+	return utest_hash64(name, strlen(name),
+			    utest_hash64(suite, strlen(suite), 0));
+}
+
+static uint64_t since_ms(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t)(now.tv_sec - start->tv_sec) * 1000u +
+	       (uint64_t)(now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+/* Split @a spec, `[HOST:]PORT` or empty, into @a host and @a port */
+static void split_address(const char *spec, char *host, size_t host_size,
+			  char *port, size_t port_size)
+{
+	const char *colon = strrchr(spec, ':');
+
+	snprintf(host, host_size, "127.0.0.1");
+	snprintf(port, port_size, "0");
+
+	if (colon) {
+		if (colon > spec) {
+			snprintf(host, host_size, "%.*s", (int)(colon - spec),
+				 spec);
+		}
+		spec = colon + 1;
+	}
+	if (*spec) {
+		snprintf(port, port_size, "%s", spec);
+	}
+}
+
+static void tune(int fd)
+{
+	int on = 1;
+
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	/* A machine that vanishes is a lost worker after a while */
+	setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+}
+
+static int read_all(int fd, void *buf, size_t len)
+{
+	char *data = buf;
+
+	while (len) {
+		ssize_t n = read(fd, data, len);
+
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return -1;
+		}
+		data += n;
+		len -= (size_t)n;
+	}
+
+	return 0;
+}
+
+/* Copy of an event, with the given strings */
+static char *event_dup(const struct z_utest_event *ev,
+		       const char *const str[Z_UTEST_EVENT_STRINGS],
+		       size_t *size)
+{
+	struct z_utest_event copy = *ev;
+	char *data;
+	char *at;
+
+	*size = sizeof(copy);
+	for (int i = 0; i < Z_UTEST_EVENT_STRINGS; i++) {
+		copy.len[i] = str[i] ? (uint32_t)strlen(str[i]) : 0;
+		*size += copy.len[i] + 1;
+	}
+
+	data = malloc(*size);
+	if (!data) {
+		return NULL;
+	}
+
+	memcpy(data, &copy, sizeof(copy));
+	at = data + sizeof(copy);
+	for (int i = 0; i < Z_UTEST_EVENT_STRINGS; i++) {
+		memcpy(at, str[i] ? str[i] : "", copy.len[i] + 1);
+		at += copy.len[i] + 1;
+	}
+
+	return data;
+}
+
+/* ------------------------------ worker ----------------------------- */
+
+static int compare_keys(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+bool z_utest_dist_selected(const char *suite, const char *name)
+{
+	uint64_t key;
+
+	if (!batch.active) {
+		return true;
+	}
+
+	key = test_key(suite, name);
+
+	return bsearch(&key, batch.keys, batch.count, sizeof(key),
+		       compare_keys) != NULL;
+}
+
+static bool select_batch(const char *data, size_t len)
+{
+	const char *end = data + len;
+	size_t count = 0;
+
+	for (const char *at = data; at < end; at += strlen(at) + 1) {
+		count++;
+	}
+
+	batch.keys = calloc(count / 2 + 1, sizeof(*batch.keys));
+	if (!batch.keys) {
+		return false;
+	}
+
+	for (const char *at = data; at < end && batch.count < count / 2;) {
+		const char *name = at + strlen(at) + 1;
+
+		batch.keys[batch.count++] = test_key(at, name);
+		at = name + strlen(name) + 1;
+	}
+	qsort(batch.keys, batch.count, sizeof(*batch.keys), compare_keys);
+	batch.active = true;
+
+	return true;
+}
+
+/* Tell the coordinator how the batch process ended, if it could not */
+static void batch_died(int sock, int status, const char *suite,
+		       const char *name)
+{
+	char out_buf[4096];
+	struct utest_outbuf out;
+	char msg[160];
+	struct z_utest_event ev = {
+		.type = Z_UTEST_EVENT_TEST_END,
+		.status = TC_FAIL,
+	};
+	const char *str[Z_UTEST_EVENT_STRINGS] = { suite, name, msg };
+	size_t len[Z_UTEST_EVENT_STRINGS] = { strlen(suite), strlen(name) };
+
+	if (WIFSIGNALED(status)) {
+		snprintf(msg, sizeof(msg),
+			 "\n    test process killed by signal %d (%s)\n",
+			 WTERMSIG(status), strsignal(WTERMSIG(status)));
+	} else {
+		snprintf(msg, sizeof(msg),
+			 "\n    test process exited with status %d\n",
+			 WEXITSTATUS(status));
+	}
+	len[Z_UTEST_EVENT_MESSAGE] = strlen(msg);
+
+	utest_outbuf_init(&out, sock, out_buf, sizeof(out_buf));
+	if (*name) {
+		z_utest_event_write(&out, &ev, str, len);
+	}
+
+	ev = (struct z_utest_event){
+		.type = Z_UTEST_EVENT_RUN_END,
+		.status = TC_FAIL,
+	};
+	str[0] = str[1] = str[2] = NULL;
+	z_utest_event_write(&out, &ev, str, len);
+	utest_outbuf_flush(&out);
+}
+
+/* Run a batch in a process of its own, relaying its results */
+static int run_batch(int sock, const char *data, size_t len,
+		     int (*run)(void))
+{
+	char suite[256] = "";
+	char name[256] = "";
+	char *buf = NULL;
+	size_t buf_len = 0;
+	size_t buf_size = 0;
+	bool ended = false;
+	int status = 0;
+	int fds[2];
+	pid_t pid;
+	int ret = 0;
+
+	if (pipe2(fds, O_CLOEXEC)) {
+		return -1;
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+
+	pid = fork();
+	if (pid < 0) {
+		close(fds[0]);
+		close(fds[1]);
+		return -1;
+	}
+
+	if (pid == 0) {
+		char value[16];
+
+		close(fds[0]);
+		close(sock);
+		if (!select_batch(data, len)) {
+			_exit(1);
+		}
+		snprintf(value, sizeof(value), "%d", fds[1]);
+		setenv("UTEST_RESULT_FD", value, 1);
+		_exit(run());
+	}
+
+	close(fds[1]);
+
+	for (;;) {
+		size_t at = 0;
+		size_t size;
+		ssize_t n;
+
+		if (buf_size - buf_len < 4096) {
+			size_t grown_size = buf_size ? 2 * buf_size : 65536;
+			char *grown = realloc(buf, grown_size);
+
+			if (!grown) {
+				ret = -1;
+				break;
+			}
+			buf = grown;
+			buf_size = grown_size;
+		}
+
+		n = read(fds[0], buf + buf_len, buf_size - buf_len);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			break;
+		}
+		buf_len += (size_t)n;
+
+		/* Keep track of the running test, in case the process dies */
+		while ((size = z_utest_event_size(buf + at, buf_len - at))) {
+			const char *str[Z_UTEST_EVENT_STRINGS];
+			struct z_utest_event ev;
+
+			z_utest_event_read(buf + at, &ev, str);
+			if (ev.type == Z_UTEST_EVENT_TEST_START) {
+				snprintf(suite, sizeof(suite), "%s",
+					 str[Z_UTEST_EVENT_SUITE]);
+				snprintf(name, sizeof(name), "%s",
+					 str[Z_UTEST_EVENT_NAME]);
+			} else if (ev.type == Z_UTEST_EVENT_TEST_END &&
+				   !strcmp(name, str[Z_UTEST_EVENT_NAME])) {
+				name[0] = '\0';
+			} else if (ev.type == Z_UTEST_EVENT_RUN_END) {
+				ended = true;
+			}
+			at += size;
+		}
+
+		if (at && z_utest_write_all(sock, buf, at)) {
+			ret = -1;
+			break;
+		}
+		memmove(buf, buf + at, buf_len - at);
+		buf_len -= at;
+	}
+
+	close(fds[0]);
+	while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+	}
+	free(buf);
+
+	if (!ended && !ret) {
+		batch_died(sock, status, suite, name);
+	}
+
+	return ret;
+}
+
+static int connect_to(const char *spec)
+{
+	struct addrinfo hints = {
+		.ai_family = AF_UNSPEC,
+		.ai_socktype = SOCK_STREAM,
+	};
+	struct addrinfo *addrs;
+	struct timespec start;
+	char host[256];
+	char port[32];
+	int err;
+
+	split_address(spec, host, sizeof(host), port, sizeof(port));
+	err = getaddrinfo(host, port, &hints, &addrs);
+	if (err) {
+		fprintf(stderr, "utest: cannot find coordinator %s: %s\n", spec,
+			gai_strerror(err));
+		return -1;
+	}
+
+	/* The coordinator may still be starting */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	do {
+		for (struct addrinfo *a = addrs; a; a = a->ai_next) {
+			int fd = socket(a->ai_family,
+					a->ai_socktype | SOCK_CLOEXEC,
+					a->ai_protocol);
+
+			if (fd < 0) {
+				continue;
+			}
+			if (!connect(fd, a->ai_addr, a->ai_addrlen)) {
+				freeaddrinfo(addrs);
+				tune(fd);
+				return fd;
+			}
+			err = errno;
+			close(fd);
+		}
+		usleep(100 * 1000);
+	} while (since_ms(&start) < CONNECT_TIMEOUT_MS);
+
+	freeaddrinfo(addrs);
+	fprintf(stderr, "utest: cannot reach coordinator %s: %s\n", spec,
+		strerror(err));
+
+	return -1;
+}
+
+/* Run the batches of the coordinator until it has no more */
+void z_utest_dist_work(int (*run)(void))
+{
+	int sock = connect_to(utest_option("worker"));
+	struct msg msg;
+	char *data;
+
+	if (sock < 0) {
+		return;
+	}
+
+	/* The coordinator going away is not a reason to die */
+	signal(SIGPIPE, SIG_IGN);
+
+	while (!read_all(sock, &msg, sizeof(msg)) && msg.type == ORDER_BATCH) {
+		data = malloc(msg.len ? msg.len : 1);
+		if (!data || read_all(sock, data, msg.len) ||
+		    run_batch(sock, data, msg.len, run)) {
+			free(data);
+			break;
+		}
+		free(data);
+	}
+
+	close(sock);
+}
+
+/* --------------------------- coordinator --------------------------- */
+
+bool z_utest_dist_listing(void)
+{
+	return utest_option("coordinate") != NULL;
+}
+
+static int find(const char *suite, const char *name)
+{
+	uint64_t key;
+	size_t i;
+
+	if (!co.nslots) {
+		return -1;
+	}
+
+	key = test_key(suite, name);
+	for (i = key & (co.nslots - 1); co.slots[i] >= 0;
+	     i = (i + 1) & (co.nslots - 1)) {
+		const struct test *t = &co.tests[co.slots[i]];
+
+		if (co.keys[i] == key && !strcmp(t->suite, suite) &&
+		    !strcmp(t->name, name)) {
+			return co.slots[i];
+		}
+	}
+
+	return -1;
+}
+
+static bool index_grow(void)
+{
+	size_t nslots = co.nslots ? 2 * co.nslots : 1024;
+	uint64_t *keys = calloc(nslots, sizeof(*keys));
+	int *slots = malloc(nslots * sizeof(*slots));
+
+	if (!keys || !slots) {
+		free(keys);
+		free(slots);
+		return false;
+	}
+
+	memset(slots, 0xff, nslots * sizeof(*slots));
+	for (size_t i = 0; i < co.nslots; i++) {
+		size_t j = co.keys[i] & (nslots - 1);
+
+		if (co.slots[i] < 0) {
+			continue;
+		}
+		while (slots[j] >= 0) {
+			j = (j + 1) & (nslots - 1);
+		}
+		keys[j] = co.keys[i];
+		slots[j] = co.slots[i];
+	}
+
+	free(co.keys);
+	free(co.slots);
+	co.keys = keys;
+	co.slots = slots;
+	co.nslots = nslots;
+
+	return true;
+}
+
+/* Called for each selected test, instead of running it */
+void z_utest_dist_list(const char *suite, const char *name)
+{
+	struct test *tests;
+	struct test *t;
+	uint64_t key;
+	size_t i;
+
+	/* A suite run twice has its tests handed out once */
+	if (find(suite, name) >= 0) {
+		return;
+	}
+
+	if ((size_t)co.count * 2 >= co.nslots && !index_grow()) {
+		return;
+	}
+
+	if (!co.ngroups ||
+	    strcmp(co.groups[co.ngroups - 1].suite, suite)) {
+		struct group *groups = realloc(
+			co.groups, (size_t)(co.ngroups + 1) * sizeof(*groups));
+
+		if (!groups) {
+			return;
+		}
+		co.groups = groups;
+		co.groups[co.ngroups++] = (struct group){
+			.suite = NULL,
+			.first = co.count,
+		};
+	}
+
+	tests = realloc(co.tests, (size_t)(co.count + 1) * sizeof(*tests));
+	if (!tests) {
+		return;
+	}
+	co.tests = tests;
+
+	t = &co.tests[co.count];
+	*t = (struct test){
+		.suite = strdup(suite),
+		.name = strdup(name),
+		.group = co.ngroups - 1,
+		.worker = -1,
+	};
+	if (!t->suite || !t->name) {
+		free(t->suite);
+		free(t->name);
+		return;
+	}
+	if (!co.groups[t->group].suite) {
+		co.groups[t->group].suite = t->suite;
+	}
+	co.groups[t->group].count++;
+	co.groups[t->group].left++;
+
+	key = test_key(suite, name);
+	for (i = key & (co.nslots - 1); co.slots[i] >= 0;
+	     i = (i + 1) & (co.nslots - 1)) {
+	}
+	co.keys[i] = key;
+	co.slots[i] = co.count++;
+}
+
+static void durations_path(char *path, size_t size)
+{
+	if (utest_cache_path("durations", program_invocation_short_name, path,
+			     size)) {
+		*path = '\0';
+	}
+}
+
+/* Estimate the tests from the durations of the previous run */
+static void load_durations(void)
+{
+	char path[PATH_MAX];
+	char *line = NULL;
+	size_t size = 0;
+	uint64_t total = 0;
+	int known = 0;
+	FILE *file;
+
+	durations_path(path, sizeof(path));
+	file = *path ? fopen(path, "r") : NULL;
+
+	while (file && getline(&line, &size, file) > 0) {
+		char *suite = strchr(line, '\t');
+		char *name = suite ? strchr(suite + 1, '\t') : NULL;
+		char *end = name ? strchr(name + 1, '\n') : NULL;
+		char **history;
+		int i;
+
+		if (!end) {
+			continue;
+		}
+		*suite++ = '\0';
+		*name++ = '\0';
+		*end = '\0';
+
+		i = find(suite, name);
+		if (i >= 0) {
+			co.tests[i].estimate_ns = strtoull(line, NULL, 10);
+			co.tests[i].estimated = true;
+			total += co.tests[i].estimate_ns;
+			known++;
+			continue;
+		}
+
+		/* Kept for the runs selecting it again */
+		history = realloc(co.history, (size_t)(co.nhistory + 1) *
+							     sizeof(*history));
+		if (history) {
+			co.history = history;
+			if (asprintf(&co.history[co.nhistory], "%s\t%s\t%s\n",
+				     line, suite, name) >= 0) {
+				co.nhistory++;
+			}
+		}
+	}
+
+	free(line);
+	if (file) {
+		fclose(file);
+	}
+
+	for (int i = 0; i < co.count; i++) {
+		if (!co.tests[i].estimated) {
+			co.tests[i].estimate_ns = known ? total / (uint64_t)known :
+							  0;
+		}
+		co.queued_ns += co.tests[i].estimate_ns;
+	}
+}
+
+static void save_durations(void)
+{
+	char path[PATH_MAX];
+	char tmp[PATH_MAX + 8];
+	FILE *file;
+
+	durations_path(path, sizeof(path));
+	if (!*path) {
+		return;
+	}
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+	file = fopen(tmp, "w");
+	if (!file) {
+		return;
+	}
+
+	for (int i = 0; i < co.count; i++) {
+		const struct test *t = &co.tests[i];
+		struct z_utest_event ev;
+
+		if (t->result) {
+			memcpy(&ev, t->result, sizeof(ev));
+			fprintf(file, "%llu\t%s\t%s\n",
+				(unsigned long long)ev.duration_ns, t->suite,
+				t->name);
+		} else if (t->estimated) {
+			fprintf(file, "%llu\t%s\t%s\n",
+				(unsigned long long)t->estimate_ns, t->suite,
+				t->name);
+		}
+	}
+	for (int i = 0; i < co.nhistory; i++) {
+		fputs(co.history[i], file);
+	}
+
+	if (fclose(file) || rename(tmp, path)) {
+		unlink(tmp);
+	}
+}
+
+static int by_estimate(const void *a, const void *b)
+{
+	const struct test *x = &co.tests[*(const int *)a];
+	const struct test *y = &co.tests[*(const int *)b];
+
+	if (x->estimate_ns != y->estimate_ns) {
+		return x->estimate_ns < y->estimate_ns ? 1 : -1;
+	}
+
+	/* Listing order otherwise */
+	return *(const int *)a - *(const int *)b;
+}
+
+static void replay(const char *data)
+{
+	const char *str[Z_UTEST_EVENT_STRINGS];
+	struct z_utest_event ev;
+	struct utest_result res;
+
+	z_utest_event_read(data, &ev, str);
+	res = (struct utest_result){
+		.suite = str[Z_UTEST_EVENT_SUITE],
+		.name = str[Z_UTEST_EVENT_NAME],
+		.status = ev.status,
+		.duration_ns = ev.duration_ns,
+		.message = str[Z_UTEST_EVENT_MESSAGE],
+		.message_len = ev.len[Z_UTEST_EVENT_MESSAGE],
+		.captured_stdout = str[Z_UTEST_EVENT_STDOUT],
+		.captured_stdout_len = ev.len[Z_UTEST_EVENT_STDOUT],
+		.captured_stderr = str[Z_UTEST_EVENT_STDERR],
+		.captured_stderr_len = ev.len[Z_UTEST_EVENT_STDERR],
+		.usage = ev.usage,
+	};
+
+	z_utest_report_result(&res);
+	if (ev.status == TC_FAIL) {
+		co.fail++;
+	}
+}
+
+/* Report the suite once its tests ended, and the batches running them */
+static void report_group(struct group *g)
+{
+	int fail = co.fail;
+
+	if (g->reported || g->left || g->running) {
+		return;
+	}
+
+	TC_SUITE_START(g->suite);
+	for (size_t at = 0; at < g->extra_len;
+	     at += z_utest_event_size(g->extra + at, g->extra_len - at)) {
+		replay(g->extra + at);
+	}
+	for (int i = g->first; i < g->first + g->count; i++) {
+		replay(co.tests[i].result);
+	}
+	TC_SUITE_END(g->suite, co.fail > fail ? TC_FAIL : TC_PASS);
+
+	g->reported = true;
+	co.unreported--;
+}
+
+static void end_test(int i, char *result)
+{
+	struct test *t = &co.tests[i];
+
+	t->result = result;
+	t->worker = -1;
+	co.left--;
+	co.groups[t->group].left--;
+}
+
+/* End test @a i as failed with @a msg, without running it */
+static void fail_test(int i, const char *msg)
+{
+	const char *str[Z_UTEST_EVENT_STRINGS] = { co.tests[i].suite,
+						   co.tests[i].name, msg };
+	struct z_utest_event ev = {
+		.type = Z_UTEST_EVENT_TEST_END,
+		.status = TC_FAIL,
+	};
+	size_t size;
+	char *result = event_dup(&ev, str, &size);
+
+	if (result) {
+		end_test(i, result);
+	}
+}
+
+static void requeue(int i)
+{
+	struct test *t = &co.tests[i];
+	char msg[128];
+
+	t->worker = -1;
+	if (++t->attempts >= CONFIG_utest_DIST_ATTEMPTS) {
+		snprintf(msg, sizeof(msg),
+			 "\n    handed out %d times, never ended\n",
+			 t->attempts);
+		fail_test(i, msg);
+		return;
+	}
+
+	co.requeued[co.nrequeued++] = i;
+	co.queued_ns += t->estimate_ns;
+}
+
+static int connected(void)
+{
+	int n = 0;
+
+	for (int i = 0; i < co.nworkers; i++) {
+		n += co.workers[i].fd >= 0;
+	}
+
+	return n;
+}
+
+static int take_next(void)
+{
+	if (co.nrequeued) {
+		return co.requeued[--co.nrequeued];
+	}
+
+	return co.next < co.count ? co.order[co.next++] : -1;
+}
+
+static void send_msg(struct worker *w, uint32_t type, const char *data,
+		     size_t len)
+{
+	struct msg msg = { .type = type, .len = (uint32_t)len };
+
+	if (z_utest_write_all(w->fd, &msg, sizeof(msg)) ||
+	    z_utest_write_all(w->fd, data, len)) {
+		/* Seen as lost when its connection is read */
+		shutdown(w->fd, SHUT_RDWR);
+	}
+}
+
+/* Hand a batch to idle worker @a w, a share of the work left */
+static void hand_out(struct worker *w)
+{
+	/* Local workers still starting get their share */
+	int workers = connected() > co.local ? connected() : co.local;
+	uint64_t target = co.queued_ns / (2 * (uint64_t)workers);
+	uint64_t total = 0;
+	char *data = NULL;
+	size_t len = 0;
+	int i;
+
+	if (!co.left) {
+		send_msg(w, ORDER_STOP, NULL, 0);
+		return;
+	}
+
+	w->batch_len = 0;
+	w->ngroups = 0;
+	w->started = -1;
+
+	while (w->batch_len < CONFIG_utest_DIST_BATCH_MAX &&
+	       (!w->batch_len || total < target) && (i = take_next()) >= 0) {
+		struct test *t = &co.tests[i];
+		size_t size = strlen(t->suite) + strlen(t->name) + 2;
+		char *grown = realloc(data, len + size);
+		struct group *g = &co.groups[t->group];
+
+		if (!grown) {
+			co.requeued[co.nrequeued++] = i;
+			break;
+		}
+		data = grown;
+		memcpy(data + len, t->suite, strlen(t->suite) + 1);
+		memcpy(data + len + strlen(t->suite) + 1, t->name,
+		       strlen(t->name) + 1);
+		len += size;
+
+		t->worker = (int)(w - co.workers);
+		w->batch[w->batch_len++] = i;
+		total += t->estimate_ns;
+		co.queued_ns -= t->estimate_ns;
+
+		if (!w->ngroups || w->groups[w->ngroups - 1] != t->group) {
+			bool held = false;
+
+			for (int j = 0; j < w->ngroups && !held; j++) {
+				held = w->groups[j] == t->group;
+			}
+			if (!held) {
+				w->groups[w->ngroups++] = t->group;
+				g->running++;
+			}
+		}
+	}
+
+	if (w->batch_len) {
+		send_msg(w, ORDER_BATCH, data, len);
+	}
+	free(data);
+}
+
+/* The batch of @a w is over: the tests it did not end go back */
+static void batch_over(struct worker *w, bool lost)
+{
+	for (int j = 0; j < w->batch_len; j++) {
+		int i = w->batch[j];
+
+		if (co.tests[i].result || co.tests[i].worker != w - co.workers) {
+			continue;
+		}
+
+		/* Only the running test counts as tried when a worker is lost */
+		if (lost && i != w->started) {
+			co.tests[i].worker = -1;
+			co.requeued[co.nrequeued++] = i;
+			co.queued_ns += co.tests[i].estimate_ns;
+		} else {
+			requeue(i);
+		}
+	}
+	w->batch_len = 0;
+
+	for (int j = 0; j < w->ngroups; j++) {
+		co.groups[w->groups[j]].running--;
+	}
+	w->ngroups = 0;
+
+	for (int g = 0; g < co.ngroups; g++) {
+		report_group(&co.groups[g]);
+	}
+}
+
+static struct group *group_of(const char *suite)
+{
+	for (int g = co.ngroups - 1; g >= 0; g--) {
+		if (!strcmp(co.groups[g].suite, suite)) {
+			return &co.groups[g];
+		}
+	}
+
+	return NULL;
+}
+
+static void handle(struct worker *w, const char *data, size_t size)
+{
+	const char *str[Z_UTEST_EVENT_STRINGS];
+	struct z_utest_event ev;
+	struct group *g;
+	char *copy;
+	int i;
+
+	z_utest_event_read(data, &ev, str);
+
+	switch (ev.type) {
+	case Z_UTEST_EVENT_TEST_START:
+		w->started = find(str[Z_UTEST_EVENT_SUITE],
+				  str[Z_UTEST_EVENT_NAME]);
+		break;
+	case Z_UTEST_EVENT_TEST_END:
+		i = find(str[Z_UTEST_EVENT_SUITE], str[Z_UTEST_EVENT_NAME]);
+		if (i >= 0) {
+			if (co.tests[i].result ||
+			    co.tests[i].worker != w - co.workers) {
+				break;
+			}
+			copy = malloc(size);
+			if (copy) {
+				memcpy(copy, data, size);
+				end_test(i, copy);
+			}
+			break;
+		}
+
+		/* A fixture of the suite that did not pass */
+		g = group_of(str[Z_UTEST_EVENT_SUITE]);
+		if (!g || g->reported) {
+			TC_SUITE_START(str[Z_UTEST_EVENT_SUITE]);
+			replay(data);
+			TC_SUITE_END(str[Z_UTEST_EVENT_SUITE], ev.status);
+			break;
+		}
+		copy = realloc(g->extra, g->extra_len + size);
+		if (copy) {
+			memcpy(copy + g->extra_len, data, size);
+			g->extra = copy;
+			g->extra_len += size;
+		}
+		break;
+	case Z_UTEST_EVENT_RUN_END:
+		batch_over(w, false);
+		hand_out(w);
+		break;
+	}
+}
+
+static void lose(struct worker *w)
+{
+	close(w->fd);
+	w->fd = -1;
+	batch_over(w, true);
+
+	/* Idle workers take the tests it gave back */
+	for (int j = 0; j < co.nworkers; j++) {
+		if (co.workers[j].fd >= 0 && !co.workers[j].batch_len) {
+			hand_out(&co.workers[j]);
+		}
+	}
+}
+
+/* Read what @a w sent, lose it when its connection ends */
+static void receive(struct worker *w)
+{
+	size_t at = 0;
+	size_t size;
+	ssize_t n;
+
+	if (w->size - w->len < 4096) {
+		size_t grown_size = w->size ? 2 * w->size : 65536;
+		char *grown = realloc(w->buf, grown_size);
+
+		if (grown) {
+			w->buf = grown;
+			w->size = grown_size;
+		}
+	}
+
+	n = w->size > w->len ? read(w->fd, w->buf + w->len, w->size - w->len) :
+			       0;
+	if (n < 0 && errno == EINTR) {
+		return;
+	}
+	if (n <= 0) {
+		lose(w);
+		return;
+	}
+	w->len += (size_t)n;
+
+	while ((size = z_utest_event_size(w->buf + at, w->len - at))) {
+		handle(w, w->buf + at, size);
+		at += size;
+	}
+	memmove(w->buf, w->buf + at, w->len - at);
+	w->len -= at;
+}
+
+static struct worker *add_worker(int fd)
+{
+	struct worker *workers;
+	struct worker *w;
+
+	workers = realloc(co.workers,
+			  (size_t)(co.nworkers + 1) * sizeof(*workers));
+	if (!workers) {
+		return NULL;
+	}
+	co.workers = workers;
+
+	w = &co.workers[co.nworkers];
+	*w = (struct worker){
+		.fd = fd,
+		.batch = malloc(CONFIG_utest_DIST_BATCH_MAX * sizeof(int)),
+		.groups = malloc(CONFIG_utest_DIST_BATCH_MAX * sizeof(int)),
+		.started = -1,
+	};
+	if (!w->batch || !w->groups) {
+		free(w->batch);
+		free(w->groups);
+		return NULL;
+	}
+	co.nworkers++;
+
+	return w;
+}
+
+static int listen_on(const char *spec, char *addr, size_t addr_size)
+{
+	struct addrinfo hints = {
+		.ai_family = AF_UNSPEC,
+		.ai_socktype = SOCK_STREAM,
+		.ai_flags = AI_PASSIVE,
+	};
+	struct sockaddr_storage bound;
+	socklen_t bound_len = sizeof(bound);
+	struct addrinfo *addrs;
+	char host[256];
+	char port[32];
+	int sock = -1;
+	int on = 1;
+	int err;
+
+	split_address(spec, host, sizeof(host), port, sizeof(port));
+	err = getaddrinfo(host, port, &hints, &addrs);
+	if (err) {
+		fprintf(stderr, "utest: cannot coordinate on %s: %s\n", spec,
+			gai_strerror(err));
+		return -1;
+	}
+
+	for (struct addrinfo *a = addrs; a && sock < 0; a = a->ai_next) {
+		sock = socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC,
+			      a->ai_protocol);
+		if (sock < 0) {
+			continue;
+		}
+		setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+		if (bind(sock, a->ai_addr, a->ai_addrlen) ||
+		    listen(sock, SOMAXCONN)) {
+			err = errno;
+			close(sock);
+			sock = -1;
+		}
+	}
+	freeaddrinfo(addrs);
+
+	if (sock < 0) {
+		fprintf(stderr, "utest: cannot coordinate on %s: %s\n", spec,
+			strerror(err));
+		return -1;
+	}
+
+	getsockname(sock, (struct sockaddr *)&bound, &bound_len);
+	getnameinfo((struct sockaddr *)&bound, bound_len, host, sizeof(host),
+		    port, sizeof(port), NI_NUMERICHOST | NI_NUMERICSERV);
+	snprintf(addr, addr_size, strchr(host, ':') ? "[%s]:%s" : "%s:%s",
+		 host, port);
+
+	return sock;
+}
+
+/* Start @a count workers of the same program on this machine */
+static void start_local(const char *addr, long count)
+{
+	const char *modules = utest_option("modules");
+	char **args = z_utest_programs_args();
+	char worker[320];
+	char module_arg[PATH_MAX + 16];
+	char **grown;
+	int argc = 1;
+
+	if (!args) {
+		return;
+	}
+	while (args[argc]) {
+		argc++;
+	}
+
+	/* Room for the address, the modules and the NULL */
+	grown = realloc(args, (size_t)(argc + 3) * sizeof(*args));
+	co.pids = calloc((size_t)count, sizeof(*co.pids));
+	if (!grown || !co.pids) {
+		free(grown ? grown : args);
+		return;
+	}
+	args = grown;
+
+	snprintf(worker, sizeof(worker), "--worker=%s", addr);
+	args[0] = program_invocation_name;
+	args[argc++] = worker;
+	if (modules) {
+		snprintf(module_arg, sizeof(module_arg), "--modules=%s",
+			 modules);
+		args[argc++] = module_arg;
+	}
+	args[argc] = NULL;
+
+	fflush(stdout);
+	fflush(stderr);
+
+	for (long i = 0; i < count; i++) {
+		pid_t pid = fork();
+
+		if (pid == 0) {
+			z_utest_programs_unsetenv();
+			execv("/proc/self/exe", args);
+			_exit(127);
+		}
+		if (pid > 0) {
+			co.pids[co.npids++] = pid;
+			co.local++;
+		}
+	}
+
+	free(args);
+}
+
+/* Notice the local workers that exited */
+static void reap_local(void)
+{
+	for (int i = 0; i < co.npids; i++) {
+		if (co.pids[i] > 0 && waitpid(co.pids[i], NULL, WNOHANG) > 0) {
+			co.pids[i] = 0;
+			co.local--;
+		}
+	}
+}
+
+static void accept_worker(int lsock)
+{
+	int fd = accept4(lsock, NULL, NULL, SOCK_CLOEXEC);
+	struct worker *w;
+
+	if (fd < 0) {
+		return;
+	}
+	tune(fd);
+
+	w = add_worker(fd);
+	if (!w) {
+		close(fd);
+		return;
+	}
+
+	hand_out(w);
+}
+
+/* Fail the tests no worker can run anymore */
+static void give_up(const char *msg)
+{
+	for (int i = 0; i < co.count; i++) {
+		if (!co.tests[i].result) {
+			fail_test(i, msg);
+		}
+	}
+}
+
+int z_utest_dist_run(void)
+{
+	const char *spec = utest_option("coordinate");
+	long nlocal = utest_option_long("workers", 0);
+	struct pollfd *fds = NULL;
+	char addr[300];
+	int lsock;
+
+	if (!spec || !co.count) {
+		return 0;
+	}
+
+	co.unreported = co.ngroups;
+	co.left = co.count;
+	co.order = malloc((size_t)co.count * sizeof(*co.order));
+	co.requeued = malloc((size_t)co.count * sizeof(*co.requeued));
+	if (!co.order || !co.requeued) {
+		return co.count;
+	}
+
+	load_durations();
+	for (int i = 0; i < co.count; i++) {
+		co.order[i] = i;
+	}
+	qsort(co.order, (size_t)co.count, sizeof(*co.order), by_estimate);
+
+	/* Workers gone do not take the coordinator with them */
+	signal(SIGPIPE, SIG_IGN);
+
+	lsock = listen_on(spec, addr, sizeof(addr));
+	if (lsock < 0) {
+		give_up("\n    no coordinator to run it\n");
+	} else {
+		fprintf(stderr, "utest: coordinating %d tests on %s\n",
+			co.count, addr);
+		if (nlocal > 0) {
+			start_local(addr, nlocal);
+		}
+	}
+
+	while (lsock >= 0 && co.left) {
+		int n = 0;
+
+		reap_local();
+		if (nlocal > 0 && !co.local && !connected()) {
+			give_up("\n    no worker left to run it\n");
+			break;
+		}
+
+		free(fds);
+		fds = calloc((size_t)co.nworkers + 1, sizeof(*fds));
+		if (!fds) {
+			give_up("\n    out of memory\n");
+			break;
+		}
+		fds[n].fd = lsock;
+		fds[n++].events = POLLIN;
+		for (int i = 0; i < co.nworkers; i++) {
+			fds[n].fd = co.workers[i].fd;
+			fds[n++].events = POLLIN;
+		}
+
+		/* Woken up now and then to notice local workers dying */
+		if (poll(fds, (nfds_t)n, 1000) <= 0) {
+			continue;
+		}
+
+		if (fds[0].revents) {
+			accept_worker(lsock);
+		}
+		for (int i = 0; i + 1 < n; i++) {
+			if (fds[i + 1].revents && co.workers[i].fd >= 0) {
+				receive(&co.workers[i]);
+			}
+		}
+	}
+
+	/* The workers stop, what their last batches sent is not waited for */
+	for (int i = 0; i < co.nworkers; i++) {
+		if (co.workers[i].fd >= 0) {
+			send_msg(&co.workers[i], ORDER_STOP, NULL, 0);
+			close(co.workers[i].fd);
+		}
+	}
+	for (int i = 0; i < co.npids; i++) {
+		if (co.pids[i] > 0) {
+			waitpid(co.pids[i], NULL, 0);
+		}
+	}
+	for (int g = 0; g < co.ngroups; g++) {
+		co.groups[g].running = 0;
+		report_group(&co.groups[g]);
+	}
+	if (lsock >= 0) {
+		close(lsock);
+	}
+	free(fds);
+
+	save_durations();
+
+	return co.fail;
+}
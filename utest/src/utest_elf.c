@@ -0,0 +1,1040 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define _GNU_SOURCE
+#include <utest_elf.h>
+#include <fcntl.h>
+#include <link.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Address range of a compilation unit, from .debug_aranges */
+struct cu_range {
+	uintptr_t lo;
+	uintptr_t hi;
+	const char *name;
+};
+
+static struct {
+	bool loaded;
+	const uint8_t *map;
+	size_t map_len;
+	const ElfW(Shdr) *shdrs;
+	size_t shnum;
+	const char *shstr;
+	uintptr_t bias;
+	struct z_utest_elf_func *funcs;
+	size_t count;
+	struct z_utest_elf_func *objects;
+	size_t nobjects;
+	struct cu_range *ranges;
+	size_t nranges;
+	bool data_loaded;
+	const char **data_files;
+	size_t ndata_files;
+	struct z_utest_elf_ref *refs;
+	size_t nrefs;
+	bool code_relocs;
+} elf;
+
+/* A DWARF section being read, reads past the end yield zeroes */
+struct cursor {
+	const uint8_t *p;
+	const uint8_t *end;
+};
+
+static const ElfW(Shdr) *section(const char *name)
+{
+	for (size_t i = 0; i < elf.shnum; i++) {
+		const ElfW(Shdr) *sh = &elf.shdrs[i];
+
+		if (sh->sh_type != SHT_NOBITS &&
+		    sh->sh_offset + sh->sh_size <= elf.map_len &&
+		    !strcmp(elf.shstr + sh->sh_name, name)) {
+			return sh;
+		}
+	}
+
+	return NULL;
+}
+
+static struct cursor section_cursor(const char *name)
+{
+	const ElfW(Shdr) *sh = section(name);
+	struct cursor c = { NULL, NULL };
+
+	if (sh) {
+		c.p = elf.map + sh->sh_offset;
+		c.end = c.p + sh->sh_size;
+	}
+
+	return c;
+}
+
+/* ------------------------------ DWARF ------------------------------ */
+
+static uint64_t read_u(struct cursor *c, size_t n)
+{
+	uint64_t v = 0;
+
+	if ((size_t)(c->end - c->p) < n) {
+		c->p = c->end;
+		return 0;
+	}
+
+	/* DWARF data is little-endian on every target we run on */
+	for (size_t i = 0; i < n; i++) {
+		v |= (uint64_t)c->p[i] << (8 * i);
+	}
+	c->p += n;
+
+	return v;
+}
+
+static uint64_t read_uleb(struct cursor *c)
+{
+	uint64_t v = 0;
+	unsigned int shift = 0;
+
+	while (c->p < c->end) {
+		uint8_t b = *c->p++;
+
+		if (shift < 64) {
+			v |= (uint64_t)(b & 0x7f) << shift;
+		}
+		shift += 7;
+		if (!(b & 0x80)) {
+			break;
+		}
+	}
+
+	return v;
+}
+
+static void skip(struct cursor *c, uint64_t n)
+{
+	c->p = ((uint64_t)(c->end - c->p) < n) ? c->end : c->p + n;
+}
+
+static const char *string_at(const char *section_name, uint64_t off)
+{
+	struct cursor s = section_cursor(section_name);
+
+	if (!s.p || off >= (uint64_t)(s.end - s.p) ||
+	    !memchr(s.p + off, '\0', (size_t)(s.end - s.p - off))) {
+		return NULL;
+	}
+
+	return (const char *)s.p + off;
+}
+
+/*
+ * Read one attribute value of @a form. Returns the string for the string
+ * forms we can resolve, NULL otherwise.
+ */
+static const char *read_form(struct cursor *c, uint64_t form, int offsize,
+			     int addrsize)
+{
+	const char *str;
+
+	switch (form) {
+	case 0x01: /* addr */
+		skip(c, (uint64_t)addrsize);
+		break;
+	case 0x03: /* block2 */
+		skip(c, read_u(c, 2));
+		break;
+	case 0x04: /* block4 */
+		skip(c, read_u(c, 4));
+		break;
+	case 0x05: /* data2 */
+	case 0x12: /* ref2 */
+	case 0x26: /* strx2 */
+	case 0x2a: /* addrx2 */
+		skip(c, 2);
+		break;
+	case 0x06: /* data4 */
+	case 0x13: /* ref4 */
+	case 0x1c: /* ref_sup4 */
+	case 0x28: /* strx4 */
+	case 0x2c: /* addrx4 */
+		skip(c, 4);
+		break;
+	case 0x07: /* data8 */
+	case 0x14: /* ref8 */
+	case 0x20: /* ref_sig8 */
+	case 0x24: /* ref_sup8 */
+		skip(c, 8);
+		break;
+	case 0x08: /* string */
+		str = (const char *)c->p;
+		while (c->p < c->end && *c->p) {
+			c->p++;
+		}
+		if (c->p == c->end) {
+			return NULL;
+		}
+		c->p++;
+		return str;
+	case 0x09: /* block */
+	case 0x18: /* exprloc */
+		skip(c, read_uleb(c));
+		break;
+	case 0x0a: /* block1 */
+		skip(c, read_u(c, 1));
+		break;
+	case 0x0b: /* data1 */
+	case 0x0c: /* flag */
+	case 0x11: /* ref1 */
+	case 0x25: /* strx1 */
+	case 0x29: /* addrx1 */
+		skip(c, 1);
+		break;
+	case 0x0d: /* sdata */
+	case 0x0f: /* udata */
+	case 0x15: /* ref_udata */
+	case 0x1a: /* strx */
+	case 0x1b: /* addrx */
+	case 0x22: /* loclistx */
+	case 0x23: /* rnglistx */
+		read_uleb(c);
+		break;
+	case 0x0e: /* strp */
+		return string_at(".debug_str", read_u(c, (size_t)offsize));
+	case 0x1f: /* line_strp */
+		return string_at(".debug_line_str", read_u(c, (size_t)offsize));
+	case 0x10: /* ref_addr */
+	case 0x17: /* sec_offset */
+	case 0x1d: /* strp_sup */
+		skip(c, (uint64_t)offsize);
+		break;
+	case 0x16: /* indirect */
+		return read_form(c, read_uleb(c), offsize, addrsize);
+	case 0x19: /* flag_present */
+	case 0x21: /* implicit_const */
+		break;
+	case 0x1e: /* data16 */
+		skip(c, 16);
+		break;
+	case 0x27: /* strx3 */
+	case 0x2b: /* addrx3 */
+		skip(c, 3);
+		break;
+	default:
+		/* Unknown form, give up on this unit */
+		c->p = c->end;
+		break;
+	}
+
+	return NULL;
+}
+
+/* DW_AT_name of the compilation unit at @a off in .debug_info */
+static const char *cu_name(uint64_t off)
+{
+	struct cursor info = section_cursor(".debug_info");
+	struct cursor abbrev = section_cursor(".debug_abbrev");
+	uint64_t abbrev_off;
+	uint64_t code;
+	int offsize = 4;
+	int addrsize;
+	unsigned int version;
+
+	if (!info.p || !abbrev.p || off >= (uint64_t)(info.end - info.p)) {
+		return NULL;
+	}
+	info.p += off;
+
+	if (read_u(&info, 4) == 0xffffffffu) {
+		read_u(&info, 8);
+		offsize = 8;
+	}
+	version = (unsigned int)read_u(&info, 2);
+	if (version >= 5) {
+		read_u(&info, 1); /* unit_type */
+		addrsize = (int)read_u(&info, 1);
+		abbrev_off = read_u(&info, (size_t)offsize);
+	} else {
+		abbrev_off = read_u(&info, (size_t)offsize);
+		addrsize = (int)read_u(&info, 1);
+	}
+	code = read_uleb(&info);
+
+	/* Find the abbreviation of the unit DIE */
+	skip(&abbrev, abbrev_off);
+	while (abbrev.p < abbrev.end) {
+		uint64_t c = read_uleb(&abbrev);
+
+		if (!c) {
+			return NULL;
+		}
+		read_uleb(&abbrev); /* tag */
+		read_u(&abbrev, 1); /* children */
+		if (c == code) {
+			break;
+		}
+		for (;;) {
+			uint64_t attr = read_uleb(&abbrev);
+			uint64_t form = read_uleb(&abbrev);
+
+			if (form == 0x21) {
+				read_uleb(&abbrev);
+			}
+			if ((!attr && !form) || abbrev.p >= abbrev.end) {
+				break;
+			}
+		}
+	}
+
+	while (abbrev.p < abbrev.end && info.p < info.end) {
+		uint64_t attr = read_uleb(&abbrev);
+		uint64_t form = read_uleb(&abbrev);
+		const char *str;
+
+		if (!attr && !form) {
+			break;
+		}
+		if (form == 0x21) {
+			read_uleb(&abbrev);
+		}
+
+		str = read_form(&info, form, offsize, addrsize);
+		if (attr == 0x03) { /* DW_AT_name */
+			return str;
+		}
+	}
+
+	return NULL;
+}
+
+static int cmp_range(const void *a, const void *b)
+{
+	const struct cu_range *x = a;
+	const struct cu_range *y = b;
+
+	return (x->lo > y->lo) - (x->lo < y->lo);
+}
+
+static void load_ranges(void)
+{
+	struct cursor c = section_cursor(".debug_aranges");
+	size_t cap = 0;
+
+	while (c.p && c.p < c.end) {
+		const uint8_t *start = c.p;
+		uint64_t len = read_u(&c, 4);
+		int offsize = 4;
+		struct cursor set;
+		uint64_t info_off;
+		const char *name;
+		size_t addrsize;
+
+		if (len == 0xffffffffu) {
+			len = read_u(&c, 8);
+			offsize = 8;
+		}
+		if (len > (uint64_t)(c.end - c.p)) {
+			break;
+		}
+		set.p = c.p;
+		set.end = c.p + len;
+		c.p = set.end;
+
+		read_u(&set, 2); /* version */
+		info_off = read_u(&set, (size_t)offsize);
+		addrsize = (size_t)read_u(&set, 1);
+		read_u(&set, 1); /* segment selector size */
+		if (addrsize != 4 && addrsize != 8) {
+			continue;
+		}
+
+		/* Tuples are aligned on twice the address size */
+		while ((size_t)(set.p - start) % (2 * addrsize)) {
+			set.p++;
+		}
+
+		name = cu_name(info_off);
+		if (!name) {
+			continue;
+		}
+
+		while (set.p < set.end) {
+			uint64_t lo = read_u(&set, addrsize);
+			uint64_t size = read_u(&set, addrsize);
+			struct cu_range *r;
+
+			if (!lo && !size) {
+				break;
+			}
+			if (elf.nranges == cap) {
+				cap = cap ? cap * 2 : 256;
+				r = realloc(elf.ranges, cap * sizeof(*r));
+				if (!r) {
+					return;
+				}
+				elf.ranges = r;
+			}
+			r = &elf.ranges[elf.nranges++];
+			r->lo = (uintptr_t)lo;
+			r->hi = (uintptr_t)(lo + size);
+			r->name = name;
+		}
+	}
+
+	if (elf.nranges) {
+		qsort(elf.ranges, elf.nranges, sizeof(*elf.ranges), cmp_range);
+	}
+}
+
+static const char *file_of(uintptr_t addr)
+{
+	size_t lo = 0;
+	size_t hi = elf.nranges;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (elf.ranges[mid].lo <= addr) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	if (lo && addr < elf.ranges[lo - 1].hi) {
+		return elf.ranges[lo - 1].name;
+	}
+
+	return "";
+}
+
+/* Whether the location expression of a variable gives it a static address */
+static bool static_location(struct cursor expr)
+{
+	uint8_t op = (uint8_t)read_u(&expr, 1);
+
+	/* DW_OP_addr, DW_OP_addrx, or a thread-local variable */
+	if (op == 0x03 || op == 0xa1) {
+		return true;
+	}
+	while (expr.p < expr.end) {
+		op = *expr.p++;
+	}
+
+	return op == 0x9b || op == 0xe0;
+}
+
+/* Index the abbreviations of a unit at @a off by code, 0 if it cannot be */
+static size_t index_abbrevs(struct cursor abbrev, uint64_t off,
+			    const uint8_t ***index, size_t *size)
+{
+	size_t len = 0;
+
+	skip(&abbrev, off);
+	while (abbrev.p < abbrev.end) {
+		uint64_t code = read_uleb(&abbrev);
+
+		if (!code) {
+			break;
+		}
+		if (code >= *size) {
+			size_t grown_size = 2 * code + 64;
+			const uint8_t **grown = realloc(
+				*index, grown_size * sizeof(*grown));
+
+			if (!grown) {
+				return 0;
+			}
+			*index = grown;
+			*size = grown_size;
+		}
+		while (len <= code) {
+			(*index)[len++] = NULL;
+		}
+		(*index)[code] = abbrev.p;
+
+		read_uleb(&abbrev); /* tag */
+		read_u(&abbrev, 1); /* children */
+		for (;;) {
+			uint64_t attr = read_uleb(&abbrev);
+			uint64_t form = read_uleb(&abbrev);
+
+			if (form == 0x21) {
+				read_uleb(&abbrev);
+			}
+			if ((!attr && !form) || abbrev.p >= abbrev.end) {
+				break;
+			}
+		}
+	}
+
+	return len;
+}
+
+/* Whether the unit in @a unit, past its header, defines a variable */
+static bool unit_defines_data(struct cursor unit, struct cursor abbrevs,
+			      const uint8_t **index, size_t len, int offsize,
+			      int addrsize, const char **name)
+{
+	bool first = true;
+
+	while (unit.p < unit.end) {
+		uint64_t code = read_uleb(&unit);
+		struct cursor abbrev = { NULL, abbrevs.end };
+		uint64_t tag;
+
+		/* End of the children of a DIE */
+		if (!code) {
+			continue;
+		}
+		if (code >= len || !index[code]) {
+			return false;
+		}
+		abbrev.p = index[code];
+		tag = read_uleb(&abbrev);
+		read_u(&abbrev, 1); /* children */
+
+		while (abbrev.p < abbrev.end && unit.p < unit.end) {
+			uint64_t attr = read_uleb(&abbrev);
+			uint64_t form = read_uleb(&abbrev);
+			struct cursor expr;
+			const char *str;
+
+			if (!attr && !form) {
+				break;
+			}
+			if (form == 0x21) {
+				read_uleb(&abbrev);
+			}
+
+			/* DW_AT_location of a DW_TAG_variable, exprloc or block1 */
+			if (tag == 0x34 && attr == 0x02 &&
+			    (form == 0x18 || form == 0x0a)) {
+				uint64_t n = form == 0x18 ? read_uleb(&unit) :
+							    read_u(&unit, 1);
+
+				expr.p = unit.p;
+				skip(&unit, n);
+				expr.end = unit.p;
+				if (expr.p < expr.end && static_location(expr)) {
+					return true;
+				}
+				continue;
+			}
+
+			str = read_form(&unit, form, offsize, addrsize);
+			if (first && attr == 0x03) { /* DW_AT_name */
+				*name = str;
+			}
+		}
+		first = false;
+	}
+
+	return false;
+}
+
+/* Names of the units defining variables, see z_utest_elf_data_files() */
+static void load_data_files(void)
+{
+	struct cursor info = section_cursor(".debug_info");
+	struct cursor abbrevs = section_cursor(".debug_abbrev");
+	const uint8_t **index = NULL;
+	size_t index_size = 0;
+	size_t cap = 0;
+
+	while (info.p && abbrevs.p && info.p < info.end) {
+		uint64_t len = read_u(&info, 4);
+		const char *name = NULL;
+		uint64_t abbrev_off;
+		struct cursor unit;
+		unsigned int version;
+		size_t codes;
+		int offsize = 4;
+		int addrsize;
+
+		if (len == 0xffffffffu) {
+			len = read_u(&info, 8);
+			offsize = 8;
+		}
+		if (!len || len > (uint64_t)(info.end - info.p)) {
+			break;
+		}
+		unit.p = info.p;
+		unit.end = info.p + len;
+		info.p = unit.end;
+
+		version = (unsigned int)read_u(&unit, 2);
+		if (version >= 5) {
+			uint64_t type = read_u(&unit, 1);
+
+			addrsize = (int)read_u(&unit, 1);
+			abbrev_off = read_u(&unit, (size_t)offsize);
+			if (type != 0x01 && type != 0x03) {
+				/* Not a compile or partial unit */
+				continue;
+			}
+		} else {
+			abbrev_off = read_u(&unit, (size_t)offsize);
+			addrsize = (int)read_u(&unit, 1);
+		}
+
+		codes = index_abbrevs(abbrevs, abbrev_off, &index, &index_size);
+		if (!unit_defines_data(unit, abbrevs, index, codes, offsize,
+				       addrsize, &name) ||
+		    !name) {
+			continue;
+		}
+
+		if (elf.ndata_files == cap) {
+			const char **grown;
+
+			cap = cap ? cap * 2 : 64;
+			grown = realloc(elf.data_files, cap * sizeof(*grown));
+			if (!grown) {
+				break;
+			}
+			elf.data_files = grown;
+		}
+		elf.data_files[elf.ndata_files++] = name;
+	}
+
+	free(index);
+}
+
+/* ----------------------------- symbols ----------------------------- */
+
+static int cmp_func(const void *a, const void *b)
+{
+	const struct z_utest_elf_func *x = a;
+	const struct z_utest_elf_func *y = b;
+
+	if (x->addr != y->addr) {
+		return (x->addr > y->addr) - (x->addr < y->addr);
+	}
+
+	return strcmp(x->name, y->name);
+}
+
+/* Symbols of type @a type, sorted by address and without aliases */
+static struct z_utest_elf_func *collect(const ElfW(Sym) *syms, size_t nsyms,
+					const char *strs, size_t strs_len,
+					unsigned int type, size_t *count)
+{
+	struct z_utest_elf_func *out = calloc(nsyms ? nsyms : 1, sizeof(*out));
+	size_t n = 0;
+
+	*count = 0;
+	if (!out) {
+		return NULL;
+	}
+
+	for (size_t i = 0; i < nsyms; i++) {
+		const ElfW(Sym) *s = &syms[i];
+
+		if (ELF64_ST_TYPE(s->st_info) != type ||
+		    s->st_shndx == SHN_UNDEF || !s->st_size ||
+		    s->st_name >= strs_len) {
+			continue;
+		}
+
+		out[n].name = strs + s->st_name;
+		out[n].file = "";
+		out[n].addr = (uintptr_t)s->st_value;
+		out[n].size = (size_t)s->st_size;
+		n++;
+	}
+
+	qsort(out, n, sizeof(*out), cmp_func);
+
+	/* Drop aliases */
+	for (size_t i = 0; i < n; i++) {
+		if (*count && out[*count - 1].addr == out[i].addr) {
+			continue;
+		}
+		out[(*count)++] = out[i];
+	}
+
+	return out;
+}
+
+static void load_symbols(void)
+{
+	const ElfW(Shdr) *symtab = section(".symtab");
+	const ElfW(Shdr) *strtab;
+	const ElfW(Sym) *syms;
+	const char *strs;
+	size_t nsyms;
+
+	if (!symtab) {
+		symtab = section(".dynsym");
+	}
+	if (!symtab || symtab->sh_link >= elf.shnum) {
+		return;
+	}
+
+	strtab = &elf.shdrs[symtab->sh_link];
+	if (strtab->sh_offset + strtab->sh_size > elf.map_len) {
+		return;
+	}
+
+	syms = (const ElfW(Sym) *)(elf.map + symtab->sh_offset);
+	nsyms = symtab->sh_size / sizeof(*syms);
+	strs = (const char *)elf.map + strtab->sh_offset;
+
+	elf.funcs = collect(syms, nsyms, strs, strtab->sh_size, STT_FUNC,
+			    &elf.count);
+	elf.objects = collect(syms, nsyms, strs, strtab->sh_size, STT_OBJECT,
+			      &elf.nobjects);
+
+	for (size_t i = 0; i < elf.count; i++) {
+		elf.funcs[i].file = file_of(elf.funcs[i].addr);
+	}
+}
+
+/* ---------------------------- relocations -------------------------- */
+
+#ifdef __x86_64__
+
+static int cmp_ref(const void *a, const void *b)
+{
+	const struct z_utest_elf_ref *x = a;
+	const struct z_utest_elf_ref *y = b;
+
+	return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+/* Translate one relocation, return false for the types we do not follow */
+static bool make_ref(const ElfW(Rela) *r, const ElfW(Shdr) *symtab,
+		     struct z_utest_elf_ref *ref)
+{
+	size_t index = ELF64_R_SYM(r->r_info);
+	uintptr_t value = 0;
+
+	ref->offset = (uintptr_t)r->r_offset;
+	ref->name = NULL;
+
+	if (index && symtab && symtab->sh_link < elf.shnum &&
+	    symtab->sh_offset + symtab->sh_size <= elf.map_len &&
+	    index < symtab->sh_size / sizeof(ElfW(Sym))) {
+		const ElfW(Sym) *sym =
+			(const ElfW(Sym) *)(elf.map + symtab->sh_offset) +
+			index;
+		const ElfW(Shdr) *strtab = &elf.shdrs[symtab->sh_link];
+
+		if (sym->st_shndx != SHN_UNDEF) {
+			value = (uintptr_t)sym->st_value;
+		} else if (sym->st_name < strtab->sh_size &&
+			   strtab->sh_offset + strtab->sh_size <=
+				   elf.map_len) {
+			ref->name = (const char *)elf.map +
+				    strtab->sh_offset + sym->st_name;
+		}
+	}
+
+	switch (ELF64_R_TYPE(r->r_info)) {
+	case R_X86_64_64:
+		ref->size = 8;
+		ref->target = value + (uintptr_t)r->r_addend;
+		break;
+	case R_X86_64_RELATIVE:
+		ref->size = 8;
+		ref->target = (uintptr_t)r->r_addend;
+		break;
+	case R_X86_64_PC32:
+	case R_X86_64_PLT32:
+	case R_X86_64_GOTPCREL:
+	case R_X86_64_GOTPCRELX:
+	case R_X86_64_REX_GOTPCRELX:
+		/* Exact when the field ends the instruction, as usual */
+		ref->size = 4;
+		ref->target = value + (uintptr_t)r->r_addend + 4;
+		break;
+	case R_X86_64_32:
+	case R_X86_64_32S:
+		ref->size = 4;
+		ref->target = value + (uintptr_t)r->r_addend;
+		break;
+	default:
+		return false;
+	}
+
+	if (ref->name) {
+		ref->target = 0;
+	}
+
+	return true;
+}
+
+/*
+ * Relocations left in the executable: the dynamic ones of a PIE, and with
+ * -Wl,--emit-relocs the static ones of every section, code included.
+ */
+static void load_relocs(void)
+{
+	size_t cap = 0;
+
+	for (size_t i = 0; i < elf.shnum; i++) {
+		const ElfW(Shdr) *sh = &elf.shdrs[i];
+		const ElfW(Shdr) *symtab = NULL;
+		const ElfW(Rela) *relas;
+		size_t n;
+
+		if (sh->sh_type != SHT_RELA ||
+		    sh->sh_entsize != sizeof(ElfW(Rela)) ||
+		    sh->sh_offset + sh->sh_size > elf.map_len) {
+			continue;
+		}
+
+		/* Offsets of debug sections are not addresses */
+		if (sh->sh_info && (sh->sh_info >= elf.shnum ||
+				    !(elf.shdrs[sh->sh_info].sh_flags &
+				      SHF_ALLOC))) {
+			continue;
+		}
+		if (sh->sh_info &&
+		    (elf.shdrs[sh->sh_info].sh_flags & SHF_EXECINSTR)) {
+			elf.code_relocs = true;
+		}
+		if (sh->sh_link && sh->sh_link < elf.shnum) {
+			symtab = &elf.shdrs[sh->sh_link];
+		}
+
+		relas = (const ElfW(Rela) *)(elf.map + sh->sh_offset);
+		n = sh->sh_size / sizeof(*relas);
+
+		for (size_t j = 0; j < n; j++) {
+			if (elf.nrefs == cap) {
+				struct z_utest_elf_ref *refs;
+
+				cap = cap ? cap * 2 : 1024;
+				refs = realloc(elf.refs, cap * sizeof(*refs));
+				if (!refs) {
+					elf.code_relocs = false;
+					return;
+				}
+				elf.refs = refs;
+			}
+			if (make_ref(&relas[j], symtab, &elf.refs[elf.nrefs])) {
+				elf.nrefs++;
+			}
+		}
+	}
+
+	if (elf.nrefs) {
+		qsort(elf.refs, elf.nrefs, sizeof(*elf.refs), cmp_ref);
+	}
+}
+
+#else
+
+static void load_relocs(void)
+{
+}
+
+#endif /* __x86_64__ */
+
+static int first_object(struct dl_phdr_info *info, size_t size, void *data)
+{
+	(void)size;
+	*(uintptr_t *)data = (uintptr_t)info->dlpi_addr;
+
+	/* The executable comes first */
+	return 1;
+}
+
+static void load(void)
+{
+	const ElfW(Ehdr) *ehdr;
+	struct stat st;
+	void *map;
+	int fd;
+
+	elf.loaded = true;
+
+	fd = open("/proc/self/exe", O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return;
+	}
+	if (fstat(fd, &st) || (size_t)st.st_size < sizeof(*ehdr)) {
+		close(fd);
+		return;
+	}
+	map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		return;
+	}
+
+	elf.map = map;
+	elf.map_len = (size_t)st.st_size;
+	ehdr = map;
+
+	if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) ||
+	    ehdr->e_ident[EI_CLASS] != (sizeof(void *) == 8 ? ELFCLASS64
+							      : ELFCLASS32) ||
+	    ehdr->e_shentsize != sizeof(ElfW(Shdr)) ||
+	    ehdr->e_shoff + (uint64_t)ehdr->e_shnum * sizeof(ElfW(Shdr)) >
+		    elf.map_len ||
+	    ehdr->e_shstrndx >= ehdr->e_shnum) {
+		return;
+	}
+
+	elf.shdrs = (const ElfW(Shdr) *)(elf.map + ehdr->e_shoff);
+	elf.shnum = ehdr->e_shnum;
+	elf.shstr = (const char *)elf.map +
+		    elf.shdrs[ehdr->e_shstrndx].sh_offset;
+
+	dl_iterate_phdr(first_object, &elf.bias);
+
+	load_ranges();
+	load_symbols();
+	load_relocs();
+}
+
+static void ensure_loaded(void)
+{
+	if (!elf.loaded) {
+		load();
+	}
+}
+
+const struct z_utest_elf_func *z_utest_elf_functions(size_t *count)
+{
+	ensure_loaded();
+
+	*count = elf.count;
+
+	return elf.funcs;
+}
+
+const struct z_utest_elf_func *z_utest_elf_objects(size_t *count)
+{
+	ensure_loaded();
+
+	*count = elf.nobjects;
+
+	return elf.objects;
+}
+
+const char *const *z_utest_elf_data_files(size_t *count)
+{
+	ensure_loaded();
+
+	/* Every unit is read, only do so when asked */
+	if (!elf.data_loaded) {
+		elf.data_loaded = true;
+		load_data_files();
+	}
+
+	*count = elf.ndata_files;
+
+	return elf.data_files;
+}
+
+long z_utest_elf_find(const struct z_utest_elf_func *syms, size_t count,
+		      uintptr_t addr)
+{
+	size_t lo = 0;
+	size_t hi = count;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (syms[mid].addr <= addr) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	if (lo && addr < syms[lo - 1].addr + syms[lo - 1].size) {
+		return (long)(lo - 1);
+	}
+
+	return -1;
+}
+
+long z_utest_elf_lookup(uintptr_t addr)
+{
+	ensure_loaded();
+
+	return z_utest_elf_find(elf.funcs, elf.count, addr - elf.bias);
+}
+
+uintptr_t z_utest_elf_bias(void)
+{
+	ensure_loaded();
+
+	return elf.bias;
+}
+
+const uint8_t *z_utest_elf_bytes(uintptr_t addr, size_t *avail,
+				 uint64_t *flags)
+{
+	ensure_loaded();
+
+	*avail = 0;
+	*flags = 0;
+
+	for (size_t i = 0; i < elf.shnum; i++) {
+		const ElfW(Shdr) *sh = &elf.shdrs[i];
+
+		if (!(sh->sh_flags & SHF_ALLOC) || addr < sh->sh_addr ||
+		    addr - sh->sh_addr >= sh->sh_size) {
+			continue;
+		}
+
+		*flags = (uint64_t)sh->sh_flags;
+		if (sh->sh_type == SHT_NOBITS ||
+		    sh->sh_offset + sh->sh_size > elf.map_len) {
+			return NULL;
+		}
+
+		*avail = (size_t)(sh->sh_size - (addr - sh->sh_addr));
+
+		return elf.map + sh->sh_offset + (addr - sh->sh_addr);
+	}
+
+	return NULL;
+}
+
+const struct z_utest_elf_ref *z_utest_elf_refs(uintptr_t addr, size_t size,
+					       size_t *count)
+{
+	size_t lo = 0;
+	size_t hi;
+	size_t end;
+
+	ensure_loaded();
+
+	hi = elf.nrefs;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (elf.refs[mid].offset < addr) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	for (end = lo; end < elf.nrefs && elf.refs[end].offset < addr + size;
+	     end++) {
+	}
+
+	*count = end - lo;
+
+	return *count ? &elf.refs[lo] : NULL;
+}
+
+bool z_utest_elf_code_relocated(void)
+{
+	ensure_loaded();
+
+	return elf.code_relocs;
+}
@@ -0,0 +1,119 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <utest.h>
+#include <utest_filter.h>
+#include <utest_hash.h>
+#include <fnmatch.h>
+#include <stdio.h>
+#include <string.h>
+
+const char *utest_test_id(const char *suite, const char *name, char *buf,
+			  size_t size)
+{
+	const char *prefix = "TEST(";
+	const char *tc = name;
+	size_t len = strlen(name);
+
+	/* "TEST(suite, case)" -> "case" */
+	if (!strncmp(name, prefix, strlen(prefix)) && name[len - 1] == ')') {
+		const char *comma = strstr(name, ", ");
+
+		if (comma) {
+			tc = comma + 2;
+			len = (size_t)(name + len - 1 - tc);
+		}
+	}
+
+	snprintf(buf, size, "%s.%.*s", suite, (int)len, tc);
+
+	return buf;
+}
+
+/* Match @a id against the patterns in [start, end) separated by ':' */
+static bool match_any(const char *start, const char *end, const char *id)
+{
+	char pattern[Z_UTEST_TEST_ID_MAX];
+
+	while (start < end) {
+		const char *sep = memchr(start, ':', (size_t)(end - start));
+		size_t len = (size_t)((sep ? sep : end) - start);
+
+		if (len && len < sizeof(pattern)) {
+			memcpy(pattern, start, len);
+			pattern[len] = '\0';
+			if (!fnmatch(pattern, id, 0)) {
+				return true;
+			}
+		}
+
+		start += len + 1;
+	}
+
+	return false;
+}
+
+static bool filter_match(const char *filter, const char *id)
+{
+	const char *end = filter + strlen(filter);
+	const char *neg = strchr(filter, '-');
+
+	if (neg != filter && !match_any(filter, neg ? neg : end, id)) {
+		return false;
+	}
+
+	return !neg || !match_any(neg + 1, end, id);
+}
+
+/*
+ * Tests are spread over shards by hash of their identifier, which needs no
+ * state and stays stable when tests are added elsewhere.
+ */
+bool z_utest_shard_match(const char *id, long index, long count)
+{
+	return utest_hash64(id, strlen(id), 0) % (uint64_t)count ==
+	       (uint64_t)index;
+}
+
+bool z_utest_test_selected(const char *suite, const char *name)
+{
+	static long shard_index = -1;
+	static long shard_count = -1;
+	const char *filter = utest_option("filter");
+	char id[Z_UTEST_TEST_ID_MAX];
+
+	/* In a batch of a distributed run, see utest_dist.h */
+	if (!z_utest_dist_selected(suite, name)) {
+		return false;
+	}
+
+	/* In a piece of a run in priority order, see utest_priority.h */
+	if (!z_utest_priority_selected(suite, name)) {
+		return false;
+	}
+
+	if (shard_count < 0) {
+		shard_count = utest_option_long("shard-count", 1);
+		shard_index = utest_option_long("shard-index", 0);
+		if (shard_count < 1 || shard_index < 0 ||
+		    shard_index >= shard_count) {
+			shard_count = 1;
+			shard_index = 0;
+		}
+	}
+
+	if ((filter && *filter) || shard_count > 1) {
+		utest_test_id(suite, name, id, sizeof(id));
+
+		if (filter && *filter && !filter_match(filter, id)) {
+			return false;
+		}
+		if (shard_count > 1 &&
+		    !z_utest_shard_match(id, shard_index, shard_count)) {
+			return false;
+		}
+	}
+
+	return z_utest_coverage_selected(suite, name);
+}
@@ -0,0 +1,96 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <utest.h>
+#include <utest_fixture.h>
+#include <stdio.h>
+
+enum fixture_state {
+	FIXTURE_UNUSED,
+	FIXTURE_BUILDING,
+	FIXTURE_READY,
+	FIXTURE_FAILED,
+};
+
+/* Built fixtures, most recent first so teardown runs in reverse order */
+static struct utest_shared_fixture *built;
+
+static struct utest_shared_fixture *tearing_down;
+
+void *utest_shared_fixture_get(struct utest_shared_fixture *fixture)
+{
+	switch (fixture->state) {
+	case FIXTURE_READY:
+		return fixture->data;
+	case FIXTURE_BUILDING:
+		/* The previous attempt left through a failed assertion */
+		fixture->state = FIXTURE_FAILED;
+		break;
+	case FIXTURE_UNUSED:
+		fixture->state = FIXTURE_BUILDING;
+		fixture->data = fixture->setup();
+		fixture->state = FIXTURE_READY;
+		fixture->next = built;
+		built = fixture;
+		return fixture->data;
+	default:
+		break;
+	}
+
+	z_utest_failure_printf("\n    shared fixture %s failed to build\n",
+			       fixture->name);
+	utest_fail();
+
+	return NULL;
+}
+
+static void teardown_current(void)
+{
+	tearing_down->teardown(tearing_down->data);
+}
+
+int z_utest_shared_fixtures_release(bool (*match)(const void *fixture,
+						   const void *arg),
+				    const void *arg)
+{
+	struct utest_shared_fixture **it = &built;
+	char label[128];
+	int fail = 0;
+
+	while (*it) {
+		if (match && !match(*it, arg)) {
+			it = &(*it)->next;
+			continue;
+		}
+
+		tearing_down = *it;
+		*it = tearing_down->next;
+
+		if (tearing_down->teardown) {
+			snprintf(label, sizeof(label), "AFTER_ALL(%s)",
+				 tearing_down->name);
+			if (z_utest_run_fixture(label, teardown_current) ==
+			    TC_FAIL) {
+				fail++;
+			}
+		}
+
+		tearing_down->state = FIXTURE_UNUSED;
+		tearing_down->data = NULL;
+		tearing_down->next = NULL;
+	}
+
+	return fail;
+}
+
+int z_utest_shared_fixtures_teardown(void)
+{
+	return z_utest_shared_fixtures_release(NULL, NULL);
+}
+
+/* Fixtures built so far belong to another process, leave them alone */
+void z_utest_shared_fixtures_detach(void)
+{
+	built = NULL;
+}
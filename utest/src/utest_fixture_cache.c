@@ -0,0 +1,240 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <utest.h>
+#include <utest_fixture.h>
+#include <utest_hash.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define BLOB_MAGIC 0x58465455u /* "UTFX" */
+#define BLOB_ALIGN 64
+
+/* Cache file header, the blob starts right after it */
+struct blob_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;
+	uint64_t size;
+	uint8_t pad[BLOB_ALIGN - 24];
+};
+
+enum cached_state {
+	CACHED_UNUSED,
+	CACHED_BUILDING,
+	CACHED_READY,
+	CACHED_FAILED,
+};
+
+size_t utest_blob_reserve(struct utest_blob *blob, size_t len, size_t align)
+{
+	size_t off;
+
+	if (!align || align > BLOB_ALIGN) {
+		align = BLOB_ALIGN;
+	}
+
+	off = (blob->len + align - 1) & ~(align - 1);
+
+	if (off + len > blob->size) {
+		size_t size = blob->size ? blob->size : 4096;
+		char *data;
+
+		while (size < off + len) {
+			size *= 2;
+		}
+
+		data = realloc(blob->data, size);
+		if (!data) {
+			z_utest_failure_printf("\n    fixture blob of %zu bytes "
+					       "out of memory\n", size);
+			utest_fail();
+		}
+
+		blob->data = data;
+		blob->size = size;
+	}
+
+	memset(blob->data + blob->len, 0, off + len - blob->len);
+	blob->len = off + len;
+
+	return off;
+}
+
+size_t utest_blob_append(struct utest_blob *blob, const void *data,
+			 size_t len, size_t align)
+{
+	size_t off = utest_blob_reserve(blob, len, align);
+
+	memcpy(blob->data + off, data, len);
+
+	return off;
+}
+
+static int compute_key(const struct utest_cached_fixture *fixture,
+		       uint64_t *key)
+{
+	uint64_t hash = utest_hash64(fixture->name, strlen(fixture->name),
+				     fixture->version);
+
+	for (size_t i = 0; i < fixture->num_inputs; i++) {
+		const char *path = fixture->inputs[i];
+		uint64_t content;
+
+		if (utest_hash_file(path, 0, &content)) {
+			z_utest_failure_printf("\n    fixture %s: cannot read "
+					       "input %s\n", fixture->name,
+					       path);
+			return -1;
+		}
+
+		hash = utest_hash64(path, strlen(path), hash);
+		hash = utest_hash_combine(hash, content);
+	}
+
+	*key = hash;
+
+	return 0;
+}
+
+/* Map the cache file if it matches @a key */
+static const void *load(const char *path, uint32_t version, uint64_t key,
+			size_t *size)
+{
+	struct blob_header hdr;
+	struct stat st;
+	void *map;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	if (fstat(fd, &st) || (size_t)st.st_size < sizeof(hdr) ||
+	    pread(fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr) ||
+	    hdr.magic != BLOB_MAGIC || hdr.version != version ||
+	    hdr.key != key || hdr.size != (uint64_t)st.st_size - sizeof(hdr)) {
+		close(fd);
+		return NULL;
+	}
+
+	map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		return NULL;
+	}
+
+	*size = hdr.size;
+
+	return (const char *)map + sizeof(hdr);
+}
+
+/* Write the cache file atomically, concurrent runs may race on it */
+static void store(const char *path, uint32_t version, uint64_t key,
+		  const struct utest_blob *blob)
+{
+	struct blob_header hdr = {
+		.magic = BLOB_MAGIC,
+		.version = version,
+		.key = key,
+		.size = blob->len,
+	};
+	char tmp[512];
+	int fd;
+
+	snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", path, (long)getpid());
+
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		return;
+	}
+
+	if (z_utest_write_all(fd, &hdr, sizeof(hdr)) ||
+	    z_utest_write_all(fd, blob->data, blob->len) || close(fd) ||
+	    rename(tmp, path)) {
+		unlink(tmp);
+	}
+}
+
+static int build(struct utest_cached_fixture *fixture, const char *path,
+		 uint64_t key)
+{
+	struct utest_blob blob = { 0 };
+
+	if (fixture->build(&blob)) {
+		free(blob.data);
+		z_utest_failure_printf("\n    fixture %s failed to build\n",
+				       fixture->name);
+		return -1;
+	}
+
+	if (path) {
+		store(path, fixture->version, key, &blob);
+		fixture->data = load(path, fixture->version, key,
+				     &fixture->size);
+	}
+
+	if (fixture->data) {
+		free(blob.data);
+	} else {
+		/* Cache not writable, keep the heap copy for this run */
+		fixture->data = blob.data ? blob.data : "";
+		fixture->size = blob.len;
+	}
+
+	return 0;
+}
+
+const void *utest_cached_fixture_get(struct utest_cached_fixture *fixture,
+				     size_t *size)
+{
+	char file[256];
+	char path[512];
+	const char *cache;
+	uint64_t key;
+
+	/* Every test using the fixture depends on its inputs */
+	for (size_t i = 0; i < fixture->num_inputs; i++) {
+		utest_depend_file(fixture->inputs[i]);
+	}
+
+	if (fixture->state == CACHED_UNUSED) {
+		fixture->state = CACHED_BUILDING;
+
+		if (compute_key(fixture, &key) == 0) {
+			snprintf(file, sizeof(file), "%s.blob", fixture->name);
+			cache = utest_cache_path("fixtures", file, path,
+						 sizeof(path)) ? NULL : path;
+
+			if (cache) {
+				fixture->data = load(cache, fixture->version,
+						     key, &fixture->size);
+			}
+
+			if (fixture->data || build(fixture, cache, key) == 0) {
+				fixture->state = CACHED_READY;
+			}
+		}
+	}
+
+	if (fixture->state != CACHED_READY) {
+		/* Either failed just now or left through an assertion */
+		fixture->state = CACHED_FAILED;
+		z_utest_failure_printf("\n    cached fixture %s unavailable\n",
+				       fixture->name);
+		utest_fail();
+	}
+
+	if (size) {
+		*size = fixture->size;
+	}
+
+	return fixture->data;
+}
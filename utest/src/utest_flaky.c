@@ -0,0 +1,480 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define _GNU_SOURCE
+#include <utest.h>
+#include <utest_flaky.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define WINDOW                                                   \
+	(CONFIG_utest_FLAKY_WINDOW < 1	? 1 :                   \
+	 CONFIG_utest_FLAKY_WINDOW > 64 ? 64 :                  \
+					  CONFIG_utest_FLAKY_WINDOW)
+#define DEFAULT_THRESHOLD 5.0
+
+/* A test that failed and runs again */
+struct attempt {
+	uint64_t key;
+	char *suite;
+	char *name;
+	/* Runs that failed so far */
+	unsigned int failed;
+	/* Message of the first failure */
+	char *message;
+	size_t message_len;
+};
+
+/* Outcomes of the last runs of a test, the latest in bit 0, 1 if failed */
+struct history {
+	char *suite;
+	char *name;
+	uint64_t bits;
+	unsigned int count;
+	/* Quarantined at the start of this run */
+	bool quarantined;
+};
+
+static struct {
+	long retries;
+	struct attempt *attempts;
+	size_t nattempts;
+	bool retry;
+	int status;
+
+	/* History, see the `flaky` option */
+	bool enabled;
+	double threshold;
+	struct history *tests;
+	int count;
+	/* Index of tests by key, -1 when free */
+	uint64_t *keys;
+	int *slots;
+	size_t nslots;
+} flaky;
+
+/* Room for a failure message and what is said about it */
+static char message[CONFIG_utest_FAILURE_MSG_SIZE + 256];
+
+static uint64_t test_key(const char *suite, const char *name)
+{
+	return utest_hash64(name, strlen(name),
+			    utest_hash64(suite, strlen(suite), 0));
+}
+
+/* ------------------------- retries --------------------------------- */
+
+static struct attempt *find_attempt(uint64_t key, const char *suite,
+				    const char *name)
+{
+	for (size_t i = 0; i < flaky.nattempts; i++) {
+		struct attempt *a = &flaky.attempts[i];
+
+		if (a->key == key && !strcmp(a->suite, suite) &&
+		    !strcmp(a->name, name)) {
+			return a;
+		}
+	}
+
+	return NULL;
+}
+
+static void drop_attempt(struct attempt *a)
+{
+	free(a->suite);
+	free(a->name);
+	free(a->message);
+	*a = flaky.attempts[--flaky.nattempts];
+}
+
+/*
+ * The next result of the test may be retried. Test names are copied, the
+ * names of parameterized instances live in reused buffers.
+ */
+void z_utest_flaky_expect(const char *suite, const char *name)
+{
+	uint64_t key = test_key(suite, name);
+	struct attempt *grown;
+	struct attempt *a;
+
+	if (flaky.retries <= 0 || find_attempt(key, suite, name)) {
+		return;
+	}
+
+	grown = realloc(flaky.attempts,
+			(flaky.nattempts + 1) * sizeof(*flaky.attempts));
+	if (!grown) {
+		return;
+	}
+	flaky.attempts = grown;
+
+	a = &flaky.attempts[flaky.nattempts];
+	*a = (struct attempt){
+		.key = key,
+		.suite = strdup(suite),
+		.name = strdup(name),
+	};
+	if (!a->suite || !a->name) {
+		free(a->suite);
+		free(a->name);
+		return;
+	}
+	flaky.nattempts++;
+}
+
+/* Keep the first failure, swallow the result, return false if it cannot */
+static bool retry(struct attempt *a, const struct utest_result *result)
+{
+	if (!a->message) {
+		a->message = malloc(result->message_len + 1);
+		if (!a->message) {
+			return false;
+		}
+		memcpy(a->message, result->message, result->message_len);
+		a->message[result->message_len] = '\0';
+		a->message_len = result->message_len;
+	}
+
+	a->failed++;
+	flaky.retry = true;
+
+	return true;
+}
+
+/* @a result as @a status, with a note after @a msg, in @a out */
+static void annotate(struct utest_result *out, const struct utest_result *result,
+		     int status, const char *msg, size_t msg_len,
+		     const char *fmt, ...)
+{
+	size_t room = sizeof(message) - 2;
+	size_t len = msg_len < room ? msg_len : room;
+	va_list vargs;
+	int n;
+
+	memmove(message, msg, len);
+	if (!len || message[len - 1] != '\n') {
+		message[len++] = '\n';
+	}
+	va_start(vargs, fmt);
+	n = vsnprintf(message + len, sizeof(message) - len, fmt, vargs);
+	va_end(vargs);
+	if (n > 0) {
+		len += (size_t)n < sizeof(message) - len ?
+			       (size_t)n :
+			       sizeof(message) - len - 1;
+	}
+
+	*out = *result;
+	out->status = status;
+	out->message = message;
+	out->message_len = len;
+}
+
+bool z_utest_flaky_retry(void)
+{
+	bool ret = flaky.retry;
+
+	flaky.retry = false;
+
+	return ret;
+}
+
+int z_utest_flaky_status(void)
+{
+	return flaky.status;
+}
+
+/* ------------------------- history --------------------------------- */
+
+static bool index_grow(void)
+{
+	size_t nslots = flaky.nslots ? 2 * flaky.nslots : 256;
+	uint64_t *keys = calloc(nslots, sizeof(*keys));
+	int *slots = malloc(nslots * sizeof(*slots));
+
+	if (!keys || !slots) {
+		free(keys);
+		free(slots);
+		return false;
+	}
+
+	for (size_t i = 0; i < nslots; i++) {
+		slots[i] = -1;
+	}
+	for (size_t i = 0; i < flaky.nslots; i++) {
+		size_t j = flaky.keys[i] & (nslots - 1);
+
+		if (flaky.slots[i] < 0) {
+			continue;
+		}
+		while (slots[j] >= 0) {
+			j = (j + 1) & (nslots - 1);
+		}
+		keys[j] = flaky.keys[i];
+		slots[j] = flaky.slots[i];
+	}
+
+	free(flaky.keys);
+	free(flaky.slots);
+	flaky.keys = keys;
+	flaky.slots = slots;
+	flaky.nslots = nslots;
+
+	return true;
+}
+
+/* The history of a test, added if new, NULL if it cannot be */
+static struct history *find_history(const char *suite, const char *name)
+{
+	uint64_t key = test_key(suite, name);
+	struct history *grown;
+	size_t i;
+
+	if (!flaky.nslots && !index_grow()) {
+		return NULL;
+	}
+
+	for (i = key & (flaky.nslots - 1); flaky.slots[i] >= 0;
+	     i = (i + 1) & (flaky.nslots - 1)) {
+		struct history *h = &flaky.tests[flaky.slots[i]];
+
+		if (flaky.keys[i] == key && !strcmp(h->suite, suite) &&
+		    !strcmp(h->name, name)) {
+			return h;
+		}
+	}
+
+	/* Keep the index at most half full */
+	if ((size_t)(flaky.count + 1) * 2 > flaky.nslots) {
+		if (!index_grow()) {
+			return NULL;
+		}
+		return find_history(suite, name);
+	}
+
+	grown = realloc(flaky.tests, (size_t)(flaky.count + 1) *
+					     sizeof(*flaky.tests));
+	if (!grown) {
+		return NULL;
+	}
+	flaky.tests = grown;
+
+	grown[flaky.count] = (struct history){
+		.suite = strdup(suite),
+		.name = strdup(name),
+	};
+	if (!grown[flaky.count].suite || !grown[flaky.count].name) {
+		free(grown[flaky.count].suite);
+		free(grown[flaky.count].name);
+		return NULL;
+	}
+	flaky.keys[i] = key;
+	flaky.slots[i] = flaky.count;
+
+	return &flaky.tests[flaky.count++];
+}
+
+static unsigned int failures(const struct history *h)
+{
+	uint64_t mask = h->count >= 64 ? ~0ull : (1ull << h->count) - 1;
+
+	return (unsigned int)__builtin_popcountll(h->bits & mask);
+}
+
+/* Both passed and failed, and failed too often */
+static bool is_flaky(const struct history *h)
+{
+	unsigned int failed = failures(h);
+
+	return failed && failed < h->count &&
+	       100.0 * failed > flaky.threshold * h->count;
+}
+
+static void record(struct history *h, bool failed)
+{
+	h->bits = (h->bits << 1) | (failed ? 1 : 0);
+	if (h->count < WINDOW) {
+		h->count++;
+	}
+}
+
+static void history_path(char *path, size_t size)
+{
+	if (utest_cache_path("flaky", program_invocation_short_name, path,
+			     size)) {
+		*path = '\0';
+	}
+}
+
+static void load_history(void)
+{
+	char path[PATH_MAX];
+	char *line = NULL;
+	size_t size = 0;
+	FILE *file;
+
+	history_path(path, sizeof(path));
+	file = *path ? fopen(path, "r") : NULL;
+
+	while (file && getline(&line, &size, file) > 0) {
+		char *count = strchr(line, '\t');
+		char *suite = count ? strchr(count + 1, '\t') : NULL;
+		char *name = suite ? strchr(suite + 1, '\t') : NULL;
+		char *end = name ? strchr(name + 1, '\n') : NULL;
+		struct history *h;
+
+		if (!end) {
+			continue;
+		}
+		*count++ = '\0';
+		*suite++ = '\0';
+		*name++ = '\0';
+		*end = '\0';
+
+		h = find_history(suite, name);
+		if (!h) {
+			continue;
+		}
+		h->bits = strtoull(line, NULL, 16);
+		h->count = (unsigned int)strtoul(count, NULL, 10);
+		if (h->count > WINDOW) {
+			h->count = WINDOW;
+		}
+		h->quarantined = is_flaky(h);
+	}
+
+	free(line);
+	if (file) {
+		fclose(file);
+	}
+}
+
+static void save_history(void)
+{
+	char path[PATH_MAX];
+	char tmp[PATH_MAX + 8];
+	FILE *file;
+
+	history_path(path, sizeof(path));
+	if (!*path) {
+		return;
+	}
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+	file = fopen(tmp, "w");
+	if (!file) {
+		return;
+	}
+
+	for (int i = 0; i < flaky.count; i++) {
+		const struct history *h = &flaky.tests[i];
+
+		fprintf(file, "%016llx\t%u\t%s\t%s\n",
+			(unsigned long long)h->bits, h->count, h->suite,
+			h->name);
+	}
+
+	if (fclose(file) || rename(tmp, path)) {
+		unlink(tmp);
+	}
+}
+
+static void flaky_run_end(struct utest_reporter *rep, int result)
+{
+	(void)rep;
+	(void)result;
+
+	save_history();
+}
+
+static struct utest_reporter flaky_reporter = {
+	.name = "flaky",
+	.on_run_end = flaky_run_end,
+};
+
+/* ------------------------- results --------------------------------- */
+
+/*
+ * Decide what becomes of @a result on its way to the reporters: return
+ * false if it is swallowed because the test runs again, otherwise fill
+ * @a out with the result to report.
+ */
+bool z_utest_flaky_filter(const struct utest_result *result,
+			  struct utest_result *out)
+{
+	struct attempt *a = NULL;
+	struct history *h = NULL;
+
+	*out = *result;
+
+	if (flaky.nattempts) {
+		a = find_attempt(test_key(result->suite, result->name),
+				 result->suite, result->name);
+	}
+
+	if (a && result->status == TC_FAIL && a->failed < flaky.retries &&
+	    retry(a, result)) {
+		return false;
+	}
+
+	if (a && a->failed && result->status == TC_PASS) {
+		annotate(out, result, TC_FLAKY, a->message, a->message_len,
+			 "    failed %u time%s, passed on attempt %u\n",
+			 a->failed, a->failed == 1 ? "" : "s", a->failed + 1);
+	} else if (a && a->failed) {
+		annotate(out, result, result->status, result->message,
+			 result->message_len,
+			 "    failed all %u attempts\n", a->failed + 1);
+	}
+	if (a) {
+		drop_attempt(a);
+	}
+
+	if (flaky.enabled) {
+		h = find_history(result->suite, result->name);
+	}
+
+	if (h && h->quarantined && out->status == TC_FAIL) {
+		annotate(out, out, TC_FLAKY, out->message, out->message_len,
+			 "    quarantined, failed %u of the last %u runs\n",
+			 failures(h), h->count);
+	}
+
+	if (h &&
+	    (out->status == TC_PASS || out->status == TC_FAIL ||
+	     out->status == TC_FLAKY)) {
+		record(h, out->status != TC_PASS);
+	}
+
+	flaky.status = out->status;
+
+	return true;
+}
+
+void z_utest_flaky_init(void)
+{
+	const char *threshold = utest_option("flaky");
+
+	flaky.retries = utest_option_long("retries", 0);
+	flaky.retry = false;
+	flaky.status = TC_PASS;
+
+	/* The runner the results are sent to keeps them */
+	flaky.enabled = threshold && !utest_option("result-fd");
+	if (!flaky.enabled) {
+		return;
+	}
+
+	flaky.threshold = *threshold ? strtod(threshold, NULL) :
+				       DEFAULT_THRESHOLD;
+	if (!flaky.count) {
+		load_history();
+	}
+	utest_register_reporter(&flaky_reporter);
+}
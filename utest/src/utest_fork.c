@@ -0,0 +1,538 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define _GNU_SOURCE
+#include <utest.h>
+#include <utest_flaky.h>
+#include <utest_fork.h>
+#include <utest_jobserver.h>
+#include <utest_limits.h>
+#include <utest_ring.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * A job slot. Results come back through the ring of the slot; the pipe
+ * carries nothing, the runner only waits for it to close as the child
+ * exits.
+ */
+struct child {
+	pid_t pid;
+	int fd;
+	/* Tag of the records of this child */
+	uint32_t tag;
+	bool reported;
+	bool failed;
+	/* The failed test runs again, see utest_flaky.h */
+	bool retry;
+	/* Resources taken by the test, see utest_tags.h */
+	uint64_t tags;
+	/* Copied, parameterized test names live in a reused buffer */
+	char name[Z_UTEST_TEST_NAME_MAX];
+	const char *suite;
+	struct timespec start;
+	/* What it takes to run the test again */
+	struct unit_test test;
+	z_utest_run_fn run;
+	const struct utest_param_source *params;
+	size_t param_index;
+};
+
+/* A test waiting for its resources */
+struct held_test {
+	struct unit_test test;
+	z_utest_run_fn run;
+};
+
+static bool enabled;
+static bool in_child;
+static struct z_utest_ring *child_ring;
+static uint32_t child_tag;
+static const char *child_test;
+static bool result_sent;
+static int jobs = 1;
+static int running;
+static uint32_t spawned;
+static struct child *children;
+static struct z_utest_ring *rings;
+/* One per slot and one for the jobserver, see reap() */
+static struct pollfd *fds;
+static struct held_test *held;
+static size_t held_len;
+static size_t held_size;
+
+bool utest_fork_enabled(void)
+{
+	return enabled;
+}
+
+int utest_fork_jobs(void)
+{
+	return enabled ? jobs : 1;
+}
+
+bool utest_in_child(void)
+{
+	return in_child;
+}
+
+/*
+ * Worker processes a test may fork out of @a wanted. The jobs of the fork
+ * mode are already taken by the tests running together, each gets its
+ * share of @a wanted, at least one.
+ */
+int z_utest_fork_workers(int wanted)
+{
+	if (in_child && jobs > 1) {
+		wanted /= jobs;
+	}
+
+	return wanted > 1 ? wanted : 1;
+}
+
+void z_utest_fork_init(void)
+{
+	const char *value = utest_option("jobs");
+
+	/* Limits apply to test processes */
+	enabled = z_utest_limits_init() || utest_option_enabled("fork");
+	z_utest_jobserver_init();
+
+	if (value) {
+		enabled = true;
+		jobs = (int)utest_option_long("jobs", 1);
+		if (jobs <= 0) {
+			jobs = z_utest_jobserver_jobs();
+		}
+		if (jobs <= 0) {
+			jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+		}
+		if (jobs <= 0) {
+			jobs = 1;
+		}
+	}
+
+	if (enabled) {
+		children = calloc((size_t)jobs, sizeof(*children));
+		fds = calloc((size_t)jobs + 1, sizeof(*fds));
+		rings = z_utest_rings_create(jobs);
+		if (!children || !fds || !rings) {
+			free(children);
+			free(fds);
+			children = NULL;
+			fds = NULL;
+			enabled = false;
+		}
+	}
+}
+
+/* ------------------------------ child ------------------------------ */
+
+static void send_result(const struct utest_result *result)
+{
+	struct z_utest_ring_rec rec = {
+		.tag = child_tag,
+		.status = result->status,
+		.duration_ns = result->duration_ns,
+		.len = { (uint32_t)result->message_len,
+			 (uint32_t)result->captured_stdout_len,
+			 (uint32_t)result->captured_stderr_len },
+		.usage = result->usage,
+	};
+	const char *const str[Z_UTEST_RING_STRINGS] = {
+		result->message, result->captured_stdout,
+		result->captured_stderr
+	};
+
+	result_sent = true;
+	z_utest_ring_push(child_ring, &rec, str);
+}
+
+/* The result was sent, a shared fixture teardown failure is only printed */
+static void print_teardown(const struct utest_result *result)
+{
+	fprintf(stderr, "\n%s failed in the process of %s%.*s\n",
+		result->name, child_test,
+		(int)result->message_len, result->message);
+}
+
+static void run_child(struct unit_test *test, z_utest_run_fn run,
+		      struct child *c)
+{
+	in_child = true;
+	child_ring = z_utest_ring_get(rings, (int)(c - children));
+	child_tag = c->tag;
+	child_test = test->name;
+
+	z_utest_limits_apply((int)(c - children));
+	z_utest_capture_fork_child();
+	z_utest_report_set_sink(send_result);
+	/* The runner tears down what it built before forking */
+	z_utest_shared_fixtures_detach();
+
+	run(test);
+
+	/* What the test built only lives as long as this process */
+	z_utest_report_set_sink(print_teardown);
+	z_utest_shared_fixtures_teardown();
+
+	fflush(stdout);
+	fflush(stderr);
+	_exit(0);
+}
+
+bool z_utest_fork_report_death(const char *msg, size_t len)
+{
+	struct z_utest_ring_rec rec = {
+		.tag = child_tag,
+		.status = TC_FAIL,
+		.len = { (uint32_t)len, 0, 0 },
+	};
+	const char *const str[Z_UTEST_RING_STRINGS] = { msg, NULL, NULL };
+
+	if (!in_child || result_sent) {
+		return false;
+	}
+
+	result_sent = true;
+	z_utest_ring_push(child_ring, &rec, str);
+
+	return true;
+}
+
+/* ----------------------------- parent ------------------------------ */
+
+static uint64_t since(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t)(now.tv_sec - start->tv_sec) * 1000000000u +
+	       (uint64_t)(now.tv_nsec - start->tv_nsec);
+}
+
+/* Report a result of the child in slot @a c, which may retry its test */
+static void report(struct child *c, const struct utest_result *res)
+{
+	c->reported = true;
+	z_utest_flaky_expect(c->suite, c->name);
+	z_utest_report_result(res);
+	c->retry = z_utest_flaky_retry();
+	c->failed = !c->retry && z_utest_flaky_status() == TC_FAIL;
+}
+
+/* Report a result of the child the ring belongs to */
+static void take(const struct z_utest_ring_rec *rec, const char *data,
+		 void *arg)
+{
+	struct child *c = arg;
+	struct utest_result res = {
+		.suite = c->suite,
+		.name = c->name,
+		.status = rec->status,
+		.duration_ns = rec->duration_ns,
+		.message = data,
+		.message_len = rec->len[Z_UTEST_RING_MESSAGE],
+		.captured_stdout = data + rec->len[Z_UTEST_RING_MESSAGE],
+		.captured_stdout_len = rec->len[Z_UTEST_RING_STDOUT],
+		.captured_stderr = data + rec->len[Z_UTEST_RING_MESSAGE] +
+				   rec->len[Z_UTEST_RING_STDOUT],
+		.captured_stderr_len = rec->len[Z_UTEST_RING_STDERR],
+		.usage = rec->usage,
+	};
+
+	if (rec->tag != c->tag || c->reported) {
+		return;
+	}
+	report(c, &res);
+}
+
+static int spawn(struct unit_test *test, z_utest_run_fn run, struct child *c);
+
+static int respawn_slot(void *arg)
+{
+	struct child *c = arg;
+
+	return spawn(&c->test, c->run, c);
+}
+
+/* The child exited, report it if it did not, return 1 if it failed */
+static int finish(struct child *c, int status, const struct rusage *usage)
+{
+	struct utest_result res = {
+		.suite = c->suite,
+		.name = c->name,
+		.status = TC_FAIL,
+		.duration_ns = since(&c->start),
+	};
+	char msg[160];
+	int fail;
+
+	z_utest_ring_consume(z_utest_ring_get(rings, (int)(c - children)),
+			     take, c);
+
+	if (!c->reported) {
+		z_utest_usage_from(usage, NULL, &res.usage);
+		if (z_utest_limits_explain((int)(c - children), status, msg,
+					   sizeof(msg))) {
+			/* Went over a limit */
+		} else if (WIFSIGNALED(status)) {
+			snprintf(msg, sizeof(msg),
+				 "\n    test process killed by signal %d (%s)\n",
+				 WTERMSIG(status), strsignal(WTERMSIG(status)));
+		} else {
+			snprintf(msg, sizeof(msg),
+				 "\n    test process exited with status %d "
+				 "without a result\n",
+				 WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+		}
+		res.message = msg;
+		res.message_len = strlen(msg);
+		report(c, &res);
+	}
+
+	/* In a new process, keeping the slot, its resources and token */
+	if (c->retry) {
+		c->pid = 0;
+		c->reported = false;
+		c->retry = false;
+		running--;
+		return z_utest_param_run(c->params, c->param_index,
+					 respawn_slot, c);
+	}
+
+	fail = c->failed ? 1 : 0;
+	z_utest_resources_give(c->tags);
+	memset(c, 0, sizeof(*c));
+	running--;
+	z_utest_jobserver_done(running);
+
+	return fail;
+}
+
+/*
+ * Wait for children to exit, or for a jobserver token if @a token, return
+ * the number of failed tests
+ */
+static int reap(bool token)
+{
+	int fail = 0;
+	int n;
+
+	for (int i = 0; i < jobs; i++) {
+		fds[i].fd = children[i].pid ? children[i].fd : -1;
+		fds[i].events = POLLIN;
+		fds[i].revents = 0;
+	}
+	fds[jobs].fd = token ? z_utest_jobserver_fd() : -1;
+	fds[jobs].events = POLLIN;
+	fds[jobs].revents = 0;
+
+	n = poll(fds, (nfds_t)jobs + 1, -1);
+	if (n < 0) {
+		return 0;
+	}
+
+	/* Every result published so far, in one pass over the rings */
+	for (int i = 0; i < jobs; i++) {
+		if (children[i].pid) {
+			z_utest_ring_consume(z_utest_ring_get(rings, i), take,
+					     &children[i]);
+		}
+	}
+
+	for (int i = 0; i < jobs; i++) {
+		struct child *c = &children[i];
+		struct rusage usage = { 0 };
+		int status = 0;
+
+		if (!fds[i].revents) {
+			continue;
+		}
+
+		close(c->fd);
+		while (wait4(c->pid, &status, 0, &usage) < 0 && errno == EINTR) {
+		}
+		fail += finish(c, status, &usage);
+	}
+
+	return fail;
+}
+
+/* Start @a test in slot @a c, return the number of failed tests */
+static int spawn(struct unit_test *test, z_utest_run_fn run, struct child *c)
+{
+	int fds[2];
+	pid_t pid;
+
+	c->tag = ++spawned;
+	z_utest_limits_prepare((int)(c - children));
+
+	/* Do not hand buffered output over to the child */
+	fflush(stdout);
+	fflush(stderr);
+
+	if (pipe2(fds, O_CLOEXEC)) {
+		goto in_process;
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		close(fds[0]);
+		close(fds[1]);
+		goto in_process;
+	}
+
+	if (pid == 0) {
+		close(fds[0]);
+		run_child(test, run, c);
+	}
+
+	close(fds[1]);
+
+	c->pid = pid;
+	c->fd = fds[0];
+	c->tags = test->tags;
+	if (test->name != c->name) {
+		snprintf(c->name, sizeof(c->name), "%s", test->name);
+		c->suite = z_utest_report_current_suite();
+	}
+	c->test = *test;
+	c->test.name = c->name;
+	c->run = run;
+	c->params = z_utest_param_source();
+	c->param_index = utest_param_index();
+	clock_gettime(CLOCK_MONOTONIC, &c->start);
+	running++;
+
+	z_utest_report_test_dispatched(c->name);
+
+	return 0;
+
+in_process:
+	z_utest_jobserver_done(running);
+	do {
+		z_utest_flaky_expect(z_utest_report_current_suite(),
+				     test->name);
+		run(test);
+	} while (z_utest_flaky_retry());
+	z_utest_resources_give(test->tags);
+
+	return z_utest_flaky_status() == TC_FAIL;
+}
+
+static struct child *free_slot(void)
+{
+	for (int i = 0; i < jobs; i++) {
+		if (!children[i].pid) {
+			return &children[i];
+		}
+	}
+
+	return NULL;
+}
+
+/* Take a slot, the resources of @a test and a jobserver token, or nothing */
+static struct child *take_job(const struct unit_test *test)
+{
+	if (running >= jobs || !z_utest_resources_fit(test->tags, running) ||
+	    !z_utest_jobserver_start(running)) {
+		return NULL;
+	}
+
+	z_utest_resources_take(test->tags);
+
+	return free_slot();
+}
+
+/* Start the held back tests that can start now, in order */
+static int start_held(void)
+{
+	size_t kept = 0;
+	int fail = 0;
+
+	for (size_t i = 0; i < held_len; i++) {
+		struct child *c = take_job(&held[i].test);
+
+		if (c) {
+			fail += spawn(&held[i].test, held[i].run, c);
+		} else {
+			held[kept++] = held[i];
+		}
+	}
+	held_len = kept;
+
+	return fail;
+}
+
+/* Keep @a test for later, false if it cannot be */
+static bool hold(const struct unit_test *test, z_utest_run_fn run)
+{
+	/* The parameter of an instance is only valid while it is submitted */
+	if (jobs == 1 || z_utest_param_source()) {
+		return false;
+	}
+
+	if (held_len == held_size) {
+		size_t size = held_size ? 2 * held_size : 16;
+		struct held_test *grown = realloc(held, size * sizeof(*held));
+
+		if (!grown) {
+			return false;
+		}
+		held = grown;
+		held_size = size;
+	}
+
+	held[held_len].test = *test;
+	held[held_len].run = run;
+	held_len++;
+
+	return true;
+}
+
+int z_utest_fork_submit(struct unit_test *test, z_utest_run_fn run)
+{
+	int fail = start_held();
+	struct child *c;
+
+	/*
+	 * A free slot, the resources of the test, and a jobserver token when
+	 * others are busy. A test waiting for its resources lets the next
+	 * ones take the free slots.
+	 */
+	while (!(c = take_job(test))) {
+		bool fits = z_utest_resources_fit(test->tags, running);
+
+		if (running < jobs && !fits && hold(test, run)) {
+			return fail;
+		}
+		fail += reap(running < jobs && fits);
+		fail += start_held();
+	}
+
+	return fail + spawn(test, run, c);
+}
+
+int z_utest_fork_drain(void)
+{
+	int fail = start_held();
+
+	while (running) {
+		fail += reap(held_len && running < jobs);
+		fail += start_held();
+	}
+
+	return fail;
+}
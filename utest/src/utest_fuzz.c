@@ -0,0 +1,953 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define _GNU_SOURCE
+#include <utest.h>
+#include <utest_fuzz.h>
+#include <utest_rng.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define REPLAY_MAX_LEN (64u << 20)
+
+/* Exit status of a worker that found an input failing an assertion */
+#define FUZZ_EXIT_FAILURE 86
+
+/* The callbacks below must not be instrumented themselves */
+#if defined(__clang__)
+#define NO_COVERAGE __attribute__((no_sanitize("coverage")))
+#elif __GNUC__ >= 12
+#define NO_COVERAGE __attribute__((no_sanitize_coverage))
+#else
+#define NO_COVERAGE
+#endif
+
+/* ----------------------------- coverage ---------------------------- */
+
+/* Hit counters and buckets seen so far, indexed by guard, 0 is unused */
+static uint8_t *counters;
+static uint8_t *seen;
+static uint32_t guard_count;
+
+/* Edges seen through trace-pc, hashed into a fixed map */
+#define PC_MAP_SIZE (1u << 16)
+static uint8_t pc_counters[PC_MAP_SIZE];
+static uint8_t pc_seen[PC_MAP_SIZE];
+static uintptr_t pc_prev;
+static bool pc_used;
+
+NO_COVERAGE
+void __sanitizer_cov_trace_pc_guard_init(uint32_t *start, uint32_t *stop)
+{
+	size_t n = (size_t)(stop - start);
+	uint8_t *c;
+	uint8_t *s;
+
+	if (start == stop || *start) {
+		return;
+	}
+
+	c = realloc(counters, guard_count + n + 1);
+	s = c ? realloc(seen, guard_count + n + 1) : NULL;
+	if (!s) {
+		/* Leave these guards disabled */
+		counters = c;
+		return;
+	}
+
+	memset(c + guard_count + 1, 0, n);
+	memset(s + guard_count + 1, 0, n);
+	if (!guard_count) {
+		c[0] = 0;
+		s[0] = 0;
+	}
+	counters = c;
+	seen = s;
+
+	for (uint32_t *g = start; g < stop; g++) {
+		*g = ++guard_count;
+	}
+}
+
+NO_COVERAGE
+void __sanitizer_cov_trace_pc_guard(uint32_t *guard)
+{
+	counters[*guard]++;
+}
+
+/* GCC only has trace-pc, count edges between call sites like AFL does */
+NO_COVERAGE
+void __sanitizer_cov_trace_pc(void)
+{
+	uintptr_t pc = (uintptr_t)__builtin_return_address(0);
+	uintptr_t cur = (pc ^ (pc >> 16)) & (PC_MAP_SIZE - 1);
+
+	pc_counters[cur ^ pc_prev]++;
+	pc_prev = cur >> 1;
+	pc_used = true;
+}
+
+static bool instrumented(void)
+{
+	return guard_count || pc_used;
+}
+
+/* Hit counts are only compared by order of magnitude, like AFL does */
+static uint8_t bucket(uint8_t count)
+{
+	if (count < 4) {
+		return (uint8_t)(1u << (count - 1));
+	}
+	if (count < 8) {
+		return 1u << 3;
+	}
+	if (count < 16) {
+		return 1u << 4;
+	}
+	if (count < 32) {
+		return 1u << 5;
+	}
+	if (count < 128) {
+		return 1u << 6;
+	}
+	return 1u << 7;
+}
+
+static size_t collect_map(uint8_t *hits, uint8_t *known, size_t n)
+{
+	size_t fresh = 0;
+	size_t i = 0;
+
+	while (i < n) {
+		uint64_t word = 0;
+
+		/* Most counters are zero, skip them eight at a time */
+		if (i + 8 <= n) {
+			memcpy(&word, hits + i, sizeof(word));
+			if (!word) {
+				i += 8;
+				continue;
+			}
+		}
+
+		if (hits[i]) {
+			uint8_t b = bucket(hits[i]);
+
+			hits[i] = 0;
+			if (!(known[i] & b)) {
+				known[i] |= b;
+				fresh++;
+			}
+		}
+		i++;
+	}
+
+	return fresh;
+}
+
+/* Fold the counters of the last execution in, return the new features */
+static size_t collect(void)
+{
+	size_t fresh = collect_map(pc_counters, pc_seen, PC_MAP_SIZE);
+
+	if (guard_count) {
+		fresh += collect_map(counters + 1, seen + 1, guard_count);
+	}
+	pc_prev = 0;
+
+	return fresh;
+}
+
+static size_t features(void)
+{
+	size_t n = 0;
+
+	for (uint32_t i = 1; i <= guard_count; i++) {
+		n += (size_t)__builtin_popcount(seen[i]);
+	}
+	for (size_t i = 0; i < PC_MAP_SIZE; i++) {
+		n += (size_t)__builtin_popcount(pc_seen[i]);
+	}
+
+	return n;
+}
+
+/* ---------------------------- execution ---------------------------- */
+
+static utest_fuzz_fn target;
+static const uint8_t *volatile cur_data;
+static volatile size_t cur_len;
+
+static void call_target(void)
+{
+	target(cur_data, cur_len);
+}
+
+/* Run the target on a private copy, so that overreads can be caught */
+static int execute(const uint8_t *data, size_t len)
+{
+	uint8_t *copy = malloc(len ? len : 1);
+	int ret;
+
+	if (!copy) {
+		return TC_PASS;
+	}
+	if (len) {
+		memcpy(copy, data, len);
+	}
+
+	cur_data = copy;
+	cur_len = len;
+	z_utest_failure_reset();
+	ret = z_utest_try(call_target);
+	cur_data = NULL;
+	cur_len = 0;
+	free(copy);
+
+	return ret;
+}
+
+static uint8_t *read_file(const char *path, size_t max_len, size_t *len)
+{
+	FILE *f = fopen(path, "rb");
+	uint8_t *data;
+	size_t size = 0;
+
+	if (!f) {
+		return NULL;
+	}
+
+	data = malloc(max_len ? max_len : 1);
+	if (data) {
+		size = fread(data, 1, max_len, f);
+	}
+	fclose(f);
+
+	*len = size;
+
+	return data;
+}
+
+static int not_hidden(const struct dirent *d)
+{
+	return d->d_name[0] != '.';
+}
+
+/* --------------------------- replay mode --------------------------- */
+
+static void replay(const char *dir)
+{
+	struct dirent **names = NULL;
+	char path[Z_UTEST_PATH_MAX + sizeof(names[0]->d_name)];
+	int n;
+
+	if (execute(NULL, 0) == TC_FAIL) {
+		z_utest_failure_printf("    failing input: empty\n");
+		utest_fail();
+	}
+
+	n = scandir(dir, &names, not_hidden, alphasort);
+
+	for (int i = 0; i < n; i++) {
+		uint8_t *data;
+		size_t len;
+		int ret = TC_PASS;
+
+		snprintf(path, sizeof(path), "%s/%s", dir, names[i]->d_name);
+		data = read_file(path, REPLAY_MAX_LEN, &len);
+		if (data) {
+			ret = execute(data, len);
+			free(data);
+		}
+
+		if (ret == TC_FAIL) {
+			z_utest_failure_printf("    failing input: %s\n", path);
+			for (int j = i; j < n; j++) {
+				free(names[j]);
+			}
+			free(names);
+			utest_fail();
+		}
+		free(names[i]);
+	}
+
+	free(names);
+}
+
+/* ---------------------------- fuzz mode ---------------------------- */
+
+struct input {
+	uint8_t *data;
+	size_t len;
+};
+
+/* Shared by the workers and the test process */
+struct fuzz_shared {
+	uint64_t execs;
+	int claimed;
+	char crash_path[Z_UTEST_PATH_MAX];
+};
+
+static struct {
+	const char *dir;
+	size_t max_len;
+	int worker;
+	struct utest_rng rng;
+	struct input *inputs;
+	size_t count;
+	size_t cap;
+	/* Hashes of the corpus file names already loaded */
+	uint64_t *known;
+	size_t known_cap;
+	size_t known_count;
+	char crash_prefix[Z_UTEST_PATH_MAX];
+	struct fuzz_shared *shared;
+} fz;
+
+static bool known_insert(uint64_t hash)
+{
+	size_t i;
+
+	hash |= 1;
+
+	if (2 * (fz.known_count + 1) > fz.known_cap) {
+		size_t cap = fz.known_cap ? fz.known_cap * 2 : 1024;
+		uint64_t *known = calloc(cap, sizeof(*known));
+
+		if (!known) {
+			return true;
+		}
+		for (size_t j = 0; j < fz.known_cap; j++) {
+			if (!fz.known[j]) {
+				continue;
+			}
+			for (i = fz.known[j] & (cap - 1); known[i];
+			     i = (i + 1) & (cap - 1)) {
+			}
+			known[i] = fz.known[j];
+		}
+		free(fz.known);
+		fz.known = known;
+		fz.known_cap = cap;
+	}
+
+	for (i = hash & (fz.known_cap - 1); fz.known[i];
+	     i = (i + 1) & (fz.known_cap - 1)) {
+		if (fz.known[i] == hash) {
+			return false;
+		}
+	}
+	fz.known[i] = hash;
+	fz.known_count++;
+
+	return true;
+}
+
+static void corpus_add(const uint8_t *data, size_t len)
+{
+	struct input *in;
+
+	if (fz.count == fz.cap) {
+		size_t cap = fz.cap ? fz.cap * 2 : 256;
+
+		in = realloc(fz.inputs, cap * sizeof(*in));
+		if (!in) {
+			return;
+		}
+		fz.inputs = in;
+		fz.cap = cap;
+	}
+
+	in = &fz.inputs[fz.count];
+	in->data = malloc(len ? len : 1);
+	if (!in->data) {
+		return;
+	}
+	if (len) {
+		memcpy(in->data, data, len);
+	}
+	in->len = len;
+	fz.count++;
+}
+
+static void hex64(char *buf, uint64_t v)
+{
+	for (int i = 15; i >= 0; i--) {
+		buf[i] = "0123456789abcdef"[v & 0xf];
+		v >>= 4;
+	}
+	buf[16] = '\0';
+}
+
+/* Written atomically, other workers may be scanning the directory */
+static void corpus_save(const uint8_t *data, size_t len)
+{
+	char name[17];
+	char path[Z_UTEST_PATH_MAX];
+	char tmp[Z_UTEST_PATH_MAX];
+	uint64_t hash = utest_hash64(data, len, 0);
+	int fd;
+
+	hex64(name, hash);
+	known_insert(utest_hash64(name, 16, 0));
+
+	snprintf(path, sizeof(path), "%s/%s", fz.dir, name);
+	snprintf(tmp, sizeof(tmp), "%s/.tmp-%ld", fz.dir, (long)getpid());
+
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		return;
+	}
+	if (z_utest_write_all(fd, data, len) || close(fd) ||
+	    rename(tmp, path)) {
+		unlink(tmp);
+	}
+}
+
+/* Async-signal-safe, called from the crash handler */
+static void crash_save(const uint8_t *data, size_t len)
+{
+	char path[Z_UTEST_PATH_MAX];
+	size_t n = strlen(fz.crash_prefix);
+	int fd;
+
+	if ((!data && len) || n + 17 > sizeof(path)) {
+		return;
+	}
+
+	memcpy(path, fz.crash_prefix, n);
+	hex64(path + n, utest_hash64(data, len, 0));
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		return;
+	}
+	z_utest_write_all(fd, data, len);
+	close(fd);
+
+	if (!__atomic_exchange_n(&fz.shared->claimed, 1, __ATOMIC_SEQ_CST)) {
+		memcpy(fz.shared->crash_path, path, sizeof(path));
+	}
+}
+
+static void crash_save_current(void)
+{
+	crash_save(cur_data, cur_len);
+}
+
+static void crash_handler(int sig)
+{
+	crash_save_current();
+	raise(sig);
+}
+
+static void install_crash_handlers(void)
+{
+	static const int sigs[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+	struct sigaction sa = { .sa_handler = crash_handler };
+	stack_t ss = { .ss_size = 1 << 16 };
+	extern void __sanitizer_set_death_callback(void (*cb)(void))
+		__attribute__((weak));
+
+	/* Stack overflows must still be able to save their input */
+	ss.ss_sp = malloc(ss.ss_size);
+	if (ss.ss_sp && !sigaltstack(&ss, NULL)) {
+		sa.sa_flags = SA_ONSTACK;
+	}
+	sa.sa_flags |= SA_RESETHAND | SA_NODEFER;
+
+	for (size_t i = 0; i < sizeof(sigs) / sizeof(sigs[0]); i++) {
+		sigaction(sigs[i], &sa, NULL);
+	}
+
+	/* Sanitizers report errors and exit without a signal */
+	if (__sanitizer_set_death_callback) {
+		__sanitizer_set_death_callback(crash_save_current);
+	}
+}
+
+static const uint32_t interesting[] = {
+	0, 1, 0x7f, 0x80, 0xff, 0x100, 0x7fff, 0x8000, 0xffff, 0x10000,
+	0x7fffffff, 0x80000000, 0xffffffff, 16, 32, 64, 100, 1000, 1024, 4096,
+};
+
+static size_t pick(size_t n)
+{
+	return n ? (size_t)(utest_rng_next(&fz.rng) % n) : 0;
+}
+
+static size_t mutate(uint8_t *buf, size_t len, size_t max)
+{
+	size_t off = pick(len);
+	size_t n;
+
+	switch (utest_rng_next(&fz.rng) % 10) {
+	case 0: /* Flip a bit */
+		if (len) {
+			buf[off] ^= (uint8_t)(1u << pick(8));
+		}
+		break;
+	case 1: /* Set a random byte */
+		if (len) {
+			buf[off] = (uint8_t)utest_rng_next(&fz.rng);
+		}
+		break;
+	case 2: /* Insert random bytes */
+		n = 1 + pick(4);
+		if (len + n <= max) {
+			off = pick(len + 1);
+			memmove(buf + off + n, buf + off, len - off);
+			for (size_t i = 0; i < n; i++) {
+				buf[off + i] = (uint8_t)utest_rng_next(&fz.rng);
+			}
+			len += n;
+		}
+		break;
+	case 3: /* Erase bytes */
+		if (len > 1) {
+			n = 1 + pick(len - off < 16 ? len - off : 16);
+			if (off + n > len) {
+				n = len - off;
+			}
+			memmove(buf + off, buf + off + n, len - off - n);
+			len -= n;
+		}
+		break;
+	case 4: /* Copy a chunk over another place */
+		if (len > 1) {
+			size_t to = pick(len);
+
+			n = 1 + pick(len - (off > to ? off : to));
+			memmove(buf + to, buf + off, n);
+		}
+		break;
+	case 5: /* Duplicate a chunk */
+		if (len) {
+			n = 1 + pick(len - off < 32 ? len - off : 32);
+			if (len + n <= max) {
+				size_t to = pick(len);
+
+				memmove(buf + to + n, buf + to, len - to);
+				memmove(buf + to, buf + (off >= to ? off + n : off),
+					n);
+				len += n;
+			}
+		}
+		break;
+	case 6: { /* Write an interesting value */
+		uint32_t v = interesting[pick(sizeof(interesting) /
+					     sizeof(interesting[0]))];
+
+		n = (size_t)1 << pick(3);
+		if (len >= n) {
+			off = pick(len - n + 1);
+			if (utest_rng_next(&fz.rng) & 1) {
+				v = __builtin_bswap32(v) >> (32 - 8 * n);
+			}
+			memcpy(buf + off, &v, n);
+		}
+		break;
+	}
+	case 7: { /* Add or subtract a small number */
+		uint32_t v = 0;
+		int32_t delta = (int32_t)(1 + pick(35));
+
+		n = (size_t)1 << pick(3);
+		if (len >= n) {
+			off = pick(len - n + 1);
+			memcpy(&v, buf + off, n);
+			v += (utest_rng_next(&fz.rng) & 1) ? (uint32_t)delta
+							    : (uint32_t)-delta;
+			memcpy(buf + off, &v, n);
+		}
+		break;
+	}
+	case 8: { /* Splice in a chunk of another input */
+		const struct input *other = &fz.inputs[pick(fz.count)];
+
+		if (other->len) {
+			size_t from = pick(other->len);
+
+			n = 1 + pick(other->len - from);
+			if (len + n > max) {
+				n = max - len;
+			}
+			off = pick(len + 1);
+			memmove(buf + off + n, buf + off, len - off);
+			memcpy(buf + off, other->data + from, n);
+			len += n;
+		}
+		break;
+	}
+	default: /* Truncate */
+		if (len) {
+			len = pick(len);
+		}
+		break;
+	}
+
+	return len;
+}
+
+static uint64_t now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
+
+static void check(int ret, const uint8_t *data, size_t len)
+{
+	if (ret == TC_FAIL) {
+		crash_save(data, len);
+		_exit(FUZZ_EXIT_FAILURE);
+	}
+}
+
+/* Load corpus files not seen yet, keep the ones reaching new code */
+static void sync_corpus(void)
+{
+	struct dirent **names = NULL;
+	char path[Z_UTEST_PATH_MAX];
+	int n = scandir(fz.dir, &names, not_hidden, alphasort);
+
+	for (int i = 0; i < n; i++) {
+		const char *name = names[i]->d_name;
+		uint8_t *data;
+		size_t len;
+
+		if (known_insert(utest_hash64(name, strlen(name), 0))) {
+			snprintf(path, sizeof(path), "%s/%s", fz.dir, name);
+			data = read_file(path, fz.max_len, &len);
+			if (data) {
+				check(execute(data, len), data, len);
+				if (collect() || !fz.count) {
+					corpus_add(data, len);
+				}
+				free(data);
+			}
+		}
+		free(names[i]);
+	}
+
+	free(names);
+}
+
+static void status(const char *id, uint64_t start)
+{
+	uint64_t execs = __atomic_load_n(&fz.shared->execs, __ATOMIC_RELAXED);
+	uint64_t ms = now_ms() - start;
+
+	dprintf(z_utest_stdout_fd(),
+		"fuzz %s: %" PRIu64 " execs, %" PRIu64 " exec/s, "
+		"cov %zu, corpus %zu\n",
+		id, execs, ms ? execs * 1000 / ms : 0, features(), fz.count);
+}
+
+static void worker(const char *id, uint64_t deadline)
+{
+	uint64_t start = now_ms();
+	uint64_t next_sync = start + 1000;
+	uint64_t execs = 0;
+	uint8_t *buf = malloc(fz.max_len ? fz.max_len : 1);
+	int null = open("/dev/null", O_WRONLY | O_CLOEXEC);
+
+	/* The target's own output is of no interest here */
+	if (null >= 0) {
+		dup2(null, STDOUT_FILENO);
+		dup2(null, STDERR_FILENO);
+	}
+
+	install_crash_handlers();
+	utest_rng_seed(&fz.rng, now_ms() ^ ((uint64_t)getpid() << 32) ^
+					(uint64_t)fz.worker);
+
+	collect();
+	sync_corpus();
+	if (!fz.count) {
+		check(execute(NULL, 0), NULL, 0);
+		collect();
+		corpus_add(NULL, 0);
+	}
+
+	if (fz.worker == 0 && !instrumented()) {
+		dprintf(z_utest_stdout_fd(),
+			"fuzz %s: no coverage instrumentation, build the code "
+			"under test with -fsanitize-coverage=trace-pc-guard "
+			"(or trace-pc with GCC)\n",
+			id);
+	}
+
+	while (buf) {
+		const struct input *in = &fz.inputs[pick(fz.count)];
+		size_t len = in->len;
+		int stack = 1 << pick(4);
+
+		memcpy(buf, in->data, len);
+		for (int i = 0; i < stack; i++) {
+			len = mutate(buf, len, fz.max_len);
+		}
+
+		check(execute(buf, len), buf, len);
+		if (collect()) {
+			corpus_add(buf, len);
+			corpus_save(buf, len);
+		}
+
+		if (++execs % 256) {
+			continue;
+		}
+
+		__atomic_fetch_add(&fz.shared->execs, 256, __ATOMIC_RELAXED);
+		if (now_ms() >= next_sync) {
+			next_sync += 1000;
+			sync_corpus();
+			if (fz.worker == 0) {
+				status(id, start);
+			}
+			if (deadline && now_ms() >= deadline) {
+				break;
+			}
+		}
+	}
+
+	if (fz.worker == 0) {
+		status(id, start);
+	}
+	_exit(0);
+}
+
+static int make_dirs(const char *path)
+{
+	char buf[Z_UTEST_PATH_MAX];
+
+	snprintf(buf, sizeof(buf), "%s", path);
+
+	for (char *p = buf + 1; *p; p++) {
+		if (*p == '/') {
+			*p = '\0';
+			if (mkdir(buf, 0755) && errno != EEXIST) {
+				return -1;
+			}
+			*p = '/';
+		}
+	}
+
+	return (mkdir(buf, 0755) && errno != EEXIST) ? -1 : 0;
+}
+
+static void report(int status)
+{
+	const char *path = fz.shared->crash_path;
+	uint8_t *data = NULL;
+	size_t len = 0;
+
+	z_utest_failure_reset();
+
+	if (WIFEXITED(status) && WEXITSTATUS(status) == FUZZ_EXIT_FAILURE &&
+	    path[0]) {
+		data = read_file(path, fz.max_len, &len);
+	}
+
+	/* Replay assertion failures here to get their message */
+	if (data && execute(data, len) == TC_FAIL) {
+		z_utest_failure_printf("    failing input saved to %s\n", path);
+	} else if (WIFSIGNALED(status)) {
+		z_utest_failure_printf("\n    fuzz worker killed by signal %d "
+				       "(%s)\n    crashing input saved to %s\n",
+				       WTERMSIG(status),
+				       strsignal(WTERMSIG(status)),
+				       path[0] ? path : "(unknown)");
+	} else {
+		z_utest_failure_printf("\n    fuzz worker exited with status %d"
+				       "\n    failing input saved to %s\n",
+				       WIFEXITED(status) ? WEXITSTATUS(status)
+							 : -1,
+				       path[0] ? path : "(unknown)");
+	}
+
+	free(data);
+}
+
+/*
+ * Reap the workers, stopping the others when the first one finds
+ * something. Each holds the write end of a pipe of @a fds: the pipe
+ * closing tells a worker exited, and it alone is reaped, not the children
+ * the test itself may have.
+ */
+static bool reap_workers(const pid_t *pids, int *fds, long jobs, int *status)
+{
+	struct pollfd pfd[jobs];
+	bool failed = false;
+	long alive = 0;
+
+	for (long w = 0; w < jobs; w++) {
+		alive += fds[w] >= 0;
+	}
+
+	while (alive > 0) {
+		nfds_t n = 0;
+
+		for (long w = 0; w < jobs; w++) {
+			if (fds[w] >= 0) {
+				pfd[n++] = (struct pollfd){ .fd = fds[w],
+							    .events = POLLIN };
+			}
+		}
+		if (poll(pfd, n, -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+
+		for (long w = 0, i = 0; w < jobs; w++) {
+			int st = 0;
+
+			if (fds[w] < 0 || !pfd[i++].revents) {
+				continue;
+			}
+			close(fds[w]);
+			fds[w] = -1;
+			alive--;
+			while (waitpid(pids[w], &st, 0) < 0 && errno == EINTR) {
+			}
+
+			if (!failed && (!WIFEXITED(st) || WEXITSTATUS(st))) {
+				failed = true;
+				*status = st;
+				for (long k = 0; k < jobs; k++) {
+					if (fds[k] >= 0) {
+						kill(pids[k], SIGKILL);
+					}
+				}
+			}
+		}
+	}
+
+	return failed;
+}
+
+static void fuzz(const char *corpus, const char *id)
+{
+	long jobs = utest_option_long("fuzz-jobs", 0);
+	long seconds = utest_option_long("fuzz-time", 0);
+	uint64_t deadline = seconds > 0 ? now_ms() + 1000u * (uint64_t)seconds
+					 : 0;
+	char dir[Z_UTEST_PATH_MAX];
+	char file[Z_UTEST_TEST_ID_MAX + 16];
+	pid_t *pids;
+	int *fds;
+	int status = 0;
+	bool failed;
+
+	snprintf(dir, sizeof(dir), "%s/%s", corpus, id);
+	snprintf(file, sizeof(file), "%s-crash-", id);
+
+	if (make_dirs(dir) ||
+	    utest_cache_path("fuzz", file, fz.crash_prefix,
+			     sizeof(fz.crash_prefix))) {
+		z_utest_failure_printf("\n    cannot create %s\n", dir);
+		utest_fail();
+	}
+
+	if (jobs <= 0) {
+		jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	/* Tests fuzzing together in the fork mode share the CPUs */
+	jobs = z_utest_fork_workers(jobs > INT_MAX ? INT_MAX : (int)jobs);
+
+	fz.dir = dir;
+	fz.max_len = (size_t)utest_option_long("fuzz-max-len",
+					       CONFIG_utest_FUZZ_MAX_LEN);
+	fz.shared = mmap(NULL, sizeof(*fz.shared), PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	pids = calloc((size_t)jobs, sizeof(*pids));
+	fds = calloc((size_t)jobs, sizeof(*fds));
+	if (fz.shared == MAP_FAILED || !pids || !fds) {
+		z_utest_failure_printf("\n    cannot start fuzz workers\n");
+		utest_fail();
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+
+	for (long w = 0; w < jobs; w++) {
+		int pipefd[2];
+
+		fds[w] = -1;
+		if (pipe2(pipefd, O_CLOEXEC)) {
+			continue;
+		}
+
+		pids[w] = fork();
+		if (pids[w] == 0) {
+			close(pipefd[0]);
+			fz.worker = (int)w;
+			worker(id, deadline);
+		}
+
+		close(pipefd[1]);
+		if (pids[w] < 0) {
+			close(pipefd[0]);
+			continue;
+		}
+		fds[w] = pipefd[0];
+	}
+
+	failed = reap_workers(pids, fds, jobs, &status);
+
+	free(pids);
+	free(fds);
+
+	if (failed) {
+		report(status);
+	}
+	munmap(fz.shared, sizeof(*fz.shared));
+	fz.shared = NULL;
+
+	if (failed) {
+		utest_fail();
+	}
+}
+
+void z_utest_fuzz_run(utest_fuzz_fn fn)
+{
+	const char *corpus = utest_option("corpus-dir");
+	char id[Z_UTEST_TEST_ID_MAX];
+	char dir[Z_UTEST_PATH_MAX];
+
+	if (!corpus || !*corpus) {
+		corpus = "corpus";
+	}
+
+	utest_test_id(z_utest_report_current_suite(),
+		      z_utest_report_current_test(), id, sizeof(id));
+
+	target = fn;
+
+	if (utest_option_enabled("fuzz")) {
+		fuzz(corpus, id);
+		return;
+	}
+
+	snprintf(dir, sizeof(dir), "%s/%s", corpus, id);
+	utest_depend_file(dir);
+	replay(dir);
+}
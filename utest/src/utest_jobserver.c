@@ -0,0 +1,250 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define _GNU_SOURCE
+#include <utest.h>
+#include <utest_jobserver.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static bool initialized;
+/* N of the -jN of make, 0 if unknown */
+static int make_jobs;
+/* Non-blocking, private to this process; -1 without jobserver */
+static int read_fd = -1;
+static int write_fd = -1;
+/* Tokens taken, make wants the same bytes back */
+static char *held;
+static size_t held_len;
+static size_t held_size;
+/* Tokens held by a parent are not for its forked children to give back */
+static pid_t owner;
+
+static void release_all(void);
+
+static void claim(void)
+{
+	if (owner != getpid()) {
+		owner = getpid();
+		held_len = 0;
+	}
+}
+
+/*
+ * A read end of its own, not to turn the shared pipe non-blocking for make
+ * and everyone else. Without it, a token could be taken by another process
+ * between poll() and read(), leaving the runner blocked with test processes
+ * to reap.
+ */
+static int reopen(int fd, int flags)
+{
+	char path[32];
+
+	if (fcntl(fd, F_GETFD) < 0) {
+		return -1;
+	}
+
+	snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+
+	return open(path, flags | O_NONBLOCK | O_CLOEXEC);
+}
+
+/* Value of the last `name` argument of the make flags, or NULL */
+static const char *flag(const char *flags, const char *name, char *value,
+			size_t size)
+{
+	const char *found = NULL;
+	size_t len = strlen(name);
+
+	for (const char *it = strstr(flags, name); it;
+	     it = strstr(it + 1, name)) {
+		found = it + len;
+	}
+	if (!found) {
+		return NULL;
+	}
+
+	len = strcspn(found, " ");
+	if (len >= size) {
+		return NULL;
+	}
+	memcpy(value, found, len);
+	value[len] = '\0';
+
+	return value;
+}
+
+static void connect_to(const char *flags)
+{
+	char value[256];
+	const char *auth = flag(flags, "--jobserver-auth=", value,
+				sizeof(value));
+	int r;
+	int w;
+
+	for (const char *it = strstr(flags, "-j"); it;
+	     it = strstr(it + 1, "-j")) {
+		if (isdigit((unsigned char)it[2])) {
+			make_jobs = atoi(it + 2);
+		}
+	}
+
+	if (!auth) {
+		auth = flag(flags, "--jobserver-fds=", value, sizeof(value));
+	}
+	if (!auth) {
+		return;
+	}
+
+	if (!strncmp(auth, "fifo:", 5)) {
+		read_fd = open(auth + 5, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+		write_fd = read_fd;
+	} else if (sscanf(auth, "%d,%d", &r, &w) == 2 &&
+		   fcntl(w, F_GETFD) >= 0) {
+		read_fd = reopen(r, O_RDONLY);
+		write_fd = w;
+	}
+
+	if (read_fd < 0) {
+		write_fd = -1;
+	}
+}
+
+void z_utest_jobserver_init(void)
+{
+	const char *flags = getenv("MAKEFLAGS");
+
+	if (initialized) {
+		return;
+	}
+	initialized = true;
+	owner = getpid();
+
+	if (flags) {
+		connect_to(flags);
+	}
+	if (read_fd >= 0) {
+		atexit(release_all);
+	}
+}
+
+/*
+ * Serve @a jobs jobs to the processes started from now on, when there is
+ * no jobserver already: the runner keeps one, the pipe holds the others.
+ */
+bool z_utest_jobserver_create(int jobs)
+{
+	const char *flags = getenv("MAKEFLAGS");
+	char *value;
+	int fds[2];
+	int n;
+
+	z_utest_jobserver_init();
+	if (read_fd >= 0 || jobs <= 1) {
+		return read_fd >= 0;
+	}
+
+	/* Inherited on purpose, as make does */
+	if (pipe(fds)) {
+		return false;
+	}
+	for (int i = 1; i < jobs; i++) {
+		if (z_utest_write_all(fds[1], "+", 1)) {
+			break;
+		}
+	}
+
+	n = asprintf(&value, "%s -j%d --jobserver-auth=%d,%d",
+		     flags ? flags : "", jobs, fds[0], fds[1]);
+	if (n < 0) {
+		close(fds[0]);
+		close(fds[1]);
+		return false;
+	}
+	connect_to(value);
+	if (read_fd < 0) {
+		free(value);
+		close(fds[0]);
+		close(fds[1]);
+		return false;
+	}
+	setenv("MAKEFLAGS", value, 1);
+	free(value);
+	atexit(release_all);
+
+	return true;
+}
+
+int z_utest_jobserver_fd(void)
+{
+	return read_fd;
+}
+
+/* Number of jobs of the jobserver, 0 without one or if unknown */
+int z_utest_jobserver_jobs(void)
+{
+	return read_fd >= 0 ? make_jobs : 0;
+}
+
+/*
+ * Called before starting a job while @a running others run: true if it may
+ * start. The first job runs on the token of the runner.
+ */
+bool z_utest_jobserver_start(int running)
+{
+	char token;
+	ssize_t n;
+
+	claim();
+	if (read_fd < 0 || running <= 0 || held_len >= (size_t)running) {
+		return true;
+	}
+
+	if (held_len == held_size) {
+		size_t size = held_size ? 2 * held_size : 16;
+		char *grown = realloc(held, size);
+
+		if (!grown) {
+			return false;
+		}
+		held = grown;
+		held_size = size;
+	}
+
+	do {
+		n = read(read_fd, &token, 1);
+	} while (n < 0 && errno == EINTR);
+	if (n != 1) {
+		return false;
+	}
+	held[held_len++] = token;
+
+	return true;
+}
+
+/* Called after a job ended, give back the tokens @a running jobs do not use */
+void z_utest_jobserver_done(int running)
+{
+	size_t keep = running > 1 ? (size_t)running - 1 : 0;
+
+	claim();
+	while (held_len > keep) {
+		if (z_utest_write_all(write_fd, &held[held_len - 1], 1)) {
+			break;
+		}
+		held_len--;
+	}
+}
+
+static void release_all(void)
+{
+	if (owner == getpid()) {
+		z_utest_jobserver_done(0);
+	}
+}
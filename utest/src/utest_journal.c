@@ -0,0 +1,551 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define _GNU_SOURCE
+#include <utest.h>
+#include <utest_journal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAGIC "UTESTJ01"
+/* The file grows by doubling from there */
+#define MIN_MAP_SIZE (1024 * 1024)
+
+enum record_type {
+	RECORD_START,
+	RECORD_END,
+};
+
+/* Strings of a record, in this order, each followed by a NUL */
+enum {
+	STR_SUITE,
+	STR_NAME,
+	STR_MESSAGE,
+	STR_STDOUT,
+	STR_STDERR,
+	STR_COUNT
+};
+
+struct header {
+	char magic[8];
+	/* Bytes of complete records after the header */
+	uint64_t used;
+};
+
+struct record {
+	/* Hash of the rest of the record, to find a torn one */
+	uint64_t check;
+	/* Of the whole record, padded to 8 bytes */
+	uint32_t size;
+	uint32_t type;
+	int32_t status;
+	uint32_t len[STR_COUNT];
+	uint64_t duration_ns;
+	struct utest_usage usage;
+};
+
+static struct {
+	int fd;
+	char *map;
+	size_t map_size;
+	long sync_ms;
+	struct timespec synced;
+	/* Set while results from the journal go to the reporters */
+	bool replaying;
+	/* Offsets of the last record of each test, open addressing */
+	uint64_t *keys;
+	uint64_t *offsets;
+	size_t slots;
+	size_t count;
+} journal = { .fd = -1 };
+
+static struct header *header(void)
+{
+	return (struct header *)journal.map;
+}
+
+static struct record *record_at(uint64_t offset)
+{
+	return (struct record *)(journal.map + offset);
+}
+
+static const char *record_str(const struct record *rec, int which)
+{
+	const char *str = (const char *)(rec + 1);
+
+	for (int i = 0; i < which; i++) {
+		str += rec->len[i] + 1;
+	}
+
+	return str;
+}
+
+static uint64_t test_key(const char *suite, const char *name)
+{
+	return utest_hash64(name, strlen(name),
+			    utest_hash64(suite, strlen(suite), 0));
+}
+
+static bool same_test(const struct record *rec, const char *suite,
+		      const char *name)
+{
+	return !strcmp(record_str(rec, STR_SUITE), suite) &&
+	       !strcmp(record_str(rec, STR_NAME), name);
+}
+
+/* Slot of the test, or the empty slot where it goes; offset 0 is free */
+static size_t find_slot(uint64_t key, const char *suite, const char *name)
+{
+	size_t i = key & (journal.slots - 1);
+
+	while (journal.offsets[i] &&
+	       (journal.keys[i] != key ||
+		!same_test(record_at(journal.offsets[i]), suite, name))) {
+		i = (i + 1) & (journal.slots - 1);
+	}
+
+	return i;
+}
+
+static bool index_grow(void)
+{
+	uint64_t *keys = journal.keys;
+	uint64_t *offsets = journal.offsets;
+	size_t slots = journal.slots;
+
+	journal.slots = slots ? slots * 2 : 256;
+	journal.keys = calloc(journal.slots, sizeof(*journal.keys));
+	journal.offsets = calloc(journal.slots, sizeof(*journal.offsets));
+	if (!journal.keys || !journal.offsets) {
+		free(journal.keys);
+		free(journal.offsets);
+		journal.keys = keys;
+		journal.offsets = offsets;
+		journal.slots = slots;
+		return false;
+	}
+
+	for (size_t i = 0; i < slots; i++) {
+		size_t j = keys[i] & (journal.slots - 1);
+
+		if (!offsets[i]) {
+			continue;
+		}
+		while (journal.offsets[j]) {
+			j = (j + 1) & (journal.slots - 1);
+		}
+		journal.keys[j] = keys[i];
+		journal.offsets[j] = offsets[i];
+	}
+
+	free(keys);
+	free(offsets);
+
+	return true;
+}
+
+/* Make the record at @a offset the last one of its test */
+static void index_add(uint64_t offset)
+{
+	const struct record *rec = record_at(offset);
+	const char *suite = record_str(rec, STR_SUITE);
+	const char *name = record_str(rec, STR_NAME);
+	uint64_t key = test_key(suite, name);
+	size_t i;
+
+	if (journal.count * 2 >= journal.slots && !index_grow()) {
+		return;
+	}
+
+	i = find_slot(key, suite, name);
+	if (!journal.offsets[i]) {
+		journal.count++;
+	}
+	journal.keys[i] = key;
+	journal.offsets[i] = offset;
+}
+
+static void index_free(void)
+{
+	free(journal.keys);
+	free(journal.offsets);
+	journal.keys = NULL;
+	journal.offsets = NULL;
+	journal.slots = 0;
+	journal.count = 0;
+}
+
+static uint64_t record_check(const struct record *rec)
+{
+	return utest_hash64((const char *)rec + sizeof(rec->check),
+			    rec->size - sizeof(rec->check), 0);
+}
+
+static bool record_valid(const struct record *rec, uint64_t room)
+{
+	uint64_t size = sizeof(*rec);
+
+	if (room < sizeof(*rec) || rec->size > room || rec->size % 8) {
+		return false;
+	}
+
+	for (int i = 0; i < STR_COUNT; i++) {
+		size += (uint64_t)rec->len[i] + 1;
+	}
+
+	return size <= rec->size && rec->check == record_check(rec);
+}
+
+static void journal_sync(void)
+{
+	msync(journal.map, sizeof(struct header) + header()->used, MS_SYNC);
+	/* The size of the file, when it grew */
+	fdatasync(journal.fd);
+	clock_gettime(CLOCK_MONOTONIC, &journal.synced);
+}
+
+static void journal_close(void)
+{
+	uint64_t size;
+
+	if (journal.fd < 0) {
+		return;
+	}
+
+	journal_sync();
+	size = sizeof(struct header) + header()->used;
+	munmap(journal.map, journal.map_size);
+	/* Or the file keeps the room it had to grow into */
+	if (ftruncate(journal.fd, (off_t)size)) {
+		/* Only a waste of room, the journal reads the same */
+	}
+	close(journal.fd);
+	journal.fd = -1;
+	journal.map = NULL;
+	index_free();
+}
+
+static bool map_file(size_t size)
+{
+	if (ftruncate(journal.fd, (off_t)size)) {
+		return false;
+	}
+
+	journal.map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			   journal.fd, 0);
+	if (journal.map == MAP_FAILED) {
+		journal.map = NULL;
+		return false;
+	}
+	journal.map_size = size;
+
+	return true;
+}
+
+/* Make room for @a size more bytes of records */
+static bool reserve(size_t size)
+{
+	size_t need = sizeof(struct header) + header()->used + size;
+	size_t grown = journal.map_size;
+	void *map;
+
+	if (need <= journal.map_size) {
+		return true;
+	}
+
+	while (grown < need) {
+		grown *= 2;
+	}
+
+	if (ftruncate(journal.fd, (off_t)grown)) {
+		return false;
+	}
+	map = mremap(journal.map, journal.map_size, grown, MREMAP_MAYMOVE);
+	if (map == MAP_FAILED) {
+		return false;
+	}
+	journal.map = map;
+	journal.map_size = grown;
+
+	return true;
+}
+
+/* Index the records of a journal, dropping what a crash left half written */
+static void load(void)
+{
+	uint64_t offset = sizeof(struct header);
+	uint64_t end = journal.map_size;
+
+	if (sizeof(struct header) + header()->used < end) {
+		end = sizeof(struct header) + header()->used;
+	}
+
+	while (offset < end && record_valid(record_at(offset), end - offset)) {
+		index_add(offset);
+		offset += record_at(offset)->size;
+	}
+
+	header()->used = offset - sizeof(struct header);
+}
+
+static bool journal_open(const char *path, bool resume)
+{
+	struct header head;
+	struct stat st;
+	size_t size = MIN_MAP_SIZE;
+
+	journal.fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC |
+					(resume ? 0 : O_TRUNC),
+			  0644);
+	if (journal.fd < 0 || fstat(journal.fd, &st)) {
+		fprintf(stderr, "utest: cannot open journal %s: %s\n", path,
+			strerror(errno));
+		goto fail;
+	}
+
+	/* Before the file grows to be mapped */
+	if (st.st_size &&
+	    (pread(journal.fd, &head, sizeof(head), 0) != sizeof(head) ||
+	     memcmp(head.magic, MAGIC, sizeof(head.magic)))) {
+		fprintf(stderr, "utest: %s is not a journal\n", path);
+		goto fail;
+	}
+
+	while (size < (size_t)st.st_size) {
+		size *= 2;
+	}
+	if (!map_file(size)) {
+		fprintf(stderr, "utest: cannot map journal %s: %s\n", path,
+			strerror(errno));
+		goto fail;
+	}
+
+	if (st.st_size) {
+		load();
+	} else {
+		memcpy(header()->magic, MAGIC, sizeof(header()->magic));
+		header()->used = 0;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &journal.synced);
+
+	return true;
+
+fail:
+	if (journal.fd >= 0) {
+		close(journal.fd);
+		journal.fd = -1;
+	}
+
+	return false;
+}
+
+static void append(enum record_type type, const struct utest_result *result)
+{
+	const char *strs[STR_COUNT] = {
+		result->suite,
+		result->name,
+		result->message ? result->message : "",
+		result->captured_stdout ? result->captured_stdout : "",
+		result->captured_stderr ? result->captured_stderr : "",
+	};
+	size_t lens[STR_COUNT] = {
+		strlen(result->suite),
+		strlen(result->name),
+		result->message ? result->message_len : 0,
+		result->captured_stdout ? result->captured_stdout_len : 0,
+		result->captured_stderr ? result->captured_stderr_len : 0,
+	};
+	size_t size = sizeof(struct record);
+	uint64_t offset;
+	struct record *rec;
+	char *str;
+
+	for (int i = 0; i < STR_COUNT; i++) {
+		size += lens[i] + 1;
+	}
+	size = (size + 7) & ~(size_t)7;
+
+	if (size > UINT32_MAX || !reserve(size)) {
+		fprintf(stderr, "utest: journal full, results of %s not kept\n",
+			result->name);
+		return;
+	}
+
+	offset = sizeof(struct header) + header()->used;
+	rec = record_at(offset);
+	memset(rec, 0, size);
+	rec->size = (uint32_t)size;
+	rec->type = type;
+	rec->status = result->status;
+	rec->duration_ns = result->duration_ns;
+	rec->usage = result->usage;
+
+	str = (char *)(rec + 1);
+	for (int i = 0; i < STR_COUNT; i++) {
+		rec->len[i] = (uint32_t)lens[i];
+		memcpy(str, strs[i], lens[i]);
+		str += lens[i] + 1;
+	}
+	rec->check = record_check(rec);
+
+	/* Only now is the record part of the journal */
+	header()->used += size;
+	index_add(offset);
+}
+
+static uint64_t ms_since(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t)(now.tv_sec - start->tv_sec) * 1000u +
+	       (uint64_t)(now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+/* ------------------------- reporter -------------------------------- */
+
+static void journal_test_start(struct utest_reporter *rep, const char *suite,
+			       const char *name)
+{
+	(void)rep;
+
+	/*
+	 * A test run in process takes the runner with it when it crashes,
+	 * the start record tells the next run. In the fork mode the runner
+	 * reports such a crash itself.
+	 */
+	if (journal.fd < 0 || journal.replaying || utest_fork_enabled()) {
+		return;
+	}
+
+	append(RECORD_START, &(struct utest_result){
+				     .suite = suite,
+				     .name = name,
+			     });
+}
+
+static void journal_test_end(struct utest_reporter *rep,
+			     const struct utest_result *result)
+{
+	(void)rep;
+
+	if (journal.fd < 0 || journal.replaying) {
+		return;
+	}
+
+	append(RECORD_END, result);
+	if (journal.sync_ms <= 0 ||
+	    ms_since(&journal.synced) >= (uint64_t)journal.sync_ms) {
+		journal_sync();
+	}
+}
+
+static void journal_run_end(struct utest_reporter *rep, int result)
+{
+	(void)rep;
+	(void)result;
+
+	journal_close();
+}
+
+static struct utest_reporter journal_reporter = {
+	.name = "journal",
+	.on_test_start = journal_test_start,
+	.on_test_end = journal_test_end,
+	.on_run_end = journal_run_end,
+};
+
+void z_utest_journal_init(void)
+{
+	const char *path = utest_option("journal");
+	bool resume = utest_option_enabled("resume");
+	char def[PATH_MAX];
+
+	journal_close();
+
+	if (!path && !resume) {
+		return;
+	}
+
+	if (!path || !*path) {
+		if (utest_cache_path("journal", "results", def, sizeof(def))) {
+			fprintf(stderr, "utest: no room for the journal\n");
+			return;
+		}
+		path = def;
+	}
+
+	journal.sync_ms = utest_option_long("journal-sync", 1000);
+	if (journal_open(path, resume)) {
+		utest_register_reporter(&journal_reporter);
+	}
+}
+
+/*
+ * Hand the result the journal has for a test to the reporters, return its
+ * status, or -1 if the test still has to run.
+ */
+int z_utest_journal_replay(const char *suite, const char *name)
+{
+	struct utest_result res;
+	const struct record *rec;
+	size_t i;
+
+	if (journal.fd < 0 || !journal.count || !utest_option_enabled("resume")) {
+		return -1;
+	}
+
+	i = find_slot(test_key(suite, name), suite, name);
+	if (!journal.offsets[i]) {
+		return -1;
+	}
+	rec = record_at(journal.offsets[i]);
+
+	journal.replaying = true;
+	z_utest_report_test_dispatched(name);
+
+	if (rec->type == RECORD_START) {
+		static const char msg[] =
+			"\n    the runner died while this test ran\n";
+
+		/* Journaled as ended, a next resume does not see it again */
+		journal.replaying = false;
+		res = (struct utest_result){
+			.suite = suite,
+			.name = name,
+			.status = TC_FAIL,
+			.message = msg,
+			.message_len = sizeof(msg) - 1,
+		};
+	} else {
+		res = (struct utest_result){
+			.suite = suite,
+			.name = name,
+			.status = rec->status,
+			.duration_ns = rec->duration_ns,
+			.message = record_str(rec, STR_MESSAGE),
+			.message_len = rec->len[STR_MESSAGE],
+			.captured_stdout = record_str(rec, STR_STDOUT),
+			.captured_stdout_len = rec->len[STR_STDOUT],
+			.captured_stderr = record_str(rec, STR_STDERR),
+			.captured_stderr_len = rec->len[STR_STDERR],
+			.usage = rec->usage,
+		};
+	}
+
+	z_utest_report_result(&res);
+	journal.replaying = false;
+
+	return res.status;
+}
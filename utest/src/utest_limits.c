@@ -0,0 +1,374 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define _GNU_SOURCE
+#include <utest.h>
+#include <utest_limits.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+struct limit {
+	const char *option;
+	int resource;
+	bool set;
+	unsigned long long value;
+};
+
+static struct limit limits[] = {
+	{ "limit-as", RLIMIT_AS, false, 0 },
+	{ "limit-cpu", RLIMIT_CPU, false, 0 },
+	{ "limit-nofile", RLIMIT_NOFILE, false, 0 },
+};
+
+#define LIMIT_AS (&limits[0])
+#define LIMIT_CPU (&limits[1])
+
+static unsigned long long limit_memory;
+/* Cgroup the slot cgroups are created in, "" without limit-memory */
+static char cgroup_dir[PATH_MAX];
+static pid_t owner;
+/* OOM kills of each slot cgroup before its current test */
+static unsigned long long *oom_kills;
+static int slots;
+
+/* A number with an optional K, M or G suffix */
+static bool parse_size(const char *value, unsigned long long *size)
+{
+	unsigned long long n;
+	unsigned int shift = 0;
+	char *end;
+
+	if (!value || !*value) {
+		return false;
+	}
+
+	errno = 0;
+	n = strtoull(value, &end, 0);
+	switch (toupper((unsigned char)*end)) {
+	case 'K':
+		shift = 10;
+		break;
+	case 'M':
+		shift = 20;
+		break;
+	case 'G':
+		shift = 30;
+		break;
+	}
+	if (shift) {
+		end++;
+	}
+	if (errno || end == value || *end || n > (ULLONG_MAX >> shift)) {
+		return false;
+	}
+
+	*size = n << shift;
+
+	return true;
+}
+
+static int write_file(const char *dir, const char *file, const char *value)
+{
+	char path[PATH_MAX];
+	int fd;
+	int ret;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, file);
+	fd = open(path, O_WRONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return -1;
+	}
+	ret = z_utest_write_all(fd, value, strlen(value));
+	if (close(fd)) {
+		ret = -1;
+	}
+
+	return ret;
+}
+
+static bool read_file(const char *dir, const char *file, char *buf,
+		      size_t size)
+{
+	char path[PATH_MAX];
+	ssize_t n;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, file);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return false;
+	}
+	n = read(fd, buf, size - 1);
+	close(fd);
+	if (n < 0) {
+		return false;
+	}
+	buf[n] = '\0';
+
+	return true;
+}
+
+/* Check whether the space separated @a list has @a word */
+static bool has_word(const char *list, const char *word)
+{
+	size_t len = strlen(word);
+
+	for (const char *it = strstr(list, word); it;
+	     it = strstr(it + 1, word)) {
+		if ((it == list || isspace((unsigned char)it[-1])) &&
+		    (!it[len] || isspace((unsigned char)it[len]))) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void slot_dir(int slot, char *path, size_t size)
+{
+	snprintf(path, size, "%.3800s/utest-%d-%d", cgroup_dir, (int)owner,
+		 slot);
+}
+
+static unsigned long long oom_count(const char *dir)
+{
+	char events[512];
+	const char *kill;
+
+	if (!read_file(dir, "memory.events", events, sizeof(events))) {
+		return 0;
+	}
+	kill = strstr(events, "oom_kill ");
+
+	return kill ? strtoull(kill + 9, NULL, 10) : 0;
+}
+
+static void cgroup_cleanup(void)
+{
+	char dir[PATH_MAX];
+
+	if (owner != getpid()) {
+		return;
+	}
+	for (int i = 0; i < slots; i++) {
+		slot_dir(i, dir, sizeof(dir));
+		rmdir(dir);
+	}
+}
+
+/* Use @a dir for the slot cgroups if their memory can be limited there */
+static bool cgroup_init(const char *dir)
+{
+	char buf[512];
+
+	if (!dir || !*dir ||
+	    !read_file(dir, "cgroup.controllers", buf, sizeof(buf)) ||
+	    !has_word(buf, "memory")) {
+		return false;
+	}
+
+	if (!read_file(dir, "cgroup.subtree_control", buf, sizeof(buf)) ||
+	    !has_word(buf, "memory")) {
+		write_file(dir, "cgroup.subtree_control", "+memory");
+		if (!read_file(dir, "cgroup.subtree_control", buf,
+			       sizeof(buf)) ||
+		    !has_word(buf, "memory")) {
+			return false;
+		}
+	}
+
+	snprintf(cgroup_dir, sizeof(cgroup_dir), "%s", dir);
+	atexit(cgroup_cleanup);
+
+	return true;
+}
+
+/* Read the limit options, return true if there is any */
+bool z_utest_limits_init(void)
+{
+	bool any = false;
+
+	owner = getpid();
+
+	for (size_t i = 0; i < sizeof(limits) / sizeof(limits[0]); i++) {
+		const char *value = utest_option(limits[i].option);
+
+		limits[i].set = parse_size(value, &limits[i].value);
+		if (value && !limits[i].set) {
+			fprintf(stderr, "utest: invalid %s=%s\n",
+				limits[i].option, value);
+		}
+		any |= limits[i].set;
+	}
+
+	if (parse_size(utest_option("limit-memory"), &limit_memory)) {
+		any = true;
+		if (!cgroup_init(utest_option("cgroup")) && !LIMIT_AS->set) {
+			fprintf(stderr, "utest: no usable cgroup, limit-memory "
+					"applies to the address space\n");
+			LIMIT_AS->set = true;
+			LIMIT_AS->value = limit_memory;
+		}
+	}
+
+	return any;
+}
+
+/* Called by the runner before a test starts in job slot @a slot */
+void z_utest_limits_prepare(int slot)
+{
+	char dir[PATH_MAX];
+	char value[32];
+
+	if (!*cgroup_dir) {
+		return;
+	}
+
+	if (slot >= slots) {
+		unsigned long long *grown =
+			realloc(oom_kills, (size_t)(slot + 1) * sizeof(*grown));
+
+		if (!grown) {
+			return;
+		}
+		memset(grown + slots, 0, (size_t)(slot + 1 - slots) *
+						 sizeof(*grown));
+		oom_kills = grown;
+		slots = slot + 1;
+	}
+
+	slot_dir(slot, dir, sizeof(dir));
+	if (mkdir(dir, 0755) && errno != EEXIST) {
+		return;
+	}
+
+	snprintf(value, sizeof(value), "%llu", limit_memory);
+	write_file(dir, "memory.max", value);
+	/* Or the limit only makes the test swap */
+	write_file(dir, "memory.swap.max", "0");
+	oom_kills[slot] = oom_count(dir);
+}
+
+static void set_limit(int resource, rlim_t soft, rlim_t hard)
+{
+	struct rlimit lim;
+
+	if (getrlimit(resource, &lim)) {
+		return;
+	}
+
+	/* Lowering the hard limit is always allowed, raising it is not */
+	if (hard < lim.rlim_max) {
+		lim.rlim_max = hard;
+	}
+	lim.rlim_cur = soft < lim.rlim_max ? soft : lim.rlim_max;
+	setrlimit(resource, &lim);
+}
+
+/* Called in the test process of job slot @a slot */
+void z_utest_limits_apply(int slot)
+{
+	char dir[PATH_MAX];
+
+	if (*cgroup_dir) {
+		slot_dir(slot, dir, sizeof(dir));
+		if (write_file(dir, "cgroup.procs", "0")) {
+			fprintf(stderr, "utest: cannot join cgroup %s: %s\n",
+				dir, strerror(errno));
+		}
+	}
+
+	for (size_t i = 0; i < sizeof(limits) / sizeof(limits[0]); i++) {
+		rlim_t value = (rlim_t)limits[i].value;
+
+		if (!limits[i].set) {
+			continue;
+		}
+
+		/* SIGXCPU at the soft limit, a second later SIGKILL */
+		set_limit(limits[i].resource, value,
+			  &limits[i] == LIMIT_CPU ? value + 1 : value);
+	}
+}
+
+/*
+ * Describe in @a msg how the test process of @a slot went over a limit, if
+ * that is why it ended with @a status.
+ */
+bool z_utest_limits_explain(int slot, int status, char *msg, size_t size)
+{
+	char dir[PATH_MAX];
+
+	if (!WIFSIGNALED(status)) {
+		return false;
+	}
+
+	if (*cgroup_dir && slot < slots) {
+		slot_dir(slot, dir, sizeof(dir));
+		if (oom_count(dir) > oom_kills[slot]) {
+			snprintf(msg, size,
+				 "\n    test process went over limit-memory "
+				 "(%llu bytes) and was killed\n",
+				 limit_memory);
+			return true;
+		}
+	}
+
+	if (LIMIT_CPU->set && WTERMSIG(status) == SIGXCPU) {
+		snprintf(msg, size,
+			 "\n    test process went over limit-cpu (%llu s)\n",
+			 LIMIT_CPU->value);
+		return true;
+	}
+
+	/* The hard limit, if SIGXCPU did not end it */
+	if (LIMIT_CPU->set && WTERMSIG(status) == SIGKILL) {
+		snprintf(msg, size,
+			 "\n    test process killed by signal %d (%s), it may "
+			 "have gone over limit-cpu (%llu s)\n",
+			 SIGKILL, strsignal(SIGKILL), LIMIT_CPU->value);
+		return true;
+	}
+
+	return false;
+}
+
+static uint64_t ns(const struct timeval *tv)
+{
+	return (uint64_t)tv->tv_sec * 1000000000u +
+	       (uint64_t)tv->tv_usec * 1000u;
+}
+
+/*
+ * Usage between @a start and @a end, or all of @a end without @a start.
+ * The peak resident set size is never relative.
+ */
+void z_utest_usage_from(const struct rusage *end, const struct rusage *start,
+			struct utest_usage *usage)
+{
+	static const struct rusage zero;
+
+	if (!start) {
+		start = &zero;
+	}
+
+	usage->user_ns = ns(&end->ru_utime) - ns(&start->ru_utime);
+	usage->system_ns = ns(&end->ru_stime) - ns(&start->ru_stime);
+	usage->max_rss_kb = (uint64_t)end->ru_maxrss;
+	usage->minor_faults = (uint64_t)(end->ru_minflt - start->ru_minflt);
+	usage->major_faults = (uint64_t)(end->ru_majflt - start->ru_majflt);
+	usage->voluntary_switches = (uint64_t)(end->ru_nvcsw - start->ru_nvcsw);
+	usage->involuntary_switches =
+		(uint64_t)(end->ru_nivcsw - start->ru_nivcsw);
+}
@@ -0,0 +1,254 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define _GNU_SOURCE
+#include <utest.h>
+#include <utest_module.h>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define ERROR_MAX 512
+
+struct z_utest_module {
+	/* As listed, or found in a listed directory */
+	char path[PATH_MAX];
+	/* Of the file the loaded copy was made from */
+	struct stat st;
+	void *handle;
+	void (*run)(void);
+	/* Load address, as reported by dladdr() */
+	const void *base;
+	/* Why the module could not be loaded, "" if it was */
+	char error[ERROR_MAX];
+	struct z_utest_module *next;
+};
+
+static struct z_utest_module *modules;
+
+/* A runner of modules may have no test of its own */
+__attribute__((weak)) void RunAllTest(void)
+{
+}
+
+static int copy_file(const char *from, const char *to)
+{
+	char buf[65536];
+	int in = open(from, O_RDONLY | O_CLOEXEC);
+	int out = -1;
+	ssize_t n = -1;
+
+	if (in >= 0) {
+		out = open(to, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0700);
+	}
+	while (out >= 0 && (n = read(in, buf, sizeof(buf))) > 0) {
+		if (z_utest_write_all(out, buf, (size_t)n)) {
+			n = -1;
+			break;
+		}
+	}
+
+	if (in >= 0) {
+		close(in);
+	}
+	if (out >= 0 && close(out)) {
+		n = -1;
+	}
+
+	return n == 0 ? 0 : -1;
+}
+
+/*
+ * Load a private copy of the module: the original can be rebuilt while the
+ * copy runs, and a reload never gets the old code back from the loader.
+ */
+static void load(struct z_utest_module *m)
+{
+	static unsigned int seq;
+	const char *base = strrchr(m->path, '/');
+	char file[NAME_MAX + 1];
+	char copy[PATH_MAX];
+	Dl_info info;
+
+	m->handle = NULL;
+	m->run = NULL;
+	m->error[0] = '\0';
+
+	snprintf(file, sizeof(file), "%.200s.%d.%u.so",
+		 base ? base + 1 : m->path, (int)getpid(), seq++);
+	if (stat(m->path, &m->st) ||
+	    utest_cache_path("modules", file, copy, sizeof(copy)) ||
+	    copy_file(m->path, copy)) {
+		snprintf(m->error, sizeof(m->error), "cannot copy %.400s: %s",
+			 m->path, strerror(errno));
+		return;
+	}
+
+	m->handle = dlopen(copy, RTLD_NOW | RTLD_LOCAL);
+	unlink(copy);
+	if (!m->handle) {
+		snprintf(m->error, sizeof(m->error), "%s", dlerror());
+		return;
+	}
+
+	m->run = (void (*)(void))dlsym(m->handle, "RunAllTest");
+	if (!m->run) {
+		snprintf(m->error, sizeof(m->error), "%.400s has no RunAllTest()",
+			 m->path);
+		dlclose(m->handle);
+		m->handle = NULL;
+		return;
+	}
+
+	m->base = dladdr((void *)m->run, &info) ? info.dli_fbase : NULL;
+}
+
+static void add(const char *path)
+{
+	struct z_utest_module **it = &modules;
+	struct z_utest_module *m = calloc(1, sizeof(*m));
+
+	if (!m) {
+		return;
+	}
+	snprintf(m->path, sizeof(m->path), "%s", path);
+	load(m);
+
+	while (*it) {
+		it = &(*it)->next;
+	}
+	*it = m;
+}
+
+static int is_module(const struct dirent *entry)
+{
+	size_t len = strlen(entry->d_name);
+
+	return len > 3 && !strcmp(entry->d_name + len - 3, ".so");
+}
+
+static void add_dir(const char *dir)
+{
+	struct dirent **entries;
+	char path[PATH_MAX];
+	int n = scandir(dir, &entries, is_module, alphasort);
+
+	for (int i = 0; i < n; i++) {
+		snprintf(path, sizeof(path), "%s/%s", dir, entries[i]->d_name);
+		add(path);
+		free(entries[i]);
+	}
+	if (n >= 0) {
+		free(entries);
+	}
+}
+
+void z_utest_modules_load(void)
+{
+	const char *list = utest_option("modules");
+	char *copy;
+	char *save;
+
+	if (!list || !*list || modules) {
+		return;
+	}
+
+	copy = strdup(list);
+	if (!copy) {
+		return;
+	}
+
+	for (char *item = strtok_r(copy, ":", &save); item;
+	     item = strtok_r(NULL, ":", &save)) {
+		struct stat st;
+
+		if (!stat(item, &st) && S_ISDIR(st.st_mode)) {
+			add_dir(item);
+		} else {
+			add(item);
+		}
+	}
+
+	free(copy);
+}
+
+int z_utest_module_run(const struct z_utest_module *m)
+{
+	char label[PATH_MAX + 16];
+
+	if (m->run) {
+		m->run();
+		return 0;
+	}
+
+	/* Reported like a failed suite fixture */
+	snprintf(label, sizeof(label), "MODULE(%s)", m->path);
+	TC_SUITE_START(label);
+	z_utest_report_fixture_start(label);
+	z_utest_failure_printf("\n    %s\n", m->error);
+	z_utest_report_fixture_end(TC_FAIL);
+	TC_SUITE_END(label, TC_FAIL);
+
+	return 1;
+}
+
+int z_utest_modules_run(void)
+{
+	int fail = 0;
+
+	for (struct z_utest_module *m = modules; m; m = m->next) {
+		fail += z_utest_module_run(m);
+	}
+
+	return fail;
+}
+
+bool z_utest_module_contains(const struct z_utest_module *m,
+			     const void *addr)
+{
+	Dl_info info;
+
+	return m->base && dladdr(addr, &info) && info.dli_fbase == m->base;
+}
+
+static bool changed(const struct z_utest_module *m)
+{
+	struct stat st;
+
+	if (stat(m->path, &st)) {
+		return false;
+	}
+
+	return st.st_ino != m->st.st_ino || st.st_dev != m->st.st_dev ||
+	       st.st_size != m->st.st_size ||
+	       st.st_mtim.tv_sec != m->st.st_mtim.tv_sec ||
+	       st.st_mtim.tv_nsec != m->st.st_mtim.tv_nsec;
+}
+
+void z_utest_modules_reload(void (*retire)(const struct z_utest_module *),
+			    void (*warm)(const struct z_utest_module *))
+{
+	for (struct z_utest_module *m = modules; m; m = m->next) {
+		if (!changed(m)) {
+			continue;
+		}
+
+		fprintf(stderr, "utest: %s changed, reloading\n", m->path);
+		if (m->handle) {
+			retire(m);
+			dlclose(m->handle);
+		}
+		load(m);
+		if (m->handle) {
+			warm(m);
+		}
+	}
+}
@@ -0,0 +1,194 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define _GNU_SOURCE
+#include <utest_options.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define OPTION_NAME_MAX 64
+
+static int opt_argc;
+static char **opt_argv;
+
+/* Options of a request to the server, without program name */
+static int overlay_argc;
+static char **overlay_argv;
+
+void utest_options_init(int argc, char *argv[])
+{
+	opt_argc = argc;
+	opt_argv = argv;
+}
+
+char **z_utest_options_args(int *argc)
+{
+	*argc = opt_argc;
+
+	return opt_argv;
+}
+
+void z_utest_options_overlay(int argc, char *argv[])
+{
+	overlay_argc = argc;
+	overlay_argv = argv;
+}
+
+static const char *find_in(int argc, char *argv[], int first,
+			   const char *name)
+{
+	size_t len = strlen(name);
+
+	/* Last occurrence wins, like most command line tools */
+	for (int i = argc - 1; i >= first; i--) {
+		const char *arg = argv[i];
+
+		if (strncmp(arg, "--", 2) || strncmp(arg + 2, name, len)) {
+			continue;
+		}
+
+		if (arg[2 + len] == '\0') {
+			return "";
+		}
+		if (arg[2 + len] == '=') {
+			return arg + 3 + len;
+		}
+	}
+
+	return NULL;
+}
+
+static const char *find_arg(const char *name)
+{
+	const char *value = find_in(overlay_argc, overlay_argv, 0, name);
+
+	return value ? value : find_in(opt_argc, opt_argv, 1, name);
+}
+
+static const char *find_env(const char *name)
+{
+	char var[sizeof("UTEST_") + OPTION_NAME_MAX];
+	size_t i;
+
+	strcpy(var, "UTEST_");
+	for (i = 0; name[i] && i < OPTION_NAME_MAX; i++) {
+		var[6 + i] = (name[i] == '-') ? '_' : (char)toupper(name[i]);
+	}
+	var[6 + i] = '\0';
+
+	return getenv(var);
+}
+
+const char *utest_option(const char *name)
+{
+	const char *value = find_arg(name);
+
+	return value ? value : find_env(name);
+}
+
+bool utest_option_enabled(const char *name)
+{
+	const char *value = utest_option(name);
+
+	if (!value) {
+		return false;
+	}
+
+	return strcmp(value, "0") && strcmp(value, "no") &&
+	       strcmp(value, "off") && strcmp(value, "false");
+}
+
+long utest_option_long(const char *name, long def)
+{
+	const char *value = utest_option(name);
+	char *end;
+	long ret;
+
+	if (!value || !*value) {
+		return def;
+	}
+
+	ret = strtol(value, &end, 0);
+
+	return *end ? def : ret;
+}
+
+static int make_dir(const char *path)
+{
+	if (mkdir(path, 0755) && errno != EEXIST) {
+		return -1;
+	}
+
+	return 0;
+}
+
+int utest_cache_path(const char *subdir, const char *file, char *path,
+		     size_t size)
+{
+	const char *dir = utest_option("cache-dir");
+	int n;
+
+	if (!dir || !*dir) {
+		dir = ".utest-cache";
+	}
+
+	n = snprintf(path, size, "%s/%s", dir, subdir);
+	if (n < 0 || (size_t)n >= size || make_dir(dir) || make_dir(path)) {
+		return -1;
+	}
+
+	n = snprintf(path, size, "%s/%s/%s", dir, subdir, file);
+
+	return (n < 0 || (size_t)n >= size) ? -1 : 0;
+}
+
+/*
+ * Path of the file about test @a id, or about this program, in @a subdir
+ * of the cache: files of different test programs live side by side.
+ */
+int z_utest_cache_test_path(const char *subdir, const char *id, char *path,
+			    size_t size)
+{
+	char name[Z_UTEST_PATH_MAX];
+
+	snprintf(name, sizeof(name), "%s.%s", program_invocation_short_name,
+		 id);
+
+	/* Parameterized instances have a '/' in their identifier */
+	for (char *p = name; *p; p++) {
+		if (*p == '/') {
+			*p = '%';
+		}
+	}
+
+	return utest_cache_path(subdir, name, path, size);
+}
+
+/* Replace @a path with @a data, readers see the old or the new file */
+int z_utest_write_atomic(const char *path, const void *data, size_t len)
+{
+	char tmp[Z_UTEST_PATH_MAX + 32];
+	FILE *f;
+	int ret;
+
+	snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", path, (long)getpid());
+
+	f = fopen(tmp, "wb");
+	if (!f) {
+		return -1;
+	}
+
+	ret = (fwrite(data, 1, len, f) == len) ? 0 : -1;
+	if (fclose(f) || ret || rename(tmp, path)) {
+		unlink(tmp);
+		return -1;
+	}
+
+	return 0;
+}
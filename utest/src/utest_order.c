@@ -0,0 +1,522 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define _GNU_SOURCE
+#include <utest.h>
+#include <utest_order.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Exit status of a bisection process, see drive() */
+enum {
+	DRIVE_DONE = 0,
+	DRIVE_FLIPPED = 3,
+	DRIVE_ERROR = 4,
+};
+
+/* A test, or an instance of a parameterized one */
+struct instance {
+	struct unit_test test;
+	char name[Z_UTEST_TEST_NAME_MAX];
+	const struct utest_param_source *params;
+	size_t index;
+};
+
+/* What a round sends back for each test */
+struct outcome {
+	uint32_t index;
+	int32_t status;
+};
+
+static struct {
+	struct instance *tests;
+	size_t count;
+	z_utest_run_fn run;
+	/* In children: the test running, its status, where outcomes go */
+	size_t current;
+	int status;
+	int fd;
+} order = { .fd = -1 };
+
+bool z_utest_order_enabled(void)
+{
+	return utest_option("detect-order-deps") != NULL;
+}
+
+static uint64_t base_seed(void)
+{
+	const char *value = utest_option("seed");
+	struct timespec now;
+
+	if (value && *value) {
+		return strtoull(value, NULL, 0);
+	}
+
+	clock_gettime(CLOCK_REALTIME, &now);
+
+	return utest_hash_combine((uint64_t)now.tv_nsec,
+				  (uint64_t)now.tv_sec ^ (uint64_t)getpid());
+}
+
+/* ------------------------- children -------------------------------- */
+
+static void sink(const struct utest_result *result)
+{
+	struct outcome o = {
+		.index = (uint32_t)order.current,
+		.status = result->status,
+	};
+
+	order.status = result->status;
+	if (order.fd >= 0) {
+		(void)z_utest_write_all(order.fd, &o, sizeof(o));
+	}
+}
+
+/* Results go to sink(), test output nowhere */
+static void enter_child(int fd)
+{
+	int null = open("/dev/null", O_WRONLY | O_CLOEXEC);
+
+	if (null >= 0) {
+		dup2(null, STDOUT_FILENO);
+		dup2(null, STDERR_FILENO);
+		close(null);
+	}
+
+	order.fd = fd;
+	z_utest_capture_fork_child();
+	z_utest_report_set_sink(sink);
+}
+
+static pid_t fork_quiet(void)
+{
+	/* Do not hand buffered output over to the child */
+	fflush(stdout);
+	fflush(stderr);
+
+	return fork();
+}
+
+static int wait_for(pid_t pid)
+{
+	int status = 0;
+
+	while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+	}
+
+	return status;
+}
+
+static int run_instance_fn(void *arg)
+{
+	struct instance *in = arg;
+
+	return order.run(&in->test);
+}
+
+/* Run test @a i in this process, return true if it failed */
+static bool run_instance(size_t i)
+{
+	struct instance *in = &order.tests[i];
+
+	order.current = i;
+	order.status = TC_PASS;
+	z_utest_param_run(in->params, in->index, run_instance_fn, in);
+
+	return order.status == TC_FAIL;
+}
+
+/* Whether @a seq fails the last of its @a len tests, from a fresh fork */
+static bool fails_after(const size_t *seq, size_t len)
+{
+	pid_t pid = fork_quiet();
+	int status;
+
+	if (pid < 0) {
+		return false;
+	}
+
+	if (pid == 0) {
+		enter_child(-1);
+		for (size_t i = 0; i + 1 < len; i++) {
+			run_instance(seq[i]);
+		}
+		_exit(run_instance(seq[len - 1]) ? 1 : 0);
+	}
+
+	status = wait_for(pid);
+
+	/* A test that takes its process down fails */
+	return !WIFEXITED(status) || WEXITSTATUS(status);
+}
+
+/* Run the tests in @a seq, fill @a status, -1 for those that did not run */
+static void run_round(const size_t *seq, int *status)
+{
+	struct outcome o;
+	int fds[2];
+	pid_t pid;
+
+	for (size_t i = 0; i < order.count; i++) {
+		status[i] = -1;
+	}
+
+	if (pipe2(fds, O_CLOEXEC)) {
+		return;
+	}
+
+	pid = fork_quiet();
+	if (pid < 0) {
+		close(fds[0]);
+		close(fds[1]);
+		return;
+	}
+
+	if (pid == 0) {
+		close(fds[0]);
+		enter_child(fds[1]);
+		for (size_t i = 0; i < order.count; i++) {
+			run_instance(seq[i]);
+		}
+		_exit(0);
+	}
+
+	close(fds[1]);
+	while (read(fds[0], &o, sizeof(o)) == sizeof(o)) {
+		if (o.index < order.count) {
+			status[o.index] = o.status;
+		}
+	}
+	close(fds[0]);
+
+	/* The test that took the process down fails */
+	if (!WIFEXITED(wait_for(pid))) {
+		for (size_t i = 0; i < order.count; i++) {
+			if (status[seq[i]] < 0) {
+				status[seq[i]] = TC_FAIL;
+				break;
+			}
+		}
+	}
+}
+
+/* ------------------------- bisection ------------------------------- */
+
+/*
+ * In a process holding the state after prefix[0, lo), lo being 0 at first,
+ * narrow [lo, hi) down to the test of @a prefix after which @a victim
+ * fails as @a fails, and write its position to @a fd. Each step forks a
+ * process running the tests up to the middle of the range: if the victim
+ * has not changed outcome there yet, that process carries on from the
+ * middle, and the others wait for it.
+ */
+static int drive(const size_t *prefix, size_t hi, size_t victim, bool fails,
+		 int fd)
+{
+	size_t lo = 0;
+	long found;
+
+	while (hi - lo > 1) {
+		size_t mid = lo + (hi - lo) / 2;
+		pid_t pid = fork_quiet();
+		int status;
+
+		if (pid < 0) {
+			return DRIVE_ERROR;
+		}
+
+		if (pid == 0) {
+			for (size_t i = lo; i < mid; i++) {
+				run_instance(prefix[i]);
+			}
+			if (fails_after(&victim, 1) == fails) {
+				_exit(DRIVE_FLIPPED);
+			}
+			lo = mid;
+			continue;
+		}
+
+		status = wait_for(pid);
+		if (!WIFEXITED(status)) {
+			return DRIVE_ERROR;
+		}
+		if (WEXITSTATUS(status) != DRIVE_FLIPPED) {
+			/* Done by the process that took over, or failed */
+			return WEXITSTATUS(status);
+		}
+		hi = mid;
+	}
+
+	found = (long)lo;
+	if (z_utest_write_all(fd, &found, sizeof(found))) {
+		return DRIVE_ERROR;
+	}
+
+	return DRIVE_DONE;
+}
+
+/* Position of the test of @a prefix changing the outcome, -1 if not found */
+static long bisect(const size_t *prefix, size_t len, size_t victim, bool fails)
+{
+	long found = -1;
+	int fds[2];
+	pid_t pid;
+
+	if (pipe2(fds, O_CLOEXEC)) {
+		return -1;
+	}
+
+	pid = fork_quiet();
+	if (pid < 0) {
+		close(fds[0]);
+		close(fds[1]);
+		return -1;
+	}
+
+	if (pid == 0) {
+		close(fds[0]);
+		enter_child(-1);
+		_exit(drive(prefix, len, victim, fails, fds[1]));
+	}
+
+	close(fds[1]);
+	if (read(fds[0], &found, sizeof(found)) != sizeof(found)) {
+		found = -1;
+	}
+	close(fds[0]);
+	wait_for(pid);
+
+	return found;
+}
+
+/* ------------------------- detection ------------------------------- */
+
+static int collect(struct unit_test *test)
+{
+	struct instance *grown;
+	struct instance *in;
+
+	grown = realloc(order.tests, (order.count + 1) * sizeof(*order.tests));
+	if (!grown) {
+		return 0;
+	}
+	order.tests = grown;
+
+	in = &order.tests[order.count++];
+	in->test = *test;
+	snprintf(in->name, sizeof(in->name), "%s", test->name);
+	in->params = z_utest_param_source();
+	in->index = utest_param_index();
+
+	return 0;
+}
+
+static void collect_suite(const struct unit_test_suite *suite)
+{
+	const struct unit_test *tests = suite->tests;
+
+	order.count = 0;
+
+	for (size_t i = 0; tests[i].test; i++) {
+		if (!z_utest_tags_selected(tests[i].tags)) {
+			continue;
+		}
+
+		if (tests[i].params) {
+			z_utest_param_for_each(suite->name, &tests[i], collect);
+		} else if (z_utest_test_selected(suite->name, tests[i].name)) {
+			collect((struct unit_test *)&tests[i]);
+		}
+	}
+
+	/* Names are copied, the array no longer moves from here */
+	for (size_t i = 0; i < order.count; i++) {
+		order.tests[i].test.name = order.tests[i].name;
+	}
+}
+
+static void shuffle(size_t *seq, uint64_t seed)
+{
+	struct utest_rng rng;
+
+	utest_rng_seed(&rng, seed);
+	for (size_t i = order.count; i > 1; i--) {
+		size_t j = (size_t)utest_rng_below(&rng, i - 1);
+		size_t tmp = seq[i - 1];
+
+		seq[i - 1] = seq[j];
+		seq[j] = tmp;
+	}
+}
+
+/* Position of @a test in @a seq */
+static size_t position(const size_t *seq, size_t test)
+{
+	size_t i = 0;
+
+	while (seq[i] != test) {
+		i++;
+	}
+
+	return i;
+}
+
+/*
+ * Find the test @a victim depends on: the outcome it has alone changes
+ * after the tests preceding it in @a seq, order @a round. Report it,
+ * return 1 if found.
+ */
+static int explain(const size_t *seq, size_t victim, bool alone,
+		   uint64_t seed, unsigned int round)
+{
+	const char *name = order.tests[victim].name;
+	size_t len = position(seq, victim);
+	size_t *prefix;
+	char label[Z_UTEST_TEST_NAME_MAX + 16];
+	size_t pair[2];
+	long found;
+
+	/* Not reproduced from the state the suite starts in */
+	if (!len || fails_after(seq, len + 1) == alone) {
+		return 0;
+	}
+
+	prefix = malloc(len * sizeof(*prefix));
+	if (!prefix) {
+		return 0;
+	}
+	memcpy(prefix, seq, len * sizeof(*prefix));
+
+	found = bisect(prefix, len, victim, !alone);
+
+	snprintf(label, sizeof(label), "ORDER(%s)", name);
+	z_utest_report_fixture_start(label);
+
+	if (found < 0) {
+		z_utest_failure_printf(
+			"\n    %s %s after the %zu tests before it, and %s alone,"
+			" bisecting them failed\n",
+			name, alone ? "passes" : "fails", len,
+			alone ? "fails" : "passes");
+	} else {
+		pair[0] = prefix[found];
+		pair[1] = victim;
+		if (fails_after(pair, 2) != alone) {
+			z_utest_failure_printf("\n    %s %s after %s",
+					       name, alone ? "passes" : "fails",
+					       order.tests[pair[0]].name);
+		} else {
+			z_utest_failure_printf(
+				"\n    %s %s after %s and some of the %ld "
+				"tests before it",
+				name, alone ? "passes" : "fails",
+				order.tests[pair[0]].name, found);
+		}
+		z_utest_failure_printf(", and %s alone\n",
+				       alone ? "fails" : "passes");
+	}
+	if (round) {
+		z_utest_failure_printf(
+			"    in random order %u of seed 0x%llx\n", round,
+			(unsigned long long)seed);
+	} else {
+		z_utest_failure_printf("    in declaration order\n");
+	}
+
+	z_utest_report_fixture_end(TC_FAIL);
+	free(prefix);
+
+	return 1;
+}
+
+/*
+ * Run the tests of @a suite in several orders, each from the state the
+ * suite starts in, report the tests whose outcome depends on the order,
+ * return how many there are.
+ */
+int z_utest_order_detect(const struct unit_test_suite *suite,
+			 z_utest_run_fn run)
+{
+	long rounds = utest_option_long("detect-order-deps",
+					CONFIG_utest_ORDER_ROUNDS);
+	uint64_t seed = base_seed();
+	unsigned int bisected = 0;
+	size_t *seqs = NULL;
+	int *status = NULL;
+	int fail = 0;
+
+	order.run = run;
+	collect_suite(suite);
+	if (order.count < 2) {
+		return 0;
+	}
+
+	if (rounds < 0) {
+		rounds = CONFIG_utest_ORDER_ROUNDS;
+	}
+	rounds++;
+
+	seqs = malloc((size_t)rounds * order.count * sizeof(*seqs));
+	status = malloc((size_t)rounds * order.count * sizeof(*status));
+	if (!seqs || !status) {
+		goto out;
+	}
+
+	for (long r = 0; r < rounds; r++) {
+		size_t *seq = &seqs[(size_t)r * order.count];
+
+		for (size_t i = 0; i < order.count; i++) {
+			seq[i] = i;
+		}
+		if (r) {
+			shuffle(seq, utest_hash_combine(seed, (uint64_t)r));
+		}
+		run_round(seq, &status[(size_t)r * order.count]);
+	}
+
+	/*
+	 * Tests both passing and failing, explained by the first order they
+	 * have the outcome they do not have alone in
+	 */
+	for (size_t t = 0; t < order.count; t++) {
+		long failed = -1;
+		long passed = -1;
+		bool alone;
+		long r;
+
+		for (r = 0; r < rounds; r++) {
+			int s = status[(size_t)r * order.count + t];
+
+			if (s == TC_FAIL && failed < 0) {
+				failed = r;
+			} else if (s == TC_PASS && passed < 0) {
+				passed = r;
+			}
+		}
+
+		if (failed < 0 || passed < 0) {
+			continue;
+		}
+		if (bisected++ == CONFIG_utest_ORDER_BISECT_MAX) {
+			break;
+		}
+		alone = fails_after(&t, 1);
+		r = alone ? passed : failed;
+		fail += explain(&seqs[(size_t)r * order.count], t, alone, seed,
+				(unsigned int)r);
+	}
+
+out:
+	free(seqs);
+	free(status);
+
+	return fail;
+}
@@ -0,0 +1,148 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <utest.h>
+#include <utest_param.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INSTANCE_NAME_MAX 256
+
+static const void *current_param;
+static size_t current_index;
+static const struct utest_param_source *current_source;
+
+const void *utest_param(void)
+{
+	return current_param;
+}
+
+size_t utest_param_index(void)
+{
+	return current_index;
+}
+
+/* "TEST(suite, case)" -> "TEST(suite, case/index)" */
+static const char *instance_name(const char *name, size_t index, char *buf,
+				 size_t size)
+{
+	size_t len = strlen(name);
+
+	if (len && name[len - 1] == ')') {
+		len--;
+	}
+
+	snprintf(buf, size, "%.*s/%zu)", (int)len, name, index);
+
+	return buf;
+}
+
+/* Parameter @a index, in @a storage unless it is a static one */
+static const void *produce(const struct utest_param_source *params,
+			   size_t index, void *storage)
+{
+	if (params->values) {
+		return (const char *)params->values + index * params->size;
+	}
+
+	params->generate(index, storage);
+
+	return storage;
+}
+
+bool z_utest_param_any_selected(const char *suite, const struct unit_test *test)
+{
+	char name[INSTANCE_NAME_MAX];
+
+	for (size_t i = 0; i < test->params->count; i++) {
+		instance_name(test->name, i, name, sizeof(name));
+		if (z_utest_test_selected(suite, name)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+int z_utest_param_for_each(const char *suite, const struct unit_test *test,
+			   z_utest_param_fn fn)
+{
+	const struct utest_param_source *params = test->params;
+	char name[INSTANCE_NAME_MAX];
+	struct unit_test instance = *test;
+	void *storage = NULL;
+	int fail = 0;
+
+	if (!params->values) {
+		storage = calloc(1, params->size ? params->size : 1);
+		if (!storage) {
+			return 0;
+		}
+	}
+
+	instance.name = name;
+	instance.params = NULL;
+
+	for (size_t i = 0; i < params->count; i++) {
+		instance_name(test->name, i, name, sizeof(name));
+		if (!z_utest_test_selected(suite, name)) {
+			continue;
+		}
+
+		/* Only now is the parameter produced */
+		current_param = produce(params, i, storage);
+		current_index = i;
+		current_source = params;
+
+		fail += fn(&instance);
+	}
+
+	current_param = NULL;
+	current_index = 0;
+	current_source = NULL;
+	free(storage);
+
+	return fail;
+}
+
+const struct utest_param_source *z_utest_param_source(void)
+{
+	return current_source;
+}
+
+/*
+ * Call @a fn with parameter @a index of @a params, or with none if
+ * @a params is NULL, as the current one, for an instance that runs again
+ * after the next ones were submitted.
+ */
+int z_utest_param_run(const struct utest_param_source *params, size_t index,
+		      int (*fn)(void *arg), void *arg)
+{
+	const struct utest_param_source *saved_source = current_source;
+	const void *saved_param = current_param;
+	size_t saved_index = current_index;
+	void *storage = NULL;
+	int ret;
+
+	if (params && !params->values) {
+		storage = calloc(1, params->size ? params->size : 1);
+		if (!storage) {
+			return 0;
+		}
+	}
+
+	current_param = params ? produce(params, index, storage) : NULL;
+	current_index = params ? index : 0;
+	current_source = params;
+
+	ret = fn(arg);
+
+	current_param = saved_param;
+	current_index = saved_index;
+	current_source = saved_source;
+	free(storage);
+
+	return ret;
+}
@@ -0,0 +1,682 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define _GNU_SOURCE
+#include <utest.h>
+#include <utest_priority.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Order classes, see utest_priority.h */
+enum {
+	CLASS_FAILED,
+	CLASS_CHANGED,
+	CLASS_OTHER,
+};
+
+/* A test of the history, or of this run */
+struct test {
+	char *suite;
+	char *name;
+
+	/* History, of @a runs runs */
+	unsigned int runs;
+	int status;
+	unsigned int failures;
+	/* Runs since the last failure */
+	unsigned int since;
+	uint64_t duration_ns;
+	/* Hash of its code when it last ran, 0 if unknown */
+	uint64_t code;
+
+	/* Suite of the test in this run, -1 if it was not listed */
+	int group;
+	/* Case of the suite it is, or is an instance of */
+	int entry;
+	uint64_t code_now;
+	int class;
+	/* Piece of the order it runs in, -1 if left out */
+	int piece;
+	bool done;
+};
+
+static struct {
+	bool enabled;
+	bool record;
+	bool listing;
+	bool running;
+	uint64_t budget_ns;
+	struct timespec start;
+	int piece;
+
+	struct test *tests;
+	int count;
+	/* Index of tests by key, -1 when free */
+	uint64_t *keys;
+	int *slots;
+	size_t nslots;
+
+	/* Suites of the listed tests, copied, the caller may own them */
+	struct unit_test_suite *groups;
+	int ngroups;
+	/* Listed tests, in the order they run */
+	int *order;
+	int norder;
+} prio;
+
+static uint64_t test_key(const char *suite, const char *name)
+{
+	return utest_hash64(name, strlen(name),
+			    utest_hash64(suite, strlen(suite), 0));
+}
+
+static uint64_t elapsed_ns(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t)(now.tv_sec - prio.start.tv_sec) * 1000000000u +
+	       (uint64_t)(now.tv_nsec - prio.start.tv_nsec);
+}
+
+/* A duration with an optional ms, s, m or h suffix, seconds by default */
+static bool parse_duration(const char *value, uint64_t *ns)
+{
+	static const struct {
+		const char *suffix;
+		double scale;
+	} units[] = {
+		{ "", 1e9 }, { "s", 1e9 }, { "ms", 1e6 },
+		{ "m", 60e9 }, { "h", 3600e9 },
+	};
+	char *end;
+	double n;
+
+	if (!value || !*value) {
+		return false;
+	}
+
+	n = strtod(value, &end);
+	if (end == value || n <= 0) {
+		return false;
+	}
+
+	for (size_t i = 0; i < sizeof(units) / sizeof(units[0]); i++) {
+		if (!strcmp(end, units[i].suffix)) {
+			*ns = (uint64_t)(n * units[i].scale);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* ------------------------- tests ----------------------------------- */
+
+static bool index_grow(void)
+{
+	size_t nslots = prio.nslots ? 2 * prio.nslots : 256;
+	uint64_t *keys = calloc(nslots, sizeof(*keys));
+	int *slots = malloc(nslots * sizeof(*slots));
+
+	if (!keys || !slots) {
+		free(keys);
+		free(slots);
+		return false;
+	}
+
+	for (size_t i = 0; i < nslots; i++) {
+		slots[i] = -1;
+	}
+	for (size_t i = 0; i < prio.nslots; i++) {
+		size_t j = prio.keys[i] & (nslots - 1);
+
+		if (prio.slots[i] < 0) {
+			continue;
+		}
+		while (slots[j] >= 0) {
+			j = (j + 1) & (nslots - 1);
+		}
+		keys[j] = prio.keys[i];
+		slots[j] = prio.slots[i];
+	}
+
+	free(prio.keys);
+	free(prio.slots);
+	prio.keys = keys;
+	prio.slots = slots;
+	prio.nslots = nslots;
+
+	return true;
+}
+
+/* The test, added if @a add and new, NULL if none */
+static struct test *find(const char *suite, const char *name, bool add)
+{
+	uint64_t key = test_key(suite, name);
+	struct test *grown;
+	size_t i;
+
+	if (!prio.nslots && (!add || !index_grow())) {
+		return NULL;
+	}
+
+	for (i = key & (prio.nslots - 1); prio.slots[i] >= 0;
+	     i = (i + 1) & (prio.nslots - 1)) {
+		struct test *t = &prio.tests[prio.slots[i]];
+
+		if (prio.keys[i] == key && !strcmp(t->suite, suite) &&
+		    !strcmp(t->name, name)) {
+			return t;
+		}
+	}
+
+	if (!add) {
+		return NULL;
+	}
+
+	/* Keep the index at most half full */
+	if ((size_t)(prio.count + 1) * 2 > prio.nslots) {
+		return index_grow() ? find(suite, name, add) : NULL;
+	}
+
+	grown = realloc(prio.tests,
+			(size_t)(prio.count + 1) * sizeof(*prio.tests));
+	if (!grown) {
+		return NULL;
+	}
+	prio.tests = grown;
+
+	grown[prio.count] = (struct test){
+		.suite = strdup(suite),
+		.name = strdup(name),
+		.group = -1,
+		.piece = -1,
+	};
+	if (!grown[prio.count].suite || !grown[prio.count].name) {
+		free(grown[prio.count].suite);
+		free(grown[prio.count].name);
+		return NULL;
+	}
+	prio.keys[i] = key;
+	prio.slots[i] = prio.count;
+
+	return &prio.tests[prio.count++];
+}
+
+/* ------------------------- history --------------------------------- */
+
+static void history_path(char *path, size_t size)
+{
+	if (utest_cache_path("history", program_invocation_short_name, path,
+			     size)) {
+		*path = '\0';
+	}
+}
+
+static void load_history(void)
+{
+	char path[PATH_MAX];
+	char *line = NULL;
+	size_t size = 0;
+	FILE *file;
+
+	history_path(path, sizeof(path));
+	file = *path ? fopen(path, "r") : NULL;
+
+	while (file && getline(&line, &size, file) > 0) {
+		unsigned long long duration;
+		unsigned long long code;
+		unsigned int runs;
+		unsigned int failures;
+		unsigned int since;
+		int status;
+		int off = 0;
+		char *name;
+		char *end;
+		struct test *t;
+
+		/* "runs status failures since duration code\tsuite\tname" */
+		if (sscanf(line, "%u %d %u %u %llu %llx\t%n", &runs, &status,
+			   &failures, &since, &duration, &code, &off) != 6 ||
+		    !off) {
+			continue;
+		}
+		name = strchr(line + off, '\t');
+		end = name ? strchr(name + 1, '\n') : NULL;
+		if (!end) {
+			continue;
+		}
+		*name++ = '\0';
+		*end = '\0';
+
+		t = find(line + off, name, true);
+		if (!t) {
+			continue;
+		}
+		t->runs = runs;
+		t->status = status;
+		t->failures = failures;
+		t->since = since;
+		t->duration_ns = duration;
+		t->code = code;
+	}
+
+	free(line);
+	if (file) {
+		fclose(file);
+	}
+}
+
+static void save_history(void)
+{
+	char path[PATH_MAX];
+	char tmp[PATH_MAX + 8];
+	FILE *file;
+
+	history_path(path, sizeof(path));
+	if (!*path) {
+		return;
+	}
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+	file = fopen(tmp, "w");
+	if (!file) {
+		return;
+	}
+
+	for (int i = 0; i < prio.count; i++) {
+		const struct test *t = &prio.tests[i];
+
+		if (t->runs) {
+			fprintf(file, "%u %d %u %u %llu %llx\t%s\t%s\n", t->runs,
+				t->status, t->failures, t->since,
+				(unsigned long long)t->duration_ns,
+				(unsigned long long)t->code, t->suite, t->name);
+		}
+	}
+
+	if (fclose(file) || rename(tmp, path)) {
+		unlink(tmp);
+	}
+}
+
+static void history_test_end(struct utest_reporter *rep,
+			     const struct utest_result *result)
+{
+	struct test *t;
+
+	(void)rep;
+
+	t = find(result->suite, result->name, prio.record);
+	if (!t) {
+		return;
+	}
+	t->done = true;
+
+	/* Only what ran tells something */
+	if (!prio.record || (result->status != TC_PASS &&
+			     result->status != TC_FAIL &&
+			     result->status != TC_FLAKY)) {
+		return;
+	}
+
+	t->runs++;
+	t->status = result->status;
+	t->duration_ns = result->duration_ns;
+	if (result->status == TC_PASS) {
+		t->since += t->since < UINT_MAX;
+	} else {
+		t->failures++;
+		t->since = 0;
+	}
+	if (t->code_now) {
+		t->code = t->code_now;
+	}
+}
+
+static void history_run_end(struct utest_reporter *rep, int result)
+{
+	(void)rep;
+	(void)result;
+
+	if (prio.record) {
+		save_history();
+	}
+}
+
+static struct utest_reporter history_reporter = {
+	.name = "history",
+	.on_test_end = history_test_end,
+	.on_run_end = history_run_end,
+};
+
+void z_utest_priority_init(void)
+{
+	const char *budget = utest_option("time-budget");
+
+	prio.budget_ns = 0;
+	if (budget && !parse_duration(budget, &prio.budget_ns)) {
+		fprintf(stderr, "utest: bad time-budget \"%s\"\n", budget);
+	}
+
+	/* The coordinator of a distributed run has its own order */
+	prio.enabled = (prio.budget_ns || utest_option_enabled("prioritize")) &&
+		       !utest_option("coordinate");
+	/* The runner the results are sent to keeps them */
+	prio.record = (prio.enabled || utest_option_enabled("history")) &&
+		      !utest_option("result-fd");
+
+	if (!prio.enabled && !prio.record) {
+		return;
+	}
+
+	if (!prio.count) {
+		load_history();
+	}
+	utest_register_reporter(&history_reporter);
+}
+
+/* ------------------------- order ----------------------------------- */
+
+bool z_utest_priority_listing(void)
+{
+	return prio.listing;
+}
+
+void z_utest_priority_list(const struct unit_test_suite *suite,
+			   const struct unit_test *test)
+{
+	struct test *t = find(suite->name, test->name, true);
+	int g = prio.ngroups - 1;
+	int entry = 0;
+	int *order;
+
+	if (!t || t->group >= 0) {
+		return;
+	}
+
+	while (g >= 0 && strcmp(prio.groups[g].name, suite->name)) {
+		g--;
+	}
+	if (g < 0) {
+		struct unit_test_suite *groups = realloc(
+			prio.groups,
+			(size_t)(prio.ngroups + 1) * sizeof(*prio.groups));
+
+		if (!groups) {
+			return;
+		}
+		prio.groups = groups;
+		g = prio.ngroups++;
+		groups[g] = *suite;
+	}
+
+	order = realloc(prio.order, (size_t)(prio.norder + 1) * sizeof(*order));
+	if (!order) {
+		return;
+	}
+	prio.order = order;
+	order[prio.norder++] = (int)(t - prio.tests);
+
+	/* Instances of a parameterized case run its function */
+	while (suite->tests[entry].test &&
+	       suite->tests[entry].test != test->test) {
+		entry++;
+	}
+
+	t->group = g;
+	t->entry = entry;
+	if (!z_utest_code_hash(suite, test, &t->code_now)) {
+		t->code_now = 0;
+	}
+}
+
+static int classify(const struct test *t)
+{
+	if (t->runs && t->failures && t->since < CONFIG_utest_PRIORITY_RECENT) {
+		return CLASS_FAILED;
+	}
+
+	if (!t->runs || (t->code && t->code_now && t->code != t->code_now)) {
+		return CLASS_CHANGED;
+	}
+
+	return CLASS_OTHER;
+}
+
+static int by_priority(const void *a, const void *b)
+{
+	const struct test *x = &prio.tests[*(const int *)a];
+	const struct test *y = &prio.tests[*(const int *)b];
+
+	if (x->class != y->class) {
+		return x->class < y->class ? -1 : 1;
+	}
+
+	if (x->class == CLASS_FAILED) {
+		if (x->since != y->since) {
+			return x->since < y->since ? -1 : 1;
+		}
+		if (x->failures != y->failures) {
+			return x->failures > y->failures ? -1 : 1;
+		}
+	}
+
+	if (x->duration_ns != y->duration_ns) {
+		return x->duration_ns < y->duration_ns ? -1 : 1;
+	}
+
+	/* Listing order otherwise */
+	return *(const int *)a < *(const int *)b ? -1 :
+	       *(const int *)a > *(const int *)b;
+}
+
+/* Split the order into pieces of one suite, leaving out what does not fit */
+static void plan(void)
+{
+	uint64_t known_ns = 0;
+	uint64_t planned_ns = 0;
+	uint64_t mean_ns;
+	int known = 0;
+	int pieces = 0;
+	int last = -1;
+
+	for (int i = 0; i < prio.norder; i++) {
+		struct test *t = &prio.tests[prio.order[i]];
+
+		t->class = classify(t);
+		if (t->runs) {
+			known_ns += t->duration_ns;
+			known++;
+		}
+	}
+	mean_ns = known ? known_ns / (uint64_t)known : 0;
+
+	qsort(prio.order, (size_t)prio.norder, sizeof(*prio.order),
+	      by_priority);
+
+	for (int i = 0; i < prio.norder; i++) {
+		struct test *t = &prio.tests[prio.order[i]];
+		uint64_t estimate_ns = t->runs ? t->duration_ns : mean_ns;
+
+		if (prio.budget_ns && planned_ns + estimate_ns > prio.budget_ns) {
+			continue;
+		}
+		planned_ns += estimate_ns;
+
+		if (t->group != last) {
+			pieces++;
+			last = t->group;
+		}
+		t->piece = pieces - 1;
+	}
+}
+
+bool z_utest_priority_selected(const char *suite, const char *name)
+{
+	const struct test *t;
+
+	if (!prio.running) {
+		return true;
+	}
+
+	t = find(suite, name, false);
+
+	return t && t->piece == prio.piece &&
+	       (!prio.budget_ns || elapsed_ns() < prio.budget_ns);
+}
+
+/* Whether a test of suite @a g ran, or was reported */
+static bool group_started(int g)
+{
+	for (int i = 0; i < prio.norder; i++) {
+		const struct test *t = &prio.tests[prio.order[i]];
+
+		if (t->group == g && t->done) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * Report the listed tests that did not run as skipped, in a suite of their
+ * own for the suites none of whose tests ran.
+ */
+static void report_left_out(void)
+{
+	static const char msg[] = "\n    left out by the time budget\n";
+
+	for (int g = 0; g < prio.ngroups; g++) {
+		bool started = group_started(g);
+		bool opened = false;
+
+		for (int i = 0; i < prio.norder; i++) {
+			const struct test *t = &prio.tests[prio.order[i]];
+
+			if (t->group != g || t->done) {
+				continue;
+			}
+			if (started) {
+				z_utest_report_result(&(struct utest_result){
+					.suite = t->suite,
+					.name = t->name,
+					.status = TC_SKIP,
+					.message = msg,
+					.message_len = sizeof(msg) - 1,
+				});
+				continue;
+			}
+			if (!opened) {
+				TC_SUITE_START(prio.groups[g].name);
+				opened = true;
+			}
+			TC_START(t->name);
+			z_utest_failure_printf("%s", msg);
+			Z_TC_END_RESULT(TC_SKIP);
+		}
+
+		if (opened) {
+			TC_SUITE_END(prio.groups[g].name, TC_PASS);
+		}
+	}
+}
+
+/*
+ * Run the piece of the order starting at @a at, its cases in priority
+ * order; the instances of a parameterized case run together, where the
+ * first of them is.
+ */
+static void run_piece(int at)
+{
+	const struct test *first = &prio.tests[prio.order[at]];
+	struct unit_test_suite piece = prio.groups[first->group];
+	struct unit_test *tests;
+	int ntests = 0;
+	int count = 0;
+
+	while (piece.tests[ntests].test) {
+		ntests++;
+	}
+	tests = calloc((size_t)ntests + 1, sizeof(*tests));
+	if (!tests) {
+		/* In the order they are declared in */
+		z_utest_run_suite(&piece);
+		return;
+	}
+
+	for (int i = at; i < prio.norder; i++) {
+		const struct test *t = &prio.tests[prio.order[i]];
+		bool taken = false;
+
+		if (t->piece < 0) {
+			continue;
+		}
+		if (t->piece != first->piece) {
+			break;
+		}
+		for (int j = 0; j < count && !taken; j++) {
+			taken = tests[j].test == piece.tests[t->entry].test;
+		}
+		if (!taken) {
+			tests[count++] = piece.tests[t->entry];
+		}
+	}
+
+	piece.tests = tests;
+	z_utest_run_suite(&piece);
+	free(tests);
+}
+
+/*
+ * Run the tests @a run runs in priority order, false if they are not to be
+ * ordered.
+ */
+bool z_utest_priority_run(void (*run)(void))
+{
+	int last = -1;
+
+	if (!prio.enabled) {
+		return false;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &prio.start);
+
+	prio.listing = true;
+	run();
+	prio.listing = false;
+
+	plan();
+
+	prio.running = true;
+	for (int i = 0; i < prio.norder; i++) {
+		const struct test *t = &prio.tests[prio.order[i]];
+
+		if (t->piece <= last) {
+			continue;
+		}
+		last = t->piece;
+		prio.piece = t->piece;
+		run_piece(i);
+
+		if (prio.budget_ns && elapsed_ns() >= prio.budget_ns) {
+			break;
+		}
+	}
+	prio.running = false;
+
+	if (prio.budget_ns) {
+		report_left_out();
+	}
+
+	return true;
+}
@@ -0,0 +1,671 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define _GNU_SOURCE
+#include <utest.h>
+#include <utest_fork.h>
+#include <utest_jobserver.h>
+#include <utest_programs.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Options of the runner that its programs must not get */
+static const char *const own_options[] = {
+	"programs", "reporter", "modules", "serve", "client", "result-fd",
+	"journal", "journal-sync", "resume", "coordinate", "workers", "worker",
+	NULL
+};
+
+struct program {
+	char path[PATH_MAX];
+	pid_t pid;
+	int fd;
+	struct timespec start;
+	/* Events received and not reported yet */
+	char *buf;
+	size_t len;
+	size_t size;
+	bool events;
+	bool ended;
+	/* Label of the suite being reported */
+	char suite[PATH_MAX + 256];
+	bool in_suite;
+	int fail;
+};
+
+static struct program *programs;
+static int count;
+
+/* ----------------------------- program ----------------------------- */
+
+static int result_fd = -1;
+static char stream_buf[CONFIG_utest_REPORT_BUFFER_SIZE];
+static struct utest_outbuf stream_out;
+
+/* Write @a ev and its strings, NULL ones are empty */
+void z_utest_event_write(struct utest_outbuf *out, struct z_utest_event *ev,
+			 const char *const str[Z_UTEST_EVENT_STRINGS],
+			 const size_t len[Z_UTEST_EVENT_STRINGS])
+{
+	for (int i = 0; i < Z_UTEST_EVENT_STRINGS; i++) {
+		ev->len[i] = str[i] ? (uint32_t)len[i] : 0;
+	}
+
+	utest_outbuf_write(out, (const char *)ev, sizeof(*ev));
+	for (int i = 0; i < Z_UTEST_EVENT_STRINGS; i++) {
+		utest_outbuf_write(out, str[i], ev->len[i]);
+		utest_outbuf_write(out, "", 1);
+	}
+}
+
+static void send_event(struct z_utest_event *ev,
+		       const char *const str[Z_UTEST_EVENT_STRINGS],
+		       const size_t len[Z_UTEST_EVENT_STRINGS])
+{
+	z_utest_event_write(&stream_out, ev, str, len);
+}
+
+static void send_suite(uint32_t type, const char *suite, int result)
+{
+	const char *const str[Z_UTEST_EVENT_STRINGS] = { suite };
+	const size_t len[Z_UTEST_EVENT_STRINGS] = { strlen(suite) };
+	struct z_utest_event ev = { .type = type, .status = result };
+
+	send_event(&ev, str, len);
+}
+
+static void stream_run_start(struct utest_reporter *rep)
+{
+	(void)rep;
+
+	utest_outbuf_init(&stream_out, result_fd, stream_buf,
+			  sizeof(stream_buf));
+}
+
+static void stream_suite_start(struct utest_reporter *rep, const char *suite)
+{
+	(void)rep;
+
+	send_suite(Z_UTEST_EVENT_SUITE_START, suite, TC_PASS);
+}
+
+static void stream_test_start(struct utest_reporter *rep, const char *suite,
+			      const char *name)
+{
+	const char *const str[Z_UTEST_EVENT_STRINGS] = { suite, name };
+	const size_t len[Z_UTEST_EVENT_STRINGS] = { strlen(suite),
+						    strlen(name) };
+	struct z_utest_event ev = { .type = Z_UTEST_EVENT_TEST_START };
+
+	(void)rep;
+
+	send_event(&ev, str, len);
+	/* Which test was running is known when the program dies */
+	utest_outbuf_flush(&stream_out);
+}
+
+static void stream_test_end(struct utest_reporter *rep,
+			    const struct utest_result *result)
+{
+	const char *const str[Z_UTEST_EVENT_STRINGS] = {
+		result->suite, result->name, result->message,
+		result->captured_stdout, result->captured_stderr
+	};
+	const size_t len[Z_UTEST_EVENT_STRINGS] = {
+		strlen(result->suite), strlen(result->name),
+		result->message_len, result->captured_stdout_len,
+		result->captured_stderr_len
+	};
+	struct z_utest_event ev = {
+		.type = Z_UTEST_EVENT_TEST_END,
+		.status = result->status,
+		.duration_ns = result->duration_ns,
+		.usage = result->usage,
+	};
+
+	(void)rep;
+
+	send_event(&ev, str, len);
+	/* What passed before the program dies is still known */
+	utest_outbuf_flush(&stream_out);
+}
+
+static void stream_suite_end(struct utest_reporter *rep, const char *suite,
+			     int result)
+{
+	(void)rep;
+
+	send_suite(Z_UTEST_EVENT_SUITE_END, suite, result);
+}
+
+static void stream_run_end(struct utest_reporter *rep, int result)
+{
+	(void)rep;
+
+	send_suite(Z_UTEST_EVENT_RUN_END, "", result);
+	utest_outbuf_flush(&stream_out);
+}
+
+static struct utest_reporter stream_reporter = {
+	.name = "stream",
+	.on_run_start = stream_run_start,
+	.on_suite_start = stream_suite_start,
+	.on_test_start = stream_test_start,
+	.on_test_end = stream_test_end,
+	.on_suite_end = stream_suite_end,
+	.on_run_end = stream_run_end,
+};
+
+/* The reporter sending results to the runner, NULL if not run by one */
+struct utest_reporter *z_utest_programs_reporter(void)
+{
+	long fd = utest_option_long("result-fd", -1);
+
+	if (fd < 0 || fd > INT_MAX || fcntl((int)fd, F_SETFD, FD_CLOEXEC)) {
+		return NULL;
+	}
+
+	/* Not for the test programs run by tests */
+	result_fd = (int)fd;
+	unsetenv("UTEST_RESULT_FD");
+
+	return &stream_reporter;
+}
+
+/* ------------------------------ runner ----------------------------- */
+
+static bool is_runner(const struct stat *st)
+{
+	struct stat self;
+
+	return !stat("/proc/self/exe", &self) && self.st_ino == st->st_ino &&
+	       self.st_dev == st->st_dev;
+}
+
+static void add(const char *path)
+{
+	struct program *grown;
+	struct program *p;
+
+	grown = realloc(programs, (size_t)(count + 1) * sizeof(*programs));
+	if (!grown) {
+		return;
+	}
+	programs = grown;
+
+	p = &programs[count++];
+	memset(p, 0, sizeof(*p));
+	snprintf(p->path, sizeof(p->path), "%s", path);
+	p->fd = -1;
+}
+
+static void add_dir(const char *dir)
+{
+	struct dirent **entries;
+	char path[PATH_MAX];
+	int n = scandir(dir, &entries, NULL, alphasort);
+
+	for (int i = 0; i < n; i++) {
+		struct stat st;
+
+		snprintf(path, sizeof(path), "%s/%s", dir, entries[i]->d_name);
+		if (!stat(path, &st) && S_ISREG(st.st_mode) &&
+		    !access(path, X_OK) && !is_runner(&st)) {
+			add(path);
+		}
+		free(entries[i]);
+	}
+	if (n >= 0) {
+		free(entries);
+	}
+}
+
+static void load(const char *list)
+{
+	char *copy = strdup(list);
+	char *save;
+
+	if (!copy) {
+		return;
+	}
+
+	for (char *item = strtok_r(copy, ":", &save); item;
+	     item = strtok_r(NULL, ":", &save)) {
+		struct stat st;
+
+		if (!stat(item, &st) && S_ISDIR(st.st_mode)) {
+			add_dir(item);
+		} else {
+			add(item);
+		}
+	}
+
+	free(copy);
+}
+
+static bool own_option(const char *arg)
+{
+	size_t len = strcspn(arg + 2, "=");
+
+	for (const char *const *opt = own_options; *opt; opt++) {
+		if (strlen(*opt) == len && !strncmp(arg + 2, *opt, len)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* Options of the runner for its programs, args[0] left for the path */
+char **z_utest_programs_args(void)
+{
+	int argc;
+	char **argv = z_utest_options_args(&argc);
+	char **args = calloc((size_t)argc + 2, sizeof(*args));
+	int n = 1;
+
+	for (int i = 1; args && i < argc; i++) {
+		if (!strncmp(argv[i], "--", 2) && !own_option(argv[i])) {
+			args[n++] = argv[i];
+		}
+	}
+
+	return args;
+}
+
+/* Environment variables of the options programs do not get */
+void z_utest_programs_unsetenv(void)
+{
+	for (const char *const *opt = own_options; *opt; opt++) {
+		char var[64] = "UTEST_";
+		size_t j;
+
+		for (j = 0; (*opt)[j]; j++) {
+			var[6 + j] = (*opt)[j] == '-' ? '_' :
+							(char)toupper((*opt)[j]);
+		}
+		var[6 + j] = '\0';
+		unsetenv(var);
+	}
+}
+
+static void exec_program(const struct program *p, int fd, char **args)
+{
+	char value[16];
+
+	z_utest_programs_unsetenv();
+	snprintf(value, sizeof(value), "%d", fd);
+	setenv("UTEST_RESULT_FD", value, 1);
+	fcntl(fd, F_SETFD, 0);
+
+	args[0] = (char *)p->path;
+	execv(p->path, args);
+
+	fprintf(stderr, "utest: cannot run %s: %s\n", p->path,
+		strerror(errno));
+	_exit(127);
+}
+
+static uint64_t since(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t)(now.tv_sec - start->tv_sec) * 1000000000u +
+	       (uint64_t)(now.tv_nsec - start->tv_nsec);
+}
+
+/* Report the program itself, as a test of the suite it was in, if any */
+static void report(struct program *p, int status, const char *msg)
+{
+	char label[PATH_MAX + 16];
+	struct utest_result res = {
+		.suite = p->suite,
+		.name = label,
+		.status = status,
+		.duration_ns = since(&p->start),
+		.message = msg,
+		.message_len = strlen(msg),
+	};
+
+	snprintf(label, sizeof(label), "PROGRAM(%s)", p->path);
+	if (!p->in_suite) {
+		snprintf(p->suite, sizeof(p->suite), "%s", label);
+		TC_SUITE_START(p->suite);
+	}
+
+	z_utest_report_result(&res);
+	TC_SUITE_END(p->suite, status);
+	p->in_suite = false;
+
+	if (status == TC_FAIL) {
+		p->fail++;
+	}
+}
+
+static bool start(struct program *p, char **args)
+{
+	int fds[2];
+	pid_t pid;
+
+	clock_gettime(CLOCK_MONOTONIC, &p->start);
+
+	if (pipe2(fds, O_CLOEXEC)) {
+		return false;
+	}
+
+	/* Do not hand buffered output over to the program */
+	fflush(stdout);
+	fflush(stderr);
+
+	pid = fork();
+	if (pid < 0) {
+		close(fds[0]);
+		close(fds[1]);
+		return false;
+	}
+
+	if (pid == 0) {
+		close(fds[0]);
+		exec_program(p, fds[1], args);
+	}
+
+	close(fds[1]);
+	p->pid = pid;
+	p->fd = fds[0];
+
+	return true;
+}
+
+/* Size of the complete event at @a data, 0 if not all of it arrived */
+size_t z_utest_event_size(const char *data, size_t len)
+{
+	struct z_utest_event ev;
+	size_t size = sizeof(ev);
+
+	if (len < sizeof(ev)) {
+		return 0;
+	}
+
+	memcpy(&ev, data, sizeof(ev));
+	for (int i = 0; i < Z_UTEST_EVENT_STRINGS; i++) {
+		size += (size_t)ev.len[i] + 1;
+	}
+
+	return size <= len ? size : 0;
+}
+
+/* Decode the complete event at @a data */
+void z_utest_event_read(const char *data, struct z_utest_event *ev,
+			const char *str[Z_UTEST_EVENT_STRINGS])
+{
+	memcpy(ev, data, sizeof(*ev));
+	str[0] = data + sizeof(*ev);
+	for (int i = 1; i < Z_UTEST_EVENT_STRINGS; i++) {
+		str[i] = str[i - 1] + ev->len[i - 1] + 1;
+	}
+}
+
+/* Suites of a program are reported as <program>:<suite> */
+static void suite_label(const struct program *p, const char *suite,
+			char *label, size_t size)
+{
+	const char *name = strrchr(p->path, '/');
+
+	snprintf(label, size, "%s:%s", name ? name + 1 : p->path, suite);
+}
+
+static void replay(struct program *p, const char *data)
+{
+	const char *str[Z_UTEST_EVENT_STRINGS];
+	struct utest_result res;
+	char label[sizeof(p->suite)];
+	struct z_utest_event ev;
+
+	z_utest_event_read(data, &ev, str);
+
+	switch (ev.type) {
+	case Z_UTEST_EVENT_SUITE_START:
+		suite_label(p, str[Z_UTEST_EVENT_SUITE], p->suite, sizeof(p->suite));
+		p->in_suite = true;
+		TC_SUITE_START(p->suite);
+		break;
+	case Z_UTEST_EVENT_TEST_END:
+		suite_label(p, str[Z_UTEST_EVENT_SUITE], label, sizeof(label));
+		res = (struct utest_result){
+			.suite = label,
+			.name = str[Z_UTEST_EVENT_NAME],
+			.status = ev.status,
+			.duration_ns = ev.duration_ns,
+			.message = str[Z_UTEST_EVENT_MESSAGE],
+			.message_len = ev.len[Z_UTEST_EVENT_MESSAGE],
+			.captured_stdout = str[Z_UTEST_EVENT_STDOUT],
+			.captured_stdout_len = ev.len[Z_UTEST_EVENT_STDOUT],
+			.captured_stderr = str[Z_UTEST_EVENT_STDERR],
+			.captured_stderr_len = ev.len[Z_UTEST_EVENT_STDERR],
+			.usage = ev.usage,
+		};
+		z_utest_report_result(&res);
+		if (ev.status == TC_FAIL) {
+			p->fail++;
+		}
+		break;
+	case Z_UTEST_EVENT_SUITE_END:
+		TC_SUITE_END(p->suite, ev.status);
+		p->in_suite = false;
+		break;
+	case Z_UTEST_EVENT_RUN_END:
+		p->ended = true;
+		if (ev.status == TC_FAIL && !p->fail) {
+			p->fail++;
+		}
+		break;
+	}
+}
+
+/*
+ * Report the events received, a suite at a time so that the suites of
+ * programs running together do not mix, or all of them at the end.
+ */
+static void take(struct program *p, bool all)
+{
+	size_t end = 0;
+	size_t at = 0;
+	size_t size;
+
+	while ((size = z_utest_event_size(p->buf + at, p->len - at))) {
+		struct z_utest_event ev;
+
+		memcpy(&ev, p->buf + at, sizeof(ev));
+		at += size;
+		if (all || ev.type == Z_UTEST_EVENT_SUITE_END ||
+		    ev.type == Z_UTEST_EVENT_RUN_END) {
+			end = at;
+		}
+	}
+
+	for (at = 0; at < end; at += z_utest_event_size(p->buf + at, end - at)) {
+		replay(p, p->buf + at);
+	}
+
+	memmove(p->buf, p->buf + end, p->len - end);
+	p->len -= end;
+}
+
+/* The program exited, report how if its results do not tell */
+static void finish(struct program *p, int status)
+{
+	char msg[160];
+
+	take(p, true);
+
+	if (WIFSIGNALED(status)) {
+		snprintf(msg, sizeof(msg),
+			 "\n    test program killed by signal %d (%s)\n",
+			 WTERMSIG(status), strsignal(WTERMSIG(status)));
+		report(p, TC_FAIL, msg);
+	} else if (p->ended) {
+		/* A utest program, its results tell */
+	} else if (p->events) {
+		snprintf(msg, sizeof(msg),
+			 "\n    test program exited with status %d before the "
+			 "end of its tests\n",
+			 WEXITSTATUS(status));
+		report(p, TC_FAIL, msg);
+	} else if (WEXITSTATUS(status)) {
+		snprintf(msg, sizeof(msg),
+			 "\n    test program exited with status %d\n",
+			 WEXITSTATUS(status));
+		report(p, TC_FAIL, msg);
+	} else {
+		report(p, TC_PASS, "");
+	}
+
+	free(p->buf);
+	p->buf = NULL;
+	p->len = 0;
+	p->size = 0;
+}
+
+/* Read what @a p sent, return false once it exited */
+static bool receive(struct program *p)
+{
+	ssize_t n;
+	int status = 0;
+
+	if (p->size - p->len < 4096) {
+		size_t size = p->size ? 2 * p->size : 65536;
+		char *grown = realloc(p->buf, size);
+
+		if (grown) {
+			p->buf = grown;
+			p->size = size;
+		}
+	}
+
+	n = p->size > p->len ? read(p->fd, p->buf + p->len, p->size - p->len) :
+			       0;
+	if (n < 0 && errno == EINTR) {
+		return true;
+	}
+	if (n > 0) {
+		p->len += (size_t)n;
+		p->events = true;
+		take(p, false);
+		return true;
+	}
+
+	close(p->fd);
+	p->fd = -1;
+	while (waitpid(p->pid, &status, 0) < 0 && errno == EINTR) {
+	}
+	finish(p, status);
+
+	return false;
+}
+
+/* Programs run together: a jobserver shares the jobs with their own */
+static int slots(void)
+{
+	int n = 1;
+
+	if (utest_option("jobs")) {
+		n = utest_fork_jobs();
+	} else if (z_utest_jobserver_fd() >= 0) {
+		n = count;
+	}
+
+	if (n > 1) {
+		z_utest_jobserver_create(n);
+	}
+
+	return n;
+}
+
+int z_utest_programs_run(void)
+{
+	const char *list = utest_option("programs");
+	struct pollfd *fds;
+	char **args;
+	int next = 0;
+	int running = 0;
+	int fail = 0;
+	int max;
+
+	if (!list || !*list) {
+		return 0;
+	}
+
+	load(list);
+	z_utest_jobserver_init();
+	max = slots();
+	args = z_utest_programs_args();
+	fds = calloc((size_t)count + 1, sizeof(*fds));
+	if (!args || !fds) {
+		free(args);
+		free(fds);
+		return count;
+	}
+
+	while (next < count || running) {
+		bool token;
+
+		while (next < count && running < max &&
+		       z_utest_jobserver_start(running)) {
+			struct program *p = &programs[next++];
+
+			if (start(p, args)) {
+				running++;
+				continue;
+			}
+			z_utest_jobserver_done(running);
+			report(p, TC_FAIL, "\n    cannot start test program\n");
+		}
+		if (!running) {
+			continue;
+		}
+		token = next < count && running < max;
+
+		for (int i = 0; i < count; i++) {
+			fds[i].fd = programs[i].fd;
+			fds[i].events = POLLIN;
+			fds[i].revents = 0;
+		}
+		fds[count].fd = token ? z_utest_jobserver_fd() : -1;
+		fds[count].events = POLLIN;
+		fds[count].revents = 0;
+
+		if (poll(fds, (nfds_t)count + 1, -1) < 0) {
+			continue;
+		}
+
+		for (int i = 0; i < count; i++) {
+			if (fds[i].revents && !receive(&programs[i])) {
+				running--;
+				z_utest_jobserver_done(running);
+			}
+		}
+	}
+
+	for (int i = 0; i < count; i++) {
+		fail += programs[i].fail;
+	}
+
+	free(args);
+	free(fds);
+
+	return fail;
+}
@@ -0,0 +1,777 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <utest.h>
+#include <utest_property.h>
+#include <utest_rng.h>
+#include <inttypes.h>
+#include <stdalign.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Raw choices consumed by the generators during one run */
+struct choices {
+	uint64_t *v;
+	size_t len;
+	size_t cap;
+};
+
+struct block {
+	struct block *next;
+	alignas(max_align_t) unsigned char data[];
+};
+
+static struct {
+	struct utest_rng rng;
+	/* Choices to replay, or NULL to draw fresh ones */
+	const struct choices *replay;
+	size_t pos;
+	/* Choices consumed by the current run */
+	struct choices rec;
+	/* Append the drawn values to the failure message */
+	bool describe;
+	/* Nesting of utest_gen_array() calls */
+	unsigned int depth;
+	unsigned int draws;
+	struct block *arena;
+} run;
+
+/* Shared with the workers of the parallel search */
+struct search {
+	uint64_t first_fail;
+	uint64_t passed;
+	uint64_t discarded;
+};
+
+static bool have_base_seed;
+static uint64_t base_seed;
+
+/* ------------------------------ PRNG ------------------------------- */
+
+static uint64_t rng_next(void)
+{
+	return utest_rng_next(&run.rng);
+}
+
+static uint64_t rng_below(uint64_t bound)
+{
+	return utest_rng_below(&run.rng, bound);
+}
+
+/* Value of @a bound or less, biased toward 0, small values and @a bound */
+static uint64_t rng_biased(uint64_t bound)
+{
+	switch (rng_next() & 7) {
+	case 0:
+		return 0;
+	case 1:
+		return bound;
+	case 2:
+		return rng_below(bound < 16 ? bound : 16);
+	default:
+		return rng_below(bound);
+	}
+}
+
+/* ------------------------------ arena ------------------------------ */
+
+void *utest_gen_alloc(size_t size)
+{
+	struct block *b = calloc(1, sizeof(*b) + size);
+
+	if (!b) {
+		z_utest_failure_printf("\n    property: out of memory\n");
+		utest_fail();
+	}
+
+	b->next = run.arena;
+	run.arena = b;
+
+	return b->data;
+}
+
+static void arena_free(void)
+{
+	while (run.arena) {
+		struct block *next = run.arena->next;
+
+		free(run.arena);
+		run.arena = next;
+	}
+}
+
+/* ----------------------------- choices ----------------------------- */
+
+static bool choices_reserve(struct choices *c, size_t len)
+{
+	uint64_t *v;
+	size_t cap;
+
+	if (len <= c->cap) {
+		return true;
+	}
+
+	cap = c->cap ? c->cap * 2 : 64;
+	while (cap < len) {
+		cap *= 2;
+	}
+
+	v = realloc(c->v, cap * sizeof(*v));
+	if (!v) {
+		return false;
+	}
+
+	c->v = v;
+	c->cap = cap;
+
+	return true;
+}
+
+static bool choices_copy(struct choices *dst, const struct choices *src)
+{
+	if (!choices_reserve(dst, src->len)) {
+		return false;
+	}
+
+	memcpy(dst->v, src->v, src->len * sizeof(*src->v));
+	dst->len = src->len;
+
+	return true;
+}
+
+/* Shortlex order: fewer choices first, then smaller ones */
+static bool simpler(const struct choices *a, const struct choices *b)
+{
+	if (a->len != b->len) {
+		return a->len < b->len;
+	}
+
+	for (size_t i = 0; i < a->len; i++) {
+		if (a->v[i] != b->v[i]) {
+			return a->v[i] < b->v[i];
+		}
+	}
+
+	return false;
+}
+
+/*
+ * The primitive all generators are built on: a choice in [0, bound], read
+ * from the replayed sequence or @a fresh, and recorded either way. Replayed
+ * choices out of range are folded in, missing ones read as 0.
+ */
+static uint64_t draw(uint64_t bound, uint64_t fresh)
+{
+	uint64_t v = fresh;
+
+	if (run.replay) {
+		v = run.pos < run.replay->len ? run.replay->v[run.pos] : 0;
+		run.pos++;
+		if (v > bound) {
+			v %= bound + 1;
+		}
+	}
+
+	if (!choices_reserve(&run.rec, run.rec.len + 1)) {
+		z_utest_failure_printf("\n    property: out of memory\n");
+		utest_fail();
+	}
+	run.rec.v[run.rec.len++] = v;
+
+	return v;
+}
+
+static bool describing(void)
+{
+	return run.describe;
+}
+
+/* Draws made by element generators are indented under their array */
+#define DESCRIBE(fmt, ...)                                                    \
+	z_utest_failure_printf("\n    %*sdraw %u: " fmt, (int)run.depth * 2,   \
+			       "", run.draws, ##__VA_ARGS__)
+
+/* ---------------------------- generators --------------------------- */
+
+bool utest_gen_bool(void)
+{
+	bool v = draw(1, rng_next() & 1);
+
+	if (describing()) {
+		DESCRIBE("%s", v ? "true" : "false");
+	}
+	run.draws++;
+
+	return v;
+}
+
+uint64_t utest_gen_u64(void)
+{
+	uint64_t v = draw(UINT64_MAX, rng_biased(UINT64_MAX));
+
+	if (describing()) {
+		DESCRIBE("%" PRIu64 " (0x%" PRIx64 ")", v, v);
+	}
+	run.draws++;
+
+	return v;
+}
+
+uint32_t utest_gen_u32(void)
+{
+	uint32_t v = (uint32_t)draw(UINT32_MAX, rng_biased(UINT32_MAX));
+
+	if (describing()) {
+		DESCRIBE("%" PRIu32 " (0x%" PRIx32 ")", v, v);
+	}
+	run.draws++;
+
+	return v;
+}
+
+/*
+ * Choice c in [0, max - min] stands for the c-th simplest integer of the
+ * range: 0, 1, -1, 2, -2, ... when the range contains 0, the values going
+ * away from the bound closest to 0 otherwise.
+ */
+static int64_t int_from_choice(int64_t min, int64_t max, uint64_t c)
+{
+	uint64_t pos;
+	uint64_t neg;
+	uint64_t m;
+	uint64_t j;
+	bool negative;
+
+	if (min >= 0) {
+		return (int64_t)((uint64_t)min + c);
+	}
+	if (max <= 0) {
+		return (int64_t)((uint64_t)max - c);
+	}
+
+	pos = (uint64_t)max;
+	neg = 0 - (uint64_t)min;
+	m = pos < neg ? pos : neg;
+
+	if (c == 0) {
+		return 0;
+	} else if (c <= 2 * m) {
+		j = (c + 1) / 2;
+		negative = !(c & 1);
+	} else {
+		j = m + (c - 2 * m);
+		negative = neg > pos;
+	}
+
+	return negative ? (int64_t)(0 - j) : (int64_t)j;
+}
+
+int64_t utest_gen_int(int64_t min, int64_t max)
+{
+	uint64_t span;
+	int64_t v;
+
+	if (min > max) {
+		int64_t tmp = min;
+
+		min = max;
+		max = tmp;
+	}
+
+	span = (uint64_t)max - (uint64_t)min;
+	v = int_from_choice(min, max, draw(span, rng_biased(span)));
+
+	if (describing()) {
+		DESCRIBE("%" PRId64, v);
+	}
+	run.draws++;
+
+	return v;
+}
+
+size_t utest_gen_size(size_t min, size_t max)
+{
+	size_t v;
+
+	if (min > max) {
+		return min;
+	}
+
+	v = min + (size_t)draw(max - min, rng_biased(max - min));
+
+	if (describing()) {
+		DESCRIBE("%zu", v);
+	}
+	run.draws++;
+
+	return v;
+}
+
+size_t utest_gen_choice(size_t n)
+{
+	size_t v = 0;
+
+	if (n) {
+		v = (size_t)draw(n - 1, rng_below(n - 1));
+	}
+
+	if (describing()) {
+		DESCRIBE("choice %zu of %zu", v, n);
+	}
+	run.draws++;
+
+	return v;
+}
+
+double utest_gen_double(double min, double max)
+{
+	const uint64_t steps = (uint64_t)1 << 53;
+	uint64_t c = draw(steps - 1, (rng_next() & 7) ? rng_below(steps - 1) : 0);
+	double v = min + (max - min) * ((double)c / (double)steps);
+
+	if (describing()) {
+		DESCRIBE("%.17g", v);
+	}
+	run.draws++;
+
+	return v;
+}
+
+/*
+ * Collections draw a "one more" flag before each optional element, so that
+ * deleting a flag and the element choices after it removes one element.
+ * Fresh runs decide up front how many elements they want.
+ */
+struct collection {
+	size_t min;
+	size_t max;
+	size_t target;
+	size_t count;
+};
+
+static void collection_init(struct collection *col, size_t min, size_t max)
+{
+	col->min = min;
+	col->max = max < min ? min : max;
+	col->target = min + (size_t)rng_biased(col->max - min);
+	col->count = 0;
+}
+
+static bool collection_more(struct collection *col)
+{
+	if (col->count >= col->max) {
+		return false;
+	}
+
+	if (col->count >= col->min && !draw(1, col->count < col->target)) {
+		return false;
+	}
+
+	col->count++;
+
+	return true;
+}
+
+static void *grow(void *old, size_t used, size_t *cap, size_t elem_size)
+{
+	void *data;
+
+	*cap = *cap ? *cap * 2 : 16;
+	data = utest_gen_alloc(*cap * elem_size);
+	if (used) {
+		memcpy(data, old, used * elem_size);
+	}
+
+	return data;
+}
+
+const uint8_t *utest_gen_bytes(size_t min_len, size_t max_len, size_t *len)
+{
+	struct collection col;
+	uint8_t *data = NULL;
+	size_t cap = 0;
+
+	collection_init(&col, min_len, max_len);
+
+	while (collection_more(&col)) {
+		if (col.count > cap) {
+			data = grow(data, col.count - 1, &cap, 1);
+		}
+		data[col.count - 1] = (uint8_t)draw(UINT8_MAX,
+						    rng_below(UINT8_MAX));
+	}
+
+	*len = col.count;
+
+	if (describing()) {
+		DESCRIBE("%zu bytes", col.count);
+		for (size_t i = 0; i < col.count && i < 32; i++) {
+			z_utest_failure_printf("%s%02x", i ? " " : ": ", data[i]);
+		}
+		if (col.count > 32) {
+			z_utest_failure_printf(" ...");
+		}
+	}
+	run.draws++;
+
+	return data ? data : utest_gen_alloc(1);
+}
+
+/* Ordered from the simplest character */
+static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz"
+			       "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+			       "0123456789"
+			       " !\"#$%&'()*+,-./:;<=>?@[\\]^_`{|}~";
+
+const char *utest_gen_string(size_t min_len, size_t max_len)
+{
+	const uint64_t last = sizeof(alphabet) - 2;
+	struct collection col;
+	char *str = NULL;
+	size_t cap = 0;
+
+	collection_init(&col, min_len, max_len);
+
+	while (collection_more(&col)) {
+		if (col.count + 1 > cap) {
+			str = grow(str, col.count - 1, &cap, 1);
+		}
+		str[col.count - 1] = alphabet[draw(last, rng_below(last))];
+	}
+
+	if (!str) {
+		str = utest_gen_alloc(1);
+	}
+	str[col.count] = '\0';
+
+	if (describing()) {
+		DESCRIBE("\"%.64s\"%s", str, col.count > 64 ? "..." : "");
+	}
+	run.draws++;
+
+	return str;
+}
+
+void *utest_gen_array(size_t min_count, size_t max_count, size_t elem_size,
+		      void (*gen)(void *elem), size_t *count)
+{
+	struct collection col;
+	char *data = NULL;
+	size_t cap = 0;
+
+	collection_init(&col, min_count, max_count);
+
+	if (describing()) {
+		DESCRIBE("array of %zu to %zu elements", col.min, col.max);
+	}
+	run.draws++;
+	run.depth++;
+
+	while (collection_more(&col)) {
+		if (col.count > cap) {
+			data = grow(data, col.count - 1, &cap, elem_size);
+		}
+		memset(data + (col.count - 1) * elem_size, 0, elem_size);
+		gen(data + (col.count - 1) * elem_size);
+	}
+
+	run.depth--;
+	*count = col.count;
+
+	return data ? data : utest_gen_alloc(elem_size ? elem_size : 1);
+}
+
+/* ------------------------------ runner ----------------------------- */
+
+/* Run @a body once, with fresh choices from @a seed or replaying @a replay */
+static int attempt(void (*body)(void), const struct choices *replay,
+		   uint64_t seed)
+{
+	int ret;
+
+	run.replay = replay;
+	run.pos = 0;
+	run.rec.len = 0;
+	run.depth = 0;
+	run.draws = 0;
+	utest_rng_seed(&run.rng, seed);
+
+	ret = z_utest_try(body);
+	arena_free();
+
+	return ret;
+}
+
+static uint64_t run_seed(uint64_t seed, uint64_t index)
+{
+	return utest_hash_combine(seed, index);
+}
+
+static uint64_t get_base_seed(void)
+{
+	const char *value = utest_option("seed");
+	struct timespec now;
+
+	if (have_base_seed) {
+		return base_seed;
+	}
+
+	if (value && *value) {
+		base_seed = strtoull(value, NULL, 0);
+	} else {
+		clock_gettime(CLOCK_REALTIME, &now);
+		base_seed = utest_hash_combine((uint64_t)now.tv_nsec,
+					       (uint64_t)now.tv_sec ^
+						       (uint64_t)getpid());
+	}
+	have_base_seed = true;
+
+	return base_seed;
+}
+
+static void search_range(void (*body)(void), uint64_t seed, uint64_t first,
+			 uint64_t step, uint64_t iterations,
+			 struct search *s)
+{
+	for (uint64_t i = first; i < iterations; i += step) {
+		uint64_t found = __atomic_load_n(&s->first_fail,
+						 __ATOMIC_RELAXED);
+
+		/* A run with a lower index already failed */
+		if (i > found) {
+			return;
+		}
+
+		switch (attempt(body, NULL, run_seed(seed, i))) {
+		case TC_FAIL:
+			while (i < found &&
+			       !__atomic_compare_exchange_n(&s->first_fail,
+							    &found, i, false,
+							    __ATOMIC_RELAXED,
+							    __ATOMIC_RELAXED)) {
+			}
+			return;
+		case TC_SKIP:
+			__atomic_fetch_add(&s->discarded, 1, __ATOMIC_RELAXED);
+			break;
+		default:
+			__atomic_fetch_add(&s->passed, 1, __ATOMIC_RELAXED);
+			break;
+		}
+	}
+}
+
+/* Find the first failing run, spread over @a workers processes */
+static void search(void (*body)(void), uint64_t seed, uint64_t iterations,
+		   int workers, struct search *s)
+{
+	pid_t pids[workers];
+
+	if (workers <= 1) {
+		search_range(body, seed, 0, 1, iterations, s);
+		return;
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+
+	for (int w = 0; w < workers; w++) {
+		pids[w] = fork();
+		if (pids[w] == 0) {
+			search_range(body, seed, (uint64_t)w, (uint64_t)workers,
+				     iterations, s);
+			fflush(stdout);
+			fflush(stderr);
+			_exit(0);
+		}
+	}
+
+	for (int w = 0; w < workers; w++) {
+		int status;
+
+		if (pids[w] < 0) {
+			/* Could not fork, do this share here */
+			search_range(body, seed, (uint64_t)w,
+				     (uint64_t)workers, iterations, s);
+			continue;
+		}
+		waitpid(pids[w], &status, 0);
+	}
+}
+
+/* Shrink the failing choices in @a best, return the number of runs spent */
+static unsigned long shrink(void (*body)(void), struct choices *best,
+			    unsigned long budget)
+{
+	struct choices cand = {0};
+	unsigned long spent = 0;
+	bool progress = true;
+
+#define TRY()                                                                 \
+	(spent < budget && (spent++, z_utest_failure_reset(),                 \
+			    attempt(body, &cand, 0) == TC_FAIL) &&            \
+	 simpler(&run.rec, best) && choices_copy(best, &run.rec))
+
+	while (progress && spent < budget) {
+		progress = false;
+
+		/* Delete spans of choices, i.e. elements and whole draws */
+		for (size_t k = 8; k; k /= 2) {
+			for (size_t i = best->len; i-- > 0 && spent < budget;) {
+				if (i + k > best->len ||
+				    !choices_reserve(&cand, best->len)) {
+					continue;
+				}
+				memcpy(cand.v, best->v, i * sizeof(*cand.v));
+				memcpy(cand.v + i, best->v + i + k,
+				       (best->len - i - k) * sizeof(*cand.v));
+				cand.len = best->len - k;
+				if (TRY()) {
+					progress = true;
+				}
+			}
+		}
+
+		/* Lower each choice, first to 0 then by bisection */
+		for (size_t i = 0; i < best->len && spent < budget; i++) {
+			uint64_t lo = 0;
+			uint64_t hi = best->v[i];
+
+			if (!hi || !choices_copy(&cand, best)) {
+				continue;
+			}
+
+			cand.v[i] = 0;
+			if (TRY()) {
+				progress = true;
+				continue;
+			}
+
+			while (lo + 1 < hi && spent < budget) {
+				uint64_t mid = lo + (hi - lo) / 2;
+
+				if (!choices_copy(&cand, best)) {
+					break;
+				}
+				cand.v[i] = mid;
+				if (TRY()) {
+					progress = true;
+					if (i >= best->len || best->v[i] != mid) {
+						break;
+					}
+					hi = mid;
+				} else {
+					lo = mid;
+				}
+			}
+		}
+	}
+
+#undef TRY
+
+	free(cand.v);
+
+	return spent;
+}
+
+void z_utest_property_run(void (*body)(void))
+{
+	long iterations = utest_option_long("property-iterations",
+					    CONFIG_utest_PROPERTY_ITERATIONS);
+	long budget = utest_option_long("property-shrinks",
+					CONFIG_utest_PROPERTY_SHRINKS);
+	uint64_t base = get_base_seed();
+	char id[Z_UTEST_TEST_ID_MAX];
+	struct choices best = {0};
+	struct search *s;
+	uint64_t seed;
+	uint64_t failed;
+	uint64_t passed;
+	uint64_t discarded;
+	unsigned long shrinks = 0;
+	int workers = (int)utest_option_long("property-jobs", utest_fork_jobs());
+	int ret;
+
+	utest_test_id(z_utest_report_current_suite(),
+		      z_utest_report_current_test(), id, sizeof(id));
+	seed = utest_hash64(id, strlen(id), base);
+
+	if (iterations <= 0) {
+		iterations = 1;
+	}
+	workers = z_utest_fork_workers(workers);
+	if (workers > iterations) {
+		workers = (int)iterations;
+	}
+
+	s = mmap(NULL, sizeof(*s), PROT_READ | PROT_WRITE,
+		 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (s == MAP_FAILED) {
+		z_utest_failure_printf("\n    property: cannot map search state\n");
+		utest_fail();
+	}
+	s->first_fail = UINT64_MAX;
+	s->passed = 0;
+	s->discarded = 0;
+
+	search(body, seed, (uint64_t)iterations, workers, s);
+
+	failed = s->first_fail;
+	passed = s->passed;
+	discarded = s->discarded;
+	munmap(s, sizeof(*s));
+
+	if (failed == UINT64_MAX) {
+		z_utest_failure_reset();
+		if (!passed && discarded) {
+			z_utest_failure_printf("\n    property: all %" PRIu64
+					       " runs discarded\n", discarded);
+			utest_skip();
+		}
+		return;
+	}
+
+	/* Record the choices of the failing run, then shrink them */
+	z_utest_failure_reset();
+	ret = attempt(body, NULL, run_seed(seed, failed));
+	if (ret == TC_FAIL && choices_copy(&best, &run.rec)) {
+		shrinks = shrink(body, &best, budget > 0 ? (unsigned long)budget
+							 : 0);
+	}
+
+	/* Replay the smallest counterexample for the message and trace */
+	z_utest_failure_reset();
+	z_utest_trace_reset();
+	if (ret == TC_FAIL) {
+		run.describe = true;
+		z_utest_failure_printf("\n    falsifying example:");
+		ret = attempt(body, best.v ? &best : NULL,
+			      run_seed(seed, failed));
+		run.describe = false;
+	}
+
+	free(best.v);
+	free(run.rec.v);
+	run.rec = (struct choices){0};
+
+	if (ret != TC_FAIL) {
+		z_utest_failure_reset();
+		z_utest_failure_printf("\n    property: run %" PRIu64
+				       " failed once but passes when replayed, "
+				       "is it deterministic?\n",
+				       failed);
+	}
+
+	z_utest_failure_printf("    property falsified by run %" PRIu64
+			       " of %ld, %lu shrinking runs\n"
+			       "    reproduce with --seed=0x%" PRIx64
+			       " --filter=%s\n",
+			       failed, iterations, shrinks, base, id);
+	utest_fail();
+}
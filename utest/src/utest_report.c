@@ -0,0 +1,576 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <utest.h>
+#include <utest_report.h>
+#include <utest_capture.h>
+#include <utest_flaky.h>
+#include <utest_trace.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+static struct utest_reporter *reporters;
+
+/* Set in forked test children, results go there instead of the reporters */
+static void (*result_sink)(const struct utest_result *result);
+
+static const char *current_suite = "";
+static const char *current_test = "";
+static struct timespec test_start_time;
+static struct rusage test_start_usage;
+
+static char failure_msg[CONFIG_utest_FAILURE_MSG_SIZE];
+static size_t failure_len;
+
+static uint64_t elapsed_ns(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t)(now.tv_sec - start->tv_sec) * 1000000000u +
+	       (uint64_t)(now.tv_nsec - start->tv_nsec);
+}
+
+int z_utest_stdout_fd(void)
+{
+	static int fd = -1;
+
+	if (fd < 0) {
+		fflush(stdout);
+		fd = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 3);
+		if (fd < 0) {
+			fd = STDOUT_FILENO;
+		}
+	}
+
+	return fd;
+}
+
+/* ------------------------- output buffer --------------------------- */
+
+int z_utest_write_all(int fd, const void *buf, size_t len)
+{
+	const char *data = buf;
+
+	while (len) {
+		ssize_t n = write(fd, data, len);
+
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return -1;
+		}
+		data += n;
+		len -= (size_t)n;
+	}
+
+	return 0;
+}
+
+#define write_all(fd, data, len) ((void)z_utest_write_all(fd, data, len))
+
+void utest_outbuf_init(struct utest_outbuf *out, int fd, char *buf,
+		       size_t size)
+{
+	out->fd = fd;
+	out->buf = buf;
+	out->len = 0;
+	out->size = size;
+}
+
+void utest_outbuf_flush(struct utest_outbuf *out)
+{
+	write_all(out->fd, out->buf, out->len);
+	out->len = 0;
+}
+
+void utest_outbuf_write(struct utest_outbuf *out, const char *data,
+			size_t len)
+{
+	if (out->len + len > out->size) {
+		utest_outbuf_flush(out);
+	}
+
+	if (len > out->size) {
+		write_all(out->fd, data, len);
+		return;
+	}
+
+	memcpy(out->buf + out->len, data, len);
+	out->len += len;
+}
+
+void utest_outbuf_puts(struct utest_outbuf *out, const char *str)
+{
+	utest_outbuf_write(out, str, strlen(str));
+}
+
+void utest_outbuf_vprintf(struct utest_outbuf *out, const char *fmt,
+			  va_list vargs)
+{
+	va_list copy;
+	char *big;
+	int n;
+
+	va_copy(copy, vargs);
+	n = vsnprintf(out->buf + out->len, out->size - out->len, fmt, copy);
+	va_end(copy);
+
+	if (n < 0) {
+		return;
+	}
+
+	if ((size_t)n < out->size - out->len) {
+		out->len += (size_t)n;
+		return;
+	}
+
+	/* Did not fit, make room and retry */
+	utest_outbuf_flush(out);
+
+	if ((size_t)n < out->size) {
+		out->len = (size_t)vsnprintf(out->buf, out->size, fmt, vargs);
+		return;
+	}
+
+	/* Larger than the whole buffer, a failure message can be */
+	big = malloc((size_t)n + 1);
+	if (!big) {
+		/* Better truncated than nothing */
+		vsnprintf(out->buf, out->size, fmt, vargs);
+		out->len = out->size - 1;
+		return;
+	}
+
+	vsnprintf(big, (size_t)n + 1, fmt, vargs);
+	write_all(out->fd, big, (size_t)n);
+	free(big);
+}
+
+void utest_outbuf_printf(struct utest_outbuf *out, const char *fmt, ...)
+{
+	va_list vargs;
+
+	va_start(vargs, fmt);
+	utest_outbuf_vprintf(out, fmt, vargs);
+	va_end(vargs);
+}
+
+/* ------------------------- console reporter ------------------------ */
+
+static char console_buf[CONFIG_utest_REPORT_BUFFER_SIZE];
+static struct utest_outbuf console_out;
+static bool console_usage;
+/* Output of the tests goes to the console too */
+static bool console_live;
+/* ... which is a terminal */
+static bool console_tty;
+/* Test whose line is started, empty if none */
+static char console_open[256];
+
+/*
+ * Unless it is captured, what the tests print must show up next to their
+ * results, as it used to. On a terminal, stdio is flushed before each line
+ * is written, and the line is written out as soon as it is complete. To a
+ * file or a pipe, lines go through stdio along with the output of the
+ * tests, which keeps them in order and batches the writes like the
+ * printf() of old.
+ */
+static void console_sync(void)
+{
+	if (console_tty) {
+		fflush(stdout);
+	}
+}
+
+static void console_done(void)
+{
+	if (console_tty) {
+		utest_outbuf_flush(&console_out);
+	} else if (console_live) {
+		fwrite(console_out.buf, 1, console_out.len, stdout);
+		console_out.len = 0;
+	}
+}
+
+static void console_run_start(struct utest_reporter *rep)
+{
+	(void)rep;
+
+	/* Anything already sitting in stdio must come out first */
+	fflush(stdout);
+	utest_outbuf_init(&console_out, z_utest_stdout_fd(), console_buf,
+			  sizeof(console_buf));
+	console_usage = utest_option_enabled("usage");
+	console_live = !utest_option_enabled("capture");
+	console_tty = console_live && isatty(STDOUT_FILENO);
+	console_open[0] = '\0';
+}
+
+static void console_suite_start(struct utest_reporter *rep, const char *suite)
+{
+	(void)rep;
+	(void)suite;
+
+	console_sync();
+	utest_outbuf_puts(&console_out, "\n");
+	console_done();
+}
+
+static void console_test_start(struct utest_reporter *rep, const char *suite,
+			       const char *name)
+{
+	(void)rep;
+	(void)suite;
+
+	/* Tests running together would share the line */
+	if (!console_live || console_open[0] || utest_fork_jobs() > 1) {
+		return;
+	}
+
+	console_sync();
+	utest_outbuf_printf(&console_out, ".%s ", name);
+	console_done();
+	snprintf(console_open, sizeof(console_open), "%s", name);
+}
+
+static void console_test_end(struct utest_reporter *rep,
+			     const struct utest_result *result)
+{
+	(void)rep;
+
+	console_sync();
+	if (!console_open[0]) {
+		utest_outbuf_printf(&console_out, ".%s ", result->name);
+	} else if (strncmp(console_open, result->name,
+			   sizeof(console_open) - 1)) {
+		/* Not the test the line was started for */
+		utest_outbuf_printf(&console_out, "\n.%s ", result->name);
+	}
+	console_open[0] = '\0';
+
+	if (console_usage && result->status != TC_CACHED) {
+		const struct utest_usage *u = &result->usage;
+
+		utest_outbuf_printf(
+			&console_out,
+			"(cpu %.3f+%.3f ms, rss %llu KiB, faults %llu+%llu, "
+			"switches %llu+%llu) ",
+			u->user_ns / 1e6, u->system_ns / 1e6,
+			(unsigned long long)u->max_rss_kb,
+			(unsigned long long)u->minor_faults,
+			(unsigned long long)u->major_faults,
+			(unsigned long long)u->voluntary_switches,
+			(unsigned long long)u->involuntary_switches);
+	}
+	utest_outbuf_write(&console_out, result->message, result->message_len);
+	if (result->captured_stdout_len) {
+		utest_outbuf_puts(&console_out, "\n--- captured stdout ---\n");
+		utest_outbuf_write(&console_out, result->captured_stdout,
+				   result->captured_stdout_len);
+	}
+	if (result->captured_stderr_len) {
+		utest_outbuf_puts(&console_out, "\n--- captured stderr ---\n");
+		utest_outbuf_write(&console_out, result->captured_stderr,
+				   result->captured_stderr_len);
+	}
+	utest_outbuf_printf(&console_out, " %s .\n",
+			    TC_RESULT_TO_STR(result->status));
+	console_done();
+}
+
+static void console_suite_end(struct utest_reporter *rep, const char *suite,
+			      int result)
+{
+	(void)rep;
+	(void)suite;
+	(void)result;
+
+	/* Keep the console reasonably live for interactive runs */
+	if (console_live) {
+		console_done();
+	} else {
+		utest_outbuf_flush(&console_out);
+	}
+}
+
+static void console_run_end(struct utest_reporter *rep, int result)
+{
+	(void)rep;
+
+	console_sync();
+	utest_outbuf_printf(&console_out, "\nPROJECT EXECUTION %s\n",
+			    result == TC_PASS ? "SUCCESSFUL" : "FAILED");
+	console_done();
+	fflush(stdout);
+	utest_outbuf_flush(&console_out);
+}
+
+struct utest_reporter utest_console_reporter = {
+	.name = "console",
+	.on_run_start = console_run_start,
+	.on_suite_start = console_suite_start,
+	.on_test_start = console_test_start,
+	.on_test_end = console_test_end,
+	.on_suite_end = console_suite_end,
+	.on_run_end = console_run_end,
+};
+
+/* ------------------------- registration ---------------------------- */
+
+void utest_register_reporter(struct utest_reporter *rep)
+{
+	struct utest_reporter **it = &reporters;
+
+	while (*it) {
+		if (*it == rep) {
+			return;
+		}
+		it = &(*it)->next;
+	}
+
+	rep->next = NULL;
+	*it = rep;
+}
+
+void utest_unregister_reporter(struct utest_reporter *rep)
+{
+	struct utest_reporter **it = &reporters;
+
+	while (*it) {
+		if (*it == rep) {
+			*it = rep->next;
+			rep->next = NULL;
+			return;
+		}
+		it = &(*it)->next;
+	}
+}
+
+/* ------------------------- failure message ------------------------- */
+
+void z_utest_failure_vprintf(const char *fmt, va_list vargs)
+{
+	size_t room = sizeof(failure_msg) - failure_len;
+	int n;
+
+	if (room <= 1) {
+		return;
+	}
+
+	n = vsnprintf(failure_msg + failure_len, room, fmt, vargs);
+	if (n < 0) {
+		return;
+	}
+
+	failure_len += ((size_t)n < room) ? (size_t)n : room - 1;
+}
+
+void z_utest_failure_printf(const char *fmt, ...)
+{
+	va_list vargs;
+
+	va_start(vargs, fmt);
+	z_utest_failure_vprintf(fmt, vargs);
+	va_end(vargs);
+}
+
+/* ------------------------- event dispatch -------------------------- */
+
+#define FOR_EACH_REPORTER(rep) \
+	for (struct utest_reporter *rep = reporters; rep; rep = rep->next)
+
+void z_utest_report_run_start(void)
+{
+	FOR_EACH_REPORTER(rep) {
+		if (rep->on_run_start) {
+			rep->on_run_start(rep);
+		}
+	}
+}
+
+void z_utest_report_suite_start(const char *suite)
+{
+	current_suite = suite;
+
+	FOR_EACH_REPORTER(rep) {
+		if (rep->on_suite_start) {
+			rep->on_suite_start(rep, suite);
+		}
+	}
+}
+
+void z_utest_failure_reset(void)
+{
+	failure_len = 0;
+	failure_msg[0] = '\0';
+}
+
+const char *z_utest_failure_message(size_t *len)
+{
+	*len = failure_len;
+
+	return failure_msg;
+}
+
+void z_utest_failure_truncate(size_t len)
+{
+	if (len < failure_len) {
+		failure_len = len;
+		failure_msg[len] = '\0';
+	}
+}
+
+static void begin_test(const char *name)
+{
+	current_test = name;
+	z_utest_failure_reset();
+	z_utest_trace_reset();
+	z_utest_capture_start();
+	getrusage(RUSAGE_SELF, &test_start_usage);
+	clock_gettime(CLOCK_MONOTONIC, &test_start_time);
+}
+
+static void notify_test_start(void)
+{
+	if (result_sink) {
+		return;
+	}
+
+	FOR_EACH_REPORTER(rep) {
+		if (rep->on_test_start) {
+			rep->on_test_start(rep, current_suite, current_test);
+		}
+	}
+}
+
+void z_utest_report_test_start(const char *name)
+{
+	begin_test(name);
+	notify_test_start();
+}
+
+void z_utest_report_result(const struct utest_result *result)
+{
+	struct utest_result res;
+
+	if (result_sink) {
+		result_sink(result);
+		return;
+	}
+
+	/* Not reported when the test runs again */
+	if (!z_utest_flaky_filter(result, &res)) {
+		return;
+	}
+
+	FOR_EACH_REPORTER(rep) {
+		if (rep->on_test_end) {
+			rep->on_test_end(rep, &res);
+		}
+	}
+}
+
+void z_utest_report_test_end(int result)
+{
+	struct utest_result res;
+	struct rusage usage;
+
+	if (result == TC_FAIL) {
+		z_utest_trace_dump_failure();
+	}
+
+	res = (struct utest_result){
+		.suite = current_suite,
+		.name = current_test,
+		.status = result,
+		.duration_ns = elapsed_ns(&test_start_time),
+		.message = failure_msg,
+		.message_len = failure_len,
+	};
+
+	getrusage(RUSAGE_SELF, &usage);
+	z_utest_usage_from(&usage, &test_start_usage, &res.usage);
+
+	z_utest_capture_stop();
+
+	/* Output of passing tests is not worth reporting */
+	if (result == TC_FAIL) {
+		res.captured_stdout = utest_captured_output(
+			STDOUT_FILENO, &res.captured_stdout_len);
+		res.captured_stderr = utest_captured_output(
+			STDERR_FILENO, &res.captured_stderr_len);
+	}
+
+	z_utest_report_result(&res);
+	z_utest_capture_release();
+}
+
+void z_utest_report_set_sink(void (*sink)(const struct utest_result *result))
+{
+	result_sink = sink;
+}
+
+const char *z_utest_report_current_suite(void)
+{
+	return current_suite;
+}
+
+const char *z_utest_report_current_test(void)
+{
+	return current_test;
+}
+
+void z_utest_report_test_dispatched(const char *name)
+{
+	current_test = name;
+	notify_test_start();
+}
+
+/*
+ * Suite and shared fixtures are only reported, as a test named after
+ * @a label, when they do not pass.
+ */
+void z_utest_report_fixture_start(const char *label)
+{
+	begin_test(label);
+}
+
+void z_utest_report_fixture_end(int result)
+{
+	if (result == TC_PASS) {
+		z_utest_capture_stop();
+		z_utest_capture_release();
+		return;
+	}
+
+	notify_test_start();
+	z_utest_report_test_end(result);
+}
+
+void z_utest_report_suite_end(const char *suite, int result)
+{
+	FOR_EACH_REPORTER(rep) {
+		if (rep->on_suite_end) {
+			rep->on_suite_end(rep, suite, result);
+		}
+	}
+}
+
+void z_utest_report_end(int result)
+{
+	FOR_EACH_REPORTER(rep) {
+		if (rep->on_run_end) {
+			rep->on_run_end(rep, result);
+		}
+	}
+}
@@ -0,0 +1,672 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Streaming machine readable reporters: JUnit XML, JSON Lines and TAP.
+ *
+ * Every result is formatted as soon as the test finishes into a fixed size
+ * buffer, so memory use does not depend on the number of tests.
+ */
+
+#include <utest.h>
+#include <utest_options.h>
+#include <utest_report.h>
+#include <utest_programs.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+struct stream_reporter {
+	struct utest_reporter rep;
+	struct utest_outbuf out;
+	/* JUnit only: suite counters can be patched in place with pwrite() */
+	bool seekable;
+	off_t suite_counts_off;
+	unsigned int suite_tests;
+	unsigned int suite_failures;
+	unsigned int suite_skipped;
+	uint64_t suite_ns;
+	unsigned int tests;
+	unsigned int failures;
+	unsigned int skipped;
+	char buf[CONFIG_utest_REPORT_BUFFER_SIZE];
+};
+
+#define TO_STREAM(r) ((struct stream_reporter *)(r)->user_data)
+
+static void count_result(struct stream_reporter *s,
+			 const struct utest_result *result)
+{
+	s->suite_tests++;
+	s->tests++;
+	s->suite_ns += result->duration_ns;
+
+	if (result->status == TC_FAIL) {
+		s->suite_failures++;
+		s->failures++;
+	} else if (result->status == TC_SKIP) {
+		s->suite_skipped++;
+		s->skipped++;
+	}
+}
+
+static void reset_suite_counts(struct stream_reporter *s)
+{
+	s->suite_tests = 0;
+	s->suite_failures = 0;
+	s->suite_skipped = 0;
+	s->suite_ns = 0;
+}
+
+/* Skip the blank lines the assertion messages start with */
+static const char *first_line(const char *msg, size_t len, size_t *line_len)
+{
+	const char *end = msg + len;
+	const char *eol;
+
+	while (msg < end && (*msg == '\n' || *msg == ' ' || *msg == '\t')) {
+		msg++;
+	}
+
+	eol = memchr(msg, '\n', (size_t)(end - msg));
+	*line_len = (size_t)((eol ? eol : end) - msg);
+
+	return msg;
+}
+
+/* Length of the valid UTF-8 sequence @a str starts with, 0 if none */
+static size_t utf8_len(const char *str, size_t len)
+{
+	const unsigned char *u = (const unsigned char *)str;
+	uint32_t cp;
+	size_t n;
+
+	if (u[0] < 0x80) {
+		return 1;
+	} else if (u[0] >= 0xc2 && u[0] <= 0xdf) {
+		n = 2;
+		cp = u[0] & 0x1f;
+	} else if ((u[0] & 0xf0) == 0xe0) {
+		n = 3;
+		cp = u[0] & 0x0f;
+	} else if (u[0] >= 0xf0 && u[0] <= 0xf4) {
+		n = 4;
+		cp = u[0] & 0x07;
+	} else {
+		return 0;
+	}
+
+	if (n > len) {
+		return 0;
+	}
+	for (size_t i = 1; i < n; i++) {
+		if ((u[i] & 0xc0) != 0x80) {
+			return 0;
+		}
+		cp = (cp << 6) | (u[i] & 0x3f);
+	}
+
+	/* Overlong forms, surrogates and code points past U+10FFFF */
+	if ((n == 3 && cp < 0x800) || (n == 4 && cp < 0x10000) ||
+	    (cp >= 0xd800 && cp <= 0xdfff) || cp > 0x10ffff) {
+		return 0;
+	}
+
+	return n;
+}
+
+/* ------------------------------ JUnit ------------------------------ */
+
+static void xml_escape(struct utest_outbuf *out, const char *str, size_t len)
+{
+	size_t start = 0;
+
+	for (size_t i = 0; i < len; i++) {
+		unsigned char c = (unsigned char)str[i];
+		size_t n = c >= 0x80 ? utf8_len(str + i, len - i) : 1;
+		const char *esc;
+
+		switch (c) {
+		case '&':
+			esc = "&amp;";
+			break;
+		case '<':
+			esc = "&lt;";
+			break;
+		case '>':
+			esc = "&gt;";
+			break;
+		case '"':
+			esc = "&quot;";
+			break;
+		case '\'':
+			esc = "&apos;";
+			break;
+		case '\t':
+		case '\n':
+		case '\r':
+			continue;
+		default:
+			if (!n) {
+				/* The document is declared as UTF-8 */
+				esc = "&#xFFFD;";
+				break;
+			}
+			if (c >= 0x20) {
+				i += n - 1;
+				continue;
+			}
+			/* Not representable in XML 1.0, even as a reference */
+			esc = "?";
+			break;
+		}
+
+		utest_outbuf_write(out, str + start, i - start);
+		utest_outbuf_puts(out, esc);
+		start = i + 1;
+	}
+
+	utest_outbuf_write(out, str + start, len - start);
+}
+
+static void xml_escape_str(struct utest_outbuf *out, const char *str)
+{
+	xml_escape(out, str, strlen(str));
+}
+
+#define JUNIT_COUNTS_FMT \
+	" tests=\"%010u\" failures=\"%010u\" skipped=\"%010u\" time=\"%016.6f\""
+
+static void junit_run_start(struct utest_reporter *rep)
+{
+	struct stream_reporter *s = TO_STREAM(rep);
+
+	utest_outbuf_puts(&s->out, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+				   "<testsuites>\n");
+}
+
+static void junit_suite_start(struct utest_reporter *rep, const char *suite)
+{
+	struct stream_reporter *s = TO_STREAM(rep);
+
+	reset_suite_counts(s);
+
+	utest_outbuf_puts(&s->out, "<testsuite name=\"");
+	xml_escape_str(&s->out, suite);
+	utest_outbuf_puts(&s->out, "\"");
+
+	if (s->seekable) {
+		/* Reserve room for the counters, patched in junit_suite_end() */
+		s->suite_counts_off = lseek(s->out.fd, 0, SEEK_CUR) +
+				      (off_t)s->out.len;
+		utest_outbuf_printf(&s->out, JUNIT_COUNTS_FMT, 0u, 0u, 0u, 0.0);
+	}
+
+	utest_outbuf_puts(&s->out, ">\n");
+}
+
+static void junit_test_end(struct utest_reporter *rep,
+			   const struct utest_result *result)
+{
+	struct stream_reporter *s = TO_STREAM(rep);
+	const char *line;
+	size_t line_len;
+
+	count_result(s, result);
+
+	utest_outbuf_puts(&s->out, "<testcase classname=\"");
+	xml_escape_str(&s->out, result->suite);
+	utest_outbuf_puts(&s->out, "\" name=\"");
+	xml_escape_str(&s->out, result->name);
+	utest_outbuf_printf(&s->out, "\" time=\"%.6f\"",
+			    result->duration_ns / 1e9);
+
+	if (result->status == TC_PASS || result->status == TC_CACHED) {
+		utest_outbuf_puts(&s->out, "/>\n");
+		return;
+	}
+
+	utest_outbuf_puts(&s->out, ">");
+
+	if (result->status == TC_SKIP) {
+		utest_outbuf_puts(&s->out, "<skipped/>");
+	} else {
+		/* As Surefire reports a test that passed on a rerun */
+		const char *tag = result->status == TC_FLAKY ? "flakyFailure" :
+							       "failure";
+
+		line = first_line(result->message, result->message_len,
+				  &line_len);
+		utest_outbuf_printf(&s->out, "<%s message=\"", tag);
+		xml_escape(&s->out, line, line_len);
+		utest_outbuf_puts(&s->out, "\">");
+		xml_escape(&s->out, result->message, result->message_len);
+		utest_outbuf_printf(&s->out, "</%s>", tag);
+	}
+
+	if (result->captured_stdout_len) {
+		utest_outbuf_puts(&s->out, "<system-out>");
+		xml_escape(&s->out, result->captured_stdout,
+			   result->captured_stdout_len);
+		utest_outbuf_puts(&s->out, "</system-out>");
+	}
+	if (result->captured_stderr_len) {
+		utest_outbuf_puts(&s->out, "<system-err>");
+		xml_escape(&s->out, result->captured_stderr,
+			   result->captured_stderr_len);
+		utest_outbuf_puts(&s->out, "</system-err>");
+	}
+
+	utest_outbuf_puts(&s->out, "</testcase>\n");
+}
+
+static void junit_suite_end(struct utest_reporter *rep, const char *suite,
+			    int result)
+{
+	struct stream_reporter *s = TO_STREAM(rep);
+	char counts[128];
+	int len;
+
+	(void)suite;
+	(void)result;
+
+	utest_outbuf_puts(&s->out, "</testsuite>\n");
+	utest_outbuf_flush(&s->out);
+
+	if (!s->seekable) {
+		return;
+	}
+
+	len = snprintf(counts, sizeof(counts), JUNIT_COUNTS_FMT,
+		       s->suite_tests, s->suite_failures, s->suite_skipped,
+		       s->suite_ns / 1e9);
+	if (pwrite(s->out.fd, counts, (size_t)len, s->suite_counts_off) != len) {
+		s->seekable = false;
+	}
+}
+
+static void junit_run_end(struct utest_reporter *rep, int result)
+{
+	struct stream_reporter *s = TO_STREAM(rep);
+
+	(void)result;
+
+	utest_outbuf_puts(&s->out, "</testsuites>\n");
+	utest_outbuf_flush(&s->out);
+}
+
+/* --------------------------- JSON Lines ---------------------------- */
+
+static void json_escape(struct utest_outbuf *out, const char *str, size_t len)
+{
+	size_t start = 0;
+
+	utest_outbuf_puts(out, "\"");
+
+	for (size_t i = 0; i < len; i++) {
+		unsigned char c = (unsigned char)str[i];
+		size_t n = c >= 0x80 ? utf8_len(str + i, len - i) : 1;
+		char esc[8];
+
+		if (c >= 0x20 && c != '"' && c != '\\' && n) {
+			i += n - 1;
+			continue;
+		}
+
+		switch (c) {
+		case '"':
+			strcpy(esc, "\\\"");
+			break;
+		case '\\':
+			strcpy(esc, "\\\\");
+			break;
+		case '\n':
+			strcpy(esc, "\\n");
+			break;
+		case '\r':
+			strcpy(esc, "\\r");
+			break;
+		case '\t':
+			strcpy(esc, "\\t");
+			break;
+		default:
+			/* Not valid UTF-8, which JSON text must be */
+			snprintf(esc, sizeof(esc), "\\u%04x", n ? c : 0xfffd);
+			break;
+		}
+
+		utest_outbuf_write(out, str + start, i - start);
+		utest_outbuf_puts(out, esc);
+		start = i + 1;
+	}
+
+	utest_outbuf_write(out, str + start, len - start);
+	utest_outbuf_puts(out, "\"");
+}
+
+static void json_escape_str(struct utest_outbuf *out, const char *str)
+{
+	json_escape(out, str, strlen(str));
+}
+
+static void json_suite_start(struct utest_reporter *rep, const char *suite)
+{
+	struct stream_reporter *s = TO_STREAM(rep);
+
+	reset_suite_counts(s);
+
+	utest_outbuf_puts(&s->out, "{\"type\":\"suite_start\",\"suite\":");
+	json_escape_str(&s->out, suite);
+	utest_outbuf_puts(&s->out, "}\n");
+}
+
+static void json_test_end(struct utest_reporter *rep,
+			  const struct utest_result *result)
+{
+	struct stream_reporter *s = TO_STREAM(rep);
+
+	count_result(s, result);
+
+	utest_outbuf_puts(&s->out, "{\"type\":\"test\",\"suite\":");
+	json_escape_str(&s->out, result->suite);
+	utest_outbuf_puts(&s->out, ",\"name\":");
+	json_escape_str(&s->out, result->name);
+	utest_outbuf_printf(&s->out,
+			    ",\"status\":\"%s\",\"duration_ns\":%llu,\"message\":",
+			    TC_RESULT_TO_STR(result->status),
+			    (unsigned long long)result->duration_ns);
+	json_escape(&s->out, result->message, result->message_len);
+	utest_outbuf_printf(
+		&s->out,
+		",\"usage\":{\"user_ns\":%llu,\"system_ns\":%llu,"
+		"\"max_rss_kb\":%llu,\"minor_faults\":%llu,"
+		"\"major_faults\":%llu,\"voluntary_switches\":%llu,"
+		"\"involuntary_switches\":%llu}",
+		(unsigned long long)result->usage.user_ns,
+		(unsigned long long)result->usage.system_ns,
+		(unsigned long long)result->usage.max_rss_kb,
+		(unsigned long long)result->usage.minor_faults,
+		(unsigned long long)result->usage.major_faults,
+		(unsigned long long)result->usage.voluntary_switches,
+		(unsigned long long)result->usage.involuntary_switches);
+	if (result->captured_stdout_len) {
+		utest_outbuf_puts(&s->out, ",\"stdout\":");
+		json_escape(&s->out, result->captured_stdout,
+			    result->captured_stdout_len);
+	}
+	if (result->captured_stderr_len) {
+		utest_outbuf_puts(&s->out, ",\"stderr\":");
+		json_escape(&s->out, result->captured_stderr,
+			    result->captured_stderr_len);
+	}
+	utest_outbuf_puts(&s->out, "}\n");
+}
+
+static void json_suite_end(struct utest_reporter *rep, const char *suite,
+			   int result)
+{
+	struct stream_reporter *s = TO_STREAM(rep);
+
+	utest_outbuf_puts(&s->out, "{\"type\":\"suite_end\",\"suite\":");
+	json_escape_str(&s->out, suite);
+	utest_outbuf_printf(&s->out,
+			    ",\"status\":\"%s\",\"tests\":%u,\"failures\":%u,"
+			    "\"skipped\":%u,\"duration_ns\":%llu}\n",
+			    TC_RESULT_TO_STR(result), s->suite_tests,
+			    s->suite_failures, s->suite_skipped,
+			    (unsigned long long)s->suite_ns);
+	utest_outbuf_flush(&s->out);
+}
+
+static void json_run_end(struct utest_reporter *rep, int result)
+{
+	struct stream_reporter *s = TO_STREAM(rep);
+
+	utest_outbuf_printf(&s->out,
+			    "{\"type\":\"run_end\",\"status\":\"%s\","
+			    "\"tests\":%u,\"failures\":%u,\"skipped\":%u}\n",
+			    TC_RESULT_TO_STR(result), s->tests, s->failures,
+			    s->skipped);
+	utest_outbuf_flush(&s->out);
+}
+
+/* ------------------------------- TAP ------------------------------- */
+
+static void tap_escape(struct utest_outbuf *out, const char *str)
+{
+	for (; *str; str++) {
+		if (*str == '#') {
+			utest_outbuf_puts(out, "\\#");
+		} else if (*str == '\n' || *str == '\r') {
+			utest_outbuf_puts(out, " ");
+		} else {
+			utest_outbuf_write(out, str, 1);
+		}
+	}
+}
+
+static void tap_run_start(struct utest_reporter *rep)
+{
+	struct stream_reporter *s = TO_STREAM(rep);
+
+	utest_outbuf_puts(&s->out, "TAP version 13\n");
+}
+
+static void tap_suite_start(struct utest_reporter *rep, const char *suite)
+{
+	struct stream_reporter *s = TO_STREAM(rep);
+
+	utest_outbuf_puts(&s->out, "# ");
+	tap_escape(&s->out, suite);
+	utest_outbuf_puts(&s->out, "\n");
+}
+
+static void tap_yaml_block(struct utest_outbuf *out, const char *key,
+			   const char *msg, size_t len)
+{
+	const char *end = msg + len;
+
+	if (!len) {
+		return;
+	}
+
+	utest_outbuf_printf(out, "  %s: |\n", key);
+	while (msg < end) {
+		const char *eol = memchr(msg, '\n', (size_t)(end - msg));
+		size_t line = (size_t)((eol ? eol : end) - msg);
+
+		utest_outbuf_puts(out, "    ");
+		utest_outbuf_write(out, msg, line);
+		utest_outbuf_puts(out, "\n");
+		msg += line + (eol ? 1 : 0);
+	}
+}
+
+static void tap_test_end(struct utest_reporter *rep,
+			 const struct utest_result *result)
+{
+	struct stream_reporter *s = TO_STREAM(rep);
+
+	count_result(s, result);
+
+	utest_outbuf_printf(&s->out, "%s %u - ",
+			    result->status == TC_FAIL ? "not ok" : "ok",
+			    s->tests);
+	tap_escape(&s->out, result->name);
+	utest_outbuf_puts(&s->out, result->status == TC_SKIP  ? " # SKIP\n" :
+				   result->status == TC_FLAKY ? " # flaky\n" :
+								"\n");
+
+	if (result->status != TC_FAIL && result->status != TC_FLAKY) {
+		return;
+	}
+
+	/* YAML diagnostic block */
+	utest_outbuf_printf(&s->out, "  ---\n  duration_ms: %.3f\n",
+			    result->duration_ns / 1e6);
+	tap_yaml_block(&s->out, "message", result->message,
+		       result->message_len);
+	tap_yaml_block(&s->out, "stdout", result->captured_stdout,
+		       result->captured_stdout_len);
+	tap_yaml_block(&s->out, "stderr", result->captured_stderr,
+		       result->captured_stderr_len);
+	utest_outbuf_puts(&s->out, "  ...\n");
+}
+
+static void tap_suite_end(struct utest_reporter *rep, const char *suite,
+			  int result)
+{
+	struct stream_reporter *s = TO_STREAM(rep);
+
+	(void)suite;
+	(void)result;
+
+	utest_outbuf_flush(&s->out);
+}
+
+static void tap_run_end(struct utest_reporter *rep, int result)
+{
+	struct stream_reporter *s = TO_STREAM(rep);
+
+	(void)result;
+
+	utest_outbuf_printf(&s->out, "1..%u\n", s->tests);
+	utest_outbuf_flush(&s->out);
+}
+
+/* ----------------------------- factory ----------------------------- */
+
+static const struct utest_reporter stream_templates[] = {
+	{
+		.name = "junit",
+		.on_run_start = junit_run_start,
+		.on_suite_start = junit_suite_start,
+		.on_test_end = junit_test_end,
+		.on_suite_end = junit_suite_end,
+		.on_run_end = junit_run_end,
+	},
+	{
+		.name = "jsonl",
+		.on_suite_start = json_suite_start,
+		.on_test_end = json_test_end,
+		.on_suite_end = json_suite_end,
+		.on_run_end = json_run_end,
+	},
+	{
+		.name = "tap",
+		.on_run_start = tap_run_start,
+		.on_suite_start = tap_suite_start,
+		.on_test_end = tap_test_end,
+		.on_suite_end = tap_suite_end,
+		.on_run_end = tap_run_end,
+	},
+};
+
+struct utest_reporter *utest_reporter_create(const char *kind,
+					     const char *path)
+{
+	const struct utest_reporter *tmpl = NULL;
+	struct stream_reporter *s;
+	bool own;
+	int fd;
+
+	for (size_t i = 0; i < sizeof(stream_templates) /
+			       sizeof(stream_templates[0]); i++) {
+		if (!strcmp(kind, stream_templates[i].name)) {
+			tmpl = &stream_templates[i];
+		}
+	}
+
+	if (!tmpl) {
+		fprintf(stderr, "utest: unknown reporter '%s'\n", kind);
+		return NULL;
+	}
+
+	own = path && *path && strcmp(path, "-");
+	if (own) {
+		fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	} else {
+		fd = z_utest_stdout_fd();
+	}
+
+	if (fd < 0) {
+		fprintf(stderr, "utest: cannot open report file '%s'\n", path);
+		return NULL;
+	}
+
+	s = calloc(1, sizeof(*s));
+	if (!s) {
+		return NULL;
+	}
+
+	s->rep = *tmpl;
+	s->rep.user_data = s;
+	utest_outbuf_init(&s->out, fd, s->buf, sizeof(s->buf));
+	/*
+	 * The counters are only patched in a file of its own: the standard
+	 * output may be shared with the console reporter, or with whatever
+	 * redirected it, and the offset of the counters is then unknown.
+	 */
+	s->seekable = own && lseek(fd, 0, SEEK_CUR) != (off_t)-1;
+
+	return &s->rep;
+}
+
+void z_utest_setup_reporters(void)
+{
+	const char *spec = utest_option("reporter");
+	struct utest_reporter *stream = z_utest_programs_reporter();
+	bool any = false;
+	char *list;
+	char *save;
+
+	/* Run by a runner, see utest_programs.h: it does the reporting */
+	if (stream) {
+		utest_register_reporter(stream);
+		return;
+	}
+
+	if (!spec || !*spec) {
+		utest_register_reporter(&utest_console_reporter);
+		return;
+	}
+
+	list = strdup(spec);
+
+	/* Comma separated list of kind[:path] */
+	for (char *item = list ? strtok_r(list, ",", &save) : NULL; item;
+	     item = strtok_r(NULL, ",", &save)) {
+		char *path = strchr(item, ':');
+		struct utest_reporter *rep;
+
+		if (path) {
+			*path++ = '\0';
+		}
+
+		if (!strcmp(item, "console")) {
+			utest_register_reporter(&utest_console_reporter);
+			any = true;
+			continue;
+		}
+
+		rep = utest_reporter_create(item, path);
+		if (rep) {
+			utest_register_reporter(rep);
+			any = true;
+		}
+	}
+
+	free(list);
+
+	/* A run reporting nothing would look like a run doing nothing */
+	if (!any) {
+		fprintf(stderr, "utest: no usable reporter in '%s', "
+				"reporting to the console\n",
+			spec);
+		utest_register_reporter(&utest_console_reporter);
+	}
+}
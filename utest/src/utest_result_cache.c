@@ -0,0 +1,638 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define _GNU_SOURCE
+#include <utest.h>
+#include <utest_elf.h>
+#include <utest_result_cache.h>
+#include <dirent.h>
+#include <elf.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Bytes hashed for an unnamed constant, more if a string ends later */
+#define CONST_MIN_LEN 16
+#define CONST_MAX_LEN 4096
+
+/* A function or data object of the executable, and what it refers to */
+struct node {
+	bool scanned;
+	uint64_t hash;
+	uint32_t *edges;
+	size_t nedges;
+};
+
+/* Nodes are the functions, then the data objects */
+static struct {
+	bool loaded;
+	bool broken;
+	const struct z_utest_elf_func *funcs;
+	size_t nfuncs;
+	const struct z_utest_elf_func *objects;
+	size_t nobjects;
+	struct node *nodes;
+	/* A node is visited when its mark is the current generation */
+	uint32_t *marks;
+	uint32_t generation;
+	uint32_t *stack;
+} graph;
+
+/* The bytes of a node being scanned */
+struct scan {
+	uintptr_t addr;
+	const uint8_t *bytes;
+	size_t len;
+	/* Copy of the bytes, with the fields holding addresses zeroed */
+	uint8_t *masked;
+	/* Hash of what is referred to without being a node */
+	uint64_t extra;
+	uint32_t *edges;
+	size_t nedges;
+	size_t cap;
+};
+
+static bool enabled;
+
+/* Key of the test about to run, saved if it passes */
+static struct {
+	bool valid;
+	char id[Z_UTEST_TEST_ID_MAX];
+	uint64_t key;
+} pending;
+
+/* Files declared by the running test */
+static struct {
+	char **paths;
+	size_t count;
+	size_t cap;
+} depends;
+
+/* ------------------------------ graph ------------------------------ */
+
+static void add_edge(struct scan *s, size_t node)
+{
+	if (s->nedges == s->cap) {
+		size_t cap = s->cap ? s->cap * 2 : 16;
+		uint32_t *edges = realloc(s->edges, cap * sizeof(*edges));
+
+		if (!edges) {
+			graph.broken = true;
+			return;
+		}
+		s->edges = edges;
+		s->cap = cap;
+	}
+
+	s->edges[s->nedges++] = (uint32_t)node;
+}
+
+/* Record a reference to link-time address @a target */
+static void link_to(struct scan *s, uintptr_t target)
+{
+	const uint8_t *bytes;
+	uint64_t flags;
+	size_t avail;
+	size_t len;
+	long i;
+
+	i = z_utest_elf_find(graph.funcs, graph.nfuncs, target);
+	if (i >= 0) {
+		add_edge(s, (size_t)i);
+		return;
+	}
+
+	i = z_utest_elf_find(graph.objects, graph.nobjects, target);
+	if (i >= 0) {
+		add_edge(s, graph.nfuncs + (size_t)i);
+		return;
+	}
+
+	/* Unnamed read-only constants, string literals mostly */
+	bytes = z_utest_elf_bytes(target, &avail, &flags);
+	if (!bytes || (flags & (SHF_WRITE | SHF_EXECINSTR))) {
+		return;
+	}
+
+	len = strnlen((const char *)bytes,
+		      avail < CONST_MAX_LEN ? avail : CONST_MAX_LEN) + 1;
+	if (len < CONST_MIN_LEN) {
+		len = CONST_MIN_LEN;
+	}
+	if (len > avail) {
+		len = avail;
+	}
+	s->extra = utest_hash64(bytes, len, s->extra);
+}
+
+/* The @a size bytes at @a off refer to @a target, or to symbol @a name */
+static void refer(struct scan *s, size_t off, size_t size, uintptr_t target,
+		  const char *name)
+{
+	if (off > s->len || size > s->len - off) {
+		return;
+	}
+
+	memset(s->masked + off, 0, size);
+
+	if (name) {
+		s->extra = utest_hash64(name, strlen(name), s->extra);
+	} else {
+		link_to(s, target);
+	}
+}
+
+static void scan_refs(struct scan *s)
+{
+	const struct z_utest_elf_ref *refs;
+	size_t count;
+
+	refs = z_utest_elf_refs(s->addr, s->len, &count);
+	for (size_t i = 0; i < count; i++) {
+		refer(s, refs[i].offset - s->addr, refs[i].size, refs[i].target,
+		      refs[i].name);
+	}
+}
+
+#ifdef __x86_64__
+
+/*
+ * Size of the immediate after the ModRM operand of the one-byte opcode at
+ * @a p[i], -1 for the opcodes we do not look at.
+ */
+static int imm_size(const uint8_t *p, size_t i)
+{
+	/* Operand size prefix, before the REX prefix if any */
+	bool word = (i >= 1 && p[i - 1] == 0x66) ||
+		    (i >= 2 && (p[i - 1] & 0xf0) == 0x40 && p[i - 2] == 0x66);
+
+	switch (p[i]) {
+	case 0x01: case 0x03: case 0x09: case 0x0b: case 0x21: case 0x23:
+	case 0x29: case 0x2b: case 0x31: case 0x33: case 0x38: case 0x39:
+	case 0x3a: case 0x3b: case 0x84: case 0x85: case 0x88: case 0x89:
+	case 0x8a: case 0x8b: case 0x8d: case 0xff:
+		return 0;
+	case 0x80: case 0x83: case 0xc6:
+		return 1;
+	case 0x81: case 0xc7:
+		return word ? 2 : 4;
+	case 0xf6:
+		/* Only test takes an immediate */
+		return (p[i + 1] & 0x38) < 0x10 ? 1 : 0;
+	case 0xf7:
+		return (p[i + 1] & 0x38) < 0x10 ? (word ? 2 : 4) : 0;
+	default:
+		return -1;
+	}
+}
+
+/* Opcodes taking a ModRM operand and no immediate, after a 0x0f escape */
+static const uint8_t modrm_ops_0f[] = {
+	0x10, 0x11, 0x28, 0x29, 0x2e, 0x2f, 0x54, 0x57, 0x58, 0x59,
+	0x5c, 0x5e, 0x6f, 0x7e, 0x7f, 0xb6, 0xb7, 0xbe, 0xbf,
+};
+
+/*
+ * The rel32 field at @a off, relative to the instruction ending at
+ * @a next, is a reference if it lands in a section with all of @a need.
+ */
+static void rel32(struct scan *s, size_t off, size_t next, uint64_t need)
+{
+	uintptr_t target;
+	uint64_t flags;
+	size_t avail;
+	int32_t disp;
+
+	memcpy(&disp, s->bytes + off, sizeof(disp));
+	target = s->addr + next + (uintptr_t)(intptr_t)disp;
+
+	z_utest_elf_bytes(target, &avail, &flags);
+	if ((flags & need) == need) {
+		refer(s, off, sizeof(disp), target, NULL);
+	}
+}
+
+/*
+ * Without relocations, find the calls, jumps and RIP-relative operands of
+ * position independent code by their encoding. A stray match can only add
+ * a reference, or hide four bytes that would also have to land in a
+ * section to go unnoticed.
+ */
+static void scan_code(struct scan *s)
+{
+	const uint8_t *p = s->bytes;
+
+	for (size_t i = 0; i + 5 <= s->len; i++) {
+		int imm;
+
+		if (p[i] == 0xe8 || p[i] == 0xe9) {
+			/* call, jmp */
+			rel32(s, i + 1, i + 5, SHF_ALLOC | SHF_EXECINSTR);
+		} else if (i + 6 > s->len) {
+			continue;
+		} else if (p[i] == 0x0f && (p[i + 1] & 0xf0) == 0x80) {
+			/* jcc */
+			rel32(s, i + 2, i + 6, SHF_ALLOC | SHF_EXECINSTR);
+		} else if ((p[i + 1] & 0xc7) == 0x05 &&
+			   (imm = imm_size(p, i)) >= 0) {
+			if (i + 6 + (size_t)imm <= s->len) {
+				rel32(s, i + 2, i + 6 + (size_t)imm, SHF_ALLOC);
+			}
+		} else if (i + 7 <= s->len && p[i] == 0x0f &&
+			   memchr(modrm_ops_0f, p[i + 1], sizeof(modrm_ops_0f)) &&
+			   (p[i + 2] & 0xc7) == 0x05) {
+			rel32(s, i + 3, i + 7, SHF_ALLOC);
+		}
+	}
+}
+
+/* Pointers to functions in the data of a non-PIE executable */
+static void scan_data(struct scan *s)
+{
+	for (size_t off = (size_t)(-s->addr & 7); off + 8 <= s->len;
+	     off += 8) {
+		uint64_t value;
+		long i;
+
+		memcpy(&value, s->bytes + off, sizeof(value));
+		i = value ? z_utest_elf_find(graph.funcs, graph.nfuncs,
+					     (uintptr_t)value)
+			  : -1;
+		if (i >= 0 && graph.funcs[i].addr == value) {
+			refer(s, off, sizeof(value), (uintptr_t)value, NULL);
+		}
+	}
+}
+
+#endif /* __x86_64__ */
+
+static struct node *scan_node(size_t id)
+{
+	struct node *node = &graph.nodes[id];
+	bool code = id < graph.nfuncs;
+	const struct z_utest_elf_func *sym =
+		code ? &graph.funcs[id] : &graph.objects[id - graph.nfuncs];
+	struct scan s = { .addr = sym->addr };
+	uint64_t flags;
+	size_t avail;
+
+	if (node->scanned) {
+		return node;
+	}
+	node->scanned = true;
+
+	s.bytes = z_utest_elf_bytes(sym->addr, &avail, &flags);
+	if (s.bytes) {
+		s.len = sym->size < avail ? sym->size : avail;
+		s.masked = malloc(s.len ? s.len : 1);
+		if (!s.masked) {
+			graph.broken = true;
+			return node;
+		}
+		memcpy(s.masked, s.bytes, s.len);
+
+		scan_refs(&s);
+#ifdef __x86_64__
+		if (!code) {
+			scan_data(&s);
+		} else if (!z_utest_elf_code_relocated()) {
+			scan_code(&s);
+		}
+#endif
+	}
+
+	node->hash = utest_hash64(sym->name, strlen(sym->name), s.extra);
+	node->hash = utest_hash64(s.masked, s.masked ? s.len : 0, node->hash);
+	node->edges = s.edges;
+	node->nedges = s.nedges;
+	free(s.masked);
+
+	return node;
+}
+
+static bool load_graph(void)
+{
+	size_t n;
+
+	if (graph.loaded) {
+		return graph.nodes != NULL;
+	}
+	graph.loaded = true;
+
+	graph.funcs = z_utest_elf_functions(&graph.nfuncs);
+	graph.objects = z_utest_elf_objects(&graph.nobjects);
+	n = graph.nfuncs + graph.nobjects;
+	if (!graph.nfuncs || n > UINT32_MAX) {
+		fprintf(stderr, "utest: cannot read the symbol table, "
+				"results are not cached\n");
+		return false;
+	}
+
+	graph.nodes = calloc(n, sizeof(*graph.nodes));
+	graph.marks = calloc(n, sizeof(*graph.marks));
+	graph.stack = calloc(n, sizeof(*graph.stack));
+	if (!graph.nodes || !graph.marks || !graph.stack) {
+		free(graph.nodes);
+		free(graph.marks);
+		free(graph.stack);
+		graph.nodes = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+static void visit(size_t node, size_t *top)
+{
+	if (graph.marks[node] != graph.generation) {
+		graph.marks[node] = graph.generation;
+		graph.stack[(*top)++] = (uint32_t)node;
+	}
+}
+
+/* Node of run-time address @a addr, a function or a data object */
+static long node_of(uintptr_t addr)
+{
+	long i;
+
+	if (!addr) {
+		return -1;
+	}
+	addr -= z_utest_elf_bias();
+
+	i = z_utest_elf_find(graph.funcs, graph.nfuncs, addr);
+	if (i >= 0) {
+		return i;
+	}
+
+	i = z_utest_elf_find(graph.objects, graph.nobjects, addr);
+
+	return i >= 0 ? (long)graph.nfuncs + i : -1;
+}
+
+/*
+ * Hash what @a test may run: everything reachable from its functions,
+ * combined in an order-independent way.
+ */
+static bool compute_key(const struct unit_test_suite *suite,
+			const struct unit_test *test, const char *id,
+			uint64_t *key)
+{
+	const uintptr_t roots[] = {
+		(uintptr_t)test->test,
+		(uintptr_t)test->setup,
+		(uintptr_t)test->teardown,
+		(uintptr_t)suite->before_all,
+		(uintptr_t)suite->after_all,
+		(uintptr_t)z_utest_param_source(),
+	};
+	uint64_t sum = 0;
+	size_t count = 0;
+	size_t top = 0;
+
+	if (!load_graph()) {
+		return false;
+	}
+
+	graph.generation++;
+
+#ifdef __x86_64__
+	for (size_t i = 0; i < sizeof(roots) / sizeof(roots[0]); i++) {
+		long node = node_of(roots[i]);
+
+		if (node >= 0) {
+			visit((size_t)node, &top);
+		}
+	}
+#else
+	/* No call graph, any change to the code invalidates every test */
+	(void)roots;
+	(void)node_of;
+	for (size_t i = 0; i < graph.nfuncs; i++) {
+		visit(i, &top);
+	}
+#endif
+
+	while (top) {
+		struct node *node = scan_node(graph.stack[--top]);
+
+		sum += node->hash;
+		count++;
+		for (size_t i = 0; i < node->nedges; i++) {
+			visit(node->edges[i], &top);
+		}
+	}
+
+	if (!count || graph.broken) {
+		return false;
+	}
+
+	*key = utest_hash64(id, strlen(id), 0);
+	*key = utest_hash_combine(*key, sum);
+	*key = utest_hash_combine(*key, (uint64_t)count);
+
+	return true;
+}
+
+/* Hash of the code @a test may run, false if it cannot be known */
+bool z_utest_code_hash(const struct unit_test_suite *suite,
+		       const struct unit_test *test, uint64_t *hash)
+{
+	char id[Z_UTEST_TEST_ID_MAX];
+
+	utest_test_id(suite->name, test->name, id, sizeof(id));
+
+	return compute_key(suite, test, id, hash);
+}
+
+/* ---------------------------- data files --------------------------- */
+
+/* Hash of the contents of @a path, 0 if it does not exist */
+static uint64_t hash_path(const char *path)
+{
+	struct dirent **entries;
+	struct stat st;
+	uint64_t hash = 0;
+	int n;
+
+	if (stat(path, &st)) {
+		return 0;
+	}
+
+	if (!S_ISDIR(st.st_mode)) {
+		return utest_hash_file(path, 0, &hash) ? 0 : hash;
+	}
+
+	n = scandir(path, &entries, NULL, alphasort);
+	if (n < 0) {
+		return 0;
+	}
+
+	hash = utest_hash64(path, strlen(path), 0);
+	for (int i = 0; i < n; i++) {
+		const char *name = entries[i]->d_name;
+		char child[Z_UTEST_PATH_MAX + sizeof(entries[i]->d_name)];
+		uint64_t content;
+
+		if (strcmp(name, ".") && strcmp(name, "..")) {
+			snprintf(child, sizeof(child), "%s/%s", path, name);
+			hash = utest_hash64(name, strlen(name) + 1, hash);
+			if (!stat(child, &st) && S_ISREG(st.st_mode) &&
+			    !utest_hash_file(child, 0, &content)) {
+				hash = utest_hash_combine(hash, content);
+			}
+		}
+		free(entries[i]);
+	}
+	free(entries);
+
+	return hash;
+}
+
+static void clear_depends(void)
+{
+	for (size_t i = 0; i < depends.count; i++) {
+		free(depends.paths[i]);
+	}
+	depends.count = 0;
+}
+
+void utest_depend_file(const char *path)
+{
+	if (!enabled || !pending.valid) {
+		return;
+	}
+
+	for (size_t i = 0; i < depends.count; i++) {
+		if (!strcmp(depends.paths[i], path)) {
+			return;
+		}
+	}
+
+	if (depends.count == depends.cap) {
+		size_t cap = depends.cap ? depends.cap * 2 : 8;
+		char **paths = realloc(depends.paths, cap * sizeof(*paths));
+
+		if (!paths) {
+			pending.valid = false;
+			return;
+		}
+		depends.paths = paths;
+		depends.cap = cap;
+	}
+
+	/* The cache file has one path per line */
+	if (strchr(path, '\n') ||
+	    !(depends.paths[depends.count] = strdup(path))) {
+		pending.valid = false;
+		return;
+	}
+	depends.count++;
+}
+
+/* ------------------------------ cache ------------------------------ */
+
+/* Whether the result at @a path passed with @a key and the same files */
+static bool check(const char *path, uint64_t key)
+{
+	char line[Z_UTEST_LINE_MAX];
+	uint64_t value;
+	bool hit;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f) {
+		return false;
+	}
+
+	hit = fgets(line, sizeof(line), f) &&
+	      sscanf(line, "utest-result %" SCNx64, &value) == 1 &&
+	      value == key;
+
+	while (hit && fgets(line, sizeof(line), f)) {
+		int off = 0;
+
+		line[strcspn(line, "\n")] = '\0';
+		hit = sscanf(line, "file %" SCNx64 " %n", &value, &off) == 1 &&
+		      off && hash_path(line + off) == value;
+	}
+
+	fclose(f);
+
+	return hit;
+}
+
+void z_utest_result_cache_init(void)
+{
+	/* A given seed or fuzzing asks for a run that a pass cannot replace */
+	enabled = utest_option_enabled("result-cache") &&
+		  !utest_option("seed") && !utest_option_enabled("fuzz");
+}
+
+bool z_utest_result_cache_hit(const struct unit_test_suite *suite,
+			      const struct unit_test *test)
+{
+	char path[Z_UTEST_PATH_MAX];
+
+	clear_depends();
+	pending.valid = false;
+
+	if (!enabled) {
+		return false;
+	}
+
+	utest_test_id(suite->name, test->name, pending.id, sizeof(pending.id));
+	if (!compute_key(suite, test, pending.id, &pending.key)) {
+		return false;
+	}
+
+	if (!z_utest_cache_test_path("results", pending.id, path,
+				     sizeof(path)) &&
+	    check(path, pending.key)) {
+		return true;
+	}
+
+	pending.valid = true;
+
+	return false;
+}
+
+void z_utest_result_cache_store(const char *suite, const char *name)
+{
+	char id[Z_UTEST_TEST_ID_MAX];
+	char path[Z_UTEST_PATH_MAX];
+	char *buf = NULL;
+	size_t len = 0;
+	FILE *f;
+
+	if (!pending.valid) {
+		return;
+	}
+	pending.valid = false;
+
+	utest_test_id(suite, name, id, sizeof(id));
+	if (strcmp(id, pending.id) ||
+	    z_utest_cache_test_path("results", id, path, sizeof(path))) {
+		return;
+	}
+
+	f = open_memstream(&buf, &len);
+	if (!f) {
+		return;
+	}
+	fprintf(f, "utest-result %016" PRIx64 "\n", pending.key);
+	for (size_t i = 0; i < depends.count; i++) {
+		fprintf(f, "file %016" PRIx64 " %s\n",
+			hash_path(depends.paths[i]), depends.paths[i]);
+	}
+	fclose(f);
+
+	/* Workers write whole files, the last one to pass wins */
+	z_utest_write_atomic(path, buf, len);
+	free(buf);
+}
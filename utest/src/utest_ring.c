@@ -0,0 +1,138 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <utest_ring.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define CACHE_LINE 64
+
+#define ARENA CONFIG_utest_RING_ARENA_SIZE
+#define RECORDS CONFIG_utest_RING_RECORDS
+
+/*
+ * Counters only grow, positions are taken modulo the sizes. Each end
+ * writes its own counters, on its own cache line.
+ */
+struct z_utest_ring {
+	/* Written by the producer */
+	_Alignas(CACHE_LINE) uint64_t head;
+	uint64_t arena_head;
+	/* Written by the consumer */
+	_Alignas(CACHE_LINE) uint64_t tail;
+	uint64_t arena_tail;
+	_Alignas(CACHE_LINE) struct z_utest_ring_rec recs[RECORDS];
+	char arena[ARENA];
+};
+
+struct z_utest_ring *z_utest_rings_create(int count)
+{
+	/* Only what is written gets memory */
+	void *map = mmap(NULL, (size_t)count * sizeof(struct z_utest_ring),
+			 PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+	return map == MAP_FAILED ? NULL : map;
+}
+
+void z_utest_rings_destroy(struct z_utest_ring *rings, int count)
+{
+	munmap(rings, (size_t)count * sizeof(struct z_utest_ring));
+}
+
+struct z_utest_ring *z_utest_ring_get(struct z_utest_ring *rings, int index)
+{
+	return &rings[index];
+}
+
+/* Shorten the strings to @a room bytes, the captured output first */
+static void cut(uint32_t len[Z_UTEST_RING_STRINGS], uint64_t room)
+{
+	uint64_t total = (uint64_t)len[0] + len[1] + len[2];
+
+	for (int i = Z_UTEST_RING_STRINGS - 1; i >= 0 && total > room; i--) {
+		uint64_t drop = total - room < len[i] ? total - room : len[i];
+
+		len[i] -= (uint32_t)drop;
+		total -= drop;
+	}
+}
+
+/*
+ * Never waits for the consumer: returns false if the ring is full. Strings
+ * are cut to the room left in the arena.
+ */
+bool z_utest_ring_push(struct z_utest_ring *ring, struct z_utest_ring_rec *rec,
+		       const char *const str[Z_UTEST_RING_STRINGS])
+{
+	uint64_t head = ring->head;
+	uint64_t start = ring->arena_head;
+	uint64_t used = start - __atomic_load_n(&ring->arena_tail,
+						 __ATOMIC_ACQUIRE);
+	uint64_t to_end = ARENA - start % ARENA;
+	uint64_t room = ARENA - used;
+	/* Free room up to the end of the arena, and from its start */
+	uint64_t at_end = to_end < room ? to_end : room;
+	uint64_t at_start = room > to_end ? room - to_end : 0;
+	uint64_t total;
+	char *dst;
+
+	if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= RECORDS) {
+		return false;
+	}
+
+	/* Strings are kept in one piece, skip the end of the arena if needed */
+	total = (uint64_t)rec->len[0] + rec->len[1] + rec->len[2];
+	if (total > at_end && at_start > at_end) {
+		start += to_end;
+		cut(rec->len, at_start);
+	} else {
+		cut(rec->len, at_end);
+	}
+
+	rec->offset = start;
+	dst = ring->arena + start % ARENA;
+	for (int i = 0; i < Z_UTEST_RING_STRINGS; i++) {
+		if (rec->len[i]) {
+			memcpy(dst, str[i], rec->len[i]);
+			dst += rec->len[i];
+		}
+	}
+	ring->recs[head % RECORDS] = *rec;
+
+	ring->arena_head = start + rec->len[0] + rec->len[1] + rec->len[2];
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+	return true;
+}
+
+/*
+ * Hand every published record to @a fn, then release them all at once.
+ * The strings of a record are only valid during the call.
+ */
+size_t z_utest_ring_consume(struct z_utest_ring *ring,
+			    void (*fn)(const struct z_utest_ring_rec *rec,
+				       const char *data, void *arg),
+			    void *arg)
+{
+	uint64_t tail = ring->tail;
+	uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	uint64_t arena_tail = ring->arena_tail;
+
+	for (uint64_t i = tail; i < head; i++) {
+		const struct z_utest_ring_rec *rec = &ring->recs[i % RECORDS];
+
+		fn(rec, ring->arena + rec->offset % ARENA, arg);
+		arena_tail = rec->offset + rec->len[0] + rec->len[1] +
+			     rec->len[2];
+	}
+
+	if (head != tail) {
+		__atomic_store_n(&ring->arena_tail, arena_tail,
+				 __ATOMIC_RELEASE);
+		__atomic_store_n(&ring->tail, head, __ATOMIC_RELEASE);
+	}
+
+	return (size_t)(head - tail);
+}
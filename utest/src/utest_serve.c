@@ -0,0 +1,605 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define _GNU_SOURCE
+#include <utest.h>
+#include <utest_serve.h>
+#include <utest_elf.h>
+#include <utest_module.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* Listening socket and pending connection handed over to a new executable */
+#define HANDOVER_ENV "UTEST_SERVE_HANDOVER"
+
+/* Status sent back when the run did not get to report one */
+#define STATUS_LOST 2
+
+/* Upper bound of a request, options and working directory */
+#define REQUEST_MAX (1024 * 1024)
+
+/* How often a running request checks that its client is still there */
+#define HANGUP_POLL_MS 100
+
+extern char **environ;
+
+/* Suites whose BEFORE_ALL passed in the server, in order */
+struct warm_suite {
+	const struct unit_test_suite *suite;
+	struct warm_suite *next;
+};
+
+static struct warm_suite *warm_suites;
+static bool warming;
+
+static volatile sig_atomic_t stopping;
+
+/* The executable the server runs, to notice when it gets rebuilt */
+static char exe_path[PATH_MAX];
+static struct stat exe_stat;
+
+bool z_utest_serve_warming(void)
+{
+	return warming;
+}
+
+void z_utest_serve_warmed(const struct unit_test_suite *suite)
+{
+	struct warm_suite **it = &warm_suites;
+	struct warm_suite *w = calloc(1, sizeof(*w));
+
+	if (!w) {
+		return;
+	}
+	while (*it) {
+		it = &(*it)->next;
+	}
+	w->suite = suite;
+	*it = w;
+}
+
+bool z_utest_serve_warm(const struct unit_test_suite *suite)
+{
+	for (struct warm_suite *w = warm_suites; w; w = w->next) {
+		if (w->suite == suite) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static int socket_path(const char *value, struct sockaddr_un *addr)
+{
+	char file[NAME_MAX + 1];
+	int n;
+
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+
+	if (value && *value) {
+		n = snprintf(addr->sun_path, sizeof(addr->sun_path), "%s",
+			     value);
+		return (n < 0 || (size_t)n >= sizeof(addr->sun_path)) ? -1 : 0;
+	}
+
+	snprintf(file, sizeof(file), "%s.sock", program_invocation_short_name);
+
+	return utest_cache_path("serve", file, addr->sun_path,
+				sizeof(addr->sun_path));
+}
+
+static int read_all(int fd, void *buf, size_t len)
+{
+	char *data = buf;
+
+	while (len) {
+		ssize_t n = read(fd, data, len);
+
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return -1;
+		}
+		data += n;
+		len -= (size_t)n;
+	}
+
+	return 0;
+}
+
+/* ------------------------------ client ----------------------------- */
+
+/*
+ * A request is a 32-bit length, then the working directory and the options
+ * as strings with their NUL, sent along with the standard output and error
+ * of the client.
+ */
+static char *build_request(size_t *len)
+{
+	char cwd[PATH_MAX];
+	char *buf = NULL;
+	size_t size = 0;
+	uint32_t n = 0;
+	char **argv;
+	int argc;
+	FILE *f = open_memstream(&buf, &size);
+
+	if (!f) {
+		return NULL;
+	}
+
+	argv = z_utest_options_args(&argc);
+	fwrite(&n, sizeof(n), 1, f);
+	fprintf(f, "%s%c", getcwd(cwd, sizeof(cwd)) ? cwd : ".", '\0');
+
+	/* The environment first, the command line overrides it */
+	for (char **env = environ; *env; env++) {
+		const char *eq = strchr(*env, '=');
+		char name[64];
+		size_t i;
+
+		if (strncmp(*env, "UTEST_", 6) || !eq ||
+		    (size_t)(eq - *env - 6) >= sizeof(name)) {
+			continue;
+		}
+		for (i = 0; *env + 6 + i < eq; i++) {
+			char c = (*env)[6 + i];
+
+			name[i] = c == '_' ? '-' : (char)tolower(c);
+		}
+		name[i] = '\0';
+		if (!strcmp(name, "client") || !strcmp(name, "serve") ||
+		    !strcmp(name, "serve-handover")) {
+			continue;
+		}
+		fprintf(f, "--%s=%s%c", name, eq + 1, '\0');
+	}
+
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+
+		if (!strncmp(arg, "--client", 8) &&
+		    (arg[8] == '\0' || arg[8] == '=')) {
+			continue;
+		}
+		fprintf(f, "%s%c", arg, '\0');
+	}
+
+	fclose(f);
+	if (!buf) {
+		return NULL;
+	}
+
+	n = (uint32_t)(size - sizeof(n));
+	memcpy(buf, &n, sizeof(n));
+	*len = size;
+
+	return buf;
+}
+
+static int send_request(int sock, const char *buf, size_t len)
+{
+	int fds[2] = { STDOUT_FILENO, STDERR_FILENO };
+	char ctl[CMSG_SPACE(sizeof(fds))];
+	struct iovec iov = { (void *)buf, len };
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = ctl,
+		.msg_controllen = sizeof(ctl),
+	};
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	ssize_t n;
+
+	memset(ctl, 0, sizeof(ctl));
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+	do {
+		n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+	} while (n < 0 && errno == EINTR);
+	if (n < 0) {
+		return -1;
+	}
+
+	/* The descriptors went with the first part */
+	return z_utest_write_all(sock, buf + n, len - (size_t)n);
+}
+
+bool z_utest_client(void)
+{
+	const char *value = utest_option("client");
+	struct sockaddr_un addr;
+	int32_t status;
+	size_t len;
+	char *req;
+	int sock;
+
+	if (!value) {
+		return false;
+	}
+
+	if (socket_path(value, &addr)) {
+		fprintf(stderr, "utest: invalid server socket path\n");
+		exit(STATUS_LOST);
+	}
+
+	sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (sock < 0 ||
+	    connect(sock, (struct sockaddr *)&addr, sizeof(addr))) {
+		fprintf(stderr, "utest: no server on %s, running here\n",
+			addr.sun_path);
+		if (sock >= 0) {
+			close(sock);
+		}
+		return false;
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+
+	req = build_request(&len);
+	if (!req || send_request(sock, req, len)) {
+		fprintf(stderr, "utest: cannot send the request to %s\n",
+			addr.sun_path);
+		exit(STATUS_LOST);
+	}
+	free(req);
+
+	if (read_all(sock, &status, sizeof(status))) {
+		fprintf(stderr, "utest: the server lost the run\n");
+		exit(STATUS_LOST);
+	}
+
+	exit(status ? 1 : 0);
+}
+
+/* ------------------------------ server ----------------------------- */
+
+static void on_stop(int signo)
+{
+	(void)signo;
+
+	stopping = 1;
+}
+
+static bool exe_changed(void)
+{
+	struct stat st;
+
+	if (!*exe_path || stat(exe_path, &st)) {
+		return false;
+	}
+
+	return st.st_ino != exe_stat.st_ino || st.st_dev != exe_stat.st_dev ||
+	       st.st_size != exe_stat.st_size ||
+	       st.st_mtim.tv_sec != exe_stat.st_mtim.tv_sec ||
+	       st.st_mtim.tv_nsec != exe_stat.st_mtim.tv_nsec;
+}
+
+static bool in_module(const void *addr, const void *module)
+{
+	return !module || z_utest_module_contains(module, addr);
+}
+
+/* Run the AFTER_ALL fixtures of the warm suites of @a module, or all */
+static void cool_down(const struct z_utest_module *module)
+{
+	char label[128];
+	struct warm_suite **it = &warm_suites;
+	struct warm_suite *rev = NULL;
+
+	/* AFTER_ALL in reverse order of BEFORE_ALL */
+	while (*it) {
+		struct warm_suite *w = *it;
+
+		if (!in_module(w->suite, module)) {
+			it = &w->next;
+			continue;
+		}
+		*it = w->next;
+		w->next = rev;
+		rev = w;
+	}
+
+	while (rev) {
+		struct warm_suite *w = rev;
+
+		rev = w->next;
+		if (w->suite->after_all) {
+			snprintf(label, sizeof(label), "AFTER_ALL(%s)",
+				 w->suite->name);
+			TC_SUITE_START(w->suite->name);
+			TC_SUITE_END(w->suite->name,
+				     z_utest_run_fixture(label,
+							 w->suite->after_all));
+		}
+		free(w);
+	}
+
+	z_utest_shared_fixtures_release(in_module, module);
+	fflush(stdout);
+	fflush(stderr);
+}
+
+static void warm_module(const struct z_utest_module *module)
+{
+	warming = true;
+	z_utest_module_run(module);
+	warming = false;
+}
+
+/* Start over from the rebuilt executable, keeping the sockets open */
+static void restart(char *argv[], int lsock, int conn)
+{
+	char fds[32];
+
+	fprintf(stderr, "utest: %s changed, restarting\n", exe_path);
+	cool_down(NULL);
+
+	snprintf(fds, sizeof(fds), "%d,%d", lsock, conn);
+	setenv(HANDOVER_ENV, fds, 1);
+	fcntl(lsock, F_SETFD, 0);
+	fcntl(conn, F_SETFD, 0);
+
+	execv(exe_path, argv);
+
+	/* Half written, most likely: go on with what is loaded */
+	fprintf(stderr, "utest: cannot restart: %s\n", strerror(errno));
+	unsetenv(HANDOVER_ENV);
+	fcntl(lsock, F_SETFD, FD_CLOEXEC);
+	fcntl(conn, F_SETFD, FD_CLOEXEC);
+}
+
+/* Read a request, return its strings and the descriptors sent with it */
+static char *read_request(int conn, size_t *len, int fds[2])
+{
+	char ctl[CMSG_SPACE(2 * sizeof(int))];
+	uint32_t size;
+	struct iovec iov = { &size, sizeof(size) };
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = ctl,
+		.msg_controllen = sizeof(ctl),
+	};
+	struct cmsghdr *cmsg;
+	char *buf;
+	ssize_t n;
+
+	fds[0] = fds[1] = -1;
+
+	do {
+		n = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+	} while (n < 0 && errno == EINTR);
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET &&
+		    cmsg->cmsg_type == SCM_RIGHTS &&
+		    cmsg->cmsg_len == CMSG_LEN(2 * sizeof(int))) {
+			memcpy(fds, CMSG_DATA(cmsg), 2 * sizeof(int));
+		}
+	}
+
+	if (n != (ssize_t)sizeof(size) || size == 0 || size > REQUEST_MAX ||
+	    fds[0] < 0) {
+		return NULL;
+	}
+
+	buf = malloc(size);
+	if (!buf || read_all(conn, buf, size) || buf[size - 1] != '\0') {
+		free(buf);
+		return NULL;
+	}
+	*len = size;
+
+	return buf;
+}
+
+static void run_request(int conn, char *req, size_t len, const int fds[2],
+			int (*run)(void))
+{
+	char **args = calloc(len, sizeof(*args));
+	int32_t status = STATUS_LOST;
+	int argc = 0;
+
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	signal(SIGPIPE, SIG_DFL);
+
+	if (chdir(req)) {
+		fprintf(stderr, "utest: cannot enter %s: %s\n", req,
+			strerror(errno));
+	}
+	for (size_t i = strlen(req) + 1; args && i < len;
+	     i += strlen(req + i) + 1) {
+		args[argc++] = req + i;
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+	dup2(fds[0], STDOUT_FILENO);
+	dup2(fds[1], STDERR_FILENO);
+	dup2(fds[0], z_utest_stdout_fd());
+
+	z_utest_options_overlay(argc, args);
+	utest_unregister_reporter(&utest_console_reporter);
+	z_utest_shared_fixtures_detach();
+
+	status = run();
+
+	fflush(stdout);
+	fflush(stderr);
+	send(conn, &status, sizeof(status), MSG_NOSIGNAL);
+	_exit(0);
+}
+
+/* Run the request in a child, stop it if the client goes away */
+static void serve_one(int lsock, int conn, int (*run)(void))
+{
+	int fds[2];
+	size_t len;
+	char *req = read_request(conn, &len, fds);
+	pid_t pid;
+
+	if (!req) {
+		goto out;
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+
+	pid = fork();
+	if (pid == 0) {
+		close(lsock);
+		run_request(conn, req, len, fds, run);
+	}
+
+	while (pid > 0 && waitpid(pid, NULL, WNOHANG) == 0) {
+		struct pollfd p = { .fd = conn, .events = POLLRDHUP };
+
+		if (poll(&p, 1, HANGUP_POLL_MS) > 0 &&
+		    (p.revents & (POLLRDHUP | POLLHUP | POLLERR))) {
+			kill(pid, SIGKILL);
+			waitpid(pid, NULL, 0);
+			break;
+		}
+	}
+
+out:
+	free(req);
+	if (fds[0] >= 0) {
+		close(fds[0]);
+	}
+	if (fds[1] >= 0) {
+		close(fds[1]);
+	}
+	close(conn);
+}
+
+static int listen_on(const struct sockaddr_un *addr)
+{
+	int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+	if (sock < 0) {
+		return -1;
+	}
+
+	/* A socket file nobody answers on is a leftover */
+	if (!connect(sock, (const struct sockaddr *)addr, sizeof(*addr))) {
+		fprintf(stderr, "utest: a server already listens on %s\n",
+			addr->sun_path);
+		close(sock);
+		return -1;
+	}
+	unlink(addr->sun_path);
+
+	if (bind(sock, (const struct sockaddr *)addr, sizeof(*addr)) ||
+	    listen(sock, SOMAXCONN)) {
+		fprintf(stderr, "utest: cannot listen on %s: %s\n",
+			addr->sun_path, strerror(errno));
+		close(sock);
+		return -1;
+	}
+
+	return sock;
+}
+
+static void warm_up(void)
+{
+	z_init_mock();
+	z_utest_crash_init();
+	utest_register_reporter(&utest_console_reporter);
+	z_utest_report_run_start();
+
+	warming = true;
+	RunAllTest();
+	z_utest_modules_run();
+	warming = false;
+
+	/* Symbols for the result cache and the crash reports */
+	z_utest_elf_functions(&(size_t){ 0 });
+}
+
+void z_utest_serve(int argc, char *argv[], int (*run)(void))
+{
+	const char *handover = getenv(HANDOVER_ENV);
+	struct sigaction sa = { .sa_handler = on_stop };
+	struct sockaddr_un addr;
+	int lsock = -1;
+	int conn = -1;
+	ssize_t n;
+
+	(void)argc;
+
+	n = readlink("/proc/self/exe", exe_path, sizeof(exe_path) - 1);
+	exe_path[n > 0 ? n : 0] = '\0';
+	if (n <= 0 || stat(exe_path, &exe_stat)) {
+		exe_path[0] = '\0';
+	}
+
+	if (socket_path(utest_option("serve"), &addr)) {
+		fprintf(stderr, "utest: invalid server socket path\n");
+		return;
+	}
+
+	if (handover && sscanf(handover, "%d,%d", &lsock, &conn) == 2) {
+		unsetenv(HANDOVER_ENV);
+		fcntl(lsock, F_SETFD, FD_CLOEXEC);
+		fcntl(conn, F_SETFD, FD_CLOEXEC);
+	} else {
+		lsock = listen_on(&addr);
+		if (lsock < 0) {
+			return;
+		}
+	}
+
+	/* No SA_RESTART, so that accept() gives up */
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	warm_up();
+	if (conn < 0) {
+		fprintf(stderr, "utest: serving on %s\n", addr.sun_path);
+	}
+
+	while (!stopping) {
+		if (conn < 0) {
+			conn = accept4(lsock, NULL, NULL, SOCK_CLOEXEC);
+			if (conn < 0) {
+				continue;
+			}
+		}
+
+		if (exe_changed()) {
+			restart(argv, lsock, conn);
+		}
+		z_utest_modules_reload(cool_down, warm_module);
+		serve_one(lsock, conn, run);
+		conn = -1;
+	}
+
+	unlink(addr.sun_path);
+	close(lsock);
+	cool_down(NULL);
+}
@@ -0,0 +1,182 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <utest.h>
+#include <utest_tags.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TAG_BITS 64
+
+/* Selection, see z_utest_tags_selected() */
+static bool including;
+static uint64_t include_mask;
+static uint64_t exclude_mask;
+
+static int capacity[TAG_BITS];
+static int in_use[TAG_BITS];
+/* Tags whose tests run alone, and tags in use up to their capacity */
+static uint64_t alone_mask;
+static uint64_t full_mask;
+static int alone_running;
+
+static int bit_of(uint64_t tag)
+{
+	return __builtin_ctzll(tag);
+}
+
+/* The tag named @a name, 0 if there is none */
+static uint64_t find(const char *name, size_t len)
+{
+	if (!utest_tags) {
+		return 0;
+	}
+
+	for (const struct utest_tag *t = utest_tags; t->name; t++) {
+		if (strlen(t->name) == len && !strncmp(t->name, name, len)) {
+			return t->tag;
+		}
+	}
+
+	return 0;
+}
+
+static void set_capacity(uint64_t tag, int value)
+{
+	int bit = bit_of(tag);
+
+	capacity[bit] = value;
+	if (value == UTEST_TAG_ALONE) {
+		alone_mask |= tag;
+	} else {
+		alone_mask &= ~tag;
+	}
+}
+
+/* Apply @a fn to the `name[=value]` items of the `:` separated @a list */
+static void for_each_item(const char *list,
+			  void (*fn)(const char *name, size_t len,
+				     const char *value))
+{
+	while (*list) {
+		size_t len = strcspn(list, ":");
+		size_t name_len = strcspn(list, ":=");
+		const char *value = name_len < len ? list + name_len + 1 : NULL;
+
+		if (len) {
+			fn(list, name_len, value);
+		}
+
+		list += len + (list[len] == ':');
+	}
+}
+
+static void select_item(const char *name, size_t len, const char *value)
+{
+	bool exclude = *name == '-';
+	uint64_t tag;
+
+	(void)value;
+
+	if (exclude) {
+		name++;
+		len--;
+	}
+
+	tag = find(name, len);
+	including |= !exclude;
+	if (!tag) {
+		fprintf(stderr, "utest: unknown tag %.*s\n", (int)len, name);
+	} else if (exclude) {
+		exclude_mask |= tag;
+	} else {
+		include_mask |= tag;
+	}
+}
+
+static void resource_item(const char *name, size_t len, const char *value)
+{
+	uint64_t tag = find(name, len);
+
+	if (!tag || !value) {
+		fprintf(stderr, "utest: unknown resource %.*s\n", (int)len,
+			name);
+		return;
+	}
+
+	set_capacity(tag, !strncmp(value, "alone", 5) ? UTEST_TAG_ALONE :
+							 atoi(value));
+}
+
+void z_utest_tags_init(void)
+{
+	const char *tags = utest_option("tags");
+	const char *resources = utest_option("resources");
+
+	if (utest_tags) {
+		for (const struct utest_tag *t = utest_tags; t->name; t++) {
+			if (t->tag) {
+				set_capacity(t->tag, t->capacity);
+			}
+		}
+	}
+
+	if (tags) {
+		for_each_item(tags, select_item);
+	}
+	if (resources) {
+		for_each_item(resources, resource_item);
+	}
+}
+
+/* Tag selection is two masks, tests are never matched by name */
+bool z_utest_tags_selected(uint64_t tags)
+{
+	if (including && !(tags & include_mask)) {
+		return false;
+	}
+
+	return !(tags & exclude_mask);
+}
+
+/* Check whether a test with @a tags can start while @a running others run */
+bool z_utest_resources_fit(uint64_t tags, int running)
+{
+	if (alone_running || (tags & full_mask)) {
+		return false;
+	}
+
+	return !(tags & alone_mask) || !running;
+}
+
+void z_utest_resources_take(uint64_t tags)
+{
+	if (tags & alone_mask) {
+		alone_running++;
+	}
+
+	for (uint64_t left = tags; left; left &= left - 1) {
+		int bit = bit_of(left);
+
+		if (capacity[bit] > 0 && ++in_use[bit] >= capacity[bit]) {
+			full_mask |= UTEST_TAG(bit);
+		}
+	}
+}
+
+void z_utest_resources_give(uint64_t tags)
+{
+	if (tags & alone_mask) {
+		alone_running--;
+	}
+
+	for (uint64_t left = tags; left; left &= left - 1) {
+		int bit = bit_of(left);
+
+		if (capacity[bit] > 0 && --in_use[bit] < capacity[bit]) {
+			full_mask &= ~UTEST_TAG(bit);
+		}
+	}
+}
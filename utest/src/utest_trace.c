@@ -0,0 +1,186 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <utest.h>
+#include <utest_trace.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+
+struct z_utest_trace_buffer z_utest_trace_buf;
+
+typedef void (*trace_print_fn)(const char *fmt, ...);
+
+void z_utest_trace_reset(void)
+{
+	z_utest_trace_buf.head = 0;
+}
+
+static double as_double(uint64_t bits)
+{
+	double d;
+
+	memcpy(&d, &bits, sizeof(d));
+
+	return d;
+}
+
+/*
+ * Format one conversion of @a spec (like "%08lx") with the raw argument
+ * @a arg, converted back to the type the length modifier asks for.
+ */
+static int format_arg(char *buf, size_t size, char *spec, size_t len,
+		      uint64_t arg)
+{
+	char conv = spec[len - 1];
+	char *mod = spec + strcspn(spec + 1, "hljztL") + 1;
+
+	switch (conv) {
+	case 'd':
+	case 'i':
+		if (!strncmp(mod, "ll", 2) || *mod == 'j') {
+			return snprintf(buf, size, spec, (long long)arg);
+		} else if (*mod == 'l') {
+			return snprintf(buf, size, spec, (long)arg);
+		} else if (*mod == 'z' || *mod == 't') {
+			return snprintf(buf, size, spec, (ptrdiff_t)arg);
+		}
+		return snprintf(buf, size, spec, (int)arg);
+	case 'u':
+	case 'o':
+	case 'x':
+	case 'X':
+		if (!strncmp(mod, "ll", 2) || *mod == 'j') {
+			return snprintf(buf, size, spec, (unsigned long long)arg);
+		} else if (*mod == 'l') {
+			return snprintf(buf, size, spec, (unsigned long)arg);
+		} else if (*mod == 'z' || *mod == 't') {
+			return snprintf(buf, size, spec, (size_t)arg);
+		}
+		return snprintf(buf, size, spec, (unsigned int)arg);
+	case 'c':
+		return snprintf(buf, size, spec, (int)arg);
+	case 'e':
+	case 'E':
+	case 'f':
+	case 'F':
+	case 'g':
+	case 'G':
+	case 'a':
+	case 'A':
+		if (*mod == 'L') {
+			/* Recorded as double, drop the modifier */
+			memmove(mod, mod + 1, strlen(mod));
+		}
+		return snprintf(buf, size, spec, as_double(arg));
+	case 's':
+		return snprintf(buf, size, spec,
+				arg ? (const char *)(uintptr_t)arg : "(null)");
+	case 'p':
+		return snprintf(buf, size, spec, (void *)(uintptr_t)arg);
+	default:
+		return snprintf(buf, size, "%s", spec);
+	}
+}
+
+static void format_entry(const struct z_utest_trace_entry *e, char *buf,
+			 size_t size)
+{
+	const char *fmt = e->fmt;
+	uint32_t arg = 0;
+	size_t pos = 0;
+
+	buf[0] = '\0';
+
+	while (*fmt && pos + 1 < size) {
+		char spec[32];
+		size_t len;
+		int n;
+
+		if (*fmt != '%') {
+			buf[pos++] = *fmt++;
+			buf[pos] = '\0';
+			continue;
+		}
+
+		if (fmt[1] == '%') {
+			buf[pos++] = '%';
+			buf[pos] = '\0';
+			fmt += 2;
+			continue;
+		}
+
+		len = strspn(fmt + 1, "#0- +'.123456789hljztL") + 2;
+		if (len >= sizeof(spec) || fmt[len - 1] == '\0') {
+			break;
+		}
+		memcpy(spec, fmt, len);
+		spec[len] = '\0';
+		fmt += len;
+
+		if (arg >= e->nargs) {
+			n = snprintf(buf + pos, size - pos, "<?>");
+		} else {
+			n = format_arg(buf + pos, size - pos, spec, len,
+				       e->args[arg++]);
+		}
+
+		if (n < 0) {
+			break;
+		}
+		pos += ((size_t)n < size - pos) ? (size_t)n : size - pos - 1;
+	}
+}
+
+static void dump(trace_print_fn print, uint32_t max)
+{
+	uint32_t head = z_utest_trace_buf.head;
+	uint32_t count = head;
+	char line[256];
+
+	if (count > CONFIG_utest_TRACE_ENTRIES) {
+		count = CONFIG_utest_TRACE_ENTRIES;
+	}
+	if (count > max) {
+		count = max;
+	}
+	if (!count) {
+		return;
+	}
+
+	print("--- trace (last %u of %u records) ---\n", count, head);
+
+	for (uint32_t i = head - count; i != head; i++) {
+		format_entry(&z_utest_trace_buf.entries[i &
+			     (CONFIG_utest_TRACE_ENTRIES - 1)],
+			     line, sizeof(line));
+		print("  [%u] %s\n", i, line);
+	}
+}
+
+static void print_stdout(const char *fmt, ...)
+{
+	va_list vargs;
+
+	va_start(vargs, fmt);
+	vprintf(fmt, vargs);
+	va_end(vargs);
+}
+
+void utest_trace_dump(void)
+{
+	dump(print_stdout, UINT32_MAX);
+}
+
+void z_utest_trace_dump_failure(void)
+{
+	long max = utest_option_long("trace-dump", CONFIG_utest_TRACE_DUMP);
+
+	if (max > 0) {
+		dump(z_utest_failure_printf, (uint32_t)max);
+	}
+}
@@ -0,0 +1,34 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <utest.h>
+#include "selftest.h"
+
+UTEST_TAGS({ "port", TAG_PORT, 1 }, { "slow", TAG_SLOW, 0 },
+	   { "alone", TAG_ALONE, UTEST_TAG_ALONE });
+
+void RunAllTest(void)
+{
+	selftest_report_formats();
+	selftest_filter();
+	selftest_fork();
+	selftest_hash();
+	selftest_coverage();
+	selftest_death();
+	selftest_ring();
+	selftest_serve();
+	selftest_module();
+	selftest_jobserver();
+	selftest_limits();
+	selftest_journal();
+	selftest_dist();
+	selftest_flaky();
+	selftest_priority();
+	selftest_order();
+}
+
+int main(int argc, char *argv[])
+{
+	return utest_main_args(argc, argv);
+}
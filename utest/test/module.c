@@ -0,0 +1,38 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * A test module the program under test loads, see utest_module.h. Built as
+ * a shared object on its own, its utest symbols resolve against the
+ * program.
+ */
+
+#include <utest.h>
+
+TEST_SETUP(module)
+{
+}
+
+TEST_TEARDOWN(module)
+{
+}
+
+TEST(module, pass)
+{
+	EXPECT_TRUE(1);
+}
+
+TEST(module, fail)
+{
+	EXPECT_EQ(1, 2);
+}
+
+TEST_SUITE(module,
+	   TEST_CASE(module, pass),
+	   TEST_CASE(module, fail));
+
+void RunAllTest(void)
+{
+	RUN_TEST_SUITE(module);
+}
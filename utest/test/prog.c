@@ -0,0 +1,389 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * The program under test of the self-test: suites the checks of whole runs
+ * pick with --filter.
+ */
+
+#include <utest.h>
+#include <utest_options.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include "prog_data.h"
+
+/* Append @a what and the process to the file SELFTEST_LOG names */
+static void log_event(const char *what)
+{
+	const char *path = getenv("SELFTEST_LOG");
+	char line[64];
+	int fd;
+
+	if (!path) {
+		return;
+	}
+	fd = open(path, O_WRONLY | O_APPEND | O_CREAT, 0600);
+	if (fd >= 0) {
+		snprintf(line, sizeof(line), "%s %d\n", what, (int)getpid());
+		write(fd, line, strlen(line));
+		close(fd);
+	}
+}
+
+TEST_SETUP(basic)
+{
+}
+
+TEST_TEARDOWN(basic)
+{
+}
+
+TEST(basic, pass)
+{
+	EXPECT_TRUE(1);
+}
+
+TEST(basic, fail)
+{
+	EXPECT_EQ(1, 2);
+}
+
+TEST_SUITE(basic,
+	   TEST_CASE(basic, pass),
+	   TEST_CASE(basic, fail));
+
+static int counter;
+
+static void *counter_setup(void)
+{
+	log_event("setup");
+
+	return &counter;
+}
+
+static void counter_teardown(void *data)
+{
+	(void)data;
+	log_event("teardown");
+}
+
+static UTEST_SHARED_FIXTURE(counter_fixture, counter_setup, counter_teardown);
+
+TEST_SETUP(shared)
+{
+}
+
+TEST_TEARDOWN(shared)
+{
+}
+
+TEST(shared, first)
+{
+	EXPECT_NOT_NULL(utest_shared_fixture(counter_fixture));
+}
+
+TEST(shared, second)
+{
+	EXPECT_NOT_NULL(utest_shared_fixture(counter_fixture));
+}
+
+TEST_SUITE(shared,
+	   TEST_CASE(shared, first),
+	   TEST_CASE(shared, second));
+
+TEST_SETUP(data)
+{
+}
+
+TEST_TEARDOWN(data)
+{
+}
+
+/* Calls into prog_data.c */
+TEST(data, call)
+{
+	EXPECT_EQ(prog_sum(1, 2), 3);
+}
+
+/* Only reads its data */
+TEST(data, read)
+{
+	EXPECT_EQ(prog_table[1], 2);
+}
+
+TEST_SUITE(data,
+	   TEST_CASE(data, call),
+	   TEST_CASE(data, read));
+
+static void sleep_and_exit(void)
+{
+	usleep(200000);
+	_exit(0);
+}
+
+/* The runner runs a death test before it forks the test processes */
+TEST_BEFORE_ALL(death)
+{
+	EXPECT_EXIT(_exit(0), UTEST_EXITED_WITH(0));
+}
+
+TEST_SETUP(death)
+{
+}
+
+TEST_TEARDOWN(death)
+{
+}
+
+TEST(death, slow_child)
+{
+	EXPECT_EXIT(sleep_and_exit(), UTEST_EXITED_WITH(0));
+}
+
+/* Skips while the child of death.slow_child runs, with --jobs=2 */
+TEST(death, skip_meanwhile)
+{
+	usleep(100000);
+	utest_skip();
+}
+
+TEST_SUITE(death,
+	   TEST_CASE(death, slow_child),
+	   TEST_CASE(death, skip_meanwhile));
+
+TEST_SETUP(jobs)
+{
+}
+
+TEST_TEARDOWN(jobs)
+{
+}
+
+/* Takes long enough for the jobs running at the same time to overlap */
+static void sleep_logged(void)
+{
+	log_event("start");
+	usleep(50000);
+	log_event("end");
+}
+
+TEST(jobs, first)
+{
+	sleep_logged();
+}
+
+TEST(jobs, second)
+{
+	sleep_logged();
+}
+
+TEST(jobs, third)
+{
+	sleep_logged();
+}
+
+TEST_SUITE(jobs,
+	   TEST_CASE(jobs, first),
+	   TEST_CASE(jobs, second),
+	   TEST_CASE(jobs, third));
+
+TEST_SETUP(limits)
+{
+}
+
+TEST_TEARDOWN(limits)
+{
+}
+
+/* Spins until killed, so only under a CPU time limit */
+TEST(limits, spin)
+{
+	struct rlimit cpu;
+	volatile unsigned long spins = 0;
+
+	getrlimit(RLIMIT_CPU, &cpu);
+	if (cpu.rlim_cur == RLIM_INFINITY) {
+		utest_skip();
+	}
+
+	for (;;) {
+		spins++;
+	}
+}
+
+TEST_SUITE(limits,
+	   TEST_CASE(limits, spin));
+
+TEST_SETUP(retry)
+{
+}
+
+TEST_TEARDOWN(retry)
+{
+}
+
+/* True the first time only, when SELFTEST_MARKS names a directory */
+static bool first_attempt(const char *what)
+{
+	const char *dir = getenv("SELFTEST_MARKS");
+	char path[512];
+	int fd;
+
+	if (!dir) {
+		return false;
+	}
+	snprintf(path, sizeof(path), "%s/%s", dir, what);
+	fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0600);
+	if (fd < 0) {
+		return false;
+	}
+	close(fd);
+
+	return true;
+}
+
+TEST(retry, fails_once)
+{
+	log_event("fails_once");
+	EXPECT_FALSE(first_attempt("fails_once"), "first attempt");
+}
+
+/* Exits without a result on its first attempt */
+TEST(retry, exits_once)
+{
+	log_event("exits_once");
+	if (first_attempt("exits_once")) {
+		_exit(3);
+	}
+}
+
+TEST_SUITE(retry,
+	   TEST_CASE(retry, fails_once),
+	   TEST_CASE(retry, exits_once));
+
+TEST_SETUP(prio)
+{
+}
+
+TEST_TEARDOWN(prio)
+{
+}
+
+/* Declared in another order than the one their history gives them */
+TEST(prio, ok)
+{
+}
+
+TEST(prio, slow)
+{
+}
+
+TEST(prio, bad)
+{
+}
+
+TEST(prio, flaky)
+{
+}
+
+TEST_SUITE(prio,
+	   TEST_CASE(prio, ok),
+	   TEST_CASE(prio, slow),
+	   TEST_CASE(prio, bad),
+	   TEST_CASE(prio, flaky));
+
+TEST_SETUP(deps)
+{
+}
+
+TEST_TEARDOWN(deps)
+{
+}
+
+/* Left set by deps.polluter, which runs after deps.victim as declared */
+static bool polluted;
+
+TEST(deps, victim)
+{
+	EXPECT_FALSE(polluted);
+}
+
+TEST(deps, polluter)
+{
+	polluted = true;
+}
+
+TEST_SUITE(deps,
+	   TEST_CASE(deps, victim),
+	   TEST_CASE(deps, polluter));
+
+TEST_SETUP(dist)
+{
+}
+
+TEST_TEARDOWN(dist)
+{
+}
+
+/* Kills the worker whose batch process it runs in */
+TEST(dist, kill_worker)
+{
+	if (!utest_option("worker")) {
+		utest_skip();
+	}
+
+	log_event("kill_worker");
+	/* Lets the worker relay that it started before it goes */
+	usleep(200000);
+	kill(getppid(), SIGKILL);
+	_exit(1);
+}
+
+/* Handed out with dist.kill_worker, never started while it kills */
+TEST(dist, after)
+{
+	log_event("after");
+}
+
+/* What the batches leave once dist.kill_worker has failed */
+TEST(dist, filler_0)
+{
+}
+
+TEST(dist, filler_1)
+{
+}
+
+TEST_SUITE(dist,
+	   TEST_CASE(dist, kill_worker),
+	   TEST_CASE(dist, after),
+	   TEST_CASE(dist, filler_0),
+	   TEST_CASE(dist, filler_1));
+
+void RunAllTest(void)
+{
+	RUN_TEST_SUITE(basic);
+	RUN_TEST_SUITE(shared);
+	RUN_TEST_SUITE(data);
+	RUN_TEST_SUITE(death);
+	RUN_TEST_SUITE(jobs);
+	RUN_TEST_SUITE(limits);
+	RUN_TEST_SUITE(retry);
+	RUN_TEST_SUITE(prio);
+	RUN_TEST_SUITE(deps);
+	RUN_TEST_SUITE(dist);
+}
+
+/* Drops the status like main_deprecated.c, a client exits with it itself */
+int main(int argc, char *argv[])
+{
+	utest_main_args(argc, argv);
+
+	return 0;
+}
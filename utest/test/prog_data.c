@@ -0,0 +1,17 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Code and data of the program under test in a file of their own, see
+ * suite data in prog.c.
+ */
+
+#include "prog_data.h"
+
+const int prog_table[PROG_TABLE_LEN] = { 1, 2, 3 };
+
+int prog_sum(int a, int b)
+{
+	return a + b;
+}
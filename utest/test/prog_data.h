@@ -0,0 +1,14 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _TESTSUITE_TEST_PROG_DATA_H_
+#define _TESTSUITE_TEST_PROG_DATA_H_
+
+#define PROG_TABLE_LEN 3
+
+extern const int prog_table[PROG_TABLE_LEN];
+
+int prog_sum(int a, int b);
+
+#endif /* _TESTSUITE_TEST_PROG_DATA_H_ */
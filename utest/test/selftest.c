@@ -0,0 +1,127 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <utest.h>
+#include <errno.h>
+#include <libgen.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "selftest.h"
+
+#define ARGS_MAX 32
+
+/* @a name in the directory of the self-test, where make check builds */
+const char *selftest_path(const char *name, char *buf, size_t size)
+{
+	char self[512];
+	ssize_t len = readlink("/proc/self/exe", self, sizeof(self) - 1);
+
+	self[len > 0 ? len : 0] = '\0';
+	snprintf(buf, size, "%s/%s", dirname(self), name);
+
+	return buf;
+}
+
+static const char *prog_path(void)
+{
+	static char path[512];
+
+	if (!path[0]) {
+		selftest_path("selftest_prog.exe", path, sizeof(path));
+	}
+
+	return path;
+}
+
+/*
+ * Run the program under test with the options @a argv, NULL terminated,
+ * and the NAME=VALUE strings of @a env added to its environment. Its
+ * standard output and error are kept in @a out, NUL terminated. Return its
+ * wait status, -1 if it could not run.
+ */
+int selftest_runv(char *out, size_t size, char *const env[],
+		  char *const argv[])
+{
+	char tmp[] = "/tmp/utest-run-XXXXXX";
+	char *args[ARGS_MAX + 2] = { "selftest_prog" };
+	int fd = mkstemp(tmp);
+	int status = -1;
+	ssize_t len = 0;
+	pid_t pid;
+
+	out[0] = '\0';
+	if (fd < 0) {
+		return -1;
+	}
+	unlink(tmp);
+
+	for (int i = 0; i < ARGS_MAX && argv[i]; i++) {
+		args[i + 1] = argv[i];
+	}
+
+	pid = fork();
+	if (pid == 0) {
+		dup2(fd, STDOUT_FILENO);
+		dup2(fd, STDERR_FILENO);
+		/* Not part of the make running the self-test */
+		unsetenv("MAKEFLAGS");
+		unsetenv("MFLAGS");
+		for (char *const *e = env; e && *e; e++) {
+			putenv(*e);
+		}
+		execv(prog_path(), args);
+		_exit(127);
+	}
+
+	if (pid > 0) {
+		while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+		}
+		len = pread(fd, out, size - 1, 0);
+	}
+	out[len > 0 ? len : 0] = '\0';
+	close(fd);
+
+	return status;
+}
+
+/* selftest_runv() with the options following @a size, up to NULL */
+int selftest_run(char *out, size_t size, ...)
+{
+	char *argv[ARGS_MAX + 1];
+	va_list args;
+	int argc = 0;
+
+	va_start(args, size);
+	while (argc < ARGS_MAX && (argv[argc] = va_arg(args, char *))) {
+		argc++;
+	}
+	va_end(args);
+	argv[argc] = NULL;
+
+	return selftest_runv(out, size, NULL, argv);
+}
+
+/* The contents of file @a path, NUL terminated, to be freed */
+char *selftest_read_file(const char *path)
+{
+	FILE *f = fopen(path, "rb");
+	char *buf = calloc(1, SELFTEST_OUTPUT_SIZE);
+	size_t len = 0;
+
+	if (f && buf) {
+		len = fread(buf, 1, SELFTEST_OUTPUT_SIZE - 1, f);
+	}
+	if (f) {
+		fclose(f);
+	}
+	if (buf) {
+		buf[len] = '\0';
+	}
+
+	return buf;
+}
@@ -0,0 +1,47 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * utest tests of its own internals, one suite per source file, run with
+ * `make check`. Whole runs are checked on the program under test, prog.c.
+ */
+
+#ifndef _TESTSUITE_TEST_SELFTEST_H_
+#define _TESTSUITE_TEST_SELFTEST_H_
+
+#include <stddef.h>
+#include <utest_tags.h>
+
+/* Tags declared by the self-test program, see main.c */
+#define TAG_PORT UTEST_TAG(0)
+#define TAG_SLOW UTEST_TAG(1)
+#define TAG_ALONE UTEST_TAG(2)
+
+/* Output of a run of the program under test kept for the checks */
+#define SELFTEST_OUTPUT_SIZE 65536
+
+int selftest_runv(char *out, size_t size, char *const env[],
+		  char *const argv[]);
+int selftest_run(char *out, size_t size, ...);
+char *selftest_read_file(const char *path);
+const char *selftest_path(const char *name, char *buf, size_t size);
+
+void selftest_report_formats(void);
+void selftest_filter(void);
+void selftest_fork(void);
+void selftest_hash(void);
+void selftest_coverage(void);
+void selftest_death(void);
+void selftest_ring(void);
+void selftest_serve(void);
+void selftest_module(void);
+void selftest_jobserver(void);
+void selftest_limits(void);
+void selftest_journal(void);
+void selftest_dist(void);
+void selftest_flaky(void);
+void selftest_priority(void);
+void selftest_order(void);
+
+#endif /* _TESTSUITE_TEST_SELFTEST_H_ */
@@ -0,0 +1,65 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <utest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "selftest.h"
+
+static char dir[] = "/tmp/utest-coverage-XXXXXX";
+static char cache_dir[64];
+
+/* Run the tests of suite data, only the changed ones with @a changed */
+static void run_data(char *out, size_t size, const char *changed)
+{
+	selftest_run(out, size, cache_dir, "--filter=data.*", changed, NULL);
+}
+
+TEST_SETUP(coverage)
+{
+	static char out[SELFTEST_OUTPUT_SIZE];
+
+	EXPECT_NOT_NULL(mkdtemp(dir));
+	snprintf(cache_dir, sizeof(cache_dir), "--cache-dir=%s", dir);
+	run_data(out, sizeof(out), "--record-coverage");
+}
+
+TEST_TEARDOWN(coverage)
+{
+	char cmd[96];
+
+	snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+	system(cmd);
+	strcpy(dir + strlen(dir) - 6, "XXXXXX");
+}
+
+TEST(coverage, changed_function)
+{
+	static char out[SELFTEST_OUTPUT_SIZE];
+
+	run_data(out, sizeof(out), "--changed-functions=prog_sum");
+	EXPECT_NOT_NULL(strstr(out, "TEST(data, call)"), "%s", out);
+	EXPECT_NULL(strstr(out, "TEST(data, read)"), "%s", out);
+}
+
+/* data.read reads the table of prog_data.c without calling into it */
+TEST(coverage, changed_file_with_data)
+{
+	static char out[SELFTEST_OUTPUT_SIZE];
+
+	run_data(out, sizeof(out), "--changed-files=utest/test/prog_data.c");
+	EXPECT_NOT_NULL(strstr(out, "prog_data.c defines data"), "%s", out);
+	EXPECT_NOT_NULL(strstr(out, "TEST(data, call)"), "%s", out);
+	EXPECT_NOT_NULL(strstr(out, "TEST(data, read)"), "%s", out);
+}
+
+TEST_SUITE(coverage,
+	   TEST_CASE(coverage, changed_function),
+	   TEST_CASE(coverage, changed_file_with_data));
+
+void selftest_coverage(void)
+{
+	RUN_TEST_SUITE(coverage);
+}
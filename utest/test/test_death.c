@@ -0,0 +1,123 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <utest.h>
+#include <utest_death.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "selftest.h"
+
+static void exit_0(void)
+{
+	_exit(0);
+}
+
+static void exit_3(void)
+{
+	_exit(3);
+}
+
+static void killed(void)
+{
+	raise(SIGUSR1);
+	_exit(0);
+}
+
+static void die_loudly(void)
+{
+	fprintf(stderr, "bad value %d\n", 42);
+	abort();
+}
+
+/* The wait status of a child running @a fn */
+static int status_of(void (*fn)(void))
+{
+	int status = -1;
+	pid_t pid = fork();
+
+	if (pid == 0) {
+		fn();
+	}
+	if (pid > 0) {
+		waitpid(pid, &status, 0);
+	}
+
+	return status;
+}
+
+TEST_SETUP(death)
+{
+}
+
+TEST_TEARDOWN(death)
+{
+}
+
+TEST(death, predicates)
+{
+	int exited_0 = status_of(exit_0);
+	int exited_3 = status_of(exit_3);
+	int signaled = status_of(killed);
+
+	EXPECT_FALSE(z_utest_died(exited_0, 0));
+	EXPECT_TRUE(z_utest_died(exited_3, 0));
+	EXPECT_TRUE(z_utest_died(signaled, 0));
+
+	EXPECT_TRUE(z_utest_exited_with(exited_0, 0));
+	EXPECT_TRUE(z_utest_exited_with(exited_3, 3));
+	EXPECT_FALSE(z_utest_exited_with(exited_3, 0));
+	EXPECT_FALSE(z_utest_exited_with(signaled, 0));
+
+	EXPECT_TRUE(z_utest_killed_by(signaled, SIGUSR1));
+	EXPECT_FALSE(z_utest_killed_by(signaled, SIGTERM));
+	EXPECT_FALSE(z_utest_killed_by(exited_3, SIGUSR1));
+	EXPECT_FALSE(z_utest_killed_by(exited_0, 0));
+}
+
+TEST(death, expect_exit)
+{
+	EXPECT_EXIT(exit_0(), UTEST_EXITED_WITH(0));
+	EXPECT_EXIT(exit_3(), UTEST_EXITED_WITH(3));
+	EXPECT_EXIT(killed(), UTEST_KILLED_BY(SIGUSR1));
+}
+
+TEST(death, expect_death)
+{
+	EXPECT_DEATH(die_loudly(), "bad value [0-9]+");
+	EXPECT_DEATH(exit_3(), NULL);
+	/* A failed assertion ends the child, its message on standard error */
+	EXPECT_DEATH(EXPECT_EQ(1, 2), "1 not equal to 2");
+}
+
+/*
+ * The child of one test process runs while another test ends: the state of
+ * a death test is its process' own, even when the runner ran one first.
+ */
+TEST(death, concurrent_tests)
+{
+	static char out[SELFTEST_OUTPUT_SIZE];
+	int status = selftest_run(out, sizeof(out), "--filter=death.*",
+				  "--jobs=2", NULL);
+
+	EXPECT_TRUE(WIFEXITED(status), "status 0x%x:\n%s", status, out);
+	EXPECT_NOT_NULL(strstr(out, ".TEST(death, slow_child)  PASS ."), "%s",
+			out);
+	EXPECT_NOT_NULL(strstr(out, ".TEST(death, skip_meanwhile)  SKIP ."),
+			"%s", out);
+}
+
+TEST_SUITE(death,
+	   TEST_CASE(death, predicates),
+	   TEST_CASE(death, expect_exit),
+	   TEST_CASE(death, expect_death),
+	   TEST_CASE(death, concurrent_tests));
+
+void selftest_death(void)
+{
+	RUN_TEST_SUITE(death);
+}
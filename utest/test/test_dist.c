@@ -0,0 +1,169 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <utest.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "selftest.h"
+
+/* More than the workers dist.kill_worker can take down */
+#define WORKERS_MAX 6
+
+static char dir[] = "/tmp/utest-dist-XXXXXX";
+static char log_path[600];
+
+/* A port of 127.0.0.1 nothing listens on, 0 if none */
+static int free_port(void)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t len = sizeof(addr);
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	int port = 0;
+
+	if (fd >= 0 && !bind(fd, (struct sockaddr *)&addr, sizeof(addr)) &&
+	    !getsockname(fd, (struct sockaddr *)&addr, &len)) {
+		port = ntohs(addr.sin_port);
+	}
+	if (fd >= 0) {
+		close(fd);
+	}
+
+	return port;
+}
+
+/* Lines of @a log starting with @a what */
+static int count_events(const char *log, const char *what)
+{
+	int count = 0;
+
+	for (const char *line = log; line && *line;) {
+		count += !strncmp(line, what, strlen(what)) &&
+			 line[strlen(what)] == ' ';
+		line = strchr(line, '\n');
+		line = line ? line + 1 : NULL;
+	}
+
+	return count;
+}
+
+/*
+ * Run workers of @a addr one after the other, each once the coordinator has
+ * seen the previous one die, until one stops on its own.
+ */
+static void run_workers(const char *addr, char *const env[])
+{
+	static char out[SELFTEST_OUTPUT_SIZE];
+	char worker[96];
+	char *argv[] = { worker, NULL };
+
+	snprintf(worker, sizeof(worker), "--worker=%s", addr);
+	for (int i = 0; i < WORKERS_MAX; i++) {
+		usleep(200000);
+		if (!WIFSIGNALED(selftest_runv(out, sizeof(out), env, argv))) {
+			break;
+		}
+	}
+}
+
+#define EXPECT_CONTAINS(text, part)                                           \
+	EXPECT_NOT_NULL(strstr(text, part), "no %s in:\n%s", part, text)
+
+TEST_SETUP(dist)
+{
+	char path[600];
+	FILE *f;
+
+	mkdtemp(dir);
+	snprintf(log_path, sizeof(log_path), "%s/log", dir);
+
+	/*
+	 * Equal durations make batches of two for a single worker, the tests
+	 * in listing order.
+	 */
+	snprintf(path, sizeof(path), "%s/durations", dir);
+	mkdir(path, 0700);
+	snprintf(path, sizeof(path), "%s/durations/selftest_prog", dir);
+	f = fopen(path, "w");
+	if (f) {
+		fputs("1000000\tdist\tTEST(dist, kill_worker)\n"
+		      "1000000\tdist\tTEST(dist, after)\n"
+		      "1000000\tdist\tTEST(dist, filler_0)\n"
+		      "1000000\tdist\tTEST(dist, filler_1)\n",
+		      f);
+		fclose(f);
+	}
+}
+
+TEST_TEARDOWN(dist)
+{
+	char cmd[64];
+
+	snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+	system(cmd);
+	strcpy(dir + strlen(dir) - 6, "XXXXXX");
+}
+
+/*
+ * dist.kill_worker takes each worker running it down, with dist.after in
+ * the same batch each time. Only the running test counts as tried: it
+ * fails after three lost workers, while dist.after runs on the next one.
+ */
+TEST(dist, lost_worker)
+{
+	static char out[SELFTEST_OUTPUT_SIZE];
+	char coordinate[64];
+	char cache[640];
+	char log_env[640];
+	char addr[32];
+	char *env[] = { log_env, NULL };
+	char *argv[] = { coordinate, "--filter=dist.*", cache, NULL };
+	int port = free_port();
+	char *log;
+	pid_t pid;
+
+	EXPECT_NE(port, 0);
+	snprintf(addr, sizeof(addr), "127.0.0.1:%d", port);
+	snprintf(coordinate, sizeof(coordinate), "--coordinate=%s", addr);
+	snprintf(cache, sizeof(cache), "--cache-dir=%s", dir);
+	snprintf(log_env, sizeof(log_env), "SELFTEST_LOG=%s", log_path);
+
+	pid = fork();
+	EXPECT_GE(pid, 0);
+	if (pid == 0) {
+		run_workers(addr, env);
+		_exit(0);
+	}
+	selftest_runv(out, sizeof(out), NULL, argv);
+	waitpid(pid, NULL, 0);
+
+	EXPECT_CONTAINS(out, ".TEST(dist, kill_worker) \n"
+			     "    handed out 3 times, never ended\n FAIL .");
+	EXPECT_CONTAINS(out, ".TEST(dist, after)  PASS .");
+	EXPECT_CONTAINS(out, ".TEST(dist, filler_0)  PASS .");
+	EXPECT_CONTAINS(out, ".TEST(dist, filler_1)  PASS .");
+
+	log = selftest_read_file(log_path);
+	EXPECT_NOT_NULL(log);
+	EXPECT_EQ(count_events(log, "kill_worker"), 3, "%s", log);
+	EXPECT_EQ(count_events(log, "after"), 1, "%s", log);
+	free(log);
+}
+
+TEST_SUITE(dist,
+	   TEST_CASE(dist, lost_worker));
+
+void selftest_dist(void)
+{
+	RUN_TEST_SUITE(dist);
+}
@@ -0,0 +1,227 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <utest.h>
+#include <utest_death.h>
+#include <utest_filter.h>
+#include <utest_options.h>
+#include <utest_tags.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "selftest.h"
+
+#define SHARD_IDS 200
+#define SHARDS 4
+
+/* Run the program under test with @a filter, the tests it ran in @a out */
+static void run_filter(char *out, size_t size, const char *filter)
+{
+	char arg[128];
+
+	snprintf(arg, sizeof(arg), "--filter=%s", filter);
+	selftest_run(out, size, arg, NULL);
+}
+
+#define EXPECT_RAN(out, test)                                                  \
+	EXPECT_NOT_NULL(strstr(out, test), "%s did not run:\n%s", test, out)
+#define EXPECT_LEFT_OUT(out, test)                                             \
+	EXPECT_NULL(strstr(out, test), "%s ran:\n%s", test, out)
+
+/*
+ * The tag masks and resource counts are set once per run, tests changing
+ * them do so in a child, with options of their own.
+ */
+static void tags_init(char *arg)
+{
+	/* Kept by z_utest_options_overlay() */
+	static char *argv[1];
+
+	argv[0] = arg;
+	z_utest_options_overlay(arg ? 1 : 0, argv);
+	z_utest_tags_init();
+}
+
+TEST_SETUP(filter)
+{
+}
+
+TEST_TEARDOWN(filter)
+{
+}
+
+TEST(filter, test_id)
+{
+	char id[Z_UTEST_TEST_ID_MAX];
+
+	utest_test_id("sample", "TEST(sample, mem_equal)", id, sizeof(id));
+	EXPECT_EQ(strcmp(id, "sample.mem_equal"), 0, "got %s", id);
+	utest_test_id("sample", "plain", id, sizeof(id));
+	EXPECT_EQ(strcmp(id, "sample.plain"), 0, "got %s", id);
+}
+
+TEST(filter, patterns)
+{
+	static char out[SELFTEST_OUTPUT_SIZE];
+
+	run_filter(out, sizeof(out), "basic.*");
+	EXPECT_RAN(out, "TEST(basic, pass)");
+	EXPECT_RAN(out, "TEST(basic, fail)");
+
+	run_filter(out, sizeof(out), "basic.p?ss");
+	EXPECT_RAN(out, "TEST(basic, pass)");
+	EXPECT_LEFT_OUT(out, "TEST(basic, fail)");
+
+	run_filter(out, sizeof(out), "other.*:*.fail");
+	EXPECT_LEFT_OUT(out, "TEST(basic, pass)");
+	EXPECT_RAN(out, "TEST(basic, fail)");
+}
+
+TEST(filter, negative_patterns)
+{
+	static char out[SELFTEST_OUTPUT_SIZE];
+
+	run_filter(out, sizeof(out), "basic.*-*.fail");
+	EXPECT_RAN(out, "TEST(basic, pass)");
+	EXPECT_LEFT_OUT(out, "TEST(basic, fail)");
+
+	/* Only exclusions: everything else is selected */
+	run_filter(out, sizeof(out), "-basic.pass");
+	EXPECT_LEFT_OUT(out, "TEST(basic, pass)");
+	EXPECT_RAN(out, "TEST(basic, fail)");
+}
+
+TEST(filter, shards)
+{
+	int per_shard[SHARDS] = { 0 };
+	char id[32];
+
+	for (int i = 0; i < SHARD_IDS; i++) {
+		int shards = 0;
+
+		snprintf(id, sizeof(id), "suite.case_%d", i);
+		EXPECT_TRUE(z_utest_shard_match(id, 0, 1));
+		for (long s = 0; s < SHARDS; s++) {
+			if (z_utest_shard_match(id, s, SHARDS)) {
+				per_shard[s]++;
+				shards++;
+			}
+		}
+		EXPECT_EQ(shards, 1, "%s is in %d shards", id, shards);
+	}
+
+	for (int s = 0; s < SHARDS; s++) {
+		EXPECT_GT(per_shard[s], SHARD_IDS / SHARDS / 2,
+			  "shard %d has %d tests", s, per_shard[s]);
+	}
+}
+
+/* Every test of the program under test runs in exactly one shard */
+TEST(filter, shard_runs)
+{
+	static const char *const tests[] = {
+		"TEST(basic, pass)", "TEST(basic, fail)",
+		"TEST(shared, first)", "TEST(shared, second)",
+	};
+	static char out[2][SELFTEST_OUTPUT_SIZE];
+
+	selftest_run(out[0], sizeof(out[0]), "--shard-count=2",
+		     "--shard-index=0", NULL);
+	selftest_run(out[1], sizeof(out[1]), "--shard-count=2",
+		     "--shard-index=1", NULL);
+
+	for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+		bool in_first = strstr(out[0], tests[i]) != NULL;
+		bool in_second = strstr(out[1], tests[i]) != NULL;
+
+		EXPECT_TRUE(in_first != in_second, "%s ran in %d shards",
+			    tests[i], in_first + in_second);
+	}
+}
+
+static void check_tags_included(void)
+{
+	tags_init("--tags=port:-slow");
+
+	EXPECT_TRUE(z_utest_tags_selected(TAG_PORT));
+	EXPECT_TRUE(z_utest_tags_selected(TAG_PORT | TAG_ALONE));
+	EXPECT_FALSE(z_utest_tags_selected(TAG_PORT | TAG_SLOW),
+		     "exclusions win");
+	EXPECT_FALSE(z_utest_tags_selected(TAG_ALONE));
+	EXPECT_FALSE(z_utest_tags_selected(0), "untagged tests are left out");
+	_exit(0);
+}
+
+static void check_tags_excluded(void)
+{
+	tags_init("--tags=-slow");
+
+	EXPECT_TRUE(z_utest_tags_selected(0));
+	EXPECT_TRUE(z_utest_tags_selected(TAG_PORT));
+	EXPECT_FALSE(z_utest_tags_selected(TAG_SLOW));
+	EXPECT_FALSE(z_utest_tags_selected(TAG_SLOW | TAG_ALONE));
+	_exit(0);
+}
+
+TEST(filter, tags)
+{
+	EXPECT_EXIT(check_tags_included(), UTEST_EXITED_WITH(0));
+	EXPECT_EXIT(check_tags_excluded(), UTEST_EXITED_WITH(0));
+}
+
+static void check_capacities(void)
+{
+	tags_init(NULL);
+
+	/* port takes one test at a time, slow any number */
+	EXPECT_TRUE(z_utest_resources_fit(TAG_PORT, 0));
+	z_utest_resources_take(TAG_PORT);
+	EXPECT_FALSE(z_utest_resources_fit(TAG_PORT, 1));
+	EXPECT_FALSE(z_utest_resources_fit(TAG_PORT | TAG_SLOW, 1));
+	EXPECT_TRUE(z_utest_resources_fit(TAG_SLOW, 1));
+	z_utest_resources_give(TAG_PORT);
+	EXPECT_TRUE(z_utest_resources_fit(TAG_PORT, 1));
+
+	/* alone only starts in an empty runner, and keeps it to itself */
+	EXPECT_FALSE(z_utest_resources_fit(TAG_ALONE, 1));
+	EXPECT_TRUE(z_utest_resources_fit(TAG_ALONE, 0));
+	z_utest_resources_take(TAG_ALONE);
+	EXPECT_FALSE(z_utest_resources_fit(0, 1));
+	z_utest_resources_give(TAG_ALONE);
+	EXPECT_TRUE(z_utest_resources_fit(0, 1));
+	_exit(0);
+}
+
+static void check_capacity_options(void)
+{
+	tags_init("--resources=port=2:slow=alone");
+
+	z_utest_resources_take(TAG_PORT);
+	EXPECT_TRUE(z_utest_resources_fit(TAG_PORT, 1));
+	z_utest_resources_take(TAG_PORT);
+	EXPECT_FALSE(z_utest_resources_fit(TAG_PORT, 2));
+	EXPECT_FALSE(z_utest_resources_fit(TAG_SLOW, 2));
+	EXPECT_TRUE(z_utest_resources_fit(TAG_SLOW, 0));
+	_exit(0);
+}
+
+TEST(filter, resources)
+{
+	EXPECT_EXIT(check_capacities(), UTEST_EXITED_WITH(0));
+	EXPECT_EXIT(check_capacity_options(), UTEST_EXITED_WITH(0));
+}
+
+TEST_SUITE(filter,
+	   TEST_CASE(filter, test_id),
+	   TEST_CASE(filter, patterns),
+	   TEST_CASE(filter, negative_patterns),
+	   TEST_CASE(filter, shards),
+	   TEST_CASE(filter, shard_runs),
+	   TEST_CASE(filter, tags),
+	   TEST_CASE(filter, resources));
+
+void selftest_filter(void)
+{
+	RUN_TEST_SUITE(filter);
+}
@@ -0,0 +1,97 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <utest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "selftest.h"
+
+static char dir[] = "/tmp/utest-flaky-XXXXXX";
+
+/* Processes of the lines of @a log starting with @a what, up to @a max */
+static int attempts(const char *log, const char *what, int pids[], int max)
+{
+	int count = 0;
+
+	for (const char *line = log; line && *line && count < max;) {
+		if (!strncmp(line, what, strlen(what)) &&
+		    line[strlen(what)] == ' ') {
+			pids[count++] = atoi(line + strlen(what) + 1);
+		}
+		line = strchr(line, '\n');
+		line = line ? line + 1 : NULL;
+	}
+
+	return count;
+}
+
+#define EXPECT_CONTAINS(text, part)                                           \
+	EXPECT_NOT_NULL(strstr(text, part), "no %s in:\n%s", part, text)
+
+TEST_SETUP(flaky)
+{
+	mkdtemp(dir);
+}
+
+TEST_TEARDOWN(flaky)
+{
+	char cmd[64];
+
+	snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+	system(cmd);
+	strcpy(dir + strlen(dir) - 6, "XXXXXX");
+}
+
+/*
+ * Tests running side by side fail their first attempt, one with a result
+ * and one without; each passes on a retry, in a process of its own, which
+ * keeps the slot of the first.
+ */
+TEST(flaky, jobs_retry)
+{
+	static char out[SELFTEST_OUTPUT_SIZE];
+	char marks_env[64];
+	char log_env[64];
+	char *env[] = { marks_env, log_env, NULL };
+	char *argv[] = { "--fork", "--jobs=2", "--retries=2",
+			 "--filter=retry.*", NULL };
+	char path[64];
+	char *log;
+	int pids[3];
+	int status;
+
+	snprintf(marks_env, sizeof(marks_env), "SELFTEST_MARKS=%s", dir);
+	snprintf(path, sizeof(path), "%s/log", dir);
+	snprintf(log_env, sizeof(log_env), "SELFTEST_LOG=%s", path);
+
+	status = selftest_runv(out, sizeof(out), env, argv);
+	EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0,
+		    "status 0x%x:\n%s", status, out);
+	EXPECT_CONTAINS(out, "first attempt\n"
+			     "    failed 1 time, passed on attempt 2\n"
+			     " FLAKY .");
+	EXPECT_CONTAINS(out, "exited with status 3 without a result\n"
+			     "    failed 1 time, passed on attempt 2\n"
+			     " FLAKY .");
+	EXPECT_CONTAINS(out, "PROJECT EXECUTION SUCCESSFUL");
+
+	log = selftest_read_file(path);
+	EXPECT_NOT_NULL(log);
+	EXPECT_EQ(attempts(log, "fails_once", pids, 3), 2, "%s", log);
+	EXPECT_NE(pids[0], pids[1], "%s", log);
+	EXPECT_EQ(attempts(log, "exits_once", pids, 3), 2, "%s", log);
+	EXPECT_NE(pids[0], pids[1], "%s", log);
+	free(log);
+}
+
+TEST_SUITE(flaky,
+	   TEST_CASE(flaky, jobs_retry));
+
+void selftest_flaky(void)
+{
+	RUN_TEST_SUITE(flaky);
+}
@@ -0,0 +1,99 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <utest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "selftest.h"
+
+static char log_path[] = "/tmp/utest-fork-XXXXXX";
+static char log_env[64];
+
+/* Count the lines of the log starting with @a what */
+static int count_events(const char *log, const char *what)
+{
+	size_t len = strlen(what);
+	int count = 0;
+
+	for (const char *line = log; line && *line;) {
+		if (!strncmp(line, what, len) && line[len] == ' ') {
+			count++;
+		}
+		line = strchr(line, '\n');
+		line = line ? line + 1 : NULL;
+	}
+
+	return count;
+}
+
+/*
+ * Run the tests of suite shared with option @a opt, which may be NULL, and
+ * check their fixture is set up @a builds times and torn down as many
+ * times, each time in the process that set it up.
+ */
+static void check_shared(char *opt, int builds)
+{
+	static char out[SELFTEST_OUTPUT_SIZE];
+	char *const env[] = { log_env, NULL };
+	char *const argv[] = { "--filter=shared.*", opt, NULL };
+	char teardown[32];
+	char *log;
+	int status;
+	int pid;
+
+	status = selftest_runv(out, sizeof(out), env, argv);
+	EXPECT_TRUE(WIFEXITED(status), "status 0x%x:\n%s", status, out);
+	EXPECT_NOT_NULL(strstr(out, "PROJECT EXECUTION SUCCESSFUL"), "%s", out);
+
+	log = selftest_read_file(log_path);
+	EXPECT_NOT_NULL(log);
+	EXPECT_EQ(count_events(log, "setup"), builds, "log:\n%s", log);
+	EXPECT_EQ(count_events(log, "teardown"), builds, "log:\n%s", log);
+	for (const char *line = log; line && *line;) {
+		if (sscanf(line, "setup %d", &pid) == 1) {
+			snprintf(teardown, sizeof(teardown), "teardown %d\n",
+				 pid);
+			EXPECT_NOT_NULL(strstr(log, teardown), "no %s in:\n%s",
+					teardown, log);
+		}
+		line = strchr(line, '\n');
+		line = line ? line + 1 : NULL;
+	}
+	free(log);
+}
+
+TEST_SETUP(fork)
+{
+	close(mkstemp(log_path));
+	snprintf(log_env, sizeof(log_env), "SELFTEST_LOG=%s", log_path);
+}
+
+TEST_TEARDOWN(fork)
+{
+	unlink(log_path);
+	strcpy(log_path + strlen(log_path) - 6, "XXXXXX");
+}
+
+TEST(fork, shared_fixture)
+{
+	check_shared(NULL, 1);
+}
+
+/* Every test process builds the fixture and tears it down */
+TEST(fork, shared_fixture_jobs)
+{
+	check_shared("--jobs=2", 2);
+}
+
+TEST_SUITE(fork,
+	   TEST_CASE(fork, shared_fixture),
+	   TEST_CASE(fork, shared_fixture_jobs));
+
+void selftest_fork(void)
+{
+	RUN_TEST_SUITE(fork);
+}
@@ -0,0 +1,83 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <utest.h>
+#include <utest_hash.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "selftest.h"
+
+/* Reference XXH64 values, seed 0 */
+static const struct {
+	const char *str;
+	uint64_t hash;
+} vectors[] = {
+	{ "", 0xEF46DB3751D8E999ull },
+	{ "a", 0xD24EC4F1A98C6E5Bull },
+	{ "abc", 0x44BC2CF5AD770999ull },
+	{ "message digest", 0x066ED728FCEEB3BEull },
+	{ "abcdefghijklmnopqrstuvwxyz", 0xCFE1F278FA89835Cull },
+	/* Long enough for the 32-byte stripes */
+	{ "Nobody inspects the spammish repetition", 0xFBCEA83C8A378BF1ull },
+};
+
+TEST_SETUP(hash)
+{
+}
+
+TEST_TEARDOWN(hash)
+{
+}
+
+TEST(hash, xxh64_vectors)
+{
+	for (size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+		uint64_t hash = utest_hash64(vectors[i].str,
+					     strlen(vectors[i].str), 0);
+
+		EXPECT_EQ(hash, vectors[i].hash, "\"%s\" hashes to %016llx",
+			  vectors[i].str, (unsigned long long)hash);
+	}
+}
+
+TEST(hash, seed)
+{
+	EXPECT_NE(utest_hash64("abc", 3, 0), utest_hash64("abc", 3, 1));
+}
+
+TEST(hash, file)
+{
+	char path[] = "/tmp/utest-hash-XXXXXX";
+	size_t len = 100000;
+	char *data = malloc(len);
+	uint64_t hash = 0;
+	int fd = mkstemp(path);
+
+	EXPECT_NOT_NULL(data);
+	EXPECT_GE(fd, 0);
+
+	for (size_t i = 0; i < len; i++) {
+		data[i] = (char)(i * 31 + i / 7);
+	}
+	EXPECT_EQ(write(fd, data, len), (ssize_t)len);
+	close(fd);
+
+	EXPECT_EQ(utest_hash_file(path, 42, &hash), 0);
+	EXPECT_EQ(hash, utest_hash64(data, len, 42),
+		  "the file hashes like its contents");
+
+	unlink(path);
+	free(data);
+}
+
+TEST_SUITE(hash,
+	   TEST_CASE(hash, xxh64_vectors),
+	   TEST_CASE(hash, seed),
+	   TEST_CASE(hash, file));
+
+void selftest_hash(void)
+{
+	RUN_TEST_SUITE(hash);
+}
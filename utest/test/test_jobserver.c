@@ -0,0 +1,109 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <utest.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "selftest.h"
+
+/* Jobs of a make -j2: the runner's own and one token in the pipe */
+#define MAKE_JOBS 2
+#define PROGRAMS 3
+/* Tests of suite jobs, run by the runner and each program */
+#define JOBS_TESTS 3
+
+static char log_path[] = "/tmp/utest-jobserver-XXXXXX";
+
+/* Most tests of the log running at the same time, @a started in all */
+static int max_running(const char *log, int *started)
+{
+	int running = 0;
+	int max = 0;
+
+	*started = 0;
+	for (const char *line = log; line && *line;) {
+		if (!strncmp(line, "start ", 6)) {
+			running++;
+			(*started)++;
+		} else if (!strncmp(line, "end ", 4)) {
+			running--;
+		}
+		max = running > max ? running : max;
+		line = strchr(line, '\n');
+		line = line ? line + 1 : NULL;
+	}
+
+	return max;
+}
+
+TEST_SETUP(jobserver)
+{
+	close(mkstemp(log_path));
+}
+
+TEST_TEARDOWN(jobserver)
+{
+	unlink(log_path);
+	strcpy(log_path + strlen(log_path) - 6, "XXXXXX");
+}
+
+/*
+ * The orchestrator runs programs whose tests run in jobs of their own, all
+ * of them within the jobs of make.
+ */
+TEST(jobserver, make_jobs)
+{
+	static char out[SELFTEST_OUTPUT_SIZE];
+	char makeflags[64];
+	char log_env[64];
+	char programs[PROGRAMS * 520 + 16];
+	char path[512];
+	char tokens[8];
+	char *env[] = { makeflags, log_env, NULL };
+	char *argv[] = { "--jobs=0", "--filter=jobs.*", programs, NULL };
+	char *log;
+	int started;
+	int fds[2];
+	int status;
+	ssize_t n;
+
+	EXPECT_EQ(pipe(fds), 0);
+	EXPECT_EQ(write(fds[1], "+", MAKE_JOBS - 1), MAKE_JOBS - 1);
+	snprintf(makeflags, sizeof(makeflags),
+		 "MAKEFLAGS= -j%d --jobserver-auth=%d,%d", MAKE_JOBS, fds[0],
+		 fds[1]);
+	snprintf(log_env, sizeof(log_env), "SELFTEST_LOG=%s", log_path);
+	selftest_path("selftest_prog.exe", path, sizeof(path));
+	snprintf(programs, sizeof(programs), "--programs=%s:%s:%s", path, path,
+		 path);
+
+	status = selftest_runv(out, sizeof(out), env, argv);
+	EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0,
+		    "status 0x%x:\n%s", status, out);
+
+	/* Every token is back */
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	n = read(fds[0], tokens, sizeof(tokens));
+	close(fds[0]);
+	close(fds[1]);
+	EXPECT_EQ(n, MAKE_JOBS - 1, "%zd tokens left in the pipe", n);
+
+	log = selftest_read_file(log_path);
+	EXPECT_NOT_NULL(log);
+	EXPECT_LE(max_running(log, &started), MAKE_JOBS, "log:\n%s", log);
+	EXPECT_EQ(started, (PROGRAMS + 1) * JOBS_TESTS, "log:\n%s", log);
+	free(log);
+}
+
+TEST_SUITE(jobserver,
+	   TEST_CASE(jobserver, make_jobs));
+
+void selftest_jobserver(void)
+{
+	RUN_TEST_SUITE(jobserver);
+}
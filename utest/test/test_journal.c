@@ -0,0 +1,171 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <utest.h>
+#include <utest_death.h>
+#include <utest_fork.h>
+#include <utest_journal.h>
+#include <utest_options.h>
+#include <utest_report.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "selftest.h"
+
+static char path[] = "/tmp/utest-journal-XXXXXX";
+static char journal_arg[64];
+
+/* The last result the journal handed to the reporters */
+static int replayed_status = -1;
+static char replayed_message[64];
+
+static void capture_test_end(struct utest_reporter *rep,
+			     const struct utest_result *result)
+{
+	(void)rep;
+
+	replayed_status = result->status;
+	snprintf(replayed_message, sizeof(replayed_message), "%.*s",
+		 (int)result->message_len, result->message);
+}
+
+static struct utest_reporter capture = {
+	.name = "capture",
+	.on_test_end = capture_test_end,
+};
+
+/*
+ * The journal is opened once per run, each step of a test runs in a child
+ * as a run of its own, its results going to the journal and to capture.
+ */
+static void journal_open(bool resume)
+{
+	/* Kept by z_utest_options_overlay() */
+	static char *argv[] = { journal_arg, "--resume" };
+
+	z_utest_options_overlay(resume ? 2 : 1, argv);
+	/* Not to the runner, in the fork mode */
+	z_utest_report_set_sink(NULL);
+	utest_unregister_reporter(&utest_console_reporter);
+	utest_register_reporter(&capture);
+	z_utest_journal_init();
+}
+
+static void report(const char *name, int status, const char *message)
+{
+	z_utest_report_result(&(struct utest_result){
+		.suite = "journal",
+		.name = name,
+		.status = status,
+		.message = message,
+		.message_len = strlen(message),
+	});
+}
+
+static void write_two(void)
+{
+	journal_open(false);
+	report("first", TC_FAIL, "boom");
+	report("second", TC_PASS, "");
+	z_utest_report_end(TC_FAIL);
+	_exit(0);
+}
+
+static void resume_torn(void)
+{
+	journal_open(true);
+
+	EXPECT_EQ(z_utest_journal_replay("journal", "first"), TC_FAIL);
+	EXPECT_EQ(replayed_status, TC_FAIL);
+	EXPECT_EQ(strcmp(replayed_message, "boom"), 0, "replayed \"%s\"",
+		  replayed_message);
+	EXPECT_EQ(z_utest_journal_replay("journal", "second"), -1,
+		  "the torn record is dropped");
+
+	/* Appended where the torn record was */
+	report("second", TC_SKIP, "");
+	z_utest_report_end(TC_FAIL);
+	_exit(0);
+}
+
+static void resume_again(void)
+{
+	journal_open(true);
+
+	EXPECT_EQ(z_utest_journal_replay("journal", "first"), TC_FAIL);
+	EXPECT_EQ(z_utest_journal_replay("journal", "second"), TC_SKIP);
+	_exit(0);
+}
+
+static void die_running(void)
+{
+	journal_open(false);
+	report("first", TC_PASS, "");
+	z_utest_report_test_start("third");
+	/* As if the runner crashed, with nothing closed */
+	abort();
+}
+
+static void resume_died(void)
+{
+	journal_open(true);
+
+	EXPECT_EQ(z_utest_journal_replay("journal", "first"), TC_PASS);
+	EXPECT_EQ(z_utest_journal_replay("journal", "third"), TC_FAIL,
+		  "the test the runner died running fails");
+	EXPECT_NOT_NULL(strstr(replayed_message, "runner died"));
+	_exit(0);
+}
+
+TEST_SETUP(journal)
+{
+	close(mkstemp(path));
+	snprintf(journal_arg, sizeof(journal_arg), "--journal=%s", path);
+}
+
+TEST_TEARDOWN(journal)
+{
+	unlink(path);
+	strcpy(path + strlen(path) - 6, "XXXXXX");
+}
+
+TEST(journal, torn_record)
+{
+	struct stat st;
+
+	EXPECT_EXIT(write_two(), UTEST_EXITED_WITH(0));
+
+	/*
+	 * Lose the end of the last record, as a crash of the machine may:
+	 * its strings, not only the padding, which reads back as zeros.
+	 */
+	EXPECT_EQ(stat(path, &st), 0);
+	EXPECT_EQ(truncate(path, st.st_size - 32), 0);
+
+	EXPECT_EXIT(resume_torn(), UTEST_EXITED_WITH(0));
+	EXPECT_EXIT(resume_again(), UTEST_EXITED_WITH(0));
+}
+
+TEST(journal, runner_died)
+{
+	/* The runner of the fork mode reports such a crash itself */
+	if (utest_fork_enabled()) {
+		utest_skip();
+	}
+
+	EXPECT_EXIT(die_running(), UTEST_KILLED_BY(SIGABRT));
+	EXPECT_EXIT(resume_died(), UTEST_EXITED_WITH(0));
+}
+
+TEST_SUITE(journal,
+	   TEST_CASE(journal, torn_record),
+	   TEST_CASE(journal, runner_died));
+
+void selftest_journal(void)
+{
+	RUN_TEST_SUITE(journal);
+}
@@ -0,0 +1,38 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <utest.h>
+#include <string.h>
+#include "selftest.h"
+
+TEST_SETUP(limits)
+{
+}
+
+TEST_TEARDOWN(limits)
+{
+}
+
+/* A test killed for its CPU time fails, the next ones still run */
+TEST(limits, cpu)
+{
+	static char out[SELFTEST_OUTPUT_SIZE];
+
+	selftest_run(out, sizeof(out), "--filter=limits.*:basic.pass",
+		     "--limit-cpu=1", NULL);
+	EXPECT_NOT_NULL(strstr(out, ".TEST(limits, spin) \n"
+				    "    test process went over limit-cpu (1 s)\n"
+				    " FAIL ."),
+			"%s", out);
+	EXPECT_NOT_NULL(strstr(out, ".TEST(basic, pass)  PASS ."), "%s", out);
+	EXPECT_NOT_NULL(strstr(out, "PROJECT EXECUTION FAILED"), "%s", out);
+}
+
+TEST_SUITE(limits,
+	   TEST_CASE(limits, cpu));
+
+void selftest_limits(void)
+{
+	RUN_TEST_SUITE(limits);
+}
@@ -0,0 +1,64 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <utest.h>
+#include <stdio.h>
+#include <string.h>
+#include "selftest.h"
+
+/* Run the tests of the module, with option @a opt which may be NULL */
+static void check_module(char *opt)
+{
+	static char out[SELFTEST_OUTPUT_SIZE];
+	char modules[600];
+	char path[512];
+
+	snprintf(modules, sizeof(modules), "--modules=%s",
+		 selftest_path("selftest_module.so", path, sizeof(path)));
+	selftest_run(out, sizeof(out), modules, "--filter=module.*", opt,
+		     NULL);
+
+	EXPECT_NOT_NULL(strstr(out, ".TEST(module, pass)  PASS ."), "%s", out);
+	EXPECT_NOT_NULL(strstr(out, "1 not equal to 2"), "%s", out);
+	EXPECT_NULL(strstr(out, "TEST(basic, pass)"), "%s", out);
+}
+
+TEST_SETUP(module)
+{
+}
+
+TEST_TEARDOWN(module)
+{
+}
+
+TEST(module, load)
+{
+	check_module(NULL);
+}
+
+TEST(module, load_jobs)
+{
+	check_module("--jobs=2");
+}
+
+TEST(module, missing)
+{
+	static char out[SELFTEST_OUTPUT_SIZE];
+
+	selftest_run(out, sizeof(out), "--modules=/nonexistent/module.so",
+		     "--filter=basic.pass", NULL);
+	EXPECT_NOT_NULL(strstr(out, "MODULE(/nonexistent/module.so)"), "%s",
+			out);
+	EXPECT_NOT_NULL(strstr(out, "PROJECT EXECUTION FAILED"), "%s", out);
+}
+
+TEST_SUITE(module,
+	   TEST_CASE(module, load),
+	   TEST_CASE(module, load_jobs),
+	   TEST_CASE(module, missing));
+
+void selftest_module(void)
+{
+	RUN_TEST_SUITE(module);
+}
@@ -0,0 +1,64 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <utest.h>
+#include <string.h>
+#include <sys/wait.h>
+#include "selftest.h"
+
+/* Random orders enough for deps.polluter to come first in one */
+#define ROUNDS "--detect-order-deps=20"
+
+#define EXPECT_CONTAINS(text, part)                                           \
+	EXPECT_NOT_NULL(strstr(text, part), "no %s in:\n%s", part, text)
+
+TEST_SETUP(order)
+{
+}
+
+TEST_TEARDOWN(order)
+{
+}
+
+/* deps.victim fails once deps.polluter ran before it */
+TEST(order, dependency_found)
+{
+	static char out[SELFTEST_OUTPUT_SIZE];
+	int status;
+
+	status = selftest_run(out, sizeof(out), ROUNDS, "--seed=1",
+			      "--filter=deps.*", NULL);
+	EXPECT_TRUE(WIFEXITED(status), "status 0x%x:\n%s", status, out);
+	EXPECT_CONTAINS(out, ".ORDER(TEST(deps, victim)) \n"
+			     "    TEST(deps, victim) fails after "
+			     "TEST(deps, polluter), and passes alone\n"
+			     "    in random order ");
+	EXPECT_CONTAINS(out, " of seed 0x1\n FAIL .");
+	EXPECT_NULL(strstr(out, "ORDER(TEST(deps, polluter))"), "%s", out);
+	/* The tests still run as declared afterwards */
+	EXPECT_CONTAINS(out, ".TEST(deps, victim)  PASS .");
+	EXPECT_CONTAINS(out, "PROJECT EXECUTION FAILED");
+}
+
+/* Tests leaving nothing behind are not reported */
+TEST(order, no_dependency)
+{
+	static char out[SELFTEST_OUTPUT_SIZE];
+	int status;
+
+	status = selftest_run(out, sizeof(out), ROUNDS, "--seed=1",
+			      "--filter=prio.*", NULL);
+	EXPECT_TRUE(WIFEXITED(status), "status 0x%x:\n%s", status, out);
+	EXPECT_NULL(strstr(out, "ORDER("), "%s", out);
+	EXPECT_CONTAINS(out, "PROJECT EXECUTION SUCCESSFUL");
+}
+
+TEST_SUITE(order,
+	   TEST_CASE(order, dependency_found),
+	   TEST_CASE(order, no_dependency));
+
+void selftest_order(void)
+{
+	RUN_TEST_SUITE(order);
+}
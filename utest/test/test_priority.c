@@ -0,0 +1,130 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <utest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "selftest.h"
+
+static char dir[] = "/tmp/utest-priority-XXXXXX";
+static char cache[64];
+
+/* Where @a part first is in @a text, -1 if nowhere */
+static long position(const char *text, const char *part)
+{
+	const char *at = strstr(text, part);
+
+	return at ? at - text : -1;
+}
+
+/* Occurrences of @a part in @a text */
+static int occurrences(const char *text, const char *part)
+{
+	int count = 0;
+
+	for (const char *at = strstr(text, part); at;
+	     at = strstr(at + 1, part)) {
+		count++;
+	}
+
+	return count;
+}
+
+#define EXPECT_CONTAINS(text, part)                                           \
+	EXPECT_NOT_NULL(strstr(text, part), "no %s in:\n%s", part, text)
+
+TEST_SETUP(priority)
+{
+	char path[128];
+	FILE *f;
+
+	mkdtemp(dir);
+	snprintf(cache, sizeof(cache), "--cache-dir=%s", dir);
+
+	/*
+	 * "runs status failures since duration code": flaky failed in the
+	 * last run, bad three runs ago, ok and slow passed, ok faster.
+	 */
+	snprintf(path, sizeof(path), "%s/history", dir);
+	mkdir(path, 0700);
+	snprintf(path, sizeof(path), "%s/history/selftest_prog", dir);
+	f = fopen(path, "w");
+	if (f) {
+		fputs("10 0 0 10 1000 0\tprio\tTEST(prio, ok)\n"
+		      "10 0 0 10 1000000000 0\tprio\tTEST(prio, slow)\n"
+		      "10 0 1 3 1000 0\tprio\tTEST(prio, bad)\n"
+		      "10 1 4 0 1000 0\tprio\tTEST(prio, flaky)\n",
+		      f);
+		fclose(f);
+	}
+}
+
+TEST_TEARDOWN(priority)
+{
+	char cmd[64];
+
+	snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+	system(cmd);
+	strcpy(dir + strlen(dir) - 6, "XXXXXX");
+}
+
+/* Recent failures first, then the shortest tests, within the suite too */
+TEST(priority, order)
+{
+	static char out[SELFTEST_OUTPUT_SIZE];
+	long flaky;
+	long bad;
+	long ok;
+	long slow;
+	int status;
+
+	status = selftest_run(out, sizeof(out), "--prioritize",
+			      "--filter=prio.*", cache, NULL);
+	EXPECT_TRUE(WIFEXITED(status), "status 0x%x:\n%s", status, out);
+
+	flaky = position(out, ".TEST(prio, flaky)");
+	bad = position(out, ".TEST(prio, bad)");
+	ok = position(out, ".TEST(prio, ok)");
+	slow = position(out, ".TEST(prio, slow)");
+	EXPECT_TRUE(flaky >= 0 && flaky < bad && bad < ok && ok < slow,
+		    "flaky, bad, ok, slow expected:\n%s", out);
+}
+
+/* The test left out is reported in the suite that ran, not a second one */
+TEST(priority, left_out)
+{
+	static char out[SELFTEST_OUTPUT_SIZE];
+	char reporter[128];
+	char path[96];
+	char *text;
+	int status;
+
+	snprintf(path, sizeof(path), "%s/report.jsonl", dir);
+	snprintf(reporter, sizeof(reporter), "--reporter=console,jsonl:%s",
+		 path);
+	status = selftest_run(out, sizeof(out), "--time-budget=500ms",
+			      "--filter=prio.*", cache, reporter, NULL);
+	EXPECT_TRUE(WIFEXITED(status), "status 0x%x:\n%s", status, out);
+	EXPECT_CONTAINS(out, ".TEST(prio, ok)  PASS .");
+	EXPECT_CONTAINS(out, ".TEST(prio, slow) \n"
+			     "    left out by the time budget\n SKIP .");
+
+	text = selftest_read_file(path);
+	EXPECT_NOT_NULL(text);
+	EXPECT_EQ(occurrences(text, "\"type\":\"suite_start\""), 1, "%s", text);
+	free(text);
+}
+
+TEST_SUITE(priority,
+	   TEST_CASE(priority, order),
+	   TEST_CASE(priority, left_out));
+
+void selftest_priority(void)
+{
+	RUN_TEST_SUITE(priority);
+}
@@ -0,0 +1,159 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <utest.h>
+#include <utest_report.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "selftest.h"
+
+/* Blank lines, markup, a control character, UTF-8 and a stray byte */
+static const char message[] = "\n    a\"b\\c <&> \x01\t\xc3\xa9 \xff end\n";
+static const char name[] = "TEST(fmt, <odd> & \"quoted\")";
+
+static char path[] = "/tmp/utest-report-XXXXXX";
+
+/* Report a suite of two tests, one failing, to a @a kind reporter */
+static char *report(const char *kind)
+{
+	struct utest_reporter *rep = utest_reporter_create(kind, path);
+	struct utest_result pass = {
+		.suite = "fmt",
+		.name = "TEST(fmt, pass)",
+		.status = TC_PASS,
+		.message = "",
+	};
+	struct utest_result fail = {
+		.suite = "fmt",
+		.name = name,
+		.status = TC_FAIL,
+		.message = message,
+		.message_len = sizeof(message) - 1,
+	};
+
+	if (!rep) {
+		return NULL;
+	}
+
+	if (rep->on_run_start) {
+		rep->on_run_start(rep);
+	}
+	if (rep->on_suite_start) {
+		rep->on_suite_start(rep, "fmt");
+	}
+	rep->on_test_end(rep, &pass);
+	rep->on_test_end(rep, &fail);
+	if (rep->on_suite_end) {
+		rep->on_suite_end(rep, "fmt", TC_FAIL);
+	}
+	if (rep->on_run_end) {
+		rep->on_run_end(rep, TC_FAIL);
+	}
+
+	return selftest_read_file(path);
+}
+
+#define EXPECT_CONTAINS(text, part)                                           \
+	EXPECT_NOT_NULL(strstr(text, part), "no %s in:\n%s", part, text)
+
+TEST_SETUP(report_formats)
+{
+	close(mkstemp(path));
+}
+
+TEST_TEARDOWN(report_formats)
+{
+	unlink(path);
+	strcpy(path + strlen(path) - 6, "XXXXXX");
+}
+
+TEST(report_formats, json_escape)
+{
+	char *text = report("jsonl");
+
+	EXPECT_NOT_NULL(text);
+	EXPECT_CONTAINS(text,
+			"\"name\":\"TEST(fmt, <odd> & \\\"quoted\\\")\"");
+	EXPECT_CONTAINS(text, "\"message\":\"\\n    a\\\"b\\\\c <&> "
+			      "\\u0001\\t\xc3\xa9 \\ufffd end\\n\"");
+	EXPECT_CONTAINS(text, "\"tests\":2,\"failures\":1,\"skipped\":0");
+	free(text);
+}
+
+TEST(report_formats, xml_escape)
+{
+	char *text = report("junit");
+
+	EXPECT_NOT_NULL(text);
+	EXPECT_CONTAINS(text, "name=\"TEST(fmt, &lt;odd&gt; &amp; "
+			      "&quot;quoted&quot;)\"");
+	/* The attribute holds the first line, the element all of it */
+	EXPECT_CONTAINS(text, "<failure message=\"a&quot;b\\c &lt;&amp;&gt; "
+			      "?\t\xc3\xa9 &#xFFFD; end\">");
+	EXPECT_CONTAINS(text, "\">\n    a&quot;b\\c &lt;&amp;&gt; "
+			      "?\t\xc3\xa9 &#xFFFD; end\n</failure>");
+	free(text);
+}
+
+TEST(report_formats, junit_counts)
+{
+	char *text = report("junit");
+
+	EXPECT_NOT_NULL(text);
+	EXPECT_CONTAINS(text, "<testsuite name=\"fmt\" tests=\"0000000002\" "
+			      "failures=\"0000000001\" "
+			      "skipped=\"0000000000\"");
+	EXPECT_CONTAINS(text, "</testsuite>\n</testsuites>\n");
+	free(text);
+}
+
+TEST(report_formats, junit_run)
+{
+	static char out[SELFTEST_OUTPUT_SIZE];
+	char arg[64];
+	char *text;
+	int status;
+
+	snprintf(arg, sizeof(arg), "--reporter=junit:%s", path);
+	status = selftest_run(out, sizeof(out), "--filter=basic.*", arg, NULL);
+	EXPECT_TRUE(WIFEXITED(status), "status 0x%x:\n%s", status, out);
+
+	text = selftest_read_file(path);
+	EXPECT_NOT_NULL(text);
+	EXPECT_CONTAINS(text, "<testsuite name=\"basic\" tests=\"0000000002\" "
+			      "failures=\"0000000001\"");
+	EXPECT_CONTAINS(text, "<testcase classname=\"basic\" "
+			      "name=\"TEST(basic, pass)\"");
+	free(text);
+}
+
+TEST(report_formats, no_usable_reporter)
+{
+	static char out[SELFTEST_OUTPUT_SIZE];
+	int status = selftest_run(out, sizeof(out), "--filter=basic.pass",
+				  "--reporter=bogus,junit:/nonexistent/x.xml",
+				  NULL);
+
+	EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0,
+		    "status 0x%x:\n%s", status, out);
+	EXPECT_CONTAINS(out, "no usable reporter");
+	/* The console reports instead */
+	EXPECT_CONTAINS(out, ".TEST(basic, pass)  PASS .");
+	EXPECT_CONTAINS(out, "PROJECT EXECUTION SUCCESSFUL");
+}
+
+TEST_SUITE(report_formats,
+	   TEST_CASE(report_formats, json_escape),
+	   TEST_CASE(report_formats, xml_escape),
+	   TEST_CASE(report_formats, junit_counts),
+	   TEST_CASE(report_formats, junit_run),
+	   TEST_CASE(report_formats, no_usable_reporter));
+
+void selftest_report_formats(void)
+{
+	RUN_TEST_SUITE(report_formats);
+}
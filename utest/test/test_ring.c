@@ -0,0 +1,148 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <utest.h>
+#include <utest_ring.h>
+#include <stdlib.h>
+#include <string.h>
+#include "selftest.h"
+
+#define ARENA CONFIG_utest_RING_ARENA_SIZE
+#define RECORDS CONFIG_utest_RING_RECORDS
+
+static struct z_utest_ring *ring;
+static char *buf[Z_UTEST_RING_STRINGS];
+
+/* What z_utest_ring_consume() handed over */
+struct seen {
+	size_t count;
+	int id[RECORDS];
+	uint32_t len[RECORDS][Z_UTEST_RING_STRINGS];
+	bool intact[RECORDS];
+};
+
+/* Push a record @a id whose strings are filled with @a id */
+static bool push(char id, uint32_t msg, uint32_t out, uint32_t err)
+{
+	struct z_utest_ring_rec rec = {
+		.status = id,
+		.len = { msg, out, err },
+	};
+	const char *str[Z_UTEST_RING_STRINGS] = { buf[0], buf[1], buf[2] };
+
+	for (int i = 0; i < Z_UTEST_RING_STRINGS; i++) {
+		memset(buf[i], id, rec.len[i]);
+	}
+
+	return z_utest_ring_push(ring, &rec, str);
+}
+
+static void collect(const struct z_utest_ring_rec *rec, const char *data,
+		    void *arg)
+{
+	struct seen *seen = arg;
+	size_t n = seen->count++;
+	uint64_t total = (uint64_t)rec->len[0] + rec->len[1] + rec->len[2];
+
+	seen->id[n] = rec->status;
+	memcpy(seen->len[n], rec->len, sizeof(rec->len));
+	seen->intact[n] = true;
+	for (uint64_t i = 0; i < total; i++) {
+		if (data[i] != (char)rec->status) {
+			seen->intact[n] = false;
+			break;
+		}
+	}
+}
+
+TEST_SETUP(ring)
+{
+	ring = z_utest_rings_create(1);
+	for (int i = 0; i < Z_UTEST_RING_STRINGS; i++) {
+		buf[i] = malloc(ARENA);
+	}
+}
+
+TEST_TEARDOWN(ring)
+{
+	z_utest_rings_destroy(ring, 1);
+	for (int i = 0; i < Z_UTEST_RING_STRINGS; i++) {
+		free(buf[i]);
+	}
+}
+
+TEST(ring, wrap)
+{
+	static struct seen seen;
+
+	EXPECT_NOT_NULL(ring);
+
+	/* The next record starts 3/4 into the arena */
+	EXPECT_TRUE(push('a', 1, ARENA / 4 * 3 - 1, 0));
+	EXPECT_EQ(z_utest_ring_consume(ring, collect, &seen), 1);
+
+	/* b fits before the end, c does not and wraps to the start */
+	EXPECT_TRUE(push('b', 1, ARENA / 8 - 1, 0));
+	EXPECT_TRUE(push('c', 1, ARENA / 2 - 1, 0));
+	/* Only [1/2, 3/4) is left, between c and b, d is longer */
+	EXPECT_TRUE(push('d', 1, ARENA / 8 * 5 - 1, 0));
+
+	seen.count = 0;
+	EXPECT_EQ(z_utest_ring_consume(ring, collect, &seen), 3);
+	EXPECT_EQ(seen.id[0], 'b');
+	EXPECT_EQ(seen.id[1], 'c');
+	EXPECT_EQ(seen.id[2], 'd');
+	EXPECT_EQ(seen.len[1][Z_UTEST_RING_STDOUT], ARENA / 2 - 1);
+	EXPECT_EQ(seen.len[2][Z_UTEST_RING_STDOUT], ARENA / 4 - 1,
+		  "d is cut to the room left");
+	for (size_t i = 0; i < seen.count; i++) {
+		EXPECT_TRUE(seen.intact[i], "record %c was overwritten",
+			    seen.id[i]);
+	}
+}
+
+TEST(ring, cut_output_first)
+{
+	static struct seen seen;
+
+	EXPECT_NOT_NULL(ring);
+
+	EXPECT_TRUE(push('a', ARENA / 2, ARENA / 4, ARENA / 2));
+	EXPECT_EQ(z_utest_ring_consume(ring, collect, &seen), 1);
+	EXPECT_EQ(seen.len[0][Z_UTEST_RING_MESSAGE], ARENA / 2);
+	EXPECT_EQ(seen.len[0][Z_UTEST_RING_STDOUT], ARENA / 4);
+	EXPECT_EQ(seen.len[0][Z_UTEST_RING_STDERR], ARENA / 4);
+	EXPECT_TRUE(seen.intact[0]);
+}
+
+TEST(ring, full)
+{
+	static struct seen seen;
+
+	EXPECT_NOT_NULL(ring);
+
+	for (int i = 0; i < RECORDS; i++) {
+		EXPECT_TRUE(push((char)('a' + i % 26), 16, 16, 16));
+	}
+	EXPECT_FALSE(push('z', 16, 16, 16), "the ring is full");
+
+	EXPECT_EQ(z_utest_ring_consume(ring, collect, &seen), RECORDS);
+	for (size_t i = 0; i < seen.count; i++) {
+		EXPECT_EQ(seen.id[i], 'a' + (int)i % 26);
+		EXPECT_TRUE(seen.intact[i]);
+	}
+
+	/* Consuming made room again */
+	EXPECT_TRUE(push('z', 16, 16, 16));
+}
+
+TEST_SUITE(ring,
+	   TEST_CASE(ring, wrap),
+	   TEST_CASE(ring, cut_output_first),
+	   TEST_CASE(ring, full));
+
+void selftest_ring(void)
+{
+	RUN_TEST_SUITE(ring);
+}
@@ -0,0 +1,46 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <utest.h>
+#include <string.h>
+#include <sys/wait.h>
+#include "selftest.h"
+
+/* No server listens there */
+#define NO_SERVER "--client=/nonexistent/utest-serve.sock"
+
+TEST_SETUP(serve)
+{
+}
+
+TEST_TEARDOWN(serve)
+{
+}
+
+/* The program under test drops the status, the client exits with it */
+TEST(serve, client_without_server)
+{
+	static char out[SELFTEST_OUTPUT_SIZE];
+	int status;
+
+	status = selftest_run(out, sizeof(out), NO_SERVER, "--filter=basic.*",
+			      NULL);
+	EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 1,
+		    "status 0x%x:\n%s", status, out);
+	EXPECT_NOT_NULL(strstr(out, "TEST(basic, pass)"), "%s", out);
+	EXPECT_NOT_NULL(strstr(out, "TEST(basic, fail)"), "%s", out);
+
+	status = selftest_run(out, sizeof(out), NO_SERVER,
+			      "--filter=basic.pass", NULL);
+	EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0,
+		    "status 0x%x:\n%s", status, out);
+}
+
+TEST_SUITE(serve,
+	   TEST_CASE(serve, client_without_server));
+
+void selftest_serve(void)
+{
+	RUN_TEST_SUITE(serve);
+}